@@ -48,6 +48,7 @@
 #include <a52dec/a52.h>
 #include <a52dec/mm_accel.h>
 #include "gsta52dec.h"
+#include <gst/gst-probes.h>
 
 #include <liboil/liboil.h>
 #include <liboil/liboilcpu.h>
@@ -77,6 +78,7 @@ enum
   ARG_DRC,
   ARG_MODE,
   ARG_LFE,
+  ARG_STATS
 };
 
 static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
@@ -200,6 +202,8 @@ gst_a52dec_class_init (GstA52DecClass * klass)
           GST_TYPE_A52DEC_MODE, A52_3F2R, G_PARAM_READWRITE));
   g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_LFE,
       g_param_spec_boolean ("lfe", "LFE", "LFE", TRUE, G_PARAM_READWRITE));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_STATS,
+      gst_element_stats_param_spec ());
 
   oil_init ();
 
@@ -353,6 +357,8 @@ flush_queued (GstA52Dec * dec)
         GST_TIME_ARGS (GST_BUFFER_DURATION (buf)));
 
     /* iterate ouput queue an push downstream */
+    gst_element_stats_output (&dec->stats, buf);
+    GST_PROBE_PUSH (dec, buf);
     ret = gst_pad_push (dec->srcpad, buf);
 
     dec->queued = g_list_delete_link (dec->queued, dec->queued);
@@ -420,6 +426,8 @@ gst_a52dec_push (GstA52Dec * a52dec,
           GST_TIME_FORMAT, GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (buf)),
           GST_TIME_ARGS (GST_BUFFER_DURATION (buf)));
 
+      gst_element_stats_output (&a52dec->stats, buf);
+      GST_PROBE_PUSH (a52dec, buf);
       result = gst_pad_push (srcpad, buf);
     } else {
       /* reverse playback, queue frame till later when we get a discont. */
@@ -554,6 +562,8 @@ gst_a52dec_handle_frame (GstA52Dec * a52dec, guint8 * data,
   gint channels, i;
   gboolean need_reneg = FALSE;
 
+  GST_PROBE_FRAME (a52dec, length, a52dec->time);
+
   /* update stream information, renegotiate or re-streaminfo if needed */
   need_reneg = FALSE;
   if (a52dec->sample_rate != sample_rate) {
@@ -622,6 +632,7 @@ gst_a52dec_handle_frame (GstA52Dec * a52dec, guint8 * data,
   a52dec->level = 1;
   if (a52_frame (a52dec->state, data, &flags, &a52dec->level, a52dec->bias)) {
     GST_WARNING ("a52_frame error");
+    gst_element_stats_dropped (&a52dec->stats);
     a52dec->discont = TRUE;
     return GST_FLOW_OK;
   }
@@ -650,6 +661,7 @@ gst_a52dec_handle_frame (GstA52Dec * a52dec, guint8 * data,
     if (a52_block (a52dec->state)) {
       /* ignore errors but mark a discont */
       GST_WARNING ("a52_block error %d", i);
+      gst_element_stats_dropped (&a52dec->stats);
       a52dec->discont = TRUE;
     } else {
       GstFlowReturn ret;
@@ -690,6 +702,10 @@ gst_a52dec_chain (GstPad * pad, GstBuffer * buf)
   GstA52Dec *a52dec = GST_A52DEC (GST_PAD_PARENT (pad));
   GstFlowReturn ret;
   gint first_access;
+  GstClockTime start;
+
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&a52dec->stats, buf);
 
   if (GST_BUFFER_IS_DISCONT (buf)) {
     GST_LOG_OBJECT (a52dec, "received DISCONT");
@@ -750,6 +766,7 @@ gst_a52dec_chain (GstPad * pad, GstBuffer * buf)
   }
 
 done:
+  gst_element_stats_stop (&a52dec->stats, start);
 
   return ret;
 
@@ -758,13 +775,15 @@ not_enough_data:
   {
     GST_ELEMENT_ERROR (GST_ELEMENT (a52dec), STREAM, DECODE, (NULL),
         ("Insufficient data in buffer. Can't determine first_acess"));
-    return GST_FLOW_ERROR;
+    ret = GST_FLOW_ERROR;
+    goto done;
   }
 bad_first_access_parameter:
   {
     GST_ELEMENT_ERROR (GST_ELEMENT (a52dec), STREAM, DECODE, (NULL),
         ("Bad first_access parameter (%d) in buffer", first_access));
-    return GST_FLOW_ERROR;
+    ret = GST_FLOW_ERROR;
+    goto done;
   }
 }
 
@@ -773,7 +792,7 @@ gst_a52dec_chain_raw (GstPad * pad, GstBuffer * buf)
 {
   GstA52Dec *a52dec = GST_A52DEC (gst_pad_get_parent (pad));
   guint8 *data;
-  guint size;
+  guint size, resync = 0;
   gint length = 0, flags, sample_rate, bit_rate;
   GstFlowReturn result = GST_FLOW_OK;
 
@@ -804,6 +823,7 @@ gst_a52dec_chain_raw (GstPad * pad, GstBuffer * buf)
 
   if (a52dec->cache) {
     buf = gst_buffer_join (a52dec->cache, buf);
+    gst_element_stats_copy (&a52dec->stats, GST_BUFFER_SIZE (buf));
     a52dec->cache = NULL;
   }
   data = GST_BUFFER_DATA (buf);
@@ -824,8 +844,9 @@ gst_a52dec_chain_raw (GstPad * pad, GstBuffer * buf)
       /* no sync */
       data++;
       size--;
+      resync++;
     } else if (length <= size) {
-      GST_DEBUG ("Sync: %d", length);
+      GST_HOT_DEBUG ("Sync: %d", length);
       result = gst_a52dec_handle_frame (a52dec, data,
           length, flags, sample_rate, bit_rate);
       if (result != GST_FLOW_OK) {
@@ -841,6 +862,9 @@ gst_a52dec_chain_raw (GstPad * pad, GstBuffer * buf)
     }
   }
 
+  if (resync > 0)
+    gst_element_stats_resync (&a52dec->stats, resync);
+
   /* keep cache */
   if (length == 0) {
     GST_LOG ("No sync found");
@@ -883,6 +907,7 @@ gst_a52dec_change_state (GstElement * element, GstStateChange transition)
       a52dec->sent_segment = FALSE;
       a52dec->flag_update = TRUE;
       gst_segment_init (&a52dec->segment, GST_FORMAT_UNDEFINED);
+      gst_element_stats_reset (&a52dec->stats);
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
       break;
@@ -966,6 +991,10 @@ gst_a52dec_get_property (GObject * object, guint prop_id, GValue * value,
       g_value_set_boolean (value, src->request_channels & A52_LFE);
       GST_OBJECT_UNLOCK (src);
       break;
+    case ARG_STATS:
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&src->stats, "a52dec-stats"));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -22,6 +22,7 @@
 #define __GST_A52DEC_H__
 
 #include <gst/gst.h>
+#include <gst/gst-element-stats.h>
 
 G_BEGIN_DECLS
 
@@ -71,6 +72,8 @@ struct _GstA52Dec {
 
   /* reverse */
   GList         *queued;
+
+  GstElementStats stats;        /* for the "stats" property */
 };
 
 struct _GstA52DecClass {
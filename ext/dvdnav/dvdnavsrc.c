@@ -266,7 +266,6 @@ gst_dvd_nav_src_init (GstDvdNavSrc * src, GstDvdNavSrcClass * klass)
   src->new_seek = FALSE;
   src->seek_pending = FALSE;
   src->need_flush = FALSE;
-  src->use_tmaps = FALSE;
   src->still_frame = FALSE;
 
   /* Pause mode is initially inactive. */
@@ -299,8 +298,14 @@ gst_dvd_nav_src_init (GstDvdNavSrc * src, GstDvdNavSrcClass * klass)
   src->vmg_file = NULL;
   src->vts_attrs = NULL;
   src->vts_file = NULL;
+  src->vts_file_nr = 0;
   src->cur_vts = 0;
 
+  src->title_indexes = NULL;
+  src->title_index = NULL;
+  src->title_index_nr = 0;
+  src->index_pool = NULL;
+
   /* avoid unnecessary start/stop in gst_base_src_check_get_range() */
   gst_pad_set_checkgetrange_function (GST_BASE_SRC_PAD (src),
       GST_DEBUG_FUNCPTR (gst_dvd_nav_src_check_get_range));
@@ -321,6 +326,8 @@ gst_dvd_nav_src_finalize (GObject * object)
   if (src->vts_attrs)
     g_array_free (src->vts_attrs, TRUE);
 
+  gst_dvd_nav_src_clear_title_indexes (src);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -535,212 +542,460 @@ gst_dvd_nav_src_set_clock (GstElement * element, GstClock * clock)
 }
 #endif
 
-/* update the time map when the title change */
+/* Convert a BCD encoded DVD time code to a GstClockTime */
+static GstClockTime
+gst_dvd_nav_src_dvd_time_to_gst (const dvd_time_t * dtime)
+{
+  guint hours, minutes, seconds, frames, rate;
+  GstClockTime ts;
+
+#define BCD_TO_DEC(b) ((((b) >> 4) & 0x0f) * 10 + ((b) & 0x0f))
+  hours = BCD_TO_DEC (dtime->hour);
+  minutes = BCD_TO_DEC (dtime->minute);
+  seconds = BCD_TO_DEC (dtime->second);
+  frames = BCD_TO_DEC (dtime->frame_u & 0x3f);
+#undef BCD_TO_DEC
+
+  ts = ((hours * 60 + minutes) * 60 + seconds) * GST_SECOND;
+
+  /* the two high bits of frame_u give the frame rate, 1 = 25 fps and
+   * 3 = 29.97 fps */
+  rate = (dtime->frame_u & 0xc0) >> 6;
+  if (rate == 1)
+    ts += gst_util_uint64_scale_int (frames, GST_SECOND, 25);
+  else if (rate == 3)
+    ts += gst_util_uint64_scale_int (frames, 1001 * GST_SECOND, 30000);
+
+  return ts;
+}
+
+/* The cells of a PGC that are part of the playback position, i.e. all cells
+ * except the non-first cells of angle blocks, like libdvdnav counts them. */
+typedef struct
+{
+  guint32 first_sector;
+  guint32 last_sector;
+  guint32 start;                /* PGC relative sector */
+  GstClockTime time;            /* PGC relative time */
+} GstDvdNavSrcCell;
+
 static gint
-gst_dvd_nav_src_update_tmaps (GstDvdNavSrc * src)
+gst_dvd_nav_src_get_pgc_cells (pgc_t * pgc, GstDvdNavSrcCell * cells)
 {
-  int32_t title, part;
-  title_info_t *info;
-  gint title_set_nr, title_ttn;
-  gint i;
+  gint i, n = 0;
+  guint32 start = 0;
+  GstClockTime time = 0;
 
-  /* Reset stuffs */
-  src->use_tmaps = FALSE;
-  src->title_tmap = NULL;
+  for (i = 0; i < pgc->nr_of_cells; i++) {
+    cell_playback_t *cell = &pgc->cell_playback[i];
 
-  /* FIXME: check if the title really changed, by now it's called on every
-   * DVDNAV_CELL_CHANGE event.
-   */
-  if (dvdnav_current_title_info (src->dvdnav, &title,
-          &part) != DVDNAV_STATUS_OK) {
-    GST_LOG_OBJECT (src, "Failed getting current title informations!");
-    return FALSE;
+    if (cell->block_type == BLOCK_TYPE_ANGLE_BLOCK &&
+        cell->block_mode != BLOCK_MODE_FIRST_CELL)
+      continue;
+
+    if (cell->last_sector < cell->first_sector)
+      continue;
+
+    cells[n].first_sector = cell->first_sector;
+    cells[n].last_sector = cell->last_sector;
+    cells[n].start = start;
+    cells[n].time = time;
+    start += cell->last_sector - cell->first_sector + 1;
+    time += gst_dvd_nav_src_dvd_time_to_gst (&cell->playback_time);
+    n++;
   }
 
-  GST_LOG_OBJECT (src, "title = %d, part = %d", title, part);
+  return n;
+}
 
-  /* load the VTS information for the title set our title is in */
+/* Map an absolute VTS sector to a PGC relative one, returns FALSE if the
+ * sector is not part of the played cells */
+static gboolean
+gst_dvd_nav_src_cell_sector (GstDvdNavSrcCell * cells, gint n_cells,
+    guint32 sector, guint32 * rel_sector)
+{
+  gint i;
 
-  /* Close old vts file */
-  if (src->vts_file) {
-    ifoClose (src->vts_file);
-    src->vts_file = NULL;
+  for (i = 0; i < n_cells; i++) {
+    if (sector >= cells[i].first_sector && sector <= cells[i].last_sector) {
+      *rel_sector = cells[i].start + (sector - cells[i].first_sector);
+      return TRUE;
+    }
   }
+  return FALSE;
+}
 
-  /* There isn't a timemap for the menus */
-  if (title < 1) {
-    GST_LOG_OBJECT (src, "Time map not available for menus");
-    return FALSE;
+static void
+gst_dvd_nav_src_index_append (GArray * index, GstClockTime time,
+    guint32 sector)
+{
+  GstDvdNavSrcTimeEntry entry;
+
+  /* only keep strictly increasing entries, so lookups can bisect */
+  if (index->len > 0) {
+    GstDvdNavSrcTimeEntry *last;
+
+    last = &g_array_index (index, GstDvdNavSrcTimeEntry, index->len - 1);
+    if (sector <= last->sector || time < last->time)
+      return;
   }
 
-  info = &src->tt_srpt->title[title - 1];
-  title_set_nr = info->title_set_nr;
-  GST_LOG_OBJECT (src, "title_set_nr = %d", title_set_nr);
-  title_ttn = info->vts_ttn;
-  GST_LOG_OBJECT (src, "title_ttn= %d", title_ttn);
+  entry.time = time;
+  entry.sector = sector;
+  g_array_append_val (index, entry);
+}
 
-  src->vts_file = ifoOpen (src->dvd, title_set_nr);
-  if (src->vts_file == NULL) {
-    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ,
-        (_("Could not open DVD")),
-        ("ifoOpen() failed: %s", g_strerror (errno)));
+/* Build the index from the title time map, returns FALSE if the time map is
+ * missing or doesn't match the PGC */
+static gboolean
+gst_dvd_nav_src_index_from_tmap (GstDvdNavSrc * src, GArray * index,
+    gint ttn, GstDvdNavSrcCell * cells, gint n_cells, GstClockTime duration)
+{
+  vts_tmapt_t *tmapt = src->vts_file->vts_tmapt;
+  vts_tmap_t *tmap;
+  GstClockTime tmu;
+  gint i;
+
+  if (tmapt == NULL || ttn < 1 || ttn > tmapt->nr_of_tmaps)
     return FALSE;
-  }
 
-  src->vts_tmapt = src->vts_file->vts_tmapt;
-  src->vts_ptt_srpt = src->vts_file->vts_ptt_srpt;
+  tmap = &tmapt->tmap[ttn - 1];
+  if (tmap->tmu == 0 || tmap->nr_of_entries == 0 || tmap->map_ent == NULL)
+    return FALSE;
 
-  if (src->vts_file->vts_tmapt != NULL) {
-    i = title_ttn - 1;
-    if (i >= 0 && i < src->vts_tmapt->nr_of_tmaps) {
-      src->title_tmap = &src->vts_tmapt->tmap[i];
-      GST_LOG_OBJECT (src, "Time map table number: %d", i);
-    } else {
-      src->title_tmap = NULL;
-      GST_LOG_OBJECT (src, "Cannot find table number for title %d", title_ttn);
+  tmu = tmap->tmu * GST_SECOND;
+
+  gst_dvd_nav_src_index_append (index, 0, 0);
+  for (i = 0; i < tmap->nr_of_entries; i++) {
+    GstDvdNavSrcTimeEntry *last;
+    guint32 sector;
+    GstClockTime time = tmu * (i + 1);
+
+    if (!gst_dvd_nav_src_cell_sector (cells, n_cells,
+            tmap->map_ent[i] & 0x7fffffff, &sector)) {
+      GST_DEBUG_OBJECT (src, "tmap entry %d (sector %u) outside of the PGC",
+          i, tmap->map_ent[i] & 0x7fffffff);
       return FALSE;
     }
-  }
 
-  /* Check that the max map entry sector size is >= then the length reported
-   * by dvdnav_get_position, as looks like this function doesn't compute 
-   * correctly the pos and length values.
-   */
-  guint32 pos;
-  guint32 dvdnav_length;
-
-  if (dvdnav_get_position (src->dvdnav, &pos,
-          &dvdnav_length) != DVDNAV_STATUS_OK) {
-    GST_WARNING_OBJECT (src,
-        "Cannot get stream length by dvdnav, "
-        "won't enable tmaps use as we cannot check if they're interaction with dvdnav is right");
-    return FALSE;
-  } else {
-    if (src->title_tmap) {
-      int tmap_length;
-
-      tmap_length =
-          (src->title_tmap->map_ent[src->
-              title_tmap->nr_of_entries] & 0x7fffffff);
-      if (tmap_length >= dvdnav_length) {
-        GST_LOG_OBJECT (src, "Using time maps for seeking");
-      } else {
-        GST_WARNING_OBJECT (src,
-            "Time maps has max sector (%d) < than length (%d) reported by dvdnav: "
-            "tmap problem or dvdnav bug?", dvdnav_length);
-      }
+    last = &g_array_index (index, GstDvdNavSrcTimeEntry, index->len - 1);
+    if (sector <= last->sector) {
+      GST_DEBUG_OBJECT (src, "tmap entry %d goes backwards (%u <= %u)", i,
+          sector, last->sector);
+      return FALSE;
     }
+    gst_dvd_nav_src_index_append (index, time, sector);
   }
 
-  /* Dump all tmaps for title set for debugging */
-  if (src->vts_tmapt) {
-    gint i, j;
-
-    GST_LOG_OBJECT (src, "nr_of_tmaps = %d", src->vts_tmapt->nr_of_tmaps);
-    for (i = 0; i < src->vts_tmapt->nr_of_tmaps; ++i) {
-      GST_LOG_OBJECT (src, "======= Table %d ===================", i);
-      GST_LOG_OBJECT (src, "Offset relative to VTS_TMAPTI: %d",
-          src->vts_tmapt->tmap_offset[i]);
-      GST_LOG_OBJECT (src, "Time unit (seconds)          : %d",
-          src->vts_tmapt->tmap[i].tmu);
-      GST_LOG_OBJECT (src, "Number of entries            : %d",
-          src->vts_tmapt->tmap[i].nr_of_entries);
-      for (j = 0; j < src->vts_tmapt->tmap[i].nr_of_entries; j++) {
-        guint64 time;
-
-        time = src->vts_tmapt->tmap[i].tmu * (j + 1) * GST_SECOND;
-        GST_LOG_OBJECT (src, "Time: %" GST_TIME_FORMAT " VOBU "
-            "Sector: %d %s", GST_TIME_ARGS (time),
-            src->vts_tmapt->tmap[i].map_ent[j] & 0x7fffffff,
-            (src->vts_tmapt->tmap[i].map_ent[j] >> 31) ? "discontinuity" : "");
-      }
-    }
-  } else {
-    GST_LOG_OBJECT (src, "no vts_tmapt to dump");
+  /* the last entry can't be further away than a time unit from the end */
+  if (GST_CLOCK_TIME_IS_VALID (duration) &&
+      tmu * tmap->nr_of_entries > duration + tmu) {
+    GST_DEBUG_OBJECT (src, "tmap covers %" GST_TIME_FORMAT ", more than the "
+        "PGC duration %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (tmu * tmap->nr_of_entries), GST_TIME_ARGS (duration));
     return FALSE;
   }
 
-  src->use_tmaps = TRUE;
+  GST_DEBUG_OBJECT (src, "using time map with %d entries of %u seconds",
+      tmap->nr_of_entries, tmap->tmu);
+
   return TRUE;
 }
 
-/* Find sector from time using time map if available */
-/* FIXME: do interpolation as in gst_dvd_nav_src_get_time_for_sector_tmap */
-static gint
-gst_dvd_nav_src_get_sector_from_time_tmap (GstDvdNavSrc * src, GstClockTime ts)
+/* Build the index from the VOBU address map, reading the elapsed cell time
+ * from the DSI packet of each nav pack. Without nav packs only the cell
+ * starts end up in the index. */
+static void
+gst_dvd_nav_src_index_from_admap (GstDvdNavSrc * src, GArray * index,
+    gint vtsn, GstDvdNavSrcCell * cells, gint n_cells)
 {
-  gint sector, i;
+  vobu_admap_t *admap = src->vts_file->vts_vobu_admap;
+  dvd_file_t *file = NULL;
+  guint8 buf[DVD_SECTOR_SIZE];
+  guint n_vobus = 0, v = 0;
+  gint i;
+
+  if (admap != NULL && admap->last_byte + 1 > VOBU_ADMAP_SIZE) {
+    n_vobus = (admap->last_byte + 1 - VOBU_ADMAP_SIZE) / 4;
+    file = DVDOpenFile (src->dvd, vtsn, DVD_READ_TITLE_VOBS);
+  }
+
+  if (file == NULL)
+    GST_DEBUG_OBJECT (src, "no VOBU map available, indexing cells only");
+
+  for (i = 0; i < n_cells; i++) {
+    gst_dvd_nav_src_index_append (index, cells[i].time, cells[i].start);
+
+    if (file == NULL)
+      continue;
 
-  if (src->vts_tmapt == NULL || src->vts_tmapt->nr_of_tmaps == 0)
-    return -1;
+    /* the address map is sorted, skip to the first VOBU of the cell */
+    while (v < n_vobus && admap->vobu_start_sectors[v] < cells[i].first_sector)
+      v++;
 
-  sector = 0;
-  for (i = 0; i < src->title_tmap->nr_of_entries; ++i) {
-    GstClockTime entry_time;
+    for (; v < n_vobus && admap->vobu_start_sectors[v] <= cells[i].last_sector;
+        v++) {
+      guint32 sector = admap->vobu_start_sectors[v];
+      dsi_t dsi;
 
-    entry_time = src->title_tmap->tmu * (i + 1) * GST_SECOND;
-    if (entry_time <= ts) {
-      sector = src->title_tmap->map_ent[i] & 0x7fffffff;
+      if (DVDReadBlocks (file, sector, 1, buf) != 1) {
+        GST_DEBUG_OBJECT (src, "failed reading nav pack at sector %u", sector);
+        DVDCloseFile (file);
+        file = NULL;
+        break;
+      }
+
+      /* the DSI is a private stream 2 packet at a fixed place in nav packs */
+      if (buf[0x400] != 0x00 || buf[0x401] != 0x00 || buf[0x402] != 0x01 ||
+          buf[0x403] != 0xbf)
+        continue;
+
+      navRead_DSI (&dsi, buf + DSI_START_BYTE);
+      gst_dvd_nav_src_index_append (index,
+          cells[i].time + gst_dvd_nav_src_dvd_time_to_gst (&dsi.dsi_gi.c_eltm),
+          cells[i].start + (sector - cells[i].first_sector));
     }
-    if (entry_time >= ts) {
-      return sector;
+  }
+
+  if (file)
+    DVDCloseFile (file);
+}
+
+/* Build the time index for a title. The index always ends with an entry
+ * for the end of the PGC so lookups can interpolate up to the end. */
+static GArray *
+gst_dvd_nav_src_build_title_index (GstDvdNavSrc * src, gint title)
+{
+  title_info_t *info;
+  vts_ptt_srpt_t *ptt_srpt;
+  pgc_t *pgc;
+  GstDvdNavSrcCell *cells;
+  GstClockTime duration;
+  GArray *index;
+  gint vtsn, ttn, pgcn, n_cells;
+  guint32 n_sectors;
+
+  if (src->tt_srpt == NULL || title < 1 || title > src->tt_srpt->nr_of_srpts)
+    return NULL;
+
+  info = &src->tt_srpt->title[title - 1];
+  vtsn = info->title_set_nr;
+  ttn = info->vts_ttn;
+  GST_LOG_OBJECT (src, "building index for title %d, title_set_nr = %d, "
+      "title_ttn = %d", title, vtsn, ttn);
+
+  if (src->vts_file == NULL || src->vts_file_nr != vtsn) {
+    if (src->vts_file) {
+      ifoClose (src->vts_file);
+      src->vts_file = NULL;
+    }
+    src->vts_file = ifoOpen (src->dvd, vtsn);
+    if (src->vts_file == NULL) {
+      GST_WARNING_OBJECT (src, "ifoOpen() failed: %s", g_strerror (errno));
+      return NULL;
     }
+    src->vts_file_nr = vtsn;
+  }
+
+  ptt_srpt = src->vts_file->vts_ptt_srpt;
+  if (ptt_srpt == NULL || src->vts_file->vts_pgcit == NULL ||
+      ttn < 1 || ttn > ptt_srpt->nr_of_srpts ||
+      ptt_srpt->title[ttn - 1].nr_of_ptts == 0)
+    return NULL;
+
+  pgcn = ptt_srpt->title[ttn - 1].ptt[0].pgcn;
+  if (pgcn < 1 || pgcn > src->vts_file->vts_pgcit->nr_of_pgci_srp)
+    return NULL;
+
+  pgc = src->vts_file->vts_pgcit->pgci_srp[pgcn - 1].pgc;
+  if (pgc == NULL || pgc->nr_of_cells == 0 || pgc->cell_playback == NULL)
+    return NULL;
+
+  cells = g_new (GstDvdNavSrcCell, pgc->nr_of_cells);
+  n_cells = gst_dvd_nav_src_get_pgc_cells (pgc, cells);
+  if (n_cells == 0) {
+    g_free (cells);
+    return NULL;
   }
 
-  if (ts == 0)
-    return 0;
+  n_sectors = cells[n_cells - 1].start + (cells[n_cells - 1].last_sector -
+      cells[n_cells - 1].first_sector) + 1;
+  duration = gst_dvd_nav_src_dvd_time_to_gst (&pgc->playback_time);
 
-  return -1;
+  index = g_array_new (FALSE, FALSE, sizeof (GstDvdNavSrcTimeEntry));
+  if (!gst_dvd_nav_src_index_from_tmap (src, index, ttn, cells, n_cells,
+          duration)) {
+    g_array_set_size (index, 0);
+    gst_dvd_nav_src_index_from_admap (src, index, vtsn, cells, n_cells);
+  }
+  g_free (cells);
+
+  /* close with the end of the PGC */
+  gst_dvd_nav_src_index_append (index, duration, n_sectors);
+
+  GST_DEBUG_OBJECT (src, "title %d index has %u entries, %u sectors, "
+      "duration %" GST_TIME_FORMAT, title, index->len, n_sectors,
+      GST_TIME_ARGS (duration));
+
+  return index;
 }
 
-/* Find time for sector using time map, does interpolation */
-static GstClockTime
-gst_dvd_nav_src_get_time_for_sector_tmap (GstDvdNavSrc * src, guint sector)
+static void
+gst_dvd_nav_src_free_title_index (GArray * index)
 {
-  gint i;
-  guint prev_sector = 0;
-  guint cur_sector = 0;
-  GstClockTime target, diff;
-
-  if (src->vts_tmapt == NULL || src->vts_tmapt->nr_of_tmaps == 0) {
-    return GST_CLOCK_TIME_NONE;
-  }
-
-  for (i = 0; i < src->title_tmap->nr_of_entries; ++i) {
-    prev_sector = cur_sector;
-    cur_sector = src->title_tmap->map_ent[i] & 0x7fffffff;
-    if (sector >= prev_sector && sector <= cur_sector) {
-      target = src->title_tmap->tmu * i * GST_SECOND;
-      if (i < src->title_tmap->nr_of_entries - 1) {
-        diff =
-            src->title_tmap->tmu * GST_SECOND * (sector -
-            prev_sector) / (cur_sector - prev_sector);
-        target += diff;
-      }
-      return target;
+  if (index)
+    g_array_free (index, TRUE);
+}
+
+/* Make @index the index of the current title. Called with the object
+ * lock taken. */
+static void
+gst_dvd_nav_src_use_title_index (GstDvdNavSrc * src, GArray * index)
+{
+  /* titles with several PGCs are indexed on their first PGC, don't use the
+   * index when dvdnav is positioning in another one */
+  if (index != NULL && src->sector_length != 0 &&
+      g_array_index (index, GstDvdNavSrcTimeEntry,
+          index->len - 1).sector != src->sector_length) {
+    GST_DEBUG_OBJECT (src, "index covers %u sectors but PGC has %u, not using "
+        "it", g_array_index (index, GstDvdNavSrcTimeEntry,
+            index->len - 1).sector, src->sector_length);
+    index = NULL;
+  }
+
+  src->title_index = index;
+}
+
+/* Runs in the index pool. Building an index can mean reading every nav
+ * pack of the title, so this is kept out of the streaming thread; until
+ * it is done, conversions use the average rate of the PGC. */
+static void
+gst_dvd_nav_src_index_title (gpointer data, GstDvdNavSrc * src)
+{
+  gint title = GPOINTER_TO_INT (data);
+  GArray *index;
+  gboolean cached;
+
+  GST_OBJECT_LOCK (src);
+  cached = g_hash_table_lookup_extended (src->title_indexes,
+      GINT_TO_POINTER (title), NULL, NULL);
+  GST_OBJECT_UNLOCK (src);
+
+  if (cached)
+    return;
+
+  index = gst_dvd_nav_src_build_title_index (src, title);
+
+  GST_OBJECT_LOCK (src);
+  /* failures are cached too, so we don't retry on every cell change */
+  g_hash_table_insert (src->title_indexes, GINT_TO_POINTER (title), index);
+  if (src->title_index_nr == title)
+    gst_dvd_nav_src_use_title_index (src, index);
+  GST_OBJECT_UNLOCK (src);
+}
+
+/* Switch to the index of the current title, having it built the first
+ * time the title is played */
+static void
+gst_dvd_nav_src_update_title_index (GstDvdNavSrc * src)
+{
+  int32_t title, part;
+  gpointer cached;
+  gboolean build = FALSE;
+
+  if (dvdnav_current_title_info (src->dvdnav, &title,
+          &part) != DVDNAV_STATUS_OK) {
+    GST_LOG_OBJECT (src, "Failed getting current title informations!");
+    title = 0;
+  }
+
+  GST_OBJECT_LOCK (src);
+  src->title_index = NULL;
+  src->title_index_nr = title;
+
+  /* There isn't an index for the menus */
+  if (title >= 1) {
+    if (g_hash_table_lookup_extended (src->title_indexes,
+            GINT_TO_POINTER (title), NULL, &cached))
+      gst_dvd_nav_src_use_title_index (src, (GArray *) cached);
+    else
+      build = (src->index_pool != NULL);
+  }
+  GST_OBJECT_UNLOCK (src);
+
+  if (build) {
+    GError *err = NULL;
+
+    GST_DEBUG_OBJECT (src, "building index for title %d", title);
+    g_thread_pool_push (src->index_pool, GINT_TO_POINTER (title), &err);
+    if (err != NULL) {
+      GST_WARNING_OBJECT (src, "could not build index: %s", err->message);
+      g_error_free (err);
     }
   }
+}
+
+static void
+gst_dvd_nav_src_clear_title_indexes (GstDvdNavSrc * src)
+{
+  GST_OBJECT_LOCK (src);
+  src->title_index = NULL;
+  src->title_index_nr = 0;
+  GST_OBJECT_UNLOCK (src);
+
+  if (src->title_indexes) {
+    g_hash_table_destroy (src->title_indexes);
+    src->title_indexes = NULL;
+  }
+}
+
+/* Find the index of the last entry at or before @time, or at or before
+ * @sector when @time is GST_CLOCK_TIME_NONE. The first entry is always
+ * at 0. */
+static guint
+gst_dvd_nav_src_index_search (GArray * index, GstClockTime time,
+    guint32 sector)
+{
+  guint lo = 0, hi = index->len - 1;
 
-  if (sector == 0)
-    return (GstClockTime) 0;
+  while (lo < hi) {
+    guint mid = (lo + hi + 1) / 2;
+    GstDvdNavSrcTimeEntry *entry;
 
-  return GST_CLOCK_TIME_NONE;
+    entry = &g_array_index (index, GstDvdNavSrcTimeEntry, mid);
+    if (GST_CLOCK_TIME_IS_VALID (time) ? entry->time <= time :
+        entry->sector <= sector)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
 }
 
-/* Find time for sector */
+/* Find time for sector, interpolating between index entries */
 static GstClockTime
 gst_dvd_nav_src_get_time_for_sector (GstDvdNavSrc * src, guint sector)
 {
   GstClockTime time;
 
   GST_OBJECT_LOCK (src);
-  if (src->use_tmaps) {
-    time = gst_dvd_nav_src_get_time_for_sector_tmap (src, sector);
-    if (time != GST_CLOCK_TIME_NONE) {
-      GST_OBJECT_UNLOCK (src);
-      return time;
+  if (src->title_index != NULL) {
+    GArray *index = src->title_index;
+    GstDvdNavSrcTimeEntry *entry, *next;
+    guint i;
+
+    i = gst_dvd_nav_src_index_search (index, GST_CLOCK_TIME_NONE, sector);
+    entry = &g_array_index (index, GstDvdNavSrcTimeEntry, i);
+    time = entry->time;
+    if (i + 1 < index->len) {
+      next = &g_array_index (index, GstDvdNavSrcTimeEntry, i + 1);
+      time += gst_util_uint64_scale (next->time - entry->time,
+          sector - entry->sector, next->sector - entry->sector);
     }
+    GST_OBJECT_UNLOCK (src);
+    return time;
   }
+
   /* Fallback to average time calculation */
   time = (GstClockTime) ((float) sector / src->sector_length * src->pgc_length);
 
@@ -748,19 +1003,24 @@ gst_dvd_nav_src_get_time_for_sector (GstDvdNavSrc * src, guint sector)
   return time;
 }
 
-/* Find sector from time */
+/* Find sector from time, this is the start of the VOBU containing @time */
 static GstClockTime
 gst_dvd_nav_src_get_sector_from_time (GstDvdNavSrc * src, GstClockTime time)
 {
   gint sector;
 
   GST_OBJECT_LOCK (src);
-  if (src->use_tmaps) {
-    sector = gst_dvd_nav_src_get_sector_from_time_tmap (src, time);
-    if (sector >= 0) {
-      GST_OBJECT_UNLOCK (src);
-      return sector;
-    }
+  if (src->title_index != NULL) {
+    GArray *index = src->title_index;
+    guint i;
+
+    i = gst_dvd_nav_src_index_search (index, time, 0);
+    /* don't seek to the end marker */
+    if (i > 0 && i == index->len - 1)
+      i--;
+    sector = g_array_index (index, GstDvdNavSrcTimeEntry, i).sector;
+    GST_OBJECT_UNLOCK (src);
+    return sector;
   }
 
   /* Fallback to average sector calculation */
@@ -1763,8 +2023,8 @@ gst_dvd_nav_src_process_next_block (GstDvdNavSrc * src, GstBuffer ** p_buf)
         GST_WARNING_OBJECT (src,
             "Cannot get new stream length after DVDNAV_CELL_CHANGE");
 
-      /* Update the time maps */
-      gst_dvd_nav_src_update_tmaps (src);
+      /* Switch to the time index of the title */
+      gst_dvd_nav_src_update_title_index (src);
 
       gst_dvd_nav_src_update_streaminfo (src);
 
@@ -1962,6 +2222,7 @@ gst_dvd_nav_src_start (GstBaseSrc * basesrc)
   GstDvdNavSrc *src = GST_DVD_NAV_SRC (basesrc);
   GstTagList *tags;
   const char *title_str;
+  GError *err = NULL;
 
   if (!read_vts_info (src)) {
     GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ,
@@ -1985,6 +2246,18 @@ gst_dvd_nav_src_start (GstBaseSrc * basesrc)
 
   src->tt_srpt = src->vmg_file->tt_srpt;
 
+  /* The title indexes are built one at a time outside of the streaming
+   * thread, using our own reader */
+  src->title_indexes = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, (GDestroyNotify) gst_dvd_nav_src_free_title_index);
+  src->index_pool = g_thread_pool_new ((GFunc) gst_dvd_nav_src_index_title,
+      src, 1, FALSE, &err);
+  if (src->index_pool == NULL) {
+    GST_WARNING_OBJECT (src, "could not create index thread pool: %s",
+        err->message);
+    g_error_free (err);
+  }
+
   if (dvdnav_open (&src->dvdnav, src->device) != DVDNAV_STATUS_OK) {
     GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
         (_("Failed to open DVD device '%s'."), src->device));
@@ -2048,7 +2321,6 @@ gst_dvd_nav_src_start (GstBaseSrc * basesrc)
   }
 
   src->streaminfo = NULL;
-  src->use_tmaps = FALSE;
   src->first_seek = TRUE;
 
   return TRUE;
@@ -2059,16 +2331,27 @@ gst_dvd_nav_src_stop (GstBaseSrc * basesrc)
 {
   GstDvdNavSrc *src = GST_DVD_NAV_SRC (basesrc);
 
+  /* Drop pending index builds and wait for the running one, it uses the
+   * reader and the vts file we are about to close */
+  if (src->index_pool) {
+    g_thread_pool_free (src->index_pool, TRUE, TRUE);
+    src->index_pool = NULL;
+  }
+
   if (src->dvdnav && dvdnav_close (src->dvdnav) != DVDNAV_STATUS_OK) {
     GST_ELEMENT_ERROR (src, RESOURCE, CLOSE, (NULL),
         ("dvdnav_close failed: %s", dvdnav_err_to_string (src->dvdnav)));
     return FALSE;
   }
 
+  /* The indexes are only valid for this disc */
+  gst_dvd_nav_src_clear_title_indexes (src);
+
   /* Close old vts file if opened */
   if (src->vts_file) {
     ifoClose (src->vts_file);
     src->vts_file = NULL;
+    src->vts_file_nr = 0;
   }
 
   /* Close the video manager */
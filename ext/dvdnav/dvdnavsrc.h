@@ -22,6 +22,7 @@
 
 #include <dvdread/dvd_reader.h>
 #include <dvdread/ifo_read.h>
+#include <dvdread/nav_read.h>
 
 #include <dvdnav/dvdnav.h>
 #include <dvdnav/nav_print.h>
@@ -46,6 +47,15 @@ typedef enum
   GST_DVD_NAV_SRC_PAUSE_UNLIMITED     /* An time unlimited pause is active. */
 } GstDvdNavSrcPauseMode;
 
+/* An entry of the per-title time index, one per VOBU (or per time map
+ * entry). Sectors are relative to the start of the title PGC, as reported by
+ * dvdnav_get_position() with PGC positioning enabled. */
+typedef struct
+{
+  GstClockTime             time;
+  guint32                  sector;
+} GstDvdNavSrcTimeEntry;
+
 /* The DVD domain types. */
 typedef enum
 {
@@ -70,7 +80,6 @@ struct _GstDvdNavSrc
   gboolean                 seek_pending;
   gboolean                 need_flush;
   gboolean                 first_seek;
-  gboolean                 use_tmaps;
   gboolean                 still_frame;
 
   /* Timing */
@@ -130,10 +139,16 @@ struct _GstDvdNavSrc
   dvd_reader_t              *dvd;
   ifo_handle_t              *vmg_file;
   tt_srpt_t                 *tt_srpt;
-  vts_ptt_srpt_t            *vts_ptt_srpt;
   ifo_handle_t              *vts_file;
-  vts_tmapt_t               *vts_tmapt;
-  vts_tmap_t                *title_tmap;
+  gint                      vts_file_nr;     /* Title set of vts_file        */
+
+  GHashTable               *title_indexes;   /* Title number => GArray of    *
+                                              * GstDvdNavSrcTimeEntry        */
+  GArray                   *title_index;     /* Index of the current title,  *
+                                              * NULL in menus                */
+  gint                      title_index_nr;  /* Title of title_index         */
+  GThreadPool              *index_pool;      /* Builds the title indexes,    *
+                                              * owns dvd and vts_file        */
 };
 
 struct _GstDvdNavSrcClass
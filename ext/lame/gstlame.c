@@ -23,7 +23,8 @@
  * SECTION:element-lame
  * @see_also: mad, vorbisenc
  *
- * This element encodes raw integer audio into an MPEG-1 layer 3 (MP3) stream.
+ * This element encodes raw integer or float audio into an MPEG-1 layer 3 (MP3)
+ * stream.
  * Note that <ulink url="http://en.wikipedia.org/wiki/MP3">MP3</ulink> is not
  * a free format, there are licensing and patent issues to take into
  * consideration. See <ulink url="http://www.vorbis.com/">Ogg/Vorbis</ulink>
@@ -106,9 +107,29 @@ GST_STATIC_PAD_TEMPLATE ("sink",
         "width = (int) 16, "
         "depth = (int) 16, "
         "rate = (int) { 8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000 }, "
+        "channels = (int) [ 1, 2 ]; "
+        "audio/x-raw-int, "
+        "endianness = (int) " G_STRINGIFY (G_BYTE_ORDER) ", "
+        "signed = (boolean) true, "
+        "width = (int) 32, "
+        "depth = (int) 32, "
+        "rate = (int) { 8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000 }, "
+        "channels = (int) [ 1, 2 ]; "
+        "audio/x-raw-float, "
+        "endianness = (int) " G_STRINGIFY (G_BYTE_ORDER) ", "
+        "width = (int) 32, "
+        "rate = (int) { 8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000 }, "
         "channels = (int) [ 1, 2 ]")
     );
 
+/* input sample formats */
+enum
+{
+  GST_LAME_FORMAT_S16,
+  GST_LAME_FORMAT_S32,
+  GST_LAME_FORMAT_F32
+};
+
 static GstStaticPadTemplate gst_lame_src_template =
 GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
@@ -299,6 +320,8 @@ enum
   ARG_NO_SHORT_BLOCKS,
   ARG_EMPHASIS,
   ARG_VBR_QUALITY,
+  ARG_FRAME_ALIGNED,
+  ARG_THREADS,
 #ifdef GSTLAME_PRESET
   ARG_XINGHEADER,               /* FIXME: remove in 0.11 */
   ARG_PRESET
@@ -318,6 +341,15 @@ static void gst_lame_get_property (GObject * object, guint prop_id,
 static gboolean gst_lame_sink_event (GstPad * pad, GstEvent * event);
 static GstFlowReturn gst_lame_chain (GstPad * pad, GstBuffer * buf);
 static gboolean gst_lame_setup (GstLame * lame);
+static gboolean gst_lame_configure (GstLame * lame, lame_global_flags * lgf);
+typedef struct _GstLameSegment GstLameSegment;
+
+static void gst_lame_segment_free (GstLameSegment * seg);
+static void gst_lame_segment_encode (GstLameSegment * seg, GstLame * lame);
+static GstFlowReturn gst_lame_segment_push (GstLameSegment * seg,
+    GstLame * lame);
+static GstFlowReturn gst_lame_parallel_finish (GstLame * lame);
+static void gst_lame_reset_frames (GstLame * lame);
 static GstStateChangeReturn gst_lame_change_state (GstElement * element,
     GstStateChange transition);
 
@@ -364,12 +396,22 @@ gst_lame_release_memory (GstLame * lame)
     lame_close (lame->lgf);
     lame->lgf = NULL;
   }
+  gst_buffer_replace (&lame->pending, NULL);
+  g_free (lame->scratch);
+  lame->scratch = NULL;
+  lame->scratch_size = 0;
+  gst_segment_queue_stop (&lame->segments);
 }
 
 static void
 gst_lame_finalize (GObject * obj)
 {
-  gst_lame_release_memory (GST_LAME (obj));
+  GstLame *lame = GST_LAME (obj);
+
+  gst_lame_release_memory (lame);
+
+  gst_segment_queue_clear (&lame->segments);
+  g_byte_array_free (lame->pcm, TRUE);
 
   G_OBJECT_CLASS (parent_class)->finalize (obj);
 }
@@ -528,6 +570,15 @@ gst_lame_class_init (GstLameClass * klass)
   g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_EMPHASIS,
       g_param_spec_boolean ("emphasis", "Emphasis", "Emphasis",
           gst_lame_default_settings.emphasis, G_PARAM_READWRITE));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_FRAME_ALIGNED,
+      g_param_spec_boolean ("frame-aligned", "Frame aligned",
+          "Output one buffer per MP3 frame with exact timestamps "
+          "(not supported with free-format)", FALSE, G_PARAM_READWRITE));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_THREADS,
+      g_param_spec_int ("threads", "Threads",
+          "Number of threads to encode segments of non-live streams in "
+          "parallel with, disables the bit reservoir (0 = off)", 0, 64, 0,
+          G_PARAM_READWRITE));
   g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_XINGHEADER,
       g_param_spec_boolean ("xingheader", "Output Xing Header",
           "Output Xing Header (BROKEN, use xingmux instead)", FALSE,
@@ -561,6 +612,27 @@ gst_lame_sink_setcaps (GstPad * pad, GstCaps * caps)
   lame = GST_LAME (GST_PAD_PARENT (pad));
   structure = gst_caps_get_structure (caps, 0);
 
+  /* the pending segment input is in the old format, encode it before the
+   * format changes */
+  if (lame->setup && lame->parallel) {
+    if (lame->last_flow == GST_FLOW_OK)
+      gst_lame_parallel_finish (lame);
+    else
+      gst_lame_reset_frames (lame);
+    lame->parallel = FALSE;
+  }
+
+  if (gst_structure_has_name (structure, "audio/x-raw-float")) {
+    lame->format = GST_LAME_FORMAT_F32;
+    lame->width = 4;
+  } else {
+    gint width = 16;
+
+    gst_structure_get_int (structure, "width", &width);
+    lame->format = (width == 32) ? GST_LAME_FORMAT_S32 : GST_LAME_FORMAT_S16;
+    lame->width = width / 8;
+  }
+
   if (!gst_structure_get_int (structure, "rate", &lame->samplerate))
     goto no_rate;
   if (!gst_structure_get_int (structure, "channels", &lame->num_channels))
@@ -649,6 +721,8 @@ gst_lame_init (GstLame * lame)
 
   lame->samplerate = 44100;
   lame->num_channels = 2;
+  lame->format = GST_LAME_FORMAT_S16;
+  lame->width = 2;
   lame->setup = FALSE;
 
   /* Set default settings */
@@ -683,6 +757,14 @@ gst_lame_init (GstLame * lame)
   lame->no_short_blocks = gst_lame_default_settings.no_short_blocks;
   lame->emphasis = gst_lame_default_settings.emphasis;
   lame->preset = gst_lame_default_settings.preset;
+  lame->frame_aligned = FALSE;
+  lame->threads = 0;
+  lame->parallel = FALSE;
+  gst_segment_queue_init (&lame->segments,
+      (GstSegmentQueueProcessFunc) gst_lame_segment_encode,
+      (GstSegmentQueuePushFunc) gst_lame_segment_push,
+      (GDestroyNotify) gst_lame_segment_free, lame);
+  lame->pcm = g_byte_array_new ();
 
   GST_DEBUG_OBJECT (lame, "done initializing");
 }
@@ -826,6 +908,12 @@ gst_lame_set_property (GObject * object, guint prop_id, const GValue * value,
     case ARG_EMPHASIS:
       lame->emphasis = g_value_get_boolean (value);
       break;
+    case ARG_FRAME_ALIGNED:
+      lame->frame_aligned = g_value_get_boolean (value);
+      break;
+    case ARG_THREADS:
+      lame->threads = g_value_get_int (value);
+      break;
     case ARG_XINGHEADER:
       break;
 #ifdef GSTLAME_PRESET
@@ -939,6 +1027,12 @@ gst_lame_get_property (GObject * object, guint prop_id, GValue * value,
     case ARG_EMPHASIS:
       g_value_set_boolean (value, lame->emphasis);
       break;
+    case ARG_FRAME_ALIGNED:
+      g_value_set_boolean (value, lame->frame_aligned);
+      break;
+    case ARG_THREADS:
+      g_value_set_int (value, lame->threads);
+      break;
     case ARG_XINGHEADER:
       break;
 #ifdef GSTLAME_PRESET
@@ -952,6 +1046,526 @@ gst_lame_get_property (GObject * object, guint prop_id, GValue * value,
   }
 }
 
+/* returns the length of the layer 3 frame starting with @header, or 0 if
+ * this is not a valid (or a free format) frame header */
+static guint
+gst_lame_frame_length (guint32 header, guint * samples, guint * rate)
+{
+  static const guint bitrates[2][15] = {
+    /* MPEG-1 */
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    /* MPEG-2 and MPEG-2.5 */
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}
+  };
+  static const guint rates[3] = { 44100, 48000, 32000 };
+  guint version, lsf, bitrate, rate_idx, padding;
+
+  if ((header & 0xffe00000) != 0xffe00000)
+    return 0;
+
+  /* 3 is MPEG-1, 2 is MPEG-2, 0 is MPEG-2.5 */
+  version = (header >> 19) & 0x3;
+  if (version == 1)
+    return 0;
+  /* layer 3 */
+  if (((header >> 17) & 0x3) != 1)
+    return 0;
+
+  lsf = (version != 3);
+  bitrate = bitrates[lsf][(header >> 12) & 0xf];
+  rate_idx = (header >> 10) & 0x3;
+  padding = (header >> 9) & 0x1;
+  if (bitrate == 0 || ((header >> 12) & 0xf) == 0xf || rate_idx == 3)
+    return 0;
+
+  *rate = rates[rate_idx] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+  *samples = lsf ? 576 : 1152;
+
+  return (lsf ? 72 : 144) * bitrate * 1000 / *rate + padding;
+}
+
+/* splits @buf, which starts at a frame boundary, into one buffer per frame
+ * and pushes those. An incomplete frame at the end is kept for the next
+ * call, unless @eos is set. Takes ownership of @buf. */
+static GstFlowReturn
+gst_lame_push_frames (GstLame * lame, GstBuffer * buf, gboolean eos)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+  guint8 *data = GST_BUFFER_DATA (buf);
+  guint size = GST_BUFFER_SIZE (buf);
+  guint offset = 0;
+
+  gst_buffer_replace (&lame->pending, NULL);
+
+  while (offset + 4 <= size && result == GST_FLOW_OK) {
+    GstBuffer *frame;
+    GstClockTime end;
+    guint len, samples = 0, rate = 0;
+
+    len = gst_lame_frame_length (GST_READ_UINT32_BE (data + offset),
+        &samples, &rate);
+
+    if (len == 0) {
+      /* lame only hands out complete frames, so this should not happen */
+      GST_WARNING_OBJECT (lame, "no frame header at offset %u, pushing %u "
+          "bytes unaligned", offset, size - offset);
+      len = size - offset;
+      samples = 0;
+    } else if (offset + len > size) {
+      break;
+    }
+
+    frame = gst_buffer_create_sub (buf, offset, len);
+
+    if (GST_CLOCK_TIME_IS_VALID (lame->frame_ts) && rate > 0) {
+      GST_BUFFER_TIMESTAMP (frame) = lame->frame_ts +
+          gst_util_uint64_scale_int (lame->frame_samples, GST_SECOND, rate);
+      end = lame->frame_ts + gst_util_uint64_scale_int (lame->frame_samples +
+          samples, GST_SECOND, rate);
+      GST_BUFFER_DURATION (frame) = end - GST_BUFFER_TIMESTAMP (frame);
+    }
+    lame->frame_samples += samples;
+
+    gst_buffer_set_caps (frame, GST_PAD_CAPS (lame->srcpad));
+    result = gst_pad_push (lame->srcpad, frame);
+    offset += len;
+  }
+
+  if (result == GST_FLOW_OK && offset < size) {
+    if (eos) {
+      GST_DEBUG_OBJECT (lame, "dropping %u bytes of incomplete frame",
+          size - offset);
+    } else {
+      lame->pending = gst_buffer_create_sub (buf, offset, size - offset);
+    }
+  }
+
+  gst_buffer_unref (buf);
+
+  lame->last_flow = result;
+  if (result != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (lame, "flow return: %s", gst_flow_get_name (result));
+  }
+
+  return result;
+}
+
+/* allocates an output buffer of @size bytes after the pending partial frame
+ * and returns where lame should write */
+static GstBuffer *
+gst_lame_alloc_output (GstLame * lame, guint size, guchar ** mp3_data)
+{
+  GstBuffer *outbuf;
+  guint pending_size = 0;
+
+  if (lame->pending)
+    pending_size = GST_BUFFER_SIZE (lame->pending);
+
+  outbuf = gst_buffer_new_and_alloc (pending_size + size);
+  if (pending_size > 0) {
+    memcpy (GST_BUFFER_DATA (outbuf), GST_BUFFER_DATA (lame->pending),
+        pending_size);
+  }
+  *mp3_data = GST_BUFFER_DATA (outbuf) + pending_size;
+
+  return outbuf;
+}
+
+static gpointer
+gst_lame_get_scratch (gpointer * scratch, guint * scratch_size, guint size)
+{
+  if (*scratch_size < size) {
+    *scratch = g_realloc (*scratch, size);
+    *scratch_size = size;
+  }
+  return *scratch;
+}
+
+/* encodes @num_samples samples per channel of interleaved @data. Input that
+ * lame only takes as separate channels is split into @scratch, mono input
+ * is always passed as is. */
+static gint
+gst_lame_encode_samples (lame_global_flags * lgf, gint format, gint channels,
+    const guint8 * data, guint num_samples, guchar * out, gint out_size,
+    gpointer * scratch, guint * scratch_size)
+{
+  guint i;
+
+  switch (format) {
+    case GST_LAME_FORMAT_S16:
+      if (channels == 1)
+        return lame_encode_buffer (lgf, (short int *) data, NULL,
+            num_samples, out, out_size);
+      return lame_encode_buffer_interleaved (lgf, (short int *) data,
+          num_samples, out, out_size);
+    case GST_LAME_FORMAT_S32:{
+      const gint32 *in = (const gint32 *) data;
+      int *left, *right;
+
+      if (channels == 1)
+        return lame_encode_buffer_int (lgf, (int *) data, NULL,
+            num_samples, out, out_size);
+
+      left = gst_lame_get_scratch (scratch, scratch_size,
+          2 * num_samples * sizeof (int));
+      right = left + num_samples;
+      for (i = 0; i < num_samples; i++) {
+        left[i] = in[2 * i];
+        right[i] = in[2 * i + 1];
+      }
+      return lame_encode_buffer_int (lgf, left, right, num_samples, out,
+          out_size);
+    }
+    case GST_LAME_FORMAT_F32:{
+#ifdef GSTLAME_IEEE_FLOAT
+      if (channels == 1)
+        return lame_encode_buffer_ieee_float (lgf, (const float *) data, NULL,
+            num_samples, out, out_size);
+      return lame_encode_buffer_interleaved_ieee_float (lgf,
+          (const float *) data, num_samples, out, out_size);
+#else
+      const gfloat *in = (const gfloat *) data;
+      gfloat *left, *right;
+
+      /* older lame only takes separate channels scaled to the range of
+       * 16 bit samples */
+      left = gst_lame_get_scratch (scratch, scratch_size,
+          channels * num_samples * sizeof (gfloat));
+      right = left + num_samples;
+      if (channels == 1) {
+        for (i = 0; i < num_samples; i++)
+          left[i] = in[i] * 32768.0f;
+        right = NULL;
+      } else {
+        for (i = 0; i < num_samples; i++) {
+          left[i] = in[2 * i] * 32768.0f;
+          right[i] = in[2 * i + 1] * 32768.0f;
+        }
+      }
+      return lame_encode_buffer_float (lgf, left, right, num_samples, out,
+          out_size);
+#endif
+    }
+    default:
+      g_assert_not_reached ();
+      return -1;
+  }
+}
+
+/* Segment-parallel encoding for non-live streams: the input is cut into
+ * segments of GST_LAME_SEGMENT_FRAMES frames that are encoded with their own
+ * encoder on a thread pool. Each segment is encoded together with
+ * GST_LAME_SEGMENT_OVERLAP frames of the previous and the next segment to
+ * warm up the psychoacoustic model and to keep lame's end of stream padding
+ * out of the frames that are kept; the frames of the overlap are dropped.
+ * The bit reservoir is disabled so every kept frame is self-contained. */
+#define GST_LAME_SEGMENT_FRAMES  256
+#define GST_LAME_SEGMENT_OVERLAP 4
+
+struct _GstLameSegment
+{
+  lame_global_flags *lgf;
+  gint format;
+  gint channels;
+  guint8 *data;
+  guint num_samples;            /* per channel */
+  guint skip;                   /* frames of the previous segment */
+  guint keep;                   /* frames to keep after those */
+
+  /* result */
+  gboolean error;
+  GstBuffer *out;
+  guint frames;
+};
+
+static void
+gst_lame_segment_free (GstLameSegment * seg)
+{
+  if (seg->lgf)
+    lame_close (seg->lgf);
+  g_free (seg->data);
+  if (seg->out)
+    gst_buffer_unref (seg->out);
+  g_free (seg);
+}
+
+/* runs in the thread pool */
+static void
+gst_lame_segment_encode (GstLameSegment * seg, GstLame * lame)
+{
+  GstBuffer *buf;
+  guint8 *data;
+  gint size, flushed, max_size;
+  guint offset = 0, start = 0, frame = 0;
+  gpointer scratch = NULL;
+  guint scratch_size = 0;
+
+  max_size = 1.25 * seg->num_samples + 7200;
+  buf = gst_buffer_new_and_alloc (max_size + 7200);
+  data = GST_BUFFER_DATA (buf);
+
+  size = gst_lame_encode_samples (seg->lgf, seg->format, seg->channels,
+      seg->data, seg->num_samples, data, max_size, &scratch, &scratch_size);
+  g_free (scratch);
+
+  if (size >= 0) {
+    flushed = lame_encode_flush (seg->lgf, data + size, 7200);
+    if (flushed >= 0)
+      size += flushed;
+    else
+      size = flushed;
+  }
+
+  if (size < 0) {
+    seg->error = TRUE;
+    size = 0;
+  }
+
+  /* pick the frames of this segment */
+  while (offset + 4 <= size &&
+      (frame < seg->skip || frame - seg->skip < seg->keep)) {
+    guint len, samples, rate;
+
+    len = gst_lame_frame_length (GST_READ_UINT32_BE (data + offset),
+        &samples, &rate);
+    if (len == 0 || offset + len > size)
+      break;
+
+    if (frame == seg->skip)
+      start = offset;
+    offset += len;
+    frame++;
+  }
+
+  if (frame > seg->skip) {
+    seg->out = gst_buffer_create_sub (buf, start, offset - start);
+    seg->frames = frame - seg->skip;
+  }
+  gst_buffer_unref (buf);
+
+  lame_close (seg->lgf);
+  seg->lgf = NULL;
+  g_free (seg->data);
+  seg->data = NULL;
+}
+
+/* queues the first @size bytes of the pending input as a segment */
+static gboolean
+gst_lame_segment_submit (GstLame * lame, guint size, guint skip, guint keep)
+{
+  GstLameSegment *seg;
+  lame_global_flags *lgf;
+  GError *err = NULL;
+
+  lgf = lame_init ();
+  if (lgf == NULL)
+    return FALSE;
+
+  lame_set_in_samplerate (lgf, lame->samplerate);
+  lame_set_out_samplerate (lgf, lame_get_out_samplerate (lame->lgf));
+  if (!gst_lame_configure (lame, lgf) ||
+      lame_set_disable_reservoir (lgf, TRUE) < 0 ||
+      lame_init_params (lgf) < 0) {
+    lame_close (lgf);
+    return FALSE;
+  }
+
+  seg = g_new0 (GstLameSegment, 1);
+  seg->lgf = lgf;
+  seg->format = lame->format;
+  seg->channels = lame->num_channels;
+  seg->data = g_memdup (lame->pcm->data, size);
+  seg->num_samples = size / (lame->width * lame->num_channels);
+  seg->skip = skip;
+  seg->keep = keep;
+
+  GST_LOG_OBJECT (lame, "queueing segment of %u samples, skipping %u frames",
+      seg->num_samples, skip);
+
+  if (!gst_segment_queue_push (&lame->segments, seg, &err))
+    goto push_failed;
+
+  return TRUE;
+
+push_failed:
+  {
+    GST_WARNING_OBJECT (lame, "failed to queue segment: %s", err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+}
+
+static GstFlowReturn
+gst_lame_segment_push (GstLameSegment * seg, GstLame * lame)
+{
+  GstBuffer *outbuf;
+  GstFlowReturn result;
+  gint rate, spf;
+
+  if (seg->error)
+    goto encode_failed;
+
+  if (seg->out == NULL)
+    return GST_FLOW_OK;
+
+  outbuf = seg->out;
+  seg->out = NULL;
+
+  if (lame->frame_aligned)
+    return gst_lame_push_frames (lame, outbuf, FALSE);
+
+  rate = lame_get_out_samplerate (lame->lgf);
+  spf = lame_get_framesize (lame->lgf);
+
+  if (GST_CLOCK_TIME_IS_VALID (lame->frame_ts)) {
+    GST_BUFFER_TIMESTAMP (outbuf) = lame->frame_ts +
+        gst_util_uint64_scale_int (lame->frame_samples, GST_SECOND, rate);
+    GST_BUFFER_DURATION (outbuf) = lame->frame_ts +
+        gst_util_uint64_scale_int (lame->frame_samples + seg->frames * spf,
+        GST_SECOND, rate) - GST_BUFFER_TIMESTAMP (outbuf);
+  }
+  lame->frame_samples += seg->frames * spf;
+
+  gst_buffer_set_caps (outbuf, GST_PAD_CAPS (lame->srcpad));
+  result = gst_pad_push (lame->srcpad, outbuf);
+  lame->last_flow = result;
+  if (result != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (lame, "flow return: %s", gst_flow_get_name (result));
+  }
+
+  return result;
+
+encode_failed:
+  {
+    GST_ELEMENT_ERROR (lame, LIBRARY, ENCODE, (NULL),
+        ("lame failed to encode a segment"));
+    return GST_FLOW_ERROR;
+  }
+}
+
+static GstFlowReturn
+gst_lame_chain_parallel (GstLame * lame, GstBuffer * buf)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+  guint frame_bytes, segment_bytes, overlap_bytes, preroll_bytes;
+
+  if (!GST_CLOCK_TIME_IS_VALID (lame->frame_ts)) {
+    lame->frame_ts = GST_BUFFER_TIMESTAMP (buf);
+    lame->frame_samples = 0;
+  }
+
+  g_byte_array_append (lame->pcm, GST_BUFFER_DATA (buf),
+      GST_BUFFER_SIZE (buf));
+  gst_buffer_unref (buf);
+
+  frame_bytes = lame_get_framesize (lame->lgf) * lame->width *
+      lame->num_channels;
+  segment_bytes = GST_LAME_SEGMENT_FRAMES * frame_bytes;
+  overlap_bytes = GST_LAME_SEGMENT_OVERLAP * frame_bytes;
+
+  while (result == GST_FLOW_OK) {
+    preroll_bytes = lame->have_preroll ? overlap_bytes : 0;
+    if (lame->pcm->len < preroll_bytes + segment_bytes + overlap_bytes)
+      break;
+
+    if (!gst_lame_segment_submit (lame,
+            preroll_bytes + segment_bytes + overlap_bytes,
+            preroll_bytes / frame_bytes, GST_LAME_SEGMENT_FRAMES))
+      goto submit_failed;
+
+    /* keep the end of this segment as the start of the next one */
+    g_byte_array_remove_range (lame->pcm, 0,
+        preroll_bytes + segment_bytes - overlap_bytes);
+    lame->have_preroll = TRUE;
+
+    result = gst_segment_queue_process (&lame->segments, FALSE, TRUE);
+  }
+
+  return result;
+
+submit_failed:
+  {
+    GST_ELEMENT_ERROR (lame, LIBRARY, SETTINGS, (NULL),
+        ("failed to set up a segment encoder"));
+    return GST_FLOW_ERROR;
+  }
+}
+
+/* encodes the remaining input and pushes all segments */
+static GstFlowReturn
+gst_lame_parallel_finish (GstLame * lame)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+
+  if (lame->have_preroll || lame->pcm->len > 0) {
+    guint skip = 0;
+
+    if (lame->have_preroll)
+      skip = GST_LAME_SEGMENT_OVERLAP;
+
+    if (!gst_lame_segment_submit (lame, lame->pcm->len, skip, G_MAXUINT))
+      result = GST_FLOW_ERROR;
+  }
+
+  if (result == GST_FLOW_OK)
+    result = gst_segment_queue_process (&lame->segments, TRUE, TRUE);
+  else
+    gst_segment_queue_process (&lame->segments, TRUE, FALSE);
+
+  g_byte_array_set_size (lame->pcm, 0);
+  lame->have_preroll = FALSE;
+
+  return result;
+}
+
+/* decides whether to use segment-parallel encoding after setup */
+static void
+gst_lame_check_parallel (GstLame * lame)
+{
+  GError *err = NULL;
+
+  lame->parallel = FALSE;
+
+  if (lame->threads == 0)
+    return;
+
+  if (lame->free_format) {
+    GST_WARNING_OBJECT (lame, "can't encode free format in parallel");
+    return;
+  }
+  if (lame_get_out_samplerate (lame->lgf) != lame->samplerate) {
+    GST_WARNING_OBJECT (lame, "can't resample when encoding in parallel");
+    return;
+  }
+
+  if (gst_segment_queue_upstream_is_live (lame->sinkpad)) {
+    GST_INFO_OBJECT (lame, "upstream is live, not encoding in parallel");
+    return;
+  }
+
+  if (!gst_segment_queue_set_threads (&lame->segments, lame->threads, &err)) {
+    GST_WARNING_OBJECT (lame, "failed to create thread pool: %s",
+        err->message);
+    g_error_free (err);
+    return;
+  }
+
+  GST_INFO_OBJECT (lame, "encoding segments on %d threads", lame->threads);
+  lame->parallel = TRUE;
+}
+
+static void
+gst_lame_reset_frames (GstLame * lame)
+{
+  gst_segment_queue_process (&lame->segments, TRUE, FALSE);
+  g_byte_array_set_size (lame->pcm, 0);
+  lame->have_preroll = FALSE;
+
+  gst_buffer_replace (&lame->pending, NULL);
+  lame->frame_ts = GST_CLOCK_TIME_NONE;
+  lame->frame_samples = 0;
+}
+
 static gboolean
 gst_lame_sink_event (GstPad * pad, GstEvent * event)
 {
@@ -964,7 +1578,29 @@ gst_lame_sink_event (GstPad * pad, GstEvent * event)
     case GST_EVENT_EOS:{
       GST_DEBUG_OBJECT (lame, "handling EOS event");
 
-      if (lame->lgf != NULL) {
+      if (lame->lgf != NULL && lame->parallel) {
+        if (lame->last_flow == GST_FLOW_OK)
+          gst_lame_parallel_finish (lame);
+        gst_lame_reset_frames (lame);
+      } else if (lame->lgf != NULL && lame->frame_aligned &&
+          !lame->free_format) {
+        GstBuffer *buf;
+        guchar *mp3_data;
+        gint size;
+
+        buf = gst_lame_alloc_output (lame, 7200, &mp3_data);
+        size = lame_encode_flush (lame->lgf, mp3_data, 7200);
+
+        if (size >= 0 && lame->last_flow == GST_FLOW_OK) {
+          GST_BUFFER_SIZE (buf) -= 7200 - size;
+          GST_DEBUG_OBJECT (lame, "pushing final %u bytes",
+              GST_BUFFER_SIZE (buf));
+          gst_lame_push_frames (lame, buf, TRUE);
+        } else {
+          gst_buffer_unref (buf);
+        }
+        gst_lame_reset_frames (lame);
+      } else if (lame->lgf != NULL) {
         GstBuffer *buf;
         gint size;
 
@@ -1009,14 +1645,18 @@ gst_lame_sink_event (GstPad * pad, GstEvent * event)
     case GST_EVENT_FLUSH_STOP:
     {
       guchar *mp3_data = NULL;
-      gint mp3_buffer_size, mp3_size = 0;
+      gint mp3_buffer_size;
 
       GST_DEBUG_OBJECT (lame, "handling FLUSH stop event");
 
       /* clear buffers */
-      mp3_buffer_size = 7200;
-      mp3_data = g_malloc (mp3_buffer_size);
-      mp3_size = lame_encode_flush (lame->lgf, mp3_data, mp3_buffer_size);
+      if (lame->lgf != NULL) {
+        mp3_buffer_size = 7200;
+        mp3_data = g_malloc (mp3_buffer_size);
+        lame_encode_flush (lame->lgf, mp3_data, mp3_buffer_size);
+        g_free (mp3_data);
+      }
+      gst_lame_reset_frames (lame);
 
       ret = gst_pad_push_event (lame->srcpad, event);
       break;
@@ -1037,6 +1677,7 @@ static GstFlowReturn
 gst_lame_chain (GstPad * pad, GstBuffer * buf)
 {
   GstLame *lame;
+  GstBuffer *outbuf;
   guchar *mp3_data;
   gint mp3_buffer_size, mp3_size;
   gint64 duration;
@@ -1052,31 +1693,52 @@ gst_lame_chain (GstPad * pad, GstBuffer * buf)
   if (!lame->setup)
     goto not_setup;
 
+  if (lame->parallel)
+    return gst_lame_chain_parallel (lame, buf);
+
   data = GST_BUFFER_DATA (buf);
   size = GST_BUFFER_SIZE (buf);
 
-  num_samples = size / 2;
+  /* samples per channel */
+  num_samples = size / (lame->width * lame->num_channels);
 
-  /* allocate space for output */
+  /* allocate space for output, lame writes straight into the buffer we
+   * push (or split into frames) */
   mp3_buffer_size = 1.25 * num_samples + 7200;
-  mp3_data = g_malloc (mp3_buffer_size);
+  outbuf = gst_lame_alloc_output (lame, mp3_buffer_size, &mp3_data);
 
-  /* lame seems to be too stupid to get mono interleaved going */
-  if (lame->num_channels == 1) {
-    mp3_size = lame_encode_buffer (lame->lgf,
-        (short int *) data,
-        (short int *) data, num_samples, mp3_data, mp3_buffer_size);
-  } else {
-    mp3_size = lame_encode_buffer_interleaved (lame->lgf,
-        (short int *) data,
-        num_samples / lame->num_channels, mp3_data, mp3_buffer_size);
-  }
+  mp3_size = gst_lame_encode_samples (lame->lgf, lame->format,
+      lame->num_channels, data, num_samples, mp3_data, mp3_buffer_size,
+      &lame->scratch, &lame->scratch_size);
 
   GST_LOG_OBJECT (lame, "encoded %d bytes of audio to %d bytes of mp3",
       size, mp3_size);
 
+  if (mp3_size < 0) {
+    gst_buffer_unref (buf);
+    gst_buffer_unref (outbuf);
+    goto encode_failed;
+  }
+
+  /* free format frames have no bitrate in the header to get their size from */
+  if (lame->frame_aligned && !lame->free_format) {
+    if (!GST_CLOCK_TIME_IS_VALID (lame->frame_ts)) {
+      lame->frame_ts = GST_BUFFER_TIMESTAMP (buf);
+      lame->frame_samples = 0;
+    }
+    gst_buffer_unref (buf);
+
+    if (mp3_size > 0) {
+      GST_BUFFER_SIZE (outbuf) -= mp3_buffer_size - mp3_size;
+      return gst_lame_push_frames (lame, outbuf, FALSE);
+    }
+
+    gst_buffer_unref (outbuf);
+    return GST_FLOW_OK;
+  }
+
   duration = gst_util_uint64_scale_int (size, GST_SECOND,
-      2 * lame->samplerate * lame->num_channels);
+      lame->width * lame->samplerate * lame->num_channels);
 
   if (GST_BUFFER_DURATION (buf) != GST_CLOCK_TIME_NONE &&
       GST_BUFFER_DURATION (buf) != duration) {
@@ -1096,16 +1758,7 @@ gst_lame_chain (GstPad * pad, GstBuffer * buf)
 
   gst_buffer_unref (buf);
 
-  if (mp3_size < 0) {
-    g_warning ("error %d", mp3_size);
-  }
-
   if (mp3_size > 0) {
-    GstBuffer *outbuf;
-
-    outbuf = gst_buffer_new ();
-    GST_BUFFER_DATA (outbuf) = mp3_data;
-    GST_BUFFER_MALLOCDATA (outbuf) = mp3_data;
     GST_BUFFER_SIZE (outbuf) = mp3_size;
     GST_BUFFER_TIMESTAMP (outbuf) = lame->last_ts;
     GST_BUFFER_OFFSET (outbuf) = lame->last_offs;
@@ -1124,7 +1777,7 @@ gst_lame_chain (GstPad * pad, GstBuffer * buf)
       lame->eos_ts = GST_CLOCK_TIME_NONE;
     lame->last_ts = GST_CLOCK_TIME_NONE;
   } else {
-    g_free (mp3_data);
+    gst_buffer_unref (outbuf);
     result = GST_FLOW_OK;
   }
 
@@ -1138,13 +1791,18 @@ not_setup:
         ("encoder not initialized (input is not audio?)"));
     return GST_FLOW_ERROR;
   }
+encode_failed:
+  {
+    GST_ELEMENT_ERROR (lame, LIBRARY, ENCODE, (NULL),
+        ("lame failed to encode the input: %d", mp3_size));
+    return GST_FLOW_ERROR;
+  }
 }
 
-/* set up the encoder state */
+/* copy the settings over to @lgf */
 static gboolean
-gst_lame_setup (GstLame * lame)
+gst_lame_configure (GstLame * lame, lame_global_flags * lgf)
 {
-
 #define CHECK_ERROR(command) G_STMT_START {\
   if ((command) < 0) { \
     GST_ERROR_OBJECT (lame, "setup failed: " G_STRINGIFY (command)); \
@@ -1152,6 +1810,56 @@ gst_lame_setup (GstLame * lame)
   } \
 }G_STMT_END
 
+  CHECK_ERROR (lame_set_num_channels (lgf, lame->num_channels));
+  CHECK_AND_FIXUP_BITRATE (lame, "bitrate", lame->bitrate, lame->free_format);
+  CHECK_ERROR (lame_set_brate (lgf, lame->bitrate));
+  CHECK_ERROR (lame_set_compression_ratio (lgf, lame->compression_ratio));
+  CHECK_ERROR (lame_set_quality (lgf, lame->quality));
+  CHECK_ERROR (lame_set_mode (lgf, lame->mode));
+  CHECK_ERROR (lame_set_force_ms (lgf, lame->force_ms));
+  CHECK_ERROR (lame_set_free_format (lgf, lame->free_format));
+  CHECK_ERROR (lame_set_copyright (lgf, lame->copyright));
+  CHECK_ERROR (lame_set_original (lgf, lame->original));
+  CHECK_ERROR (lame_set_error_protection (lgf, lame->error_protection));
+  CHECK_ERROR (lame_set_extension (lgf, lame->extension));
+  CHECK_ERROR (lame_set_strict_ISO (lgf, lame->strict_iso));
+  CHECK_ERROR (lame_set_disable_reservoir (lgf, lame->disable_reservoir));
+  CHECK_ERROR (lame_set_VBR (lgf, lame->vbr));
+  CHECK_ERROR (lame_set_VBR_q (lgf, lame->vbr_quality));
+  CHECK_ERROR (lame_set_VBR_mean_bitrate_kbps (lgf, lame->vbr_mean_bitrate));
+  CHECK_AND_FIXUP_BITRATE (lame, "vbr-min-bitrate", lame->vbr_min_bitrate,
+      lame->free_format);
+  CHECK_ERROR (lame_set_VBR_min_bitrate_kbps (lgf, lame->vbr_min_bitrate));
+  CHECK_AND_FIXUP_BITRATE (lame, "vbr-max-bitrate", lame->vbr_max_bitrate,
+      lame->free_format);
+  CHECK_ERROR (lame_set_VBR_max_bitrate_kbps (lgf, lame->vbr_max_bitrate));
+  CHECK_ERROR (lame_set_VBR_hard_min (lgf, lame->vbr_hard_min));
+  CHECK_ERROR (lame_set_lowpassfreq (lgf, lame->lowpass_freq));
+  CHECK_ERROR (lame_set_lowpasswidth (lgf, lame->lowpass_width));
+  CHECK_ERROR (lame_set_highpassfreq (lgf, lame->highpass_freq));
+  CHECK_ERROR (lame_set_highpasswidth (lgf, lame->highpass_width));
+  CHECK_ERROR (lame_set_ATHonly (lgf, lame->ath_only));
+  CHECK_ERROR (lame_set_ATHshort (lgf, lame->ath_short));
+  CHECK_ERROR (lame_set_noATH (lgf, lame->no_ath));
+  CHECK_ERROR (lame_set_ATHlower (lgf, lame->ath_lower));
+  CHECK_ERROR (lame_set_allow_diff_short (lgf, lame->allow_diff_short));
+  CHECK_ERROR (lame_set_no_short_blocks (lgf, lame->no_short_blocks));
+  CHECK_ERROR (lame_set_emphasis (lgf, lame->emphasis));
+  CHECK_ERROR (lame_set_bWriteVbrTag (lgf, 0));
+#ifdef GSTLAME_PRESET
+  if (lame->preset > 0) {
+    CHECK_ERROR (lame_set_preset (lgf, lame->preset));
+  }
+#endif
+
+  return TRUE;
+#undef CHECK_ERROR
+}
+
+/* set up the encoder state */
+static gboolean
+gst_lame_setup (GstLame * lame)
+{
   int retval;
   GstCaps *allowed_caps;
 
@@ -1203,50 +1911,8 @@ gst_lame_setup (GstLame * lame)
   else
     lame->mode = lame->requested_mode;
 
-  CHECK_ERROR (lame_set_num_channels (lame->lgf, lame->num_channels));
-  CHECK_AND_FIXUP_BITRATE (lame, "bitrate", lame->bitrate, lame->free_format);
-  CHECK_ERROR (lame_set_brate (lame->lgf, lame->bitrate));
-  CHECK_ERROR (lame_set_compression_ratio (lame->lgf, lame->compression_ratio));
-  CHECK_ERROR (lame_set_quality (lame->lgf, lame->quality));
-  CHECK_ERROR (lame_set_mode (lame->lgf, lame->mode));
-  CHECK_ERROR (lame_set_force_ms (lame->lgf, lame->force_ms));
-  CHECK_ERROR (lame_set_free_format (lame->lgf, lame->free_format));
-  CHECK_ERROR (lame_set_copyright (lame->lgf, lame->copyright));
-  CHECK_ERROR (lame_set_original (lame->lgf, lame->original));
-  CHECK_ERROR (lame_set_error_protection (lame->lgf, lame->error_protection));
-  CHECK_ERROR (lame_set_extension (lame->lgf, lame->extension));
-  CHECK_ERROR (lame_set_strict_ISO (lame->lgf, lame->strict_iso));
-  CHECK_ERROR (lame_set_disable_reservoir (lame->lgf, lame->disable_reservoir));
-  CHECK_ERROR (lame_set_VBR (lame->lgf, lame->vbr));
-  CHECK_ERROR (lame_set_VBR_q (lame->lgf, lame->vbr_quality));
-  CHECK_ERROR (lame_set_VBR_mean_bitrate_kbps (lame->lgf,
-          lame->vbr_mean_bitrate));
-  CHECK_AND_FIXUP_BITRATE (lame, "vbr-min-bitrate", lame->vbr_min_bitrate,
-      lame->free_format);
-  CHECK_ERROR (lame_set_VBR_min_bitrate_kbps (lame->lgf,
-          lame->vbr_min_bitrate));
-  CHECK_AND_FIXUP_BITRATE (lame, "vbr-max-bitrate", lame->vbr_max_bitrate,
-      lame->free_format);
-  CHECK_ERROR (lame_set_VBR_max_bitrate_kbps (lame->lgf,
-          lame->vbr_max_bitrate));
-  CHECK_ERROR (lame_set_VBR_hard_min (lame->lgf, lame->vbr_hard_min));
-  CHECK_ERROR (lame_set_lowpassfreq (lame->lgf, lame->lowpass_freq));
-  CHECK_ERROR (lame_set_lowpasswidth (lame->lgf, lame->lowpass_width));
-  CHECK_ERROR (lame_set_highpassfreq (lame->lgf, lame->highpass_freq));
-  CHECK_ERROR (lame_set_highpasswidth (lame->lgf, lame->highpass_width));
-  CHECK_ERROR (lame_set_ATHonly (lame->lgf, lame->ath_only));
-  CHECK_ERROR (lame_set_ATHshort (lame->lgf, lame->ath_short));
-  CHECK_ERROR (lame_set_noATH (lame->lgf, lame->no_ath));
-  CHECK_ERROR (lame_set_ATHlower (lame->lgf, lame->ath_lower));
-  CHECK_ERROR (lame_set_allow_diff_short (lame->lgf, lame->allow_diff_short));
-  CHECK_ERROR (lame_set_no_short_blocks (lame->lgf, lame->no_short_blocks));
-  CHECK_ERROR (lame_set_emphasis (lame->lgf, lame->emphasis));
-  CHECK_ERROR (lame_set_bWriteVbrTag (lame->lgf, 0));
-#ifdef GSTLAME_PRESET
-  if (lame->preset > 0) {
-    CHECK_ERROR (lame_set_preset (lame->lgf, lame->preset));
-  }
-#endif
+  if (!gst_lame_configure (lame, lame->lgf))
+    return FALSE;
 
   /* initialize the lame encoder */
   if ((retval = lame_init_params (lame->lgf)) >= 0) {
@@ -1254,6 +1920,7 @@ gst_lame_setup (GstLame * lame)
     /* FIXME: it would be nice to print out the mode here */
     GST_INFO ("lame encoder setup (%d kbit/s, %d Hz, %d channels)",
         lame->bitrate, lame->samplerate, lame->num_channels);
+    gst_lame_check_parallel (lame);
   } else {
     GST_ERROR_OBJECT (lame, "lame_init_params returned %d", retval);
   }
@@ -1261,7 +1928,6 @@ gst_lame_setup (GstLame * lame)
   GST_DEBUG_OBJECT (lame, "done with setup");
 
   return lame->setup;
-#undef CHECK_ERROR
 }
 
 static GstStateChangeReturn
@@ -1277,6 +1943,7 @@ gst_lame_change_state (GstElement * element, GstStateChange transition)
       lame->last_flow = GST_FLOW_OK;
       lame->last_ts = GST_CLOCK_TIME_NONE;
       lame->eos_ts = GST_CLOCK_TIME_NONE;
+      gst_lame_reset_frames (lame);
       break;
     default:
       break;
@@ -1285,6 +1952,9 @@ gst_lame_change_state (GstElement * element, GstStateChange transition)
   result = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_lame_reset_frames (lame);
+      break;
     case GST_STATE_CHANGE_READY_TO_NULL:
       gst_lame_release_memory (lame);
       break;
@@ -23,6 +23,7 @@
 
 
 #include <gst/gst.h>
+#include <gst/gst-segment-queue.h>
 
 G_BEGIN_DECLS
 
@@ -55,6 +56,8 @@ struct _GstLame {
 
   gint samplerate;
   gint num_channels;
+  gint format;                  /* input sample format */
+  gint width;                   /* bytes per input sample */
   gboolean setup;
 
   gint bitrate;
@@ -89,14 +92,33 @@ struct _GstLame {
   gboolean no_short_blocks;
   gboolean emphasis;
   gint preset;
+  gboolean frame_aligned;
 
   /* track this so we don't send a last buffer in eos handler after error */
   GstFlowReturn  last_flow;
 
   lame_global_flags *lgf;
 
+  /* input split into channels for lame */
+  gpointer scratch;
+  guint scratch_size;
+
   /* time tracker */
   guint64 last_ts, last_offs, last_duration, eos_ts;
+
+  /* frame aligned output: start of an incomplete frame left over from the
+   * previous output, and timestamp of the first frame plus the number of
+   * samples in all frames pushed since */
+  GstBuffer *pending;
+  GstClockTime frame_ts;
+  guint64 frame_samples;
+
+  /* segment-parallel encoding */
+  gint threads;
+  gboolean parallel;
+  GstSegmentQueue segments;
+  GByteArray *pcm;              /* input not queued as a segment yet */
+  gboolean have_preroll;        /* pcm starts with frames of the last one */
 };
 
 struct _GstLameClass {
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <gst/gsttagsetter.h>
+#include <gst/base/gstadapter.h>
 
 #define ID3_TYPE_FIND_MIN_SIZE 3072
 #define ID3_TYPE_FIND_MAX_SIZE 40960
@@ -115,6 +116,9 @@ struct _GstID3Tag
 
   GstEvent *segment;
   GstBuffer *buffer;
+  GstAdapter *adapter;          /* pending data after buffer */
+  guint wanted;                 /* pending bytes needed to go on */
+  gboolean draining;            /* EOS, last try with the pending data */
   gboolean prefer_v1tag;
   glong v1tag_size;
   glong v1tag_size_new;
@@ -183,6 +187,7 @@ GST_STATIC_PAD_TEMPLATE ("sink",
 
 static void gst_id3_tag_class_init (gpointer g_class, gpointer class_data);
 static void gst_id3_tag_init (GTypeInstance * instance, gpointer g_class);
+static void gst_id3_tag_finalize (GObject * object);
 static void gst_id3_tag_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec);
 static void gst_id3_tag_get_property (GObject * object,
@@ -269,6 +274,7 @@ gst_id3_tag_class_init (gpointer g_class, gpointer class_data)
 
   if (tag_class->type == GST_ID3_TAG_PARSE_BASE) {
     parent_class = g_type_class_peek_parent (g_class);
+    gobject_class->finalize = gst_id3_tag_finalize;
     gstelement_class->change_state = gst_id3_tag_change_state;
   } else {
     gst_element_class_set_details (gstelement_class,
@@ -372,9 +378,85 @@ gst_id3_tag_init (GTypeInstance * instance, gpointer g_class)
   /* FIXME: for the alli^H^H^H^Hspider - gst_id3_tag_add_src_pad (tag); */
   tag->parse_mode = GST_ID3_TAG_PARSE_BASE;
   tag->buffer = NULL;
+  tag->adapter = gst_adapter_new ();
+  tag->draining = FALSE;
   tag->segment = NULL;
 }
 
+static void
+gst_id3_tag_finalize (GObject * object)
+{
+  GstID3Tag *tag = GST_ID3_TAG (object);
+
+  g_object_unref (tag->adapter);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/* Data we can't handle yet is kept as the first buffer with the rest
+ * queued in the adapter, and only joined once there's as much as the
+ * current state wants. That copies a large tag arriving in small chunks
+ * once instead of once per chunk. */
+static guint
+gst_id3_tag_pending_size (GstID3Tag * tag)
+{
+  if (tag->buffer == NULL)
+    return 0;
+
+  return GST_BUFFER_SIZE (tag->buffer) + gst_adapter_available (tag->adapter);
+}
+
+static void
+gst_id3_tag_wait (GstID3Tag * tag, GstBuffer * buffer, guint wanted)
+{
+  g_assert (tag->buffer == NULL);
+
+  tag->buffer = buffer;
+  tag->wanted = wanted;
+}
+
+/* returns all the pending data in one buffer, no matter how much we were
+ * waiting for */
+static GstBuffer *
+gst_id3_tag_take_pending (GstID3Tag * tag)
+{
+  GstBuffer *head = tag->buffer, *joined;
+  guint head_size, avail;
+
+  head_size = GST_BUFFER_SIZE (head);
+  avail = gst_adapter_available (tag->adapter);
+  joined = gst_buffer_new_and_alloc (head_size + avail);
+  memcpy (GST_BUFFER_DATA (joined), GST_BUFFER_DATA (head), head_size);
+  gst_adapter_copy (tag->adapter, GST_BUFFER_DATA (joined) + head_size, 0,
+      avail);
+  gst_adapter_clear (tag->adapter);
+
+  gst_buffer_copy_metadata (joined, head,
+      GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_CAPS);
+  GST_BUFFER_DURATION (joined) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_OFFSET_END (joined) = GST_BUFFER_OFFSET_NONE;
+
+  gst_buffer_unref (head);
+  tag->buffer = NULL;
+
+  return joined;
+}
+
+/* returns the pending data with @buffer appended, or NULL if that's still
+ * less than we're waiting for */
+static GstBuffer *
+gst_id3_tag_collect (GstID3Tag * tag, GstBuffer * buffer)
+{
+  if (tag->buffer == NULL)
+    return buffer;
+
+  gst_adapter_push (tag->adapter, buffer);
+  if (gst_id3_tag_pending_size (tag) < tag->wanted)
+    return NULL;
+
+  return gst_id3_tag_take_pending (tag);
+}
+
 static void
 gst_id3_tag_set_property (GObject * object, guint prop_id, const GValue * value,
     GParamSpec * pspec)
@@ -911,15 +993,13 @@ gst_id3_tag_sink_event (GstPad * pad, GstEvent * event)
               &end_value, NULL);
 
           if (format == GST_FORMAT_BYTES || format == GST_FORMAT_DEFAULT) {
-            if (value !=
-                (tag->buffer ? GST_BUFFER_OFFSET (tag->buffer) +
-                    GST_BUFFER_SIZE (tag->buffer)
-                    : 0))
+            guint64 allowed = tag->buffer ? GST_BUFFER_OFFSET (tag->buffer) +
+                gst_id3_tag_pending_size (tag) : 0;
+
+            if (value != allowed)
               GST_ELEMENT_ERROR (tag, CORE, EVENT, (NULL),
                   ("Got seek to %" G_GINT64_FORMAT " during ID3v2 tag reading"
-                      " (allowed was %" G_GINT64_FORMAT ")", value,
-                      (guint64) (tag->buffer ? GST_BUFFER_OFFSET (tag->buffer)
-                          + GST_BUFFER_SIZE (tag->buffer) : 0)));
+                      " (allowed was %" G_GUINT64_FORMAT ")", value, allowed));
           }
           tag->segment = event;
           break;
@@ -1019,6 +1099,15 @@ gst_id3_tag_sink_event (GstPad * pad, GstEvent * event)
           gst_tag_list_free (merged);
         }
       }
+      if (tag->state == GST_ID3_TAG_STATE_NORMAL_START && tag->buffer) {
+        /* we were still waiting for more data to typefind, try one last
+         * time with what we have */
+        GST_DEBUG_OBJECT (tag, "typefinding %u pending bytes at EOS",
+            gst_id3_tag_pending_size (tag));
+        tag->draining = TRUE;
+        gst_id3_tag_chain (pad, gst_id3_tag_take_pending (tag));
+        tag->draining = FALSE;
+      }
       if (tag->state == GST_ID3_TAG_STATE_SEEKING_TO_NORMAL) {
         /* Absorb EOS while finishing reading V1 TAG */
         GST_LOG_OBJECT (tag, "Ignoring EOS event after reading id3v1");
@@ -1068,6 +1157,32 @@ simple_find_suggest (gpointer data, guint probability, const GstCaps * caps)
   }
 }
 
+/* Only audio (or another tag) sensibly follows an ID3 tag, there's no point
+ * in running all the video and container typefinders on it */
+static gboolean
+gst_id3_tag_typefind_plausible (GstTypeFindFactory * factory)
+{
+  GstCaps *caps;
+  guint i;
+
+  caps = gst_type_find_factory_get_caps (factory);
+  if (caps == NULL)
+    return FALSE;
+
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    const gchar *name;
+
+    name = gst_structure_get_name (gst_caps_get_structure (caps, i));
+    if (g_str_has_prefix (name, "audio/") ||
+        strcmp (name, "application/x-id3") == 0 ||
+        strcmp (name, "application/x-apetag") == 0 ||
+        strcmp (name, "application/ogg") == 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
 static GstCaps *
 gst_id3_tag_do_typefind (GstID3Tag * tag, GstBuffer * buffer)
 {
@@ -1091,10 +1206,13 @@ gst_id3_tag_do_typefind (GstID3Tag * tag, GstBuffer * buffer)
   while (walk) {
     GstTypeFindFactory *factory = GST_TYPE_FIND_FACTORY (walk->data);
 
+    walk = g_list_next (walk);
+    if (!gst_id3_tag_typefind_plausible (factory))
+      continue;
+
     gst_type_find_factory_call_function (factory, &gst_find);
     if (find.best_probability >= GST_TYPE_FIND_MAXIMUM)
       break;
-    walk = g_list_next (walk);
   }
   gst_plugin_feature_list_free (type_list);
   if (find.best_probability > 0) {
@@ -1198,10 +1316,9 @@ gst_id3_tag_chain (GstPad * pad, GstBuffer * buffer)
       GST_ID3_TAG_GET_MODE_NAME (tag->parse_mode),
       GST_ID3_TAG_GET_STATE_NAME (tag->state));
 
-  if (tag->buffer) {
-    buffer = gst_buffer_join (tag->buffer, buffer);
-    tag->buffer = NULL;
-  }
+  buffer = gst_id3_tag_collect (tag, buffer);
+  if (buffer == NULL)
+    return GST_FLOW_OK;
 
   switch (tag->state) {
     case GST_ID3_TAG_STATE_SEEKING_TO_V1_TAG:
@@ -1211,7 +1328,7 @@ gst_id3_tag_chain (GstPad * pad, GstBuffer * buffer)
       return GST_FLOW_OK;
     case GST_ID3_TAG_STATE_READING_V1_TAG:
       if (GST_BUFFER_SIZE (buffer) < 128) {
-        tag->buffer = buffer;
+        gst_id3_tag_wait (tag, buffer, 128);
         return GST_FLOW_OK;
       }
 
@@ -1272,7 +1389,7 @@ gst_id3_tag_chain (GstPad * pad, GstBuffer * buffer)
       return GST_FLOW_OK;
     case GST_ID3_TAG_STATE_READING_V2_TAG:
       if (GST_BUFFER_SIZE (buffer) < 10) {
-        tag->buffer = buffer;
+        gst_id3_tag_wait (tag, buffer, 10);
         return GST_FLOW_OK;
       }
       if (tag->v2tag_size == 0) {
@@ -1287,7 +1404,7 @@ gst_id3_tag_chain (GstPad * pad, GstBuffer * buffer)
         GST_DEBUG_OBJECT (tag,
             "Not enough data to read ID3v2. Need %ld have %d, waiting for more",
             tag->v2tag_size, GST_BUFFER_SIZE (buffer));
-        tag->buffer = buffer;
+        gst_id3_tag_wait (tag, buffer, tag->v2tag_size);
         return GST_FLOW_OK;
       }
 
@@ -1344,18 +1461,22 @@ gst_id3_tag_chain (GstPad * pad, GstBuffer * buffer)
     case GST_ID3_TAG_STATE_NORMAL_START:
       if (!IS_MUXER (tag) && (tag->found_caps == NULL)) {
         /* Don't do caps nego until we have at least ID3_TYPE_FIND_SIZE bytes */
-        if (GST_BUFFER_SIZE (buffer) < ID3_TYPE_FIND_MIN_SIZE) {
+        if (GST_BUFFER_SIZE (buffer) < ID3_TYPE_FIND_MIN_SIZE &&
+            !tag->draining) {
           GST_DEBUG_OBJECT (tag,
               "Not enough data (%d) for typefind, waiting for more",
               GST_BUFFER_SIZE (buffer));
-          tag->buffer = buffer;
+          gst_id3_tag_wait (tag, buffer, ID3_TYPE_FIND_MIN_SIZE);
           return GST_FLOW_OK;
         }
 
         if (!gst_id3_tag_do_caps_nego (tag, buffer)) {
-          if (GST_BUFFER_SIZE (buffer) < ID3_TYPE_FIND_MAX_SIZE) {
-            /* Just break for more */
-            tag->buffer = buffer;
+          if (GST_BUFFER_SIZE (buffer) < ID3_TYPE_FIND_MAX_SIZE &&
+              !tag->draining) {
+            /* Just break for more, retrying at twice the size keeps
+             * the copying linear */
+            gst_id3_tag_wait (tag, buffer,
+                MIN (2 * GST_BUFFER_SIZE (buffer), ID3_TYPE_FIND_MAX_SIZE));
             return GST_FLOW_OK;
           }
 
@@ -1498,6 +1619,7 @@ gst_id3_tag_change_state (GstElement * element, GstStateChange transition)
         gst_buffer_unref (tag->buffer);
         tag->buffer = NULL;
       }
+      gst_adapter_clear (tag->adapter);
       if (tag->found_caps) {
         gst_caps_unref (tag->found_caps);
         tag->found_caps = NULL;
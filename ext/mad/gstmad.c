@@ -37,6 +37,7 @@
 
 #include <string.h>
 #include "gstmad.h"
+#include <gst/gst-probes.h>
 #include <gst/audio/audio.h>
 
 
@@ -52,7 +53,9 @@ enum
 {
   ARG_0,
   ARG_HALF,
-  ARG_IGNORE_CRC
+  ARG_IGNORE_CRC,
+  ARG_THREADS,
+  ARG_STATS
 };
 
 GST_DEBUG_CATEGORY_STATIC (mad_debug);
@@ -104,7 +107,19 @@ static gboolean gst_mad_convert_src (GstPad * pad, GstFormat src_format,
     gint64 src_value, GstFormat * dest_format, gint64 * dest_value);
 
 static gboolean gst_mad_sink_event (GstPad * pad, GstEvent * event);
+static gboolean gst_mad_sink_setcaps (GstPad * pad, GstCaps * caps);
 static GstFlowReturn gst_mad_chain (GstPad * pad, GstBuffer * buffer);
+static GstFlowReturn gst_mad_decode (GstMad * mad, GstBuffer * buffer,
+    GstBuffer * next);
+typedef struct _GstMadSegment GstMadSegment;
+
+static void gst_mad_segment_free (GstMadSegment * seg);
+static void gst_mad_segment_decode (GstMadSegment * seg, GstMad * mad);
+static GstFlowReturn gst_mad_segment_push (GstMadSegment * seg, GstMad * mad);
+static GstFlowReturn gst_mad_parallel_finish (GstMad * mad);
+static void gst_mad_parallel_reset (GstMad * mad);
+static void gst_mad_drain (GstMad * mad);
+static void gst_mad_check_parallel (GstMad * mad);
 
 static GstStateChangeReturn gst_mad_change_state (GstElement * element,
     GstStateChange transition);
@@ -226,6 +241,12 @@ gst_mad_class_init (GstMadClass * klass)
   g_object_class_install_property (gobject_class, ARG_IGNORE_CRC,
       g_param_spec_boolean ("ignore_crc", "Ignore CRC", "Ignore CRC errors",
           TRUE, G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, ARG_THREADS,
+      g_param_spec_int ("threads", "Threads",
+          "Number of threads to decode segments of parsed, non-live streams "
+          "in parallel with (0 = off)", 0, 64, 0, G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, ARG_STATS,
+      gst_element_stats_param_spec ());
 
   /* register tags */
 #define GST_TAG_LAYER    "layer"
@@ -258,6 +279,8 @@ gst_mad_init (GstMad * mad, GstMadClass * klass)
   gst_pad_set_chain_function (mad->sinkpad, GST_DEBUG_FUNCPTR (gst_mad_chain));
   gst_pad_set_event_function (mad->sinkpad,
       GST_DEBUG_FUNCPTR (gst_mad_sink_event));
+  gst_pad_set_setcaps_function (mad->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mad_sink_setcaps));
 
   template = gst_static_pad_template_get (&mad_src_template_factory);
   mad->srcpad = gst_pad_new_from_template (template, "src");
@@ -291,6 +314,17 @@ gst_mad_init (GstMad * mad, GstMadClass * klass)
   mad->ignore_crc = TRUE;
   mad->check_for_xing = TRUE;
   mad->xing_found = FALSE;
+  mad->parsed = FALSE;
+  mad->pending_frame = NULL;
+
+  mad->threads = 0;
+  mad->parallel = FALSE;
+  gst_segment_queue_init (&mad->segments,
+      (GstSegmentQueueProcessFunc) gst_mad_segment_decode,
+      (GstSegmentQueuePushFunc) gst_mad_segment_push,
+      (GDestroyNotify) gst_mad_segment_free, mad);
+  mad->frames = g_byte_array_new ();
+  mad->frame_sizes = g_array_new (FALSE, FALSE, sizeof (guint));
 }
 
 static void
@@ -305,6 +339,16 @@ gst_mad_dispose (GObject * object)
   g_free (mad->tempbuffer);
   mad->tempbuffer = NULL;
 
+  gst_buffer_replace (&mad->pending_frame, NULL);
+
+  gst_mad_parallel_reset (mad);
+  gst_segment_queue_clear (&mad->segments);
+  if (mad->frames) {
+    g_byte_array_free (mad->frames, TRUE);
+    g_array_free (mad->frame_sizes, TRUE);
+    mad->frames = NULL;
+  }
+
   g_list_foreach (mad->pending_events, (GFunc) gst_mini_object_unref, NULL);
   g_list_free (mad->pending_events);
   mad->pending_events = NULL;
@@ -871,6 +915,9 @@ gst_mad_set_property (GObject * object, guint prop_id,
     case ARG_IGNORE_CRC:
       mad->ignore_crc = g_value_get_boolean (value);
       break;
+    case ARG_THREADS:
+      mad->threads = g_value_get_int (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -892,6 +939,13 @@ gst_mad_get_property (GObject * object, guint prop_id,
     case ARG_IGNORE_CRC:
       g_value_set_boolean (value, mad->ignore_crc);
       break;
+    case ARG_THREADS:
+      g_value_set_int (value, mad->threads);
+      break;
+    case ARG_STATS:
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&mad->stats, "mad-stats"));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -983,6 +1037,10 @@ gst_mad_sink_event (GstPad * pad, GstEvent * event)
       gst_event_parse_new_segment_full (event, &update, &rate, &applied_rate,
           &format, &start, &stop, &pos);
 
+      /* without a flush the data we still have belongs to the old
+       * segment and goes out before the new one */
+      gst_mad_drain (mad);
+
       if (format == GST_FORMAT_TIME) {
         /* FIXME: is this really correct? */
         mad->tempsize = 0;
@@ -1006,6 +1064,7 @@ gst_mad_sink_event (GstPad * pad, GstEvent * event)
       break;
     }
     case GST_EVENT_EOS:
+      gst_mad_drain (mad);
       mad->caps_set = FALSE;    /* could be a new stream */
       result = gst_pad_push_event (mad->srcpad, event);
       break;
@@ -1013,6 +1072,8 @@ gst_mad_sink_event (GstPad * pad, GstEvent * event)
       /* Clear any stored data, as it won't make sense once
        * the new data arrives */
       mad->tempsize = 0;
+      gst_buffer_replace (&mad->pending_frame, NULL);
+      gst_mad_parallel_reset (mad);
       mad_frame_mute (&mad->frame);
       mad_synth_mute (&mad->synth);
     case GST_EVENT_FLUSH_START:
@@ -1032,6 +1093,34 @@ gst_mad_sink_event (GstPad * pad, GstEvent * event)
   return result;
 }
 
+static gboolean
+gst_mad_sink_setcaps (GstPad * pad, GstCaps * caps)
+{
+  GstMad *mad = GST_MAD (GST_PAD_PARENT (pad));
+  GstStructure *structure;
+  gboolean parsed = FALSE;
+
+  structure = gst_caps_get_structure (caps, 0);
+  gst_structure_get_boolean (structure, "parsed", &parsed);
+
+  if (mad->parallel)
+    gst_mad_parallel_finish (mad);
+
+  if (!parsed && mad->pending_frame) {
+    GstBuffer *frame = mad->pending_frame;
+
+    mad->pending_frame = NULL;
+    gst_mad_decode (mad, frame, NULL);
+  }
+
+  GST_DEBUG_OBJECT (mad, "input is %sparsed", parsed ? "" : "not ");
+  mad->parsed = parsed;
+
+  gst_mad_check_parallel (mad);
+
+  return TRUE;
+}
+
 static gboolean
 gst_mad_check_restart (GstMad * mad)
 {
@@ -1281,10 +1370,470 @@ gst_mad_check_caps_reset (GstMad * mad)
   }
 }
 
+static void
+gst_mad_handle_xing (GstMad * mad, int bitrate, int time)
+{
+  GstTagList *list;
+
+  mad->xing_found = TRUE;
+  list = gst_tag_list_new ();
+  gst_tag_list_add (list, GST_TAG_MERGE_REPLACE,
+      GST_TAG_DURATION, (gint64) time * 1000 * 1000 * 1000,
+      GST_TAG_BITRATE, bitrate, NULL);
+  gst_element_post_message (GST_ELEMENT (mad),
+      gst_message_new_tag (GST_OBJECT (mad), gst_tag_list_copy (list)));
+
+  if (mad->need_newsegment)
+    mad->pending_events =
+        g_list_append (mad->pending_events, gst_event_new_tag (list));
+  else
+    gst_pad_push_event (mad->srcpad, gst_event_new_tag (list));
+}
+
+/* sends the NEWSEGMENT we owe after a restart, starting at @start, and the
+ * events that were held back until then */
+static void
+gst_mad_push_pending_events (GstMad * mad, GstClockTime start)
+{
+  if (mad->need_newsegment) {
+    GST_DEBUG ("Sending NEWSEGMENT event, start=%" GST_TIME_FORMAT,
+        GST_TIME_ARGS (start));
+
+    gst_segment_set_newsegment (&mad->segment, FALSE, 1.0,
+        GST_FORMAT_TIME, start, GST_CLOCK_TIME_NONE, start);
+
+    gst_pad_push_event (mad->srcpad,
+        gst_event_new_new_segment (FALSE, 1.0, GST_FORMAT_TIME,
+            start, GST_CLOCK_TIME_NONE, start));
+    mad->need_newsegment = FALSE;
+  }
+
+  if (mad->pending_events) {
+    GList *l;
+
+    for (l = mad->pending_events; l != NULL; l = l->next) {
+      gst_pad_push_event (mad->srcpad, GST_EVENT (l->data));
+    }
+    g_list_free (mad->pending_events);
+    mad->pending_events = NULL;
+  }
+}
+
+/* Segment-parallel decoding for non-live parsed streams: the frames are
+ * collected into segments of GST_MAD_SEGMENT_FRAMES frames that are decoded
+ * with their own mad_stream/mad_frame/mad_synth on a thread pool. Each
+ * segment starts with the last frames of the previous one, which are only
+ * decoded to fill the bit reservoir and the IMDCT and synthesis overlap;
+ * the PCM of the frames after them is the same as a single decoder would
+ * produce. A segment is also cut where the format changes, there's nothing
+ * to prime with across that. */
+#define GST_MAD_SEGMENT_FRAMES 256
+/* 9 (MPEG-1) or 29 (MPEG-2) frames can hold the bit reservoir of a frame,
+ * plus one for the overlap */
+#define GST_MAD_SEGMENT_PRIME(format) (((format) & (1 << 19)) ? 10 : 30)
+
+/* the header bits that have to stay the same within a segment: version,
+ * layer, samplerate, and whether it's mono */
+#define GST_MAD_FORMAT(header) \
+    (((header) & 0x001e0c00) | ((((header) >> 6) & 0x3) == 3))
+
+struct _GstMadSegment
+{
+  guint8 *data;                 /* frames, followed by MAD_BUFFER_GUARD zeros */
+  guint size;
+  guint skip;                   /* bytes of frames of the previous segment */
+  guint keep;                   /* frames to output after those */
+  gint options;
+  gboolean check_for_xing;
+
+  /* result */
+  gboolean error;
+  GstBuffer *out;
+  guint nsamples;               /* per channel */
+  struct mad_header header;     /* of the first output frame */
+  gboolean xing_found;
+  int xing_bitrate, xing_time;
+};
+
+static void
+gst_mad_segment_free (GstMadSegment * seg)
+{
+  g_free (seg->data);
+  if (seg->out)
+    gst_buffer_unref (seg->out);
+  g_free (seg);
+}
+
+/* runs in the thread pool */
+static void
+gst_mad_segment_decode (GstMadSegment * seg, GstMad * mad)
+{
+  struct mad_stream stream;
+  struct mad_frame frame;
+  struct mad_synth synth;
+  const guint8 *keep_start = seg->data + seg->skip;
+  gint32 *outdata = NULL;
+  guint channels = 0, rate = 0;
+
+  mad_stream_init (&stream);
+  mad_frame_init (&frame);
+  mad_synth_init (&synth);
+  mad_stream_options (&stream, seg->options);
+  mad_stream_buffer (&stream, seg->data, seg->size + MAD_BUFFER_GUARD);
+
+  seg->out = gst_buffer_new_and_alloc (seg->keep * 1152 * 2 * 4);
+  outdata = (gint32 *) GST_BUFFER_DATA (seg->out);
+
+  while (TRUE) {
+    mad_fixed_t const *left_ch, *right_ch;
+    guint count;
+
+    if (mad_frame_decode (&frame, &stream) == -1) {
+      if (stream.error == MAD_ERROR_BUFLEN)
+        break;
+      if (!MAD_RECOVERABLE (stream.error)) {
+        seg->error = TRUE;
+        break;
+      }
+      /* the first frames may point into a reservoir we don't have, that's
+       * what they're there for */
+      if (stream.error == MAD_ERROR_LOSTSYNC) {
+        mad_frame_mute (&frame);
+        mad_synth_mute (&synth);
+      }
+      continue;
+    }
+
+    if (stream.this_frame >= keep_start && seg->check_for_xing) {
+      seg->check_for_xing = FALSE;
+      if (mpg123_parse_xing_header (&frame.header, stream.this_frame,
+              stream.next_frame - stream.this_frame, &seg->xing_bitrate,
+              &seg->xing_time)) {
+        seg->xing_found = TRUE;
+        continue;
+      }
+    }
+
+    mad_synth_frame (&synth, &frame);
+
+    if (stream.this_frame < keep_start)
+      continue;
+
+    if (channels == 0) {
+      seg->header = frame.header;
+      channels = MAD_NCHANNELS (&frame.header);
+      rate = frame.header.samplerate;
+    } else if (MAD_NCHANNELS (&frame.header) != channels ||
+        frame.header.samplerate != rate) {
+      /* junk that happened to decode, the segment was cut at the last real
+       * format change */
+      continue;
+    }
+
+    count = synth.pcm.length;
+    if ((guint8 *) (outdata + count * channels) >
+        GST_BUFFER_DATA (seg->out) + GST_BUFFER_SIZE (seg->out))
+      break;
+
+    left_ch = synth.pcm.samples[0];
+    right_ch = synth.pcm.samples[1];
+    seg->nsamples += count;
+
+    if (channels == 1) {
+      while (count--) {
+        *outdata++ = scale (*left_ch++) & 0xffffffff;
+      }
+    } else {
+      while (count--) {
+        *outdata++ = scale (*left_ch++) & 0xffffffff;
+        *outdata++ = scale (*right_ch++) & 0xffffffff;
+      }
+    }
+  }
+
+  GST_BUFFER_SIZE (seg->out) = (guint8 *) outdata - GST_BUFFER_DATA (seg->out);
+
+  mad_synth_finish (&synth);
+  mad_frame_finish (&frame);
+  mad_stream_finish (&stream);
+  g_free (seg->data);
+  seg->data = NULL;
+}
+
+/* queues the pending frames as a segment. With @preroll the last frames are
+ * kept to prime the next segment */
+static gboolean
+gst_mad_segment_submit (GstMad * mad, gboolean preroll)
+{
+  GstMadSegment *seg;
+  guint i, n_frames, prime, prime_bytes = 0;
+  GError *err = NULL;
+
+  n_frames = mad->frame_sizes->len;
+
+  seg = g_new0 (GstMadSegment, 1);
+  seg->size = mad->frames->len;
+  seg->data = g_malloc (seg->size + MAD_BUFFER_GUARD);
+  memcpy (seg->data, mad->frames->data, seg->size);
+  memset (seg->data + seg->size, 0, MAD_BUFFER_GUARD);
+  for (i = 0; i < mad->n_prime; i++)
+    seg->skip += g_array_index (mad->frame_sizes, guint, i);
+  seg->keep = n_frames - mad->n_prime;
+  seg->options = mad->stream.options;
+  seg->check_for_xing = mad->check_for_xing;
+  mad->check_for_xing = FALSE;
+
+  GST_LOG_OBJECT (mad, "queueing segment of %u frames, priming with %u",
+      seg->keep, mad->n_prime);
+
+  if (!gst_segment_queue_push (&mad->segments, seg, &err))
+    goto push_failed;
+
+  prime = preroll ? MIN (GST_MAD_SEGMENT_PRIME (mad->segment_format),
+      n_frames) : 0;
+  for (i = n_frames - prime; i < n_frames; i++)
+    prime_bytes += g_array_index (mad->frame_sizes, guint, i);
+
+  g_byte_array_remove_range (mad->frames, 0, mad->frames->len - prime_bytes);
+  g_array_remove_range (mad->frame_sizes, 0, n_frames - prime);
+  mad->n_prime = prime;
+
+  return TRUE;
+
+push_failed:
+  {
+    GST_ELEMENT_ERROR (mad, STREAM, DECODE, (NULL),
+        ("failed to queue a segment: %s", err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+}
+
+static GstFlowReturn
+gst_mad_segment_push (GstMadSegment * seg, GstMad * mad)
+{
+  GstBuffer *outbuf;
+  GstClockTime time_offset;
+
+  if (seg->error)
+    goto decode_failed;
+
+  if (seg->xing_found)
+    gst_mad_handle_xing (mad, seg->xing_bitrate, seg->xing_time);
+
+  if (seg->nsamples == 0)
+    return GST_FLOW_OK;
+
+  /* segments never mix formats, so take this one's right away */
+  mad->frame.header = seg->header;
+  mad->caps_set = FALSE;
+  gst_mad_check_caps_reset (mad);
+
+  if (GST_CLOCK_TIME_IS_VALID (mad->last_ts)) {
+    mad->total_samples = gst_util_uint64_scale_int (mad->last_ts, mad->rate,
+        GST_SECOND);
+    mad->last_ts = GST_CLOCK_TIME_NONE;
+  }
+
+  time_offset = gst_util_uint64_scale_int (mad->total_samples, GST_SECOND,
+      mad->rate);
+  gst_mad_push_pending_events (mad, time_offset);
+
+  outbuf = seg->out;
+  seg->out = NULL;
+
+  GST_BUFFER_TIMESTAMP (outbuf) = time_offset;
+  GST_BUFFER_DURATION (outbuf) =
+      gst_util_uint64_scale_int (mad->total_samples + seg->nsamples,
+      GST_SECOND, mad->rate) - time_offset;
+  GST_BUFFER_OFFSET (outbuf) = mad->total_samples;
+  GST_BUFFER_OFFSET_END (outbuf) = mad->total_samples + seg->nsamples;
+  mad->total_samples += seg->nsamples;
+
+  gst_buffer_set_caps (outbuf, GST_PAD_CAPS (mad->srcpad));
+
+  outbuf = gst_audio_buffer_clip (outbuf, &mad->segment, mad->rate,
+      4 * mad->channels);
+  if (outbuf == NULL)
+    return GST_FLOW_OK;
+
+  if (mad->discont) {
+    GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DISCONT);
+    mad->discont = FALSE;
+  }
+
+  mad->segment.last_stop = GST_BUFFER_TIMESTAMP (outbuf);
+  gst_element_stats_output (&mad->stats, outbuf);
+  GST_PROBE_PUSH (mad, outbuf);
+  return gst_pad_push (mad->srcpad, outbuf);
+
+decode_failed:
+  {
+    GST_ELEMENT_ERROR (mad, STREAM, DECODE, (NULL),
+        ("mad failed to decode a segment"));
+    return GST_FLOW_ERROR;
+  }
+}
+
+static GstFlowReturn
+gst_mad_chain_parallel (GstMad * mad, GstBuffer * buffer)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+  guint size = GST_BUFFER_SIZE (buffer);
+  guint32 format = 0;
+
+  if (gst_mad_check_restart (mad)) {
+    mad->need_newsegment = TRUE;
+    GST_DEBUG ("mad restarted");
+  }
+
+  /* the first frame after a reset gives us the start time */
+  if (mad->frames->len == 0 && mad->n_prime == 0 &&
+      gst_segment_queue_is_empty (&mad->segments)) {
+    mad->last_ts = GST_BUFFER_TIMESTAMP (buffer);
+    mad->discont = TRUE;
+  }
+
+  if (size >= 4)
+    format = GST_MAD_FORMAT (GST_READ_UINT32_BE (GST_BUFFER_DATA (buffer)));
+
+  if (format != mad->segment_format) {
+    if (mad->frame_sizes->len > mad->n_prime &&
+        !gst_mad_segment_submit (mad, FALSE)) {
+      gst_buffer_unref (buffer);
+      return GST_FLOW_ERROR;
+    }
+    g_byte_array_set_size (mad->frames, 0);
+    g_array_set_size (mad->frame_sizes, 0);
+    mad->n_prime = 0;
+    mad->segment_format = format;
+  }
+
+  g_byte_array_append (mad->frames, GST_BUFFER_DATA (buffer), size);
+  gst_element_stats_copy (&mad->stats, size);
+  g_array_append_val (mad->frame_sizes, size);
+  gst_buffer_unref (buffer);
+
+  if (mad->frame_sizes->len >= mad->n_prime + GST_MAD_SEGMENT_FRAMES &&
+      !gst_mad_segment_submit (mad, TRUE))
+    return GST_FLOW_ERROR;
+
+  result = gst_segment_queue_process (&mad->segments, FALSE, TRUE);
+
+  return result;
+}
+
+/* decodes the remaining frames and pushes all segments */
+static GstFlowReturn
+gst_mad_parallel_finish (GstMad * mad)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+
+  if (mad->frame_sizes->len > mad->n_prime &&
+      !gst_mad_segment_submit (mad, FALSE))
+    result = GST_FLOW_ERROR;
+
+  if (result == GST_FLOW_OK)
+    result = gst_segment_queue_process (&mad->segments, TRUE, TRUE);
+  gst_mad_parallel_reset (mad);
+
+  return result;
+}
+
+/* decodes and pushes everything we still hold */
+static void
+gst_mad_drain (GstMad * mad)
+{
+  if (mad->parallel)
+    gst_mad_parallel_finish (mad);
+
+  /* the last parsed frame has no next one to wait for */
+  if (mad->pending_frame) {
+    GstBuffer *frame = mad->pending_frame;
+
+    mad->pending_frame = NULL;
+    gst_mad_decode (mad, frame, NULL);
+  }
+}
+
+/* drops everything queued for or in the thread pool */
+static void
+gst_mad_parallel_reset (GstMad * mad)
+{
+  if (mad->frames == NULL)
+    return;
+
+  gst_segment_queue_process (&mad->segments, TRUE, FALSE);
+  g_byte_array_set_size (mad->frames, 0);
+  g_array_set_size (mad->frame_sizes, 0);
+  mad->n_prime = 0;
+}
+
+/* decides whether to decode in parallel, after the input caps are known */
+static void
+gst_mad_check_parallel (GstMad * mad)
+{
+  GError *err = NULL;
+
+  mad->parallel = FALSE;
+
+  if (mad->threads == 0 || !mad->parsed)
+    return;
+
+  if (gst_segment_queue_upstream_is_live (mad->sinkpad)) {
+    GST_INFO_OBJECT (mad, "upstream is live, not decoding in parallel");
+    return;
+  }
+
+  if (!gst_segment_queue_set_threads (&mad->segments, mad->threads, &err)) {
+    GST_WARNING_OBJECT (mad, "failed to create thread pool: %s",
+        err->message);
+    g_error_free (err);
+    return;
+  }
+
+  GST_INFO_OBJECT (mad, "decoding segments on %d threads", mad->threads);
+  mad->parallel = TRUE;
+}
+
 static GstFlowReturn
 gst_mad_chain (GstPad * pad, GstBuffer * buffer)
 {
   GstMad *mad;
+  GstBuffer *frame;
+  GstFlowReturn result = GST_FLOW_OK;
+  GstClockTime start;
+
+  mad = GST_MAD (GST_PAD_PARENT (pad));
+
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&mad->stats, buffer);
+
+  if (mad->parallel) {
+    result = gst_mad_chain_parallel (mad, buffer);
+  } else if (!mad->parsed) {
+    result = gst_mad_decode (mad, buffer, NULL);
+  } else {
+    /* Parsed input comes one frame per buffer. libmad wants to see the
+     * start of the next frame after the one it decodes, so we hold on to
+     * each frame until the next one arrives */
+    frame = mad->pending_frame;
+    mad->pending_frame = buffer;
+    if (frame != NULL)
+      result = gst_mad_decode (mad, frame, buffer);
+  }
+
+  gst_element_stats_stop (&mad->stats, start);
+
+  return result;
+}
+
+/* Decodes the data in buffer, taking ownership of it. For parsed input,
+ * buffer is one frame and next is the frame after it, or NULL at the end
+ * of the stream */
+static GstFlowReturn
+gst_mad_decode (GstMad * mad, GstBuffer * buffer, GstBuffer * next)
+{
   guint8 *data;
   glong size, tempsize;
   gboolean new_pts = FALSE;
@@ -1292,14 +1841,16 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
   GstClockTime timestamp;
   GstFlowReturn result = GST_FLOW_OK;
 
-  mad = GST_MAD (GST_PAD_PARENT (pad));
-
   /* restarts happen on discontinuities, ie. seek, flush, PAUSED to PLAYING */
   if (gst_mad_check_restart (mad)) {
     mad->need_newsegment = TRUE;
     GST_DEBUG ("mad restarted");
   }
 
+  /* parsed frames never leave anything behind for the next one */
+  if (mad->parsed)
+    mad->tempsize = 0;
+
   /* take discont flag */
   discont = GST_BUFFER_IS_DISCONT (buffer);
 
@@ -1342,28 +1893,57 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
       mad->discont = TRUE;
       discont = FALSE;
     }
-    tocopy =
-        MIN (MAD_BUFFER_MDLEN, MIN (size,
-            MAD_BUFFER_MDLEN * 3 - mad->tempsize));
-    if (tocopy == 0) {
-      GST_ELEMENT_ERROR (mad, STREAM, DECODE, (NULL),
-          ("mad claims to need more data than %u bytes, we don't have that much",
-              MAD_BUFFER_MDLEN * 3));
-      result = GST_FLOW_ERROR;
-      goto end;
-    }
 
-    /* append the chunk to process to our internal temporary buffer */
-    GST_LOG ("tempbuffer size %ld, copying %d bytes from incoming buffer",
-        mad->tempsize, tocopy);
-    memcpy (mad->tempbuffer + mad->tempsize, data, tocopy);
-    mad->tempsize += tocopy;
+    if (mad->parsed) {
+      /* Decode the frame where it is if the next one follows it in memory,
+       * which it does when both are cut from the same upstream buffer.
+       * Otherwise copy the frame and the start of the next one, or zeros at
+       * the end of the stream. libmad keeps the bit reservoir itself. */
+      if (next && GST_BUFFER_DATA (next) == data + size &&
+          GST_BUFFER_SIZE (next) >= MAD_BUFFER_GUARD) {
+        mad_input_buffer = data;
+      } else {
+        guint guard = 0;
 
-    /* update our incoming buffer's parameters to reflect this */
-    size -= tocopy;
-    data += tocopy;
+        if (size + MAD_BUFFER_GUARD > MAD_BUFFER_MDLEN * 3)
+          goto frame_too_big;
 
-    mad_input_buffer = mad->tempbuffer;
+        memcpy (mad->tempbuffer, data, size);
+        if (next) {
+          guard = MIN (GST_BUFFER_SIZE (next), MAD_BUFFER_GUARD);
+          memcpy (mad->tempbuffer + size, GST_BUFFER_DATA (next), guard);
+        }
+        gst_element_stats_copy (&mad->stats, size + guard);
+        memset (mad->tempbuffer + size + guard, 0, MAD_BUFFER_GUARD - guard);
+        mad_input_buffer = mad->tempbuffer;
+      }
+      mad->tempsize = size + MAD_BUFFER_GUARD;
+      size = 0;
+    } else {
+      tocopy =
+          MIN (MAD_BUFFER_MDLEN, MIN (size,
+              MAD_BUFFER_MDLEN * 3 - mad->tempsize));
+      if (tocopy == 0) {
+        GST_ELEMENT_ERROR (mad, STREAM, DECODE, (NULL),
+            ("mad claims to need more data than %u bytes, we don't have that much",
+                MAD_BUFFER_MDLEN * 3));
+        result = GST_FLOW_ERROR;
+        goto end;
+      }
+
+      /* append the chunk to process to our internal temporary buffer */
+      GST_HOT_LOG ("tempbuffer size %ld, copying %d bytes from incoming "
+          "buffer", mad->tempsize, tocopy);
+      memcpy (mad->tempbuffer + mad->tempsize, data, tocopy);
+      gst_element_stats_copy (&mad->stats, tocopy);
+      mad->tempsize += tocopy;
+
+      /* update our incoming buffer's parameters to reflect this */
+      size -= tocopy;
+      data += tocopy;
+
+      mad_input_buffer = mad->tempbuffer;
+    }
 
     /* while we have data we can consume it */
     while (mad->tempsize > 0) {
@@ -1379,23 +1959,27 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
       mad_stream_buffer (&mad->stream, mad_input_buffer, mad->tempsize);
 
       /* added separate header decoding to catch errors earlier, also fixes
-       * some weird decoding errors... */
-      GST_LOG ("decoding the header now");
-      if (mad_header_decode (&mad->frame.header, &mad->stream) == -1) {
-        if (mad->stream.error == MAD_ERROR_BUFLEN) {
-          GST_LOG ("not enough data in tempbuffer (%ld), breaking to get more",
-              mad->tempsize);
-          break;
-        } else {
-          GST_WARNING ("mad_header_decode had an error: %s",
-              mad_stream_errorstr (&mad->stream));
+       * some weird decoding errors... Parsed frames have been checked
+       * already, mad_frame_decode does the header for those */
+      if (!mad->parsed) {
+        GST_HOT_LOG ("decoding the header now");
+        if (mad_header_decode (&mad->frame.header, &mad->stream) == -1) {
+          if (mad->stream.error == MAD_ERROR_BUFLEN) {
+            GST_LOG
+                ("not enough data in tempbuffer (%ld), breaking to get more",
+                mad->tempsize);
+            break;
+          } else {
+            GST_WARNING ("mad_header_decode had an error: %s",
+                mad_stream_errorstr (&mad->stream));
+          }
         }
       }
 
-      GST_LOG ("decoding one frame now");
+      GST_HOT_LOG ("decoding one frame now");
 
       if (mad_frame_decode (&mad->frame, &mad->stream) == -1) {
-        GST_LOG ("got error %d", mad->stream.error);
+        GST_HOT_LOG ("got error %d", mad->stream.error);
 
         /* not enough data, need to wait for next buffer? */
         if (mad->stream.error == MAD_ERROR_BUFLEN) {
@@ -1468,6 +2052,7 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
           }
         }
 
+        gst_element_stats_dropped (&mad->stats);
         mad_frame_mute (&mad->frame);
         mad_synth_mute (&mad->synth);
         before_sync = mad->stream.ptr.byte;
@@ -1478,6 +2063,7 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
            calculate from the byte pointers before and after resync */
         consumed = after_sync - before_sync;
         GST_DEBUG ("resynchronization consumes %d bytes", consumed);
+        gst_element_stats_resync (&mad->stats, consumed);
         GST_DEBUG ("synced to data: 0x%0x 0x%0x", *mad->stream.ptr.byte,
             *(mad->stream.ptr.byte + 1));
 
@@ -1488,7 +2074,6 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
 
       if (mad->check_for_xing) {
         int bitrate = 0, time = 0;
-        GstTagList *list;
         int frame_len = mad->stream.next_frame - mad->stream.this_frame;
 
         mad->check_for_xing = FALSE;
@@ -1496,20 +2081,7 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
         /* Assume Xing headers can only be the first frame in a mp3 file */
         if (mpg123_parse_xing_header (&mad->frame.header,
                 mad->stream.this_frame, frame_len, &bitrate, &time)) {
-          mad->xing_found = TRUE;
-          list = gst_tag_list_new ();
-          gst_tag_list_add (list, GST_TAG_MERGE_REPLACE,
-              GST_TAG_DURATION, (gint64) time * 1000 * 1000 * 1000,
-              GST_TAG_BITRATE, bitrate, NULL);
-          gst_element_post_message (GST_ELEMENT (mad),
-              gst_message_new_tag (GST_OBJECT (mad), gst_tag_list_copy (list)));
-
-          if (mad->need_newsegment)
-            mad->pending_events =
-                g_list_append (mad->pending_events, gst_event_new_tag (list));
-          else
-            gst_pad_push_event (mad->srcpad, gst_event_new_tag (list));
-
+          gst_mad_handle_xing (mad, bitrate, time);
           goto next_no_samples;
         }
       }
@@ -1568,6 +2140,8 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
             GST_SECOND, mad->rate) - time_offset;
       }
 
+      GST_PROBE_FRAME (mad, nsamples, time_offset);
+
 #ifndef GST_DISABLE_INDEX
       if (mad->index) {
         guint64 x_bytes = mad->base_byte_offset + mad->bytes_consumed;
@@ -1587,30 +2161,7 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
         gint32 *outdata;
         mad_fixed_t const *left_ch, *right_ch;
 
-        if (mad->need_newsegment) {
-          gint64 start = time_offset;
-
-          GST_DEBUG ("Sending NEWSEGMENT event, start=%" GST_TIME_FORMAT,
-              GST_TIME_ARGS (start));
-
-          gst_segment_set_newsegment (&mad->segment, FALSE, 1.0,
-              GST_FORMAT_TIME, start, GST_CLOCK_TIME_NONE, start);
-
-          gst_pad_push_event (mad->srcpad,
-              gst_event_new_new_segment (FALSE, 1.0, GST_FORMAT_TIME,
-                  start, GST_CLOCK_TIME_NONE, start));
-          mad->need_newsegment = FALSE;
-        }
-
-        if (mad->pending_events) {
-          GList *l;
-
-          for (l = mad->pending_events; l != NULL; l = l->next) {
-            gst_pad_push_event (mad->srcpad, GST_EVENT (l->data));
-          }
-          g_list_free (mad->pending_events);
-          mad->pending_events = NULL;
-        }
+        gst_mad_push_pending_events (mad, time_offset);
 
         /* will attach the caps to the buffer */
         result =
@@ -1630,7 +2181,7 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
 
         outdata = (gint32 *) GST_BUFFER_DATA (outbuffer);
 
-        GST_DEBUG ("mad out timestamp %" GST_TIME_FORMAT,
+        GST_HOT_DEBUG ("mad out timestamp %" GST_TIME_FORMAT,
             GST_TIME_ARGS (time_offset));
 
         GST_BUFFER_TIMESTAMP (outbuffer) = time_offset;
@@ -1668,6 +2219,8 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
           }
 
           mad->segment.last_stop = GST_BUFFER_TIMESTAMP (outbuffer);
+          gst_element_stats_output (&mad->stats, outbuffer);
+          GST_PROBE_PUSH (mad, outbuffer);
           result = gst_pad_push (mad->srcpad, outbuffer);
           if (result != GST_FLOW_OK) {
             /* Head for the exit, dropping samples as we go */
@@ -1707,7 +2260,7 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
       if (consumed == 0)
         consumed = mad->stream.next_frame - mad_input_buffer;
 
-      GST_LOG ("mad consumed %d bytes", consumed);
+      GST_HOT_LOG ("mad consumed %d bytes", consumed);
       /* move out pointer to where mad want the next data */
       mad_input_buffer += consumed;
       mad->tempsize -= consumed;
@@ -1716,7 +2269,12 @@ gst_mad_chain (GstPad * pad, GstBuffer * buffer)
         goto end;
     }
     /* we only get here from breaks, tempsize never actually drops below 0 */
-    memmove (mad->tempbuffer, mad_input_buffer, mad->tempsize);
+    if (mad->parsed) {
+      /* what's left is the start of the next frame */
+      mad->tempsize = 0;
+    } else {
+      memmove (mad->tempbuffer, mad_input_buffer, mad->tempsize);
+    }
   }
   result = GST_FLOW_OK;
 
@@ -1724,6 +2282,14 @@ end:
   gst_buffer_unref (buffer);
 
   return result;
+
+frame_too_big:
+  {
+    GST_ELEMENT_ERROR (mad, STREAM, DECODE, (NULL),
+        ("frame of %ld bytes is too big", size));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
 }
 
 static GstStateChangeReturn
@@ -1747,6 +2313,7 @@ gst_mad_change_state (GstElement * element, GstStateChange transition)
       mad->tempsize = 0;
       mad->discont = TRUE;
       mad->total_samples = 0;
+      gst_element_stats_reset (&mad->stats);
       mad->rate = 0;
       mad->channels = 0;
       mad->caps_set = FALSE;
@@ -1781,6 +2348,8 @@ gst_mad_change_state (GstElement * element, GstStateChange transition)
       mad_synth_finish (&mad->synth);
       mad_frame_finish (&mad->frame);
       mad_stream_finish (&mad->stream);
+      gst_buffer_replace (&mad->pending_frame, NULL);
+      gst_mad_parallel_reset (mad);
       mad->restart = TRUE;
       mad->check_for_xing = TRUE;
       if (mad->tags) {
@@ -23,6 +23,8 @@
 
 #include <gst/gst.h>
 #include <gst/tag/tag.h>
+#include <gst/gst-element-stats.h>
+#include <gst/gst-segment-queue.h>
 #include <mad.h>
 #include <id3tag.h>
 
@@ -95,8 +97,21 @@ struct _GstMad
   gboolean xing_found;
 
   gboolean framed;              /* whether there is a demuxer in front of us */
+  gboolean parsed;              /* input is one frame per buffer */
+  GstBuffer *pending_frame;     /* parsed frame waiting for the next one */
+
+  /* segment-parallel decoding */
+  gint threads;
+  gboolean parallel;
+  GstSegmentQueue segments;
+  GByteArray *frames;           /* frames not queued as a segment yet */
+  GArray *frame_sizes;          /* and their sizes */
+  guint n_prime;                /* frames at the start from the last segment */
+  guint32 segment_format;       /* GST_MAD_FORMAT of the frames */
 
   GList *pending_events;
+
+  GstElementStats stats;        /* for the "stats" property */
 };
 
 struct _GstMadClass
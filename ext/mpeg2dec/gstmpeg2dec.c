@@ -25,6 +25,7 @@
 #include <inttypes.h>
 
 #include "gstmpeg2dec.h"
+#include <gst/gst-probes.h>
 
 /* 16byte-aligns a buffer for libmpeg2 */
 #define ALIGN_16(p) ((void *)(((uintptr_t)(p) + 15) & ~((uintptr_t)15)))
@@ -57,6 +58,12 @@ GST_ELEMENT_DETAILS ("mpeg1 and mpeg2 video decoder",
  */
 #define WARN_THRESHOLD (5)
 
+enum
+{
+  ARG_0,
+  ARG_STATS
+};
+
 //#define enable_user_data
 #ifdef enable_user_data
 static GstStaticPadTemplate user_data_template_factory =
@@ -197,6 +204,9 @@ gst_mpeg2dec_class_init (GstMpeg2decClass * klass)
   gobject_class->get_property = gst_mpeg2dec_get_property;
   gobject_class->finalize = gst_mpeg2dec_finalize;
 
+  g_object_class_install_property (gobject_class, ARG_STATS,
+      gst_element_stats_param_spec ());
+
   gstelement_class->change_state = gst_mpeg2dec_change_state;
 #ifndef GST_DISABLE_INDEX
   gstelement_class->set_index = gst_mpeg2dec_set_index;
@@ -428,6 +438,7 @@ crop_buffer (GstMpeg2dec * mpeg2dec, GstBuffer ** buf)
         outbuf = crop_copy_i420_buffer (mpeg2dec, input);
       }
 
+      gst_element_stats_copy (&mpeg2dec->stats, GST_BUFFER_SIZE (outbuf));
       gst_buffer_set_caps (outbuf, GST_PAD_CAPS (mpeg2dec->srcpad));
       gst_buffer_copy_metadata (outbuf, input, GST_BUFFER_COPY_TIMESTAMPS);
       gst_buffer_unref (input);
@@ -742,6 +753,8 @@ flush_queued (GstMpeg2dec * mpeg2dec)
         GST_TIME_ARGS (GST_BUFFER_DURATION (buf)));
 
     /* iterate ouput queue an push downstream */
+    gst_element_stats_output (&mpeg2dec->stats, buf);
+    GST_PROBE_PUSH (mpeg2dec, buf);
     res = gst_pad_push (mpeg2dec->srcpad, buf);
 
     mpeg2dec->queued = g_list_delete_link (mpeg2dec->queued, mpeg2dec->queued);
@@ -942,6 +955,9 @@ handle_slice (GstMpeg2dec * mpeg2dec, const mpeg2_info_t * info)
       picture->nb_fields, GST_BUFFER_OFFSET (outbuf),
       GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (outbuf)));
 
+  GST_PROBE_FRAME (mpeg2dec, GST_BUFFER_SIZE (outbuf),
+      GST_BUFFER_TIMESTAMP (outbuf));
+
 #ifndef GST_DISABLE_INDEX
   if (mpeg2dec->index) {
     gst_index_add_association (mpeg2dec->index, mpeg2dec->index_id,
@@ -997,6 +1013,8 @@ handle_slice (GstMpeg2dec * mpeg2dec, const mpeg2_info_t * info)
         GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (outbuf)),
         GST_TIME_ARGS (GST_BUFFER_DURATION (outbuf)));
 
+    gst_element_stats_output (&mpeg2dec->stats, outbuf);
+    GST_PROBE_PUSH (mpeg2dec, outbuf);
     ret = gst_pad_push (mpeg2dec->srcpad, outbuf);
     GST_DEBUG_OBJECT (mpeg2dec, "pushed with result %s",
         gst_flow_get_name (ret));
@@ -1019,12 +1037,14 @@ no_display:
 skip:
   {
     GST_DEBUG_OBJECT (mpeg2dec, "dropping buffer because of skip flag");
+    gst_element_stats_dropped (&mpeg2dec->stats);
     return GST_FLOW_OK;
   }
 drop:
   {
     GST_DEBUG_OBJECT (mpeg2dec, "dropping buffer, discont state %d",
         mpeg2dec->discont_state);
+    gst_element_stats_dropped (&mpeg2dec->stats);
     return GST_FLOW_OK;
   }
 clipped:
@@ -1035,6 +1055,7 @@ clipped:
 dropping_qos:
   {
     GST_DEBUG_OBJECT (mpeg2dec, "dropping buffer because of QoS");
+    gst_element_stats_late (&mpeg2dec->stats);
     return GST_FLOW_OK;
   }
 }
@@ -1080,9 +1101,13 @@ gst_mpeg2dec_chain (GstPad * pad, GstBuffer * buf)
   mpeg2_state_t state;
   gboolean done = FALSE;
   GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime start;
 
   mpeg2dec = GST_MPEG2DEC (GST_PAD_PARENT (pad));
 
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&mpeg2dec->stats, buf);
+
   size = GST_BUFFER_SIZE (buf);
   data = GST_BUFFER_DATA (buf);
   pts = GST_BUFFER_TIMESTAMP (buf);
@@ -1128,9 +1153,9 @@ gst_mpeg2dec_chain (GstPad * pad, GstBuffer * buf)
   GST_LOG_OBJECT (mpeg2dec, "calling mpeg2_buffer done");
 
   while (!done) {
-    GST_LOG_OBJECT (mpeg2dec, "calling parse");
+    GST_HOT_LOG_OBJECT (mpeg2dec, "calling parse");
     state = mpeg2_parse (mpeg2dec->decoder);
-    GST_DEBUG_OBJECT (mpeg2dec, "parse state %d", state);
+    GST_HOT_DEBUG_OBJECT (mpeg2dec, "parse state %d", state);
 
     switch (state) {
 #if MPEG2_RELEASE >= MPEG2_VERSION (0, 5, 0)
@@ -1170,7 +1195,7 @@ gst_mpeg2dec_chain (GstPad * pad, GstBuffer * buf)
         ret = handle_picture (mpeg2dec, info);
         break;
       case STATE_SLICE_1ST:
-        GST_LOG_OBJECT (mpeg2dec, "1st slice of frame encountered");
+        GST_HOT_LOG_OBJECT (mpeg2dec, "1st slice of frame encountered");
         break;
       case STATE_PICTURE_2ND:
         GST_LOG_OBJECT (mpeg2dec,
@@ -1194,6 +1219,7 @@ gst_mpeg2dec_chain (GstPad * pad, GstBuffer * buf)
         /* FIXME: at some point we should probably send newsegment events to
          * let downstream know that parts of the stream are missing */
         mpeg2dec->error_count++;
+        gst_element_stats_dropped (&mpeg2dec->stats);
         GST_WARNING_OBJECT (mpeg2dec, "Decoding error #%d",
             mpeg2dec->error_count);
         if (mpeg2dec->error_count >= WARN_THRESHOLD && WARN_THRESHOLD > 0) {
@@ -1230,6 +1256,7 @@ gst_mpeg2dec_chain (GstPad * pad, GstBuffer * buf)
   }
 done:
   gst_buffer_unref (buf);
+  gst_element_stats_stop (&mpeg2dec->stats, start);
   return ret;
 
   /* errors */
@@ -1794,6 +1821,7 @@ gst_mpeg2dec_change_state (GstElement * element, GstStateChange transition)
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       gst_mpeg2dec_reset (mpeg2dec);
       gst_mpeg2dec_qos_reset (mpeg2dec);
+      gst_element_stats_reset (&mpeg2dec->stats);
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
     default:
@@ -1856,6 +1884,11 @@ gst_mpeg2dec_get_property (GObject * object, guint prop_id, GValue * value,
   mpeg2dec = GST_MPEG2DEC (object);
 
   switch (prop_id) {
+    case ARG_STATS:
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&mpeg2dec->stats,
+              "mpeg2dec-stats"));
+      break;
     default:
       break;
   }
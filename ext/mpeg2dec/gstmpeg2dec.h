@@ -24,6 +24,7 @@
 
 #include <gst/gst.h>
 #include <mpeg2.h>
+#include <gst/gst-element-stats.h>
 
 G_BEGIN_DECLS
 
@@ -127,6 +128,8 @@ struct _GstMpeg2dec {
 
   /* whether we have a pixel aspect ratio from the sink caps */
   gboolean have_par;
+
+  GstElementStats stats;        /* for the "stats" property */
 };
 
 struct _GstMpeg2decClass {
@@ -188,7 +188,8 @@ enum
   ARG_ATH_LEVEL,
   ARG_VBR_MAX_BITRATE,
   ARG_QUICK_MODE,
-  ARG_QUICK_MODE_COUNT
+  ARG_QUICK_MODE_COUNT,
+  ARG_THREADS
 };
 
 static void gst_two_lame_set_property (GObject * object, guint prop_id,
@@ -198,6 +199,17 @@ static void gst_two_lame_get_property (GObject * object, guint prop_id,
 static gboolean gst_two_lame_sink_event (GstPad * pad, GstEvent * event);
 static GstFlowReturn gst_two_lame_chain (GstPad * pad, GstBuffer * buf);
 static gboolean gst_two_lame_setup (GstTwoLame * twolame);
+static gboolean gst_two_lame_configure (GstTwoLame * twolame,
+    twolame_options * glopts);
+typedef struct _GstTwoLameSegment GstTwoLameSegment;
+
+static void gst_two_lame_segment_free (GstTwoLameSegment * seg);
+static void gst_two_lame_segment_encode (GstTwoLameSegment * seg,
+    GstTwoLame * twolame);
+static GstFlowReturn gst_two_lame_segment_push (GstTwoLameSegment * seg,
+    GstTwoLame * twolame);
+static GstFlowReturn gst_two_lame_parallel_finish (GstTwoLame * twolame);
+static void gst_two_lame_reset_segments (GstTwoLame * twolame);
 static GstStateChangeReturn gst_two_lame_change_state (GstElement * element,
     GstStateChange transition);
 
@@ -211,12 +223,18 @@ gst_two_lame_release_memory (GstTwoLame * twolame)
     twolame_close (&twolame->glopts);
     twolame->glopts = NULL;
   }
+  gst_segment_queue_stop (&twolame->segments);
 }
 
 static void
 gst_two_lame_finalize (GObject * obj)
 {
-  gst_two_lame_release_memory (GST_TWO_LAME (obj));
+  GstTwoLame *twolame = GST_TWO_LAME (obj);
+
+  gst_two_lame_release_memory (twolame);
+
+  gst_segment_queue_clear (&twolame->segments);
+  g_byte_array_free (twolame->pcm, TRUE);
 
   G_OBJECT_CLASS (parent_class)->finalize (obj);
 }
@@ -337,6 +355,12 @@ gst_two_lame_class_init (GstTwoLameClass * klass)
           0, G_MAXINT, gst_two_lame_default_settings.quick_mode_count,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_THREADS,
+      g_param_spec_int ("threads", "Threads",
+          "Number of threads to encode segments of non-live streams in "
+          "parallel with (0 = off)", 0, 64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_two_lame_change_state);
 }
@@ -360,6 +384,16 @@ gst_two_lame_sink_setcaps (GstPad * pad, GstCaps * caps)
   twolame = GST_TWO_LAME (GST_PAD_PARENT (pad));
   structure = gst_caps_get_structure (caps, 0);
 
+  /* the pending segment input is in the old format, encode it before the
+   * format changes */
+  if (twolame->setup && twolame->parallel) {
+    if (twolame->last_flow == GST_FLOW_OK)
+      gst_two_lame_parallel_finish (twolame);
+    else
+      gst_two_lame_reset_segments (twolame);
+    twolame->parallel = FALSE;
+  }
+
   if (strcmp (gst_structure_get_name (structure), "audio/x-raw-int") == 0)
     twolame->float_input = FALSE;
   else
@@ -471,6 +505,14 @@ gst_two_lame_init (GstTwoLame * twolame, GstTwoLameClass * klass)
   twolame->quick_mode = gst_two_lame_default_settings.quick_mode;
   twolame->quick_mode_count = gst_two_lame_default_settings.quick_mode_count;
 
+  twolame->threads = 0;
+  twolame->parallel = FALSE;
+  gst_segment_queue_init (&twolame->segments,
+      (GstSegmentQueueProcessFunc) gst_two_lame_segment_encode,
+      (GstSegmentQueuePushFunc) gst_two_lame_segment_push,
+      (GDestroyNotify) gst_two_lame_segment_free, twolame);
+  twolame->pcm = g_byte_array_new ();
+
   GST_DEBUG_OBJECT (twolame, "done initializing");
 }
 
@@ -561,6 +603,9 @@ gst_two_lame_set_property (GObject * object, guint prop_id,
     case ARG_QUICK_MODE_COUNT:
       twolame->quick_mode_count = g_value_get_int (value);
       break;
+    case ARG_THREADS:
+      twolame->threads = g_value_get_int (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -619,12 +664,377 @@ gst_two_lame_get_property (GObject * object, guint prop_id, GValue * value,
     case ARG_QUICK_MODE_COUNT:
       g_value_set_int (value, twolame->quick_mode_count);
       break;
+    case ARG_THREADS:
+      g_value_set_int (value, twolame->threads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
+/* returns the length of the layer 2 frame starting with @header, or 0 if
+ * this is not a valid frame header */
+static guint
+gst_two_lame_frame_length (guint32 header)
+{
+  static const guint bitrates[2][15] = {
+    /* MPEG-1 */
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+    /* MPEG-2 */
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}
+  };
+  static const guint rates[3] = { 44100, 48000, 32000 };
+  guint version, lsf, bitrate, rate_idx, rate;
+
+  if ((header & 0xffe00000) != 0xffe00000)
+    return 0;
+
+  /* 3 is MPEG-1, 2 is MPEG-2 */
+  version = (header >> 19) & 0x3;
+  if (version != 2 && version != 3)
+    return 0;
+  /* layer 2 */
+  if (((header >> 17) & 0x3) != 2)
+    return 0;
+
+  lsf = (version == 2);
+  bitrate = bitrates[lsf][(header >> 12) & 0xf];
+  rate_idx = (header >> 10) & 0x3;
+  if (bitrate == 0 || ((header >> 12) & 0xf) == 0xf || rate_idx == 3)
+    return 0;
+
+  rate = rates[rate_idx] >> lsf;
+
+  return 144 * bitrate * 1000 / rate + ((header >> 9) & 0x1);
+}
+
+/* Segment-parallel encoding for non-live streams: the input is cut into
+ * segments of GST_TWO_LAME_SEGMENT_FRAMES frames that are encoded with their
+ * own encoder on a thread pool. Each segment is encoded together with
+ * GST_TWO_LAME_SEGMENT_OVERLAP frames of the previous and the next segment
+ * to warm up the psychoacoustic model and the filterbank, the frames of the
+ * overlap are dropped. Layer 2 has no bit reservoir, so the frames that are
+ * kept are the same as with a single encoder apart from the psychoacoustic
+ * state. */
+#define GST_TWO_LAME_SEGMENT_FRAMES  256
+#define GST_TWO_LAME_SEGMENT_OVERLAP 4
+
+struct _GstTwoLameSegment
+{
+  twolame_options *glopts;
+  gint channels;
+  gboolean float_input;
+  guint8 *data;
+  guint num_samples;            /* per channel */
+  guint skip;                   /* frames of the previous segment */
+  guint keep;                   /* frames to keep after those */
+
+  /* result */
+  gboolean error;
+  GstBuffer *out;
+  guint frames;
+};
+
+static void
+gst_two_lame_segment_free (GstTwoLameSegment * seg)
+{
+  if (seg->glopts)
+    twolame_close (&seg->glopts);
+  g_free (seg->data);
+  if (seg->out)
+    gst_buffer_unref (seg->out);
+  g_free (seg);
+}
+
+/* runs in the thread pool */
+static void
+gst_two_lame_segment_encode (GstTwoLameSegment * seg, GstTwoLame * twolame)
+{
+  GstBuffer *buf;
+  guint8 *data;
+  gint size, flushed, max_size;
+  guint offset = 0, start = 0, frame = 0;
+
+  max_size = 1.25 * seg->num_samples * seg->channels + 16384;
+  buf = gst_buffer_new_and_alloc (max_size + 16384);
+  data = GST_BUFFER_DATA (buf);
+
+  if (seg->channels == 1) {
+    if (seg->float_input)
+      size = twolame_encode_buffer_float32 (seg->glopts, (float *) seg->data,
+          (float *) seg->data, seg->num_samples, data, max_size);
+    else
+      size = twolame_encode_buffer (seg->glopts, (short int *) seg->data,
+          (short int *) seg->data, seg->num_samples, data, max_size);
+  } else {
+    if (seg->float_input)
+      size = twolame_encode_buffer_float32_interleaved (seg->glopts,
+          (float *) seg->data, seg->num_samples, data, max_size);
+    else
+      size = twolame_encode_buffer_interleaved (seg->glopts,
+          (short int *) seg->data, seg->num_samples, data, max_size);
+  }
+
+  if (size >= 0) {
+    flushed = twolame_encode_flush (seg->glopts, data + size, 16384);
+    if (flushed >= 0)
+      size += flushed;
+    else
+      size = flushed;
+  }
+
+  if (size < 0) {
+    seg->error = TRUE;
+    size = 0;
+  }
+
+  /* pick the frames of this segment */
+  while (offset + 4 <= size &&
+      (frame < seg->skip || frame - seg->skip < seg->keep)) {
+    guint len;
+
+    len = gst_two_lame_frame_length (GST_READ_UINT32_BE (data + offset));
+    if (len == 0 || offset + len > size)
+      break;
+
+    if (frame == seg->skip)
+      start = offset;
+    offset += len;
+    frame++;
+  }
+
+  if (frame > seg->skip) {
+    seg->out = gst_buffer_create_sub (buf, start, offset - start);
+    seg->frames = frame - seg->skip;
+  }
+  gst_buffer_unref (buf);
+
+  twolame_close (&seg->glopts);
+  seg->glopts = NULL;
+  g_free (seg->data);
+  seg->data = NULL;
+}
+
+static guint
+gst_two_lame_frame_bytes (GstTwoLame * twolame)
+{
+  return TWOLAME_SAMPLES_PER_FRAME * twolame->num_channels *
+      (twolame->float_input ? 4 : 2);
+}
+
+/* queues the first @size bytes of the pending input as a segment */
+static gboolean
+gst_two_lame_segment_submit (GstTwoLame * twolame, guint size, guint skip,
+    guint keep)
+{
+  GstTwoLameSegment *seg;
+  twolame_options *glopts;
+  GError *err = NULL;
+
+  glopts = twolame_init ();
+  if (glopts == NULL)
+    return FALSE;
+
+  twolame_set_in_samplerate (glopts, twolame->samplerate);
+  twolame_set_out_samplerate (glopts,
+      twolame_get_out_samplerate (twolame->glopts));
+  if (!gst_two_lame_configure (twolame, glopts) ||
+      twolame_init_params (glopts) < 0) {
+    twolame_close (&glopts);
+    return FALSE;
+  }
+
+  seg = g_new0 (GstTwoLameSegment, 1);
+  seg->glopts = glopts;
+  seg->channels = twolame->num_channels;
+  seg->float_input = twolame->float_input;
+  seg->data = g_memdup (twolame->pcm->data, size);
+  seg->num_samples = size / (gst_two_lame_frame_bytes (twolame) /
+      TWOLAME_SAMPLES_PER_FRAME);
+  seg->skip = skip;
+  seg->keep = keep;
+
+  GST_LOG_OBJECT (twolame, "queueing segment of %u samples, skipping %u "
+      "frames", seg->num_samples, skip);
+
+  if (!gst_segment_queue_push (&twolame->segments, seg, &err))
+    goto push_failed;
+
+  return TRUE;
+
+push_failed:
+  {
+    GST_WARNING_OBJECT (twolame, "failed to queue segment: %s", err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+}
+
+static GstFlowReturn
+gst_two_lame_segment_push (GstTwoLameSegment * seg, GstTwoLame * twolame)
+{
+  GstBuffer *outbuf;
+  GstFlowReturn result;
+  gint rate;
+
+  if (seg->error)
+    goto encode_failed;
+
+  if (seg->out == NULL)
+    return GST_FLOW_OK;
+
+  outbuf = seg->out;
+  seg->out = NULL;
+
+  rate = twolame_get_out_samplerate (twolame->glopts);
+
+  if (GST_CLOCK_TIME_IS_VALID (twolame->frame_ts)) {
+    GST_BUFFER_TIMESTAMP (outbuf) = twolame->frame_ts +
+        gst_util_uint64_scale_int (twolame->frame_samples, GST_SECOND, rate);
+    GST_BUFFER_DURATION (outbuf) = twolame->frame_ts +
+        gst_util_uint64_scale_int (twolame->frame_samples +
+        seg->frames * TWOLAME_SAMPLES_PER_FRAME, GST_SECOND, rate) -
+        GST_BUFFER_TIMESTAMP (outbuf);
+  }
+  twolame->frame_samples += seg->frames * TWOLAME_SAMPLES_PER_FRAME;
+
+  gst_buffer_set_caps (outbuf, GST_PAD_CAPS (twolame->srcpad));
+  result = gst_pad_push (twolame->srcpad, outbuf);
+  twolame->last_flow = result;
+  if (result != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (twolame, "flow return: %s", gst_flow_get_name (result));
+  }
+
+  return result;
+
+encode_failed:
+  {
+    GST_ELEMENT_ERROR (twolame, LIBRARY, ENCODE, (NULL),
+        ("TwoLAME failed to encode a segment"));
+    return GST_FLOW_ERROR;
+  }
+}
+
+static GstFlowReturn
+gst_two_lame_chain_parallel (GstTwoLame * twolame, GstBuffer * buf)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+  guint frame_bytes, segment_bytes, overlap_bytes, preroll_bytes;
+
+  if (!GST_CLOCK_TIME_IS_VALID (twolame->frame_ts)) {
+    twolame->frame_ts = GST_BUFFER_TIMESTAMP (buf);
+    twolame->frame_samples = 0;
+  }
+
+  g_byte_array_append (twolame->pcm, GST_BUFFER_DATA (buf),
+      GST_BUFFER_SIZE (buf));
+  gst_buffer_unref (buf);
+
+  frame_bytes = gst_two_lame_frame_bytes (twolame);
+  segment_bytes = GST_TWO_LAME_SEGMENT_FRAMES * frame_bytes;
+  overlap_bytes = GST_TWO_LAME_SEGMENT_OVERLAP * frame_bytes;
+
+  while (result == GST_FLOW_OK) {
+    preroll_bytes = twolame->have_preroll ? overlap_bytes : 0;
+    if (twolame->pcm->len < preroll_bytes + segment_bytes + overlap_bytes)
+      break;
+
+    if (!gst_two_lame_segment_submit (twolame,
+            preroll_bytes + segment_bytes + overlap_bytes,
+            preroll_bytes / frame_bytes, GST_TWO_LAME_SEGMENT_FRAMES))
+      goto submit_failed;
+
+    /* keep the end of this segment as the start of the next one */
+    g_byte_array_remove_range (twolame->pcm, 0,
+        preroll_bytes + segment_bytes - overlap_bytes);
+    twolame->have_preroll = TRUE;
+
+    result = gst_segment_queue_process (&twolame->segments, FALSE, TRUE);
+  }
+
+  return result;
+
+submit_failed:
+  {
+    GST_ELEMENT_ERROR (twolame, LIBRARY, SETTINGS, (NULL),
+        ("failed to set up a segment encoder"));
+    return GST_FLOW_ERROR;
+  }
+}
+
+/* encodes the remaining input and pushes all segments */
+static GstFlowReturn
+gst_two_lame_parallel_finish (GstTwoLame * twolame)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+
+  if (twolame->have_preroll || twolame->pcm->len > 0) {
+    guint skip = 0;
+
+    if (twolame->have_preroll)
+      skip = GST_TWO_LAME_SEGMENT_OVERLAP;
+
+    if (!gst_two_lame_segment_submit (twolame, twolame->pcm->len, skip,
+            G_MAXUINT))
+      result = GST_FLOW_ERROR;
+  }
+
+  if (result == GST_FLOW_OK)
+    result = gst_segment_queue_process (&twolame->segments, TRUE, TRUE);
+  else
+    gst_segment_queue_process (&twolame->segments, TRUE, FALSE);
+
+  g_byte_array_set_size (twolame->pcm, 0);
+  twolame->have_preroll = FALSE;
+
+  return result;
+}
+
+/* decides whether to use segment-parallel encoding after setup */
+static void
+gst_two_lame_check_parallel (GstTwoLame * twolame)
+{
+  GError *err = NULL;
+
+  twolame->parallel = FALSE;
+
+  if (twolame->threads == 0)
+    return;
+
+  if (twolame_get_out_samplerate (twolame->glopts) != twolame->samplerate) {
+    GST_WARNING_OBJECT (twolame, "can't resample when encoding in parallel");
+    return;
+  }
+
+  if (gst_segment_queue_upstream_is_live (twolame->sinkpad)) {
+    GST_INFO_OBJECT (twolame, "upstream is live, not encoding in parallel");
+    return;
+  }
+
+  if (!gst_segment_queue_set_threads (&twolame->segments, twolame->threads,
+          &err)) {
+    GST_WARNING_OBJECT (twolame, "failed to create thread pool: %s",
+        err->message);
+    g_error_free (err);
+    return;
+  }
+
+  GST_INFO_OBJECT (twolame, "encoding segments on %d threads",
+      twolame->threads);
+  twolame->parallel = TRUE;
+}
+
+static void
+gst_two_lame_reset_segments (GstTwoLame * twolame)
+{
+  gst_segment_queue_process (&twolame->segments, TRUE, FALSE);
+  g_byte_array_set_size (twolame->pcm, 0);
+  twolame->have_preroll = FALSE;
+  twolame->frame_ts = GST_CLOCK_TIME_NONE;
+  twolame->frame_samples = 0;
+}
+
 static gboolean
 gst_two_lame_sink_event (GstPad * pad, GstEvent * event)
 {
@@ -637,7 +1047,11 @@ gst_two_lame_sink_event (GstPad * pad, GstEvent * event)
     case GST_EVENT_EOS:{
       GST_DEBUG_OBJECT (twolame, "handling EOS event");
 
-      if (twolame->glopts != NULL) {
+      if (twolame->glopts != NULL && twolame->parallel) {
+        if (twolame->last_flow == GST_FLOW_OK)
+          gst_two_lame_parallel_finish (twolame);
+        gst_two_lame_reset_segments (twolame);
+      } else if (twolame->glopts != NULL) {
         GstBuffer *buf;
         gint size;
 
@@ -693,6 +1107,7 @@ gst_two_lame_sink_event (GstPad * pad, GstEvent * event)
       mp3_data = g_malloc (mp3_buffer_size);
       mp3_size =
           twolame_encode_flush (twolame->glopts, mp3_data, mp3_buffer_size);
+      gst_two_lame_reset_segments (twolame);
 
       ret = gst_pad_push_event (twolame->srcpad, event);
 
@@ -727,6 +1142,9 @@ gst_two_lame_chain (GstPad * pad, GstBuffer * buf)
   if (!twolame->setup)
     goto not_setup;
 
+  if (twolame->parallel)
+    return gst_two_lame_chain_parallel (twolame, buf);
+
   data = GST_BUFFER_DATA (buf);
   size = GST_BUFFER_SIZE (buf);
 
@@ -831,11 +1249,10 @@ not_setup:
   }
 }
 
-/* set up the encoder state */
+/* copy the settings over to @glopts */
 static gboolean
-gst_two_lame_setup (GstTwoLame * twolame)
+gst_two_lame_configure (GstTwoLame * twolame, twolame_options * glopts)
 {
-
 #define CHECK_ERROR(command) G_STMT_START {\
   if ((command) < 0) { \
     GST_ERROR_OBJECT (twolame, "setup failed: " G_STRINGIFY (command)); \
@@ -843,6 +1260,38 @@ gst_two_lame_setup (GstTwoLame * twolame)
   } \
 }G_STMT_END
 
+  CHECK_ERROR (twolame_set_num_channels (glopts, twolame->num_channels));
+
+  CHECK_ERROR (twolame_set_mode (glopts, twolame->mode));
+  CHECK_ERROR (twolame_set_psymodel (glopts, twolame->psymodel));
+  CHECK_AND_FIXUP_BITRATE (twolame, "bitrate", twolame->bitrate);
+  CHECK_ERROR (twolame_set_bitrate (glopts, twolame->bitrate));
+  CHECK_ERROR (twolame_set_padding (glopts, twolame->padding));
+  CHECK_ERROR (twolame_set_energy_levels (glopts,
+          twolame->energy_level_extension));
+  CHECK_ERROR (twolame_set_emphasis (glopts, twolame->emphasis));
+  CHECK_ERROR (twolame_set_error_protection (glopts,
+          twolame->error_protection));
+  CHECK_ERROR (twolame_set_copyright (glopts, twolame->copyright));
+  CHECK_ERROR (twolame_set_original (glopts, twolame->original));
+  CHECK_ERROR (twolame_set_VBR (glopts, twolame->vbr));
+  CHECK_ERROR (twolame_set_VBR_level (glopts, twolame->vbr_level));
+  CHECK_ERROR (twolame_set_ATH_level (glopts, twolame->ath_level));
+  CHECK_AND_FIXUP_BITRATE (twolame, "vbr-max-bitrate",
+      twolame->vbr_max_bitrate);
+  CHECK_ERROR (twolame_set_VBR_max_bitrate_kbps (glopts,
+          twolame->vbr_max_bitrate));
+  CHECK_ERROR (twolame_set_quick_mode (glopts, twolame->quick_mode));
+  CHECK_ERROR (twolame_set_quick_count (glopts, twolame->quick_mode_count));
+
+  return TRUE;
+#undef CHECK_ERROR
+}
+
+/* set up the encoder state */
+static gboolean
+gst_two_lame_setup (GstTwoLame * twolame)
+{
   int retval;
   GstCaps *allowed_caps;
 
@@ -894,32 +1343,8 @@ gst_two_lame_setup (GstTwoLame * twolame)
     twolame->mode = 3;
 
   /* Fix bitrates and MPEG version */
-
-  CHECK_ERROR (twolame_set_num_channels (twolame->glopts,
-          twolame->num_channels));
-
-  CHECK_ERROR (twolame_set_mode (twolame->glopts, twolame->mode));
-  CHECK_ERROR (twolame_set_psymodel (twolame->glopts, twolame->psymodel));
-  CHECK_AND_FIXUP_BITRATE (twolame, "bitrate", twolame->bitrate);
-  CHECK_ERROR (twolame_set_bitrate (twolame->glopts, twolame->bitrate));
-  CHECK_ERROR (twolame_set_padding (twolame->glopts, twolame->padding));
-  CHECK_ERROR (twolame_set_energy_levels (twolame->glopts,
-          twolame->energy_level_extension));
-  CHECK_ERROR (twolame_set_emphasis (twolame->glopts, twolame->emphasis));
-  CHECK_ERROR (twolame_set_error_protection (twolame->glopts,
-          twolame->error_protection));
-  CHECK_ERROR (twolame_set_copyright (twolame->glopts, twolame->copyright));
-  CHECK_ERROR (twolame_set_original (twolame->glopts, twolame->original));
-  CHECK_ERROR (twolame_set_VBR (twolame->glopts, twolame->vbr));
-  CHECK_ERROR (twolame_set_VBR_level (twolame->glopts, twolame->vbr_level));
-  CHECK_ERROR (twolame_set_ATH_level (twolame->glopts, twolame->ath_level));
-  CHECK_AND_FIXUP_BITRATE (twolame, "vbr-max-bitrate",
-      twolame->vbr_max_bitrate);
-  CHECK_ERROR (twolame_set_VBR_max_bitrate_kbps (twolame->glopts,
-          twolame->vbr_max_bitrate));
-  CHECK_ERROR (twolame_set_quick_mode (twolame->glopts, twolame->quick_mode));
-  CHECK_ERROR (twolame_set_quick_count (twolame->glopts,
-          twolame->quick_mode_count));
+  if (!gst_two_lame_configure (twolame, twolame->glopts))
+    return FALSE;
 
   /* initialize the twolame encoder */
   if ((retval = twolame_init_params (twolame->glopts)) >= 0) {
@@ -927,6 +1352,7 @@ gst_two_lame_setup (GstTwoLame * twolame)
     /* FIXME: it would be nice to print out the mode here */
     GST_INFO ("twolame encoder setup (%d kbit/s, %d Hz, %d channels)",
         twolame->bitrate, twolame->samplerate, twolame->num_channels);
+    gst_two_lame_check_parallel (twolame);
   } else {
     GST_ERROR_OBJECT (twolame, "twolame_init_params returned %d", retval);
   }
@@ -934,7 +1360,6 @@ gst_two_lame_setup (GstTwoLame * twolame)
   GST_DEBUG_OBJECT (twolame, "done with setup");
 
   return twolame->setup;
-#undef CHECK_ERROR
 }
 
 static GstStateChangeReturn
@@ -950,6 +1375,7 @@ gst_two_lame_change_state (GstElement * element, GstStateChange transition)
       twolame->last_flow = GST_FLOW_OK;
       twolame->last_ts = GST_CLOCK_TIME_NONE;
       twolame->eos_ts = GST_CLOCK_TIME_NONE;
+      gst_two_lame_reset_segments (twolame);
       break;
     default:
       break;
@@ -958,6 +1384,9 @@ gst_two_lame_change_state (GstElement * element, GstStateChange transition)
   result = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_two_lame_reset_segments (twolame);
+      break;
     case GST_STATE_CHANGE_READY_TO_NULL:
       gst_two_lame_release_memory (twolame);
       break;
@@ -24,6 +24,7 @@
 
 
 #include <gst/gst.h>
+#include <gst/gst-segment-queue.h>
 
 G_BEGIN_DECLS
 
@@ -82,6 +83,15 @@ struct _GstTwoLame {
 
   /* time tracker */
   guint64 last_ts, last_offs, last_duration, eos_ts;
+
+  /* segment-parallel encoding */
+  gint threads;
+  gboolean parallel;
+  GstSegmentQueue segments;
+  GByteArray *pcm;              /* input not queued as a segment yet */
+  gboolean have_preroll;        /* pcm starts with frames of the last one */
+  GstClockTime frame_ts;
+  guint64 frame_samples;
 };
 
 struct _GstTwoLameClass {
@@ -0,0 +1,241 @@
+/* GStreamer
+ *
+ * gst-element-stats.h: counters for the "stats" property of the elements
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_ELEMENT_STATS_H__
+#define __GST_ELEMENT_STATS_H__
+
+#include <string.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstElementStats GstElementStats;
+
+/* The 64 bit counters can't be updated atomically everywhere, so they are
+ * guarded by a sequence counter: the writer makes it odd before and even
+ * again after every update, and a reader copies the counters until it saw
+ * the same even value before and after. The writer never waits. There
+ * must only be one writer per block, the streaming thread; elements that
+ * update counters from more than one thread keep a block per thread.
+ * Always update the counters with the functions below. */
+struct _GstElementStats {
+  volatile gint seq;
+
+  guint64 bytes_in;
+  guint64 buffers_in;
+  guint64 bytes_out;
+  guint64 buffers_out;
+  guint64 copies;               /* spans copied or joined */
+  guint64 bytes_copied;
+  guint64 resync_bytes;         /* input skipped while looking for sync */
+  guint64 dropped;              /* broken or unusable packets and frames */
+  guint64 late;                 /* packets that came too late to be used */
+  guint64 processing_time;      /* time spent handling input, in ns */
+};
+
+#define GST_ELEMENT_STATS_COUNTERS_OFFSET \
+    G_STRUCT_OFFSET (GstElementStats, bytes_in)
+
+/* the atomic increments are full barriers, the counters can't move across
+ * them */
+static inline void
+gst_element_stats_begin (GstElementStats * stats)
+{
+  g_atomic_int_inc (&stats->seq);
+}
+
+static inline void
+gst_element_stats_end (GstElementStats * stats)
+{
+  g_atomic_int_inc (&stats->seq);
+}
+
+/* counts as a write, so only while the element isn't streaming */
+static inline void
+gst_element_stats_reset (GstElementStats * stats)
+{
+  gst_element_stats_begin (stats);
+  memset ((guint8 *) stats + GST_ELEMENT_STATS_COUNTERS_OFFSET, 0,
+      sizeof (GstElementStats) - GST_ELEMENT_STATS_COUNTERS_OFFSET);
+  gst_element_stats_end (stats);
+}
+
+/* copies the counters of @stats to @snapshot, from any thread */
+static inline void
+gst_element_stats_snapshot (GstElementStats * stats,
+    GstElementStats * snapshot)
+{
+  gint seq;
+
+  while (TRUE) {
+    seq = g_atomic_int_get (&stats->seq);
+    if (!(seq & 1)) {
+      memcpy (snapshot, stats, sizeof (GstElementStats));
+      if (g_atomic_int_get (&stats->seq) == seq)
+        break;
+    }
+    /* the writer is in the middle of an update */
+    g_thread_yield ();
+  }
+  snapshot->seq = 0;
+}
+
+/* adds a snapshot of the counters of @stats to @total */
+static inline void
+gst_element_stats_accumulate (GstElementStats * stats,
+    GstElementStats * total)
+{
+  GstElementStats snapshot;
+
+  gst_element_stats_snapshot (stats, &snapshot);
+  total->bytes_in += snapshot.bytes_in;
+  total->buffers_in += snapshot.buffers_in;
+  total->bytes_out += snapshot.bytes_out;
+  total->buffers_out += snapshot.buffers_out;
+  total->copies += snapshot.copies;
+  total->bytes_copied += snapshot.bytes_copied;
+  total->resync_bytes += snapshot.resync_bytes;
+  total->dropped += snapshot.dropped;
+  total->late += snapshot.late;
+  total->processing_time += snapshot.processing_time;
+}
+
+static inline void
+gst_element_stats_input (GstElementStats * stats, GstBuffer * buf)
+{
+  gst_element_stats_begin (stats);
+  stats->bytes_in += GST_BUFFER_SIZE (buf);
+  stats->buffers_in++;
+  gst_element_stats_end (stats);
+}
+
+static inline void
+gst_element_stats_output (GstElementStats * stats, GstBuffer * buf)
+{
+  gst_element_stats_begin (stats);
+  stats->bytes_out += GST_BUFFER_SIZE (buf);
+  stats->buffers_out++;
+  gst_element_stats_end (stats);
+}
+
+static inline void
+gst_element_stats_copy (GstElementStats * stats, guint bytes)
+{
+  gst_element_stats_begin (stats);
+  stats->bytes_copied += bytes;
+  stats->copies++;
+  gst_element_stats_end (stats);
+}
+
+static inline void
+gst_element_stats_resync (GstElementStats * stats, guint bytes)
+{
+  gst_element_stats_begin (stats);
+  stats->resync_bytes += bytes;
+  gst_element_stats_end (stats);
+}
+
+static inline void
+gst_element_stats_dropped (GstElementStats * stats)
+{
+  gst_element_stats_begin (stats);
+  stats->dropped++;
+  gst_element_stats_end (stats);
+}
+
+static inline void
+gst_element_stats_late (GstElementStats * stats)
+{
+  gst_element_stats_begin (stats);
+  stats->late++;
+  gst_element_stats_end (stats);
+}
+
+/* Reading the clock twice per buffer isn't free, so processing-time is only
+ * measured when GST_ELEMENT_STATS_TIMING is set in the environment. */
+static inline gboolean
+gst_element_stats_timing (void)
+{
+  static gint timing = -1;
+
+  if (G_UNLIKELY (timing < 0))
+    timing = (g_getenv ("GST_ELEMENT_STATS_TIMING") != NULL);
+
+  return timing;
+}
+
+static inline GstClockTime
+gst_element_stats_start (void)
+{
+  if (G_LIKELY (!gst_element_stats_timing ()))
+    return GST_CLOCK_TIME_NONE;
+
+  return gst_util_get_timestamp ();
+}
+
+static inline void
+gst_element_stats_stop (GstElementStats * stats, GstClockTime start)
+{
+  GstClockTime elapsed;
+
+  if (G_LIKELY (!GST_CLOCK_TIME_IS_VALID (start)))
+    return;
+
+  elapsed = gst_util_get_timestamp () - start;
+  gst_element_stats_begin (stats);
+  stats->processing_time += elapsed;
+  gst_element_stats_end (stats);
+}
+
+static inline GParamSpec *
+gst_element_stats_param_spec (void)
+{
+  return g_param_spec_boxed ("stats", "Statistics",
+      "Counters for the data handled so far: bytes-in, buffers-in, "
+      "bytes-out, buffers-out, copies, bytes-copied, resync-bytes, "
+      "dropped, late and processing-time (in nanoseconds, only measured "
+      "with GST_ELEMENT_STATS_TIMING set in the environment)",
+      GST_TYPE_STRUCTURE, G_PARAM_READABLE);
+}
+
+static inline GstStructure *
+gst_element_stats_get_structure (GstElementStats * live_stats,
+    const gchar * name)
+{
+  GstElementStats snapshot, *stats = &snapshot;
+
+  gst_element_stats_snapshot (live_stats, &snapshot);
+
+  return gst_structure_new (name,
+      "bytes-in", G_TYPE_UINT64, stats->bytes_in,
+      "buffers-in", G_TYPE_UINT64, stats->buffers_in,
+      "bytes-out", G_TYPE_UINT64, stats->bytes_out,
+      "buffers-out", G_TYPE_UINT64, stats->buffers_out,
+      "copies", G_TYPE_UINT64, stats->copies,
+      "bytes-copied", G_TYPE_UINT64, stats->bytes_copied,
+      "resync-bytes", G_TYPE_UINT64, stats->resync_bytes,
+      "dropped", G_TYPE_UINT64, stats->dropped,
+      "late", G_TYPE_UINT64, stats->late,
+      "processing-time", G_TYPE_UINT64, stats->processing_time, NULL);
+}
+
+G_END_DECLS
+
+#endif /* __GST_ELEMENT_STATS_H__ */
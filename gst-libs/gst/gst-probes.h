@@ -0,0 +1,82 @@
+/* GStreamer
+ *
+ * gst-probes.h: static tracepoints and inner loop logging
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_PROBES_H__
+#define __GST_PROBES_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Static tracepoints at the packet, frame and push boundaries of the
+ * demuxers, parsers and decoders. With sys/sdt.h they are systemtap/USDT
+ * probes in the gst_plugins_ugly provider, which are a nop until a tracer
+ * attaches to them, e.g.
+ *
+ *   stap -e 'probe process("libgstasf.so").provider("gst_plugins_ugly")
+ *            .mark("push") { printf("%p %d\n", $arg1, $arg2) }'
+ *
+ * Without sys/sdt.h, or with --disable-probes, they compile to nothing.
+ *
+ *   packet (element, stream, size): a packet or chunk was parsed
+ *   frame  (element, size, timestamp): a frame was parsed or decoded
+ *   push   (element, size, timestamp): a buffer is about to be pushed
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define GST_PROBE_PACKET(obj,stream,size) \
+    DTRACE_PROBE3 (gst_plugins_ugly, packet, (obj), (guint) (stream), \
+        (guint) (size))
+#define GST_PROBE_FRAME(obj,size,ts) \
+    DTRACE_PROBE3 (gst_plugins_ugly, frame, (obj), (guint) (size), \
+        (guint64) (ts))
+#define GST_PROBE_PUSH(obj,buf) \
+    DTRACE_PROBE3 (gst_plugins_ugly, push, (obj), GST_BUFFER_SIZE (buf), \
+        (guint64) GST_BUFFER_TIMESTAMP (buf))
+#else
+#define GST_PROBE_PACKET(obj,stream,size) G_STMT_START{ }G_STMT_END
+#define GST_PROBE_FRAME(obj,size,ts)      G_STMT_START{ }G_STMT_END
+#define GST_PROBE_PUSH(obj,buf)           G_STMT_START{ }G_STMT_END
+#endif
+
+/* Logging done per byte or per chunk in the inner loops. Even when the
+ * category is disabled the threshold check is done in the hottest code,
+ * so configuring with --disable-hot-path-logging compiles these out. */
+#if defined (GST_DISABLE_HOT_PATH_LOGGING) && defined (G_HAVE_ISO_VARARGS)
+#define GST_HOT_LOG(...)           G_STMT_START{ }G_STMT_END
+#define GST_HOT_LOG_OBJECT(...)    G_STMT_START{ }G_STMT_END
+#define GST_HOT_DEBUG(...)         G_STMT_START{ }G_STMT_END
+#define GST_HOT_DEBUG_OBJECT(...)  G_STMT_START{ }G_STMT_END
+#elif defined (GST_DISABLE_HOT_PATH_LOGGING) && defined (G_HAVE_GNUC_VARARGS)
+#define GST_HOT_LOG(args...)          G_STMT_START{ }G_STMT_END
+#define GST_HOT_LOG_OBJECT(args...)   G_STMT_START{ }G_STMT_END
+#define GST_HOT_DEBUG(args...)        G_STMT_START{ }G_STMT_END
+#define GST_HOT_DEBUG_OBJECT(args...) G_STMT_START{ }G_STMT_END
+#else
+#define GST_HOT_LOG           GST_LOG
+#define GST_HOT_LOG_OBJECT    GST_LOG_OBJECT
+#define GST_HOT_DEBUG         GST_DEBUG
+#define GST_HOT_DEBUG_OBJECT  GST_DEBUG_OBJECT
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_PROBES_H__ */
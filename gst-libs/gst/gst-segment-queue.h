@@ -0,0 +1,231 @@
+/* GStreamer
+ *
+ * gst-segment-queue.h: encoding or decoding segments of a stream on a
+ * thread pool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_SEGMENT_QUEUE_H__
+#define __GST_SEGMENT_QUEUE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstSegmentQueue GstSegmentQueue;
+typedef struct _GstSegmentQueueItem GstSegmentQueueItem;
+
+/* Called on the thread pool to encode or decode a segment */
+typedef void (*GstSegmentQueueProcessFunc) (gpointer segment,
+    gpointer user_data);
+/* Called from the streaming thread with the processed segments, in the
+ * order they were queued */
+typedef GstFlowReturn (*GstSegmentQueuePushFunc) (gpointer segment,
+    gpointer user_data);
+
+/* The element cuts its input into segments that can be processed on their
+ * own, queues them and pushes the results in stream order. The queue only
+ * keeps a bounded number of segments in flight, so the streaming thread
+ * blocks when the pool can't keep up. Only for non-live input, everything
+ * in flight adds to the latency. */
+struct _GstSegmentQueue {
+  GThreadPool *pool;
+  gint threads;
+  GMutex *lock;
+  GCond *cond;
+  GQueue *items;                /* GstSegmentQueueItem, in stream order */
+
+  GstSegmentQueueProcessFunc process;
+  GstSegmentQueuePushFunc push;
+  GDestroyNotify free_func;
+  gpointer user_data;
+};
+
+struct _GstSegmentQueueItem {
+  gpointer segment;
+  gboolean done;
+};
+
+/* runs in the thread pool */
+static inline void
+gst_segment_queue_run (GstSegmentQueueItem * item, GstSegmentQueue * queue)
+{
+  queue->process (item->segment, queue->user_data);
+
+  g_mutex_lock (queue->lock);
+  item->done = TRUE;
+  g_cond_broadcast (queue->cond);
+  g_mutex_unlock (queue->lock);
+}
+
+static inline void
+gst_segment_queue_init (GstSegmentQueue * queue,
+    GstSegmentQueueProcessFunc process, GstSegmentQueuePushFunc push,
+    GDestroyNotify free_func, gpointer user_data)
+{
+  queue->pool = NULL;
+  queue->threads = 0;
+  queue->lock = g_mutex_new ();
+  queue->cond = g_cond_new ();
+  queue->items = g_queue_new ();
+  queue->process = process;
+  queue->push = push;
+  queue->free_func = free_func;
+  queue->user_data = user_data;
+}
+
+/* Pushes the processed segments in order. Waits for all of them with
+ * @drain, otherwise only while too many segments are in flight. Without
+ * @push the segments are dropped. Stops pushing after the first flow
+ * return that isn't GST_FLOW_OK, but still frees all finished segments. */
+static inline GstFlowReturn
+gst_segment_queue_process (GstSegmentQueue * queue, gboolean drain,
+    gboolean push)
+{
+  GstFlowReturn result = GST_FLOW_OK;
+  GstSegmentQueueItem *item;
+
+  g_mutex_lock (queue->lock);
+  while ((item = g_queue_peek_head (queue->items)) != NULL) {
+    if (!item->done) {
+      if (!drain && g_queue_get_length (queue->items) <= 2 * queue->threads)
+        break;
+      g_cond_wait (queue->cond, queue->lock);
+      continue;
+    }
+    g_queue_pop_head (queue->items);
+    g_mutex_unlock (queue->lock);
+
+    if (push && result == GST_FLOW_OK)
+      result = queue->push (item->segment, queue->user_data);
+    queue->free_func (item->segment);
+    g_free (item);
+
+    g_mutex_lock (queue->lock);
+  }
+  g_mutex_unlock (queue->lock);
+
+  return result;
+}
+
+/* drops all segments and frees the thread pool */
+static inline void
+gst_segment_queue_stop (GstSegmentQueue * queue)
+{
+  if (queue->items == NULL)
+    return;
+
+  gst_segment_queue_process (queue, TRUE, FALSE);
+  if (queue->pool) {
+    g_thread_pool_free (queue->pool, FALSE, TRUE);
+    queue->pool = NULL;
+  }
+}
+
+static inline void
+gst_segment_queue_clear (GstSegmentQueue * queue)
+{
+  if (queue->items == NULL)
+    return;
+
+  gst_segment_queue_stop (queue);
+  g_mutex_free (queue->lock);
+  g_cond_free (queue->cond);
+  g_queue_free (queue->items);
+  queue->items = NULL;
+}
+
+/* Creates the thread pool or changes its size. Returns FALSE and sets @err
+ * if the pool can't be created. */
+static inline gboolean
+gst_segment_queue_set_threads (GstSegmentQueue * queue, gint threads,
+    GError ** err)
+{
+  if (queue->pool == NULL) {
+    queue->pool = g_thread_pool_new ((GFunc) gst_segment_queue_run, queue,
+        threads, FALSE, err);
+    if (queue->pool == NULL)
+      return FALSE;
+  } else {
+    g_thread_pool_set_max_threads (queue->pool, threads, NULL);
+  }
+  queue->threads = threads;
+
+  return TRUE;
+}
+
+/* Queues @segment for processing. On failure @segment is freed and @err
+ * is set. */
+static inline gboolean
+gst_segment_queue_push (GstSegmentQueue * queue, gpointer segment,
+    GError ** err)
+{
+  GstSegmentQueueItem *item;
+  GError *error = NULL;
+
+  item = g_new0 (GstSegmentQueueItem, 1);
+  item->segment = segment;
+
+  g_mutex_lock (queue->lock);
+  g_queue_push_tail (queue->items, item);
+  g_mutex_unlock (queue->lock);
+
+  g_thread_pool_push (queue->pool, item, &error);
+  if (error != NULL) {
+    g_mutex_lock (queue->lock);
+    g_queue_remove (queue->items, item);
+    g_mutex_unlock (queue->lock);
+    queue->free_func (segment);
+    g_free (item);
+    g_propagate_error (err, error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static inline gboolean
+gst_segment_queue_is_empty (GstSegmentQueue * queue)
+{
+  gboolean empty;
+
+  g_mutex_lock (queue->lock);
+  empty = g_queue_is_empty (queue->items);
+  g_mutex_unlock (queue->lock);
+
+  return empty;
+}
+
+/* Whether the data coming into @sinkpad is live. When upstream doesn't
+ * answer the latency query we can't tell, so assume it is. */
+static inline gboolean
+gst_segment_queue_upstream_is_live (GstPad * sinkpad)
+{
+  GstQuery *query;
+  gboolean live = TRUE;
+
+  query = gst_query_new_latency ();
+  if (gst_pad_peer_query (sinkpad, query))
+    gst_query_parse_latency (query, &live, NULL, NULL);
+  gst_query_unref (query);
+
+  return live;
+}
+
+G_END_DECLS
+
+#endif /* __GST_SEGMENT_QUEUE_H__ */
@@ -23,12 +23,29 @@
  * throw errors (not always necessarily) in this code path
  * (looks like they carry broken payloads/packets though) */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "asfpacket.h"
 
 #include <gst/gstutils.h>
 #include <gst/gstinfo.h>
+#include <gst/gst-probes.h>
 #include <string.h>
 
+/* Fragmented media objects up to this size are allocated in full at their
+ * first fragment. The size comes from the file, so bigger ones are joined
+ * fragment by fragment as they arrive instead. */
+#define ASF_MAX_MEDIA_OBJECT_ALLOC (16 * 1024 * 1024)
+
+/* byte range of a media object covered by the fragments received */
+typedef struct
+{
+  guint start;
+  guint end;
+} AsfFragmentRange;
+
 /* we are unlikely to deal with lengths > 2GB here any time soon, so just
  * return a signed int and use that for error reporting */
 static gint
@@ -86,41 +103,233 @@ asf_packet_create_payload_buffer (AsfPacket * packet, const guint8 ** p_data,
   return gst_buffer_create_sub (packet->buf, off, payload_len);
 }
 
+static void
+asf_payload_clear (AsfPayload * payload)
+{
+  gst_buffer_replace (&payload->buf, NULL);
+  if (payload->frags) {
+    g_array_free (payload->frags, TRUE);
+    payload->frags = NULL;
+  }
+}
+
+#define ASF_PAYLOAD_QUEUE_MIN_ALLOC 16
+
+AsfPayloadQueue *
+asf_payload_queue_new (void)
+{
+  AsfPayloadQueue *queue;
+
+  queue = g_new0 (AsfPayloadQueue, 1);
+  queue->alloc = ASF_PAYLOAD_QUEUE_MIN_ALLOC;
+  queue->payloads = g_new (AsfPayload, queue->alloc);
+
+  return queue;
+}
+
+void
+asf_payload_queue_free (AsfPayloadQueue * queue)
+{
+  asf_payload_queue_clear (queue);
+  g_free (queue->payloads);
+  g_free (queue);
+}
+
+/* returns the queued copy of @payload, which stays valid until the queue
+ * is modified again */
+AsfPayload *
+asf_payload_queue_push_tail (AsfPayloadQueue * queue,
+    const AsfPayload * payload)
+{
+  if (queue->len == queue->alloc) {
+    AsfPayload *payloads;
+    guint first;
+
+    /* grow, unwrapping the ring so the head ends up at 0 again */
+    payloads = g_new (AsfPayload, queue->alloc * 2);
+    first = queue->alloc - queue->head;
+    memcpy (payloads, queue->payloads + queue->head,
+        first * sizeof (AsfPayload));
+    memcpy (payloads + first, queue->payloads,
+        queue->head * sizeof (AsfPayload));
+    g_free (queue->payloads);
+    queue->payloads = payloads;
+    queue->head = 0;
+    queue->alloc *= 2;
+  }
+
+  ++queue->len;
+  return memcpy (asf_payload_queue_peek_tail (queue), payload,
+      sizeof (AsfPayload));
+}
+
+void
+asf_payload_queue_remove_head (AsfPayloadQueue * queue)
+{
+  g_return_if_fail (queue->len > 0);
+
+  asf_payload_clear (asf_payload_queue_peek_head (queue));
+  queue->head = (queue->head + 1) & (queue->alloc - 1);
+  --queue->len;
+}
+
+void
+asf_payload_queue_remove_tail (AsfPayloadQueue * queue)
+{
+  g_return_if_fail (queue->len > 0);
+
+  asf_payload_clear (asf_payload_queue_peek_tail (queue));
+  --queue->len;
+}
+
+void
+asf_payload_queue_clear (AsfPayloadQueue * queue)
+{
+  while (queue->len > 0)
+    asf_payload_queue_remove_tail (queue);
+  queue->head = 0;
+}
+
 static AsfPayload *
 asf_payload_find_previous_fragment (AsfPayload * payload, AsfStream * stream)
 {
   AsfPayload *ret;
 
-  if (stream->payloads->len == 0) {
+  if (asf_payload_queue_get_length (stream->payloads) == 0) {
     GST_DEBUG ("No previous fragments to merge with for stream %u", stream->id);
     return NULL;
   }
 
-  ret =
-      &g_array_index (stream->payloads, AsfPayload, stream->payloads->len - 1);
+  ret = asf_payload_queue_peek_tail (stream->payloads);
 
   if (ret->mo_size != payload->mo_size ||
-      ret->mo_number != payload->mo_number || ret->mo_offset != 0) {
+      ret->mo_number != payload->mo_number || ret->mo_offset != 0 ||
+      gst_asf_payload_is_complete (ret)) {
     GST_WARNING ("Previous fragment does not match continued fragment");
     return NULL;
   }
-#if 0
-  if (this_fragment->mo_offset + this_payload_len > first_fragment->mo_size) {
-    GST_WARNING ("Merged fragments would be bigger than the media object");
+
+  return ret;
+}
+
+/* add [start,end) to the ranges received for a media object, returns
+ * FALSE if it overlaps a fragment we already have */
+static gboolean
+asf_payload_add_range (AsfPayload * mo, guint start, guint end)
+{
+  AsfFragmentRange *r;
+  gboolean left, right;
+  guint i;
+
+  if (mo->frags == NULL)
+    mo->frags = g_array_new (FALSE, FALSE, sizeof (AsfFragmentRange));
+
+  /* the ranges are sorted and merged, so there are only a few of them */
+  r = (AsfFragmentRange *) mo->frags->data;
+  for (i = 0; i < mo->frags->len && r[i].end <= start; i++);
+
+  if (i < mo->frags->len && r[i].start < end)
     return FALSE;
+
+  left = (i > 0 && r[i - 1].end == start);
+  right = (i < mo->frags->len && r[i].start == end);
+
+  if (left && right) {
+    r[i - 1].end = r[i].end;
+    g_array_remove_index (mo->frags, i);
+  } else if (left) {
+    r[i - 1].end = end;
+  } else if (right) {
+    r[i].start = start;
+  } else {
+    AsfFragmentRange range = { start, end };
+
+    g_array_insert_val (mo->frags, i, range);
   }
-#endif
+  return TRUE;
+}
 
-  return ret;
+/* copy a fragment into the media object buffer allocated at its first
+ * fragment; fragments may arrive in any order, duplicates are ignored */
+static void
+asf_payload_add_fragment (AsfPayload * mo, guint mo_offset,
+    const guint8 * data, guint len)
+{
+  if (mo_offset >= mo->mo_size || len > mo->mo_size - mo_offset) {
+    GST_WARNING ("Fragment at offset %u with %u bytes does not fit into "
+        "media object of %u bytes", mo_offset, len, mo->mo_size);
+    return;
+  }
+
+  if (len == 0)
+    return;
+
+  if (!asf_payload_add_range (mo, mo_offset, mo_offset + len)) {
+    GST_DEBUG ("Fragment at offset %u with %u bytes overlaps data we "
+        "already have, ignoring", mo_offset, len);
+    return;
+  }
+
+  memcpy (GST_BUFFER_DATA (mo->buf) + mo_offset, data, len);
+  mo->buf_filled += len;
+
+  if (gst_asf_payload_is_complete (mo)) {
+    g_array_free (mo->frags, TRUE);
+    mo->frags = NULL;
+  }
+
+  GST_HOT_LOG ("Added fragment at offset %u, have %u/%u bytes", mo_offset,
+      mo->buf_filled, mo->mo_size);
+}
+
+/* append a fragment to a media object that was too big to allocate in full,
+ * which only works for fragments arriving in order */
+static void
+asf_payload_join_fragment (GstASFDemux * demux, AsfPayload * mo,
+    guint mo_offset, GstBuffer * frag)
+{
+  if (mo_offset != mo->buf_filled ||
+      GST_BUFFER_SIZE (frag) > mo->mo_size - mo->buf_filled) {
+    GST_WARNING_OBJECT (demux, "Fragment at offset %u with %u bytes does not "
+        "continue media object at %u/%u bytes", mo_offset,
+        GST_BUFFER_SIZE (frag), mo->buf_filled, mo->mo_size);
+    gst_buffer_unref (frag);
+    return;
+  }
+
+  /* note: buffer join/merge might not preserve buffer flags */
+  mo->buf = gst_buffer_join (mo->buf, frag);
+  mo->buf_filled += GST_BUFFER_SIZE (frag);
+  gst_element_stats_copy (&demux->stats, mo->buf_filled);
+
+  GST_HOT_LOG_OBJECT (demux, "Merged fragments, merged size: %u",
+      mo->buf_filled);
+}
+
+/* whether to allocate a fragmented media object in full at its first
+ * fragment, the size is not trusted beyond what the stream announces */
+static gboolean
+asf_payload_can_allocate (AsfStream * stream, guint mo_size)
+{
+  if (mo_size == 0 || mo_size > ASF_MAX_MEDIA_OBJECT_ALLOC)
+    return FALSE;
+
+  if (stream->ext_props.valid && stream->ext_props.max_obj_size > 0 &&
+      mo_size > stream->ext_props.max_obj_size)
+    return FALSE;
+
+  return TRUE;
 }
 
 /* TODO: if we have another payload already queued for this stream and that
  * payload doesn't have a duration, maybe we can calculate a duration for it
  * (if the previous timestamp is smaller etc. etc.) */
-static void
+static AsfPayload *
 gst_asf_payload_queue_for_stream (GstASFDemux * demux, AsfPayload * payload,
     AsfStream * stream)
 {
+  AsfPayload *queued;
+
   /* remember the first timestamp in the stream */
   if (!GST_CLOCK_TIME_IS_VALID (demux->first_ts) &&
       GST_CLOCK_TIME_IS_VALID (payload->ts)) {
@@ -131,17 +340,20 @@ gst_asf_payload_queue_for_stream (GstASFDemux * demux, AsfPayload * payload,
       gst_segment_set_seek (&demux->segment, demux->segment.rate,
           GST_FORMAT_TIME, demux->segment.flags, GST_SEEK_TYPE_SET,
           demux->first_ts, GST_SEEK_TYPE_NONE, 0, NULL);
+      /* which streams may push depends on the segment start */
+      demux->stream_heap_dirty = TRUE;
     }
   }
 
   /* better drop a few frames at the beginning than send bogus timestamps */
   if (G_UNLIKELY (payload->ts < demux->first_ts)) {
-    GST_LOG_OBJECT (stream->pad, "Dropping payload with timestamp %"
+    GST_HOT_LOG_OBJECT (stream->pad, "Dropping payload with timestamp %"
         GST_TIME_FORMAT " which is before the first timestamp %"
         GST_TIME_FORMAT, GST_TIME_ARGS (payload->ts),
         GST_TIME_ARGS (demux->first_ts));
-    gst_buffer_replace (&payload->buf, NULL);
-    return;
+    asf_payload_clear (payload);
+    gst_element_stats_dropped (&demux->stats);
+    return NULL;
   }
 
   /* make timestamps start from 0 */
@@ -149,12 +361,10 @@ gst_asf_payload_queue_for_stream (GstASFDemux * demux, AsfPayload * payload,
     payload->ts -= demux->first_ts;
 
   /* remove any incomplete payloads that will never be completed */
-  while (stream->payloads->len > 0) {
+  while (asf_payload_queue_get_length (stream->payloads) > 0) {
     AsfPayload *prev;
-    guint idx_last;
 
-    idx_last = stream->payloads->len - 1;
-    prev = &g_array_index (stream->payloads, AsfPayload, idx_last);
+    prev = asf_payload_queue_peek_tail (stream->payloads);
 
     if (gst_asf_payload_is_complete (prev))
       break;
@@ -162,8 +372,8 @@ gst_asf_payload_queue_for_stream (GstASFDemux * demux, AsfPayload * payload,
     GST_DEBUG_OBJECT (demux, "Dropping incomplete fragmented media object "
         "queued for stream %u", stream->id);
 
-    gst_buffer_replace (&prev->buf, NULL);
-    g_array_remove_index (stream->payloads, idx_last);
+    asf_payload_queue_remove_tail (stream->payloads);
+    gst_element_stats_dropped (&demux->stats);
 
     /* there's data missing, so there's a discontinuity now */
     GST_BUFFER_FLAG_SET (payload->buf, GST_BUFFER_FLAG_DISCONT);
@@ -179,22 +389,24 @@ gst_asf_payload_queue_for_stream (GstASFDemux * demux, AsfPayload * payload,
       payload->ts < demux->segment.start && payload->keyframe) {
     GST_DEBUG_OBJECT (demux, "Queueing keyframe before segment start, removing"
         " %u previously-queued payloads, which would be out of segment too and"
-        " hence don't have to be decoded", stream->payloads->len);
-    while (stream->payloads->len > 0) {
-      AsfPayload *last;
-      guint idx_last;
-
-      idx_last = stream->payloads->len - 1;
-      last = &g_array_index (stream->payloads, AsfPayload, idx_last);
-      gst_buffer_replace (&last->buf, NULL);
-      g_array_remove_index (stream->payloads, idx_last);
-    }
+        " hence don't have to be decoded",
+        asf_payload_queue_get_length (stream->payloads));
+    asf_payload_queue_clear (stream->payloads);
 
     /* Mark discontinuity (should be done via stream->discont anyway though) */
     GST_BUFFER_FLAG_SET (payload->buf, GST_BUFFER_FLAG_DISCONT);
   }
 
-  g_array_append_vals (stream->payloads, payload, 1);
+  /* remember where key frames start for seeking, the current packet is the
+   * one the media object starts in */
+  if (!demux->streaming && payload->keyframe && payload->mo_offset == 0)
+    gst_asf_demux_add_keyframe_entry (demux, stream, payload->ts,
+        demux->packet);
+
+  queued = asf_payload_queue_push_tail (stream->payloads, payload);
+  gst_asf_demux_update_stream_heap (demux, stream);
+
+  return queued;
 }
 
 static void
@@ -262,9 +474,10 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
 
   is_compressed = (payload.rep_data_len == 1);
 
-  GST_LOG_OBJECT (demux, "payload for stream %u", stream_num);
-  GST_LOG_OBJECT (demux, "keyframe   : %s", (payload.keyframe) ? "yes" : "no");
-  GST_LOG_OBJECT (demux, "compressed : %s", (is_compressed) ? "yes" : "no");
+  GST_HOT_LOG_OBJECT (demux, "payload for stream %u", stream_num);
+  GST_HOT_LOG_OBJECT (demux, "keyframe   : %s",
+      (payload.keyframe) ? "yes" : "no");
+  GST_HOT_LOG_OBJECT (demux, "compressed : %s", (is_compressed) ? "yes" : "no");
 
   if (*p_size < payload.rep_data_len) {
     GST_WARNING_OBJECT (demux, "Short packet! rep_data_len=%u, size=%u",
@@ -295,7 +508,8 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
     payload_len = *p_size;
   }
 
-  GST_LOG_OBJECT (demux, "payload length: %u", payload_len);
+  GST_HOT_LOG_OBJECT (demux, "payload length: %u", payload_len);
+  GST_PROBE_PACKET (demux, stream_num, payload_len);
 
   stream = gst_asf_demux_get_stream (demux, stream_num);
 
@@ -308,7 +522,8 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
   }
 
   if (!is_compressed) {
-    GST_LOG_OBJECT (demux, "replicated data length: %u", payload.rep_data_len);
+    GST_HOT_LOG_OBJECT (demux, "replicated data length: %u",
+        payload.rep_data_len);
 
     if (payload.rep_data_len >= 8) {
       payload.mo_size = GST_READ_UINT32_LE (payload.rep_data);
@@ -316,10 +531,10 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
       payload.ts -= demux->preroll * GST_MSECOND;
       asf_payload_parse_replicated_data_extensions (stream, &payload);
 
-      GST_LOG_OBJECT (demux, "media object size   : %u", payload.mo_size);
-      GST_LOG_OBJECT (demux, "media object ts     : %" GST_TIME_FORMAT,
+      GST_HOT_LOG_OBJECT (demux, "media object size   : %u", payload.mo_size);
+      GST_HOT_LOG_OBJECT (demux, "media object ts     : %" GST_TIME_FORMAT,
           GST_TIME_ARGS (payload.ts));
-      GST_LOG_OBJECT (demux, "media object dur    : %" GST_TIME_FORMAT,
+      GST_HOT_LOG_OBJECT (demux, "media object dur    : %" GST_TIME_FORMAT,
           GST_TIME_ARGS (payload.duration));
     } else if (payload.rep_data_len != 0) {
       GST_WARNING_OBJECT (demux, "invalid replicated data length, very bad");
@@ -328,32 +543,69 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
       return FALSE;
     }
 
-    GST_LOG_OBJECT (demux, "media object offset : %u", payload.mo_offset);
+    GST_HOT_LOG_OBJECT (demux, "media object offset : %u", payload.mo_offset);
 
-    GST_LOG_OBJECT (demux, "payload length: %u", payload_len);
+    GST_HOT_LOG_OBJECT (demux, "payload length: %u", payload_len);
 
     if ((stream = gst_asf_demux_get_stream (demux, stream_num))) {
-      payload.buf = asf_packet_create_payload_buffer (packet, p_data, p_size,
-          payload_len);
-
-      /* n-th fragment of a fragmented media object? */
-      if (payload.mo_offset != 0) {
-        AsfPayload *prev;
+      if (payload.mo_offset == 0 && payload.mo_size <= payload_len) {
+        /* the whole media object is in this payload */
+        payload.buf = asf_packet_create_payload_buffer (packet, p_data, p_size,
+            payload_len);
+        payload.buf_filled = payload_len;
+        gst_asf_payload_queue_for_stream (demux, &payload, stream);
+      } else {
+        AsfPayload *prev, *queued;
+        const guint8 *frag_data = *p_data;
+        guint frag_size = *p_size;
 
+        /* fragmented media object: allocate it all at the first fragment we
+         * see and copy every fragment into place, unless it is too big */
         if ((prev = asf_payload_find_previous_fragment (&payload, stream))) {
-          if (payload.mo_offset != GST_BUFFER_SIZE (prev->buf)) {
-            GST_WARNING_OBJECT (demux, "Offset doesn't match previous data?!");
+          if (GST_BUFFER_SIZE (prev->buf) == prev->mo_size) {
+            asf_payload_add_fragment (prev, payload.mo_offset, *p_data,
+                payload_len);
+            gst_element_stats_copy (&demux->stats, payload_len);
+          } else {
+            asf_payload_join_fragment (demux, prev, payload.mo_offset,
+                asf_packet_create_payload_buffer (packet, &frag_data,
+                    &frag_size, payload_len));
+          }
+          gst_asf_demux_update_stream_heap (demux, stream);
+        } else if (!asf_payload_can_allocate (stream, payload.mo_size)) {
+          if (payload.mo_offset == 0 && payload.mo_size > 0) {
+            GST_DEBUG_OBJECT (demux, "Media object of %u bytes, joining its "
+                "fragments", payload.mo_size);
+            payload.buf = asf_packet_create_payload_buffer (packet,
+                &frag_data, &frag_size, payload_len);
+            payload.buf_filled = payload_len;
+            gst_asf_payload_queue_for_stream (demux, &payload, stream);
+          } else {
+            GST_WARNING_OBJECT (demux, "Dropping fragment at offset %u of "
+                "media object of %u bytes", payload.mo_offset,
+                payload.mo_size);
           }
-          /* note: buffer join/merge might not preserve buffer flags */
-          prev->buf = gst_buffer_join (prev->buf, payload.buf);
-          GST_LOG_OBJECT (demux, "Merged fragments, merged size: %u",
-              GST_BUFFER_SIZE (prev->buf));
         } else {
-          gst_buffer_unref (payload.buf);
+          if (payload.mo_offset != 0) {
+            GST_DEBUG_OBJECT (demux, "Fragment at offset %u without previous "
+                "fragments, starting new media object", payload.mo_offset);
+          }
+          payload.buf = gst_buffer_new_and_alloc (payload.mo_size);
+          payload.buf_filled = 0;
+          asf_payload_add_fragment (&payload, payload.mo_offset, *p_data,
+              payload_len);
+          gst_element_stats_copy (&demux->stats, payload_len);
+          /* queued with its real offset, so it isn't indexed as the start
+           * of a key frame, but later fragments are matched against a
+           * first fragment */
+          queued = gst_asf_payload_queue_for_stream (demux, &payload, stream);
+          if (queued != NULL)
+            queued->mo_offset = 0;
         }
         payload.buf = NULL;
-      } else {
-        gst_asf_payload_queue_for_stream (demux, &payload, stream);
+
+        *p_data += payload_len;
+        *p_size -= payload_len;
       }
     }
   } else {
@@ -361,7 +613,7 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
     GstClockTime ts, ts_delta;
     guint num;
 
-    GST_LOG_OBJECT (demux, "Compressed payload, length=%u", payload_len);
+    GST_HOT_LOG_OBJECT (demux, "Compressed payload, length=%u", payload_len);
 
     payload_data = *p_data;
 
@@ -376,7 +628,7 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
 
       sub_payload_len = GST_READ_UINT8 (payload_data);
 
-      GST_LOG_OBJECT (demux, "subpayload #%u: len=%u, ts=%" GST_TIME_FORMAT,
+      GST_HOT_LOG_OBJECT (demux, "subpayload #%u: len=%u, ts=%" GST_TIME_FORMAT,
           num, sub_payload_len, GST_TIME_ARGS (ts));
 
       ++payload_data;
@@ -391,6 +643,7 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
         payload.buf = asf_packet_create_payload_buffer (packet,
             &payload_data, &payload_len, sub_payload_len);
 
+        payload.buf_filled = sub_payload_len;
         payload.ts = ts;
         payload.duration = ts_delta;
 
@@ -404,25 +657,22 @@ gst_asf_demux_parse_payload (GstASFDemux * demux, AsfPacket * packet,
   return TRUE;
 }
 
-gboolean
-gst_asf_demux_parse_packet (GstASFDemux * demux, GstBuffer * buf)
+/* parses the packet header and returns the number of payloads (0 for a
+ * single payload) and their length type, or -1 for a broken packet */
+static gint
+asf_packet_parse_header (GstASFDemux * demux, AsfPacket * packet,
+    const guint8 ** p_data, guint * p_size, guint * p_lentype)
 {
-  AsfPacket packet = { 0, };
-  const guint8 *data;
+  const guint8 *data = *p_data;
+  guint size = *p_size;
   gboolean has_multiple_payloads;
-  gboolean ret = TRUE;
   guint8 ec_flags, flags1;
-  guint size;
-
-  data = GST_BUFFER_DATA (buf);
-  size = GST_BUFFER_SIZE (buf);
+  gint num = 0;
 
   /* need at least two payload flag bytes, send time, and duration */
   if (size < 2 + 4 + 2)
     goto short_packet;
 
-  packet.buf = buf;
-
   ec_flags = GST_READ_UINT8 (data);
 
   /* skip optional error correction stuff */
@@ -437,7 +687,7 @@ gst_asf_demux_parse_packet (GstASFDemux * demux, GstBuffer * buf)
           ec_len_type);
       ec_len = 2;
     }
-    GST_LOG ("packet has error correction (%u bytes)", ec_len);
+    GST_HOT_LOG ("packet has error correction (%u bytes)", ec_len);
 
     /* still need at least two payload flag bytes, send time, and duration */
     if (size <= (1 + ec_len) + 2 + 4 + 2)
@@ -449,65 +699,99 @@ gst_asf_demux_parse_packet (GstASFDemux * demux, GstBuffer * buf)
 
   /* parse payload info */
   flags1 = GST_READ_UINT8 (data);
-  packet.prop_flags = GST_READ_UINT8 (data + 1);
+  packet->prop_flags = GST_READ_UINT8 (data + 1);
 
   data += 2;
   size -= 2;
 
   has_multiple_payloads = (flags1 & 0x01) != 0;
 
-  packet.length = asf_packet_read_varlen_int (flags1, 5, &data, &size);
+  packet->length = asf_packet_read_varlen_int (flags1, 5, &data, &size);
 
-  packet.sequence = asf_packet_read_varlen_int (flags1, 1, &data, &size);
+  packet->sequence = asf_packet_read_varlen_int (flags1, 1, &data, &size);
 
-  packet.padding = asf_packet_read_varlen_int (flags1, 3, &data, &size);
+  packet->padding = asf_packet_read_varlen_int (flags1, 3, &data, &size);
 
   if (size < 6)
     goto short_packet;
 
-  packet.send_time = GST_READ_UINT32_LE (data) * GST_MSECOND;
-  packet.duration = GST_READ_UINT16_LE (data + 4) * GST_MSECOND;
+  packet->send_time = GST_READ_UINT32_LE (data) * GST_MSECOND;
+  packet->duration = GST_READ_UINT16_LE (data + 4) * GST_MSECOND;
 
   data += 4 + 2;
   size -= 4 + 2;
 
-  GST_LOG_OBJECT (demux, "multiple payloads: %u", has_multiple_payloads);
-  GST_LOG_OBJECT (demux, "packet length    : %u", packet.length);
-  GST_LOG_OBJECT (demux, "sequence         : %u", packet.sequence);
-  GST_LOG_OBJECT (demux, "padding          : %u", packet.padding);
-  GST_LOG_OBJECT (demux, "send time        : %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (packet.send_time));
-  GST_LOG_OBJECT (demux, "duration         : %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (packet.duration));
+  GST_HOT_LOG_OBJECT (demux, "multiple payloads: %u", has_multiple_payloads);
+  GST_HOT_LOG_OBJECT (demux, "packet length    : %u", packet->length);
+  GST_HOT_LOG_OBJECT (demux, "sequence         : %u", packet->sequence);
+  GST_HOT_LOG_OBJECT (demux, "padding          : %u", packet->padding);
+  GST_HOT_LOG_OBJECT (demux, "send time        : %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (packet->send_time));
+  GST_HOT_LOG_OBJECT (demux, "duration         : %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (packet->duration));
 
-  if (packet.padding == (guint) - 1 || size < packet.padding)
+  if (packet->padding == (guint) - 1 || size < packet->padding)
     goto short_packet;
 
-  size -= packet.padding;
+  size -= packet->padding;
 
   /* adjust available size for parsing if there's less actual packet data for
    * parsing than there is data in bytes (for sample see bug 431318) */
-  if (packet.length != 0 && packet.length < demux->packet_size) {
-    GST_LOG_OBJECT (demux, "shortened packet, adjusting available data size");
-    size -= (demux->packet_size - packet.length);
+  if (packet->length != 0 && packet->length < demux->packet_size) {
+    GST_HOT_LOG_OBJECT (demux,
+        "shortened packet, adjusting available data size");
+    size -= (demux->packet_size - packet->length);
   }
 
   if (has_multiple_payloads) {
-    guint i, num, lentype;
-
     if (size < 1)
       goto short_packet;
 
     num = (GST_READ_UINT8 (data) & 0x3F) >> 0;
-    lentype = (GST_READ_UINT8 (data) & 0xC0) >> 6;
+    *p_lentype = (GST_READ_UINT8 (data) & 0xC0) >> 6;
 
     ++data;
     --size;
 
-    GST_LOG_OBJECT (demux, "num payloads     : %u", num);
+    GST_HOT_LOG_OBJECT (demux, "num payloads     : %u", num);
+  }
+
+  *p_data = data;
+  *p_size = size;
+
+  return num;
+
+/* ERRORS */
+short_packet:
+  {
+    GST_WARNING_OBJECT (demux, "Short packet!");
+    return -1;
+  }
+}
+
+gboolean
+gst_asf_demux_parse_packet (GstASFDemux * demux, GstBuffer * buf)
+{
+  AsfPacket packet = { 0, };
+  const guint8 *data;
+  gboolean ret = TRUE;
+  guint size, lentype;
+  gint num;
+
+  data = GST_BUFFER_DATA (buf);
+  size = GST_BUFFER_SIZE (buf);
+
+  packet.buf = buf;
+
+  num = asf_packet_parse_header (demux, &packet, &data, &size, &lentype);
+  if (num < 0)
+    return FALSE;
+
+  if (num > 0) {
+    gint i;
 
     for (i = 0; i < num; ++i) {
-      GST_LOG_OBJECT (demux, "Parsing payload %u/%u", i + 1, num);
+      GST_HOT_LOG_OBJECT (demux, "Parsing payload %u/%u", i + 1, num);
 
       ret = gst_asf_demux_parse_payload (demux, &packet, lentype, &data, &size);
 
@@ -517,16 +801,91 @@ gst_asf_demux_parse_packet (GstASFDemux * demux, GstBuffer * buf)
       }
     }
   } else {
-    GST_LOG_OBJECT (demux, "Parsing single payload");
+    GST_HOT_LOG_OBJECT (demux, "Parsing single payload");
     ret = gst_asf_demux_parse_payload (demux, &packet, -1, &data, &size);
   }
 
   return ret;
+}
 
-/* ERRORS */
-short_packet:
-  {
-    GST_WARNING_OBJECT (demux, "Short packet!");
+/* Only looks at the payload headers of a packet and adds the key frames that
+ * start in it to the keyframe index, without creating any buffers. */
+gboolean
+gst_asf_demux_scan_packet (GstASFDemux * demux, GstBuffer * buf,
+    guint64 packet_num)
+{
+  AsfPacket packet = { 0, };
+  const guint8 *data;
+  guint size, lentype;
+  gint num, i;
+
+  data = GST_BUFFER_DATA (buf);
+  size = GST_BUFFER_SIZE (buf);
+
+  num = asf_packet_parse_header (demux, &packet, &data, &size, &lentype);
+  if (num < 0)
     return FALSE;
+
+  for (i = 0; i < MAX (num, 1); ++i) {
+    AsfStream *stream;
+    const guint8 *rep_data;
+    guint stream_num, mo_offset, rep_data_len, payload_len;
+    gboolean keyframe;
+    gint val;
+
+    if (size < 1)
+      return FALSE;
+
+    stream_num = GST_READ_UINT8 (data) & 0x7f;
+    keyframe = ((GST_READ_UINT8 (data) & 0x80) != 0);
+    ++data;
+    --size;
+
+    /* media object number */
+    if (asf_packet_read_varlen_int (packet.prop_flags, 4, &data, &size) < 0)
+      return FALSE;
+    if ((val = asf_packet_read_varlen_int (packet.prop_flags, 2, &data,
+                &size)) < 0)
+      return FALSE;
+    mo_offset = val;
+    if ((val = asf_packet_read_varlen_int (packet.prop_flags, 0, &data,
+                &size)) < 0)
+      return FALSE;
+    rep_data_len = val;
+
+    if (size < rep_data_len)
+      return FALSE;
+    rep_data = data;
+    data += rep_data_len;
+    size -= rep_data_len;
+
+    if (num > 0) {
+      if ((val = asf_packet_read_varlen_int (lentype, 0, &data, &size)) < 0)
+        return FALSE;
+      payload_len = val;
+      if (size < payload_len)
+        return FALSE;
+    } else {
+      payload_len = size;
+    }
+
+    /* same conditions as for indexing while parsing, see
+     * gst_asf_payload_queue_for_stream() */
+    if (keyframe && mo_offset == 0 && rep_data_len >= 8 &&
+        GST_CLOCK_TIME_IS_VALID (demux->first_ts) &&
+        (stream = gst_asf_demux_get_stream (demux, stream_num))) {
+      GstClockTime ts;
+
+      ts = GST_READ_UINT32_LE (rep_data + 4) * GST_MSECOND;
+      ts -= demux->preroll * GST_MSECOND;
+      if (ts >= demux->first_ts)
+        gst_asf_demux_add_keyframe_entry (demux, stream, ts - demux->first_ts,
+            packet_num);
+    }
+
+    data += payload_len;
+    size -= payload_len;
   }
+
+  return TRUE;
 }
@@ -37,8 +37,18 @@ typedef struct {
   GstClockTime  ts;
   GstClockTime  duration;          /* is not always available                */
   GstBuffer    *buf;
+  guint         buf_filled;        /* bytes of the media object received   */
+  GArray       *frags;             /* ranges received while incomplete     */
 } AsfPayload;
 
+/* ring buffer of the payloads queued for a stream */
+struct _AsfPayloadQueue {
+  AsfPayload   *payloads;
+  guint         head;              /* index of the first payload           */
+  guint         len;               /* number of queued payloads            */
+  guint         alloc;             /* allocated payloads, a power of two   */
+};
+
 typedef struct {
   GstBuffer    *buf;
   guint         length;            /* packet length (unused)               */
@@ -52,8 +62,27 @@ typedef struct {
 
 gboolean   gst_asf_demux_parse_packet (GstASFDemux * demux, GstBuffer * buf);
 
+gboolean   gst_asf_demux_scan_packet (GstASFDemux * demux, GstBuffer * buf,
+                                      guint64 packet_num);
+
+AsfPayloadQueue * asf_payload_queue_new (void);
+void              asf_payload_queue_free (AsfPayloadQueue * queue);
+AsfPayload *      asf_payload_queue_push_tail (AsfPayloadQueue * queue,
+                                               const AsfPayload * payload);
+void              asf_payload_queue_remove_head (AsfPayloadQueue * queue);
+void              asf_payload_queue_remove_tail (AsfPayloadQueue * queue);
+void              asf_payload_queue_clear (AsfPayloadQueue * queue);
+
+#define asf_payload_queue_get_length(queue) ((queue)->len)
+#define asf_payload_queue_peek_nth(queue,n) \
+    (&(queue)->payloads[((queue)->head + (n)) & ((queue)->alloc - 1)])
+#define asf_payload_queue_peek_head(queue) \
+    asf_payload_queue_peek_nth ((queue), 0)
+#define asf_payload_queue_peek_tail(queue) \
+    asf_payload_queue_peek_nth ((queue), (queue)->len - 1)
+
 #define gst_asf_payload_is_complete(payload) \
-    (GST_BUFFER_SIZE ((payload)->buf) >= (payload)->mo_size)
+    ((payload)->buf_filled >= (payload)->mo_size)
 
 G_END_DECLS
 
@@ -29,7 +29,7 @@
 #include "gstrtspwms.h"
 #include "gstrtpasfdepay.h"
 
-/* #include "gstasfmux.h" */
+#include "gstasfmux.h"
 
 static gboolean
 plugin_init (GstPlugin * plugin)
@@ -57,10 +57,9 @@ plugin_init (GstPlugin * plugin)
           GST_TYPE_RTP_ASF_DEPAY)) {
     return FALSE;
   }
-/*
-  if (!gst_element_register (plugin, "asfmux", GST_RANK_NONE, GST_TYPE_ASFMUX))
+  if (!gst_element_register (plugin, "asfmux", GST_RANK_NONE, GST_TYPE_ASFMUX)) {
     return FALSE;
-*/
+  }
 
   return TRUE;
 }
@@ -35,6 +35,7 @@
 #include <gst/gstutils.h>
 #include <gst/riff/riff-media.h>
 #include <gst/gst-i18n-plugin.h>
+#include <gst/gst-probes.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -42,6 +43,26 @@
 #include "asfheaders.h"
 #include "asfpacket.h"
 
+/* In pull mode, packets are read in spans of about this much time worth of
+ * data at the file bitrate, bounded by the minimum and maximum span size */
+#define GST_ASF_DEMUX_PULL_SPAN_TIME   (GST_SECOND / 2)
+#define GST_ASF_DEMUX_PULL_SPAN_MIN    (32 * 1024)
+#define GST_ASF_DEMUX_PULL_SPAN_MAX    (256 * 1024)
+
+/* minimum distance between two entries of the keyframe index */
+#define GST_ASF_DEMUX_KIDX_MIN_INTERVAL  (GST_SECOND / 4)
+/* bytes pulled at once by the keyframe scanning thread */
+#define GST_ASF_DEMUX_KIDX_SCAN_SPAN     GST_ASF_DEMUX_PULL_SPAN_MAX
+
+#define DEFAULT_SCAN_KEYFRAMES  FALSE
+
+enum
+{
+  PROP_0,
+  PROP_STATS,
+  PROP_SCAN_KEYFRAMES
+};
+
 static GstStaticPadTemplate gst_asf_demux_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -74,6 +95,11 @@ GST_STATIC_PAD_TEMPLATE ("video_%02d",
 
 GST_DEBUG_CATEGORY (asfdemux_dbg);
 
+static void gst_asf_demux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_asf_demux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_asf_demux_finalize (GObject * object);
 static GstStateChangeReturn gst_asf_demux_change_state (GstElement * element,
     GstStateChange transition);
 static gboolean gst_asf_demux_element_send_event (GstElement * element,
@@ -94,8 +120,13 @@ static void
 gst_asf_demux_process_queued_extended_stream_objects (GstASFDemux * demux);
 static void gst_asf_demux_activate_ext_props_streams (GstASFDemux * demux);
 static gboolean gst_asf_demux_pull_headers (GstASFDemux * demux);
+static gboolean gst_asf_demux_pull_data (GstASFDemux * demux, guint64 offset,
+    guint size, GstBuffer ** p_buf, GstFlowReturn * p_flow);
 static void gst_asf_demux_pull_indices (GstASFDemux * demux);
+static gboolean gst_asf_demux_pull_packet (GstASFDemux * demux,
+    guint64 offset, GstBuffer ** p_buf, GstFlowReturn * p_flow);
 static void gst_asf_demux_reset_stream_state_after_discont (GstASFDemux * asf);
+static void gst_asf_demux_stop_keyframe_scan (GstASFDemux * demux);
 static gboolean
 gst_asf_demux_parse_data_object_start (GstASFDemux * demux, guint8 * data);
 static void gst_asf_demux_descramble_buffer (GstASFDemux * demux,
@@ -131,16 +162,65 @@ gst_asf_demux_base_init (gpointer g_class)
 static void
 gst_asf_demux_class_init (GstASFDemuxClass * klass)
 {
+  GObjectClass *gobject_class;
   GstElementClass *gstelement_class;
 
+  gobject_class = (GObjectClass *) klass;
   gstelement_class = (GstElementClass *) klass;
 
+  gobject_class->set_property = gst_asf_demux_set_property;
+  gobject_class->get_property = gst_asf_demux_get_property;
+  gobject_class->finalize = gst_asf_demux_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      gst_element_stats_param_spec ());
+  g_object_class_install_property (gobject_class, PROP_SCAN_KEYFRAMES,
+      g_param_spec_boolean ("scan-keyframes", "Scan keyframes",
+          "Read ahead while playing files without an index to find the key "
+          "frames for seeking", DEFAULT_SCAN_KEYFRAMES, G_PARAM_READWRITE));
+
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_asf_demux_change_state);
   gstelement_class->send_event =
       GST_DEBUG_FUNCPTR (gst_asf_demux_element_send_event);
 }
 
+static void
+gst_asf_demux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstASFDemux *demux = GST_ASF_DEMUX (object);
+
+  switch (prop_id) {
+    case PROP_SCAN_KEYFRAMES:
+      demux->scan_keyframes = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_asf_demux_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstASFDemux *demux = GST_ASF_DEMUX (object);
+
+  switch (prop_id) {
+    case PROP_STATS:
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&demux->stats, "asfdemux-stats"));
+      break;
+    case PROP_SCAN_KEYFRAMES:
+      g_value_set_boolean (value, demux->scan_keyframes);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static void
 gst_asf_demux_free_stream (GstASFDemux * demux, AsfStream * stream)
 {
@@ -159,7 +239,7 @@ gst_asf_demux_free_stream (GstASFDemux * demux, AsfStream * stream)
     stream->pad = NULL;
   }
   if (stream->payloads) {
-    g_array_free (stream->payloads, TRUE);
+    asf_payload_queue_free (stream->payloads);
     stream->payloads = NULL;
   }
   if (stream->ext_props.valid) {
@@ -173,6 +253,8 @@ gst_asf_demux_reset (GstASFDemux * demux)
 {
   GST_LOG_OBJECT (demux, "resetting");
 
+  gst_asf_demux_stop_keyframe_scan (demux);
+
   gst_segment_init (&demux->segment, GST_FORMAT_UNDEFINED);
   demux->segment_running = FALSE;
   if (demux->adapter) {
@@ -207,6 +289,8 @@ gst_asf_demux_reset (GstASFDemux * demux)
   demux->num_video_streams = 0;
   demux->num_streams = 0;
   demux->activated_streams = FALSE;
+  demux->stream_heap_len = 0;
+  demux->stream_heap_dirty = TRUE;
   demux->first_ts = GST_CLOCK_TIME_NONE;
   demux->state = GST_ASF_DEMUX_STATE_HEADER;
   demux->seekable = FALSE;
@@ -215,6 +299,15 @@ gst_asf_demux_reset (GstASFDemux * demux)
   demux->sidx_num_entries = 0;
   g_free (demux->sidx_entries);
   demux->sidx_entries = NULL;
+  if (demux->kidx_entries) {
+    g_array_free (demux->kidx_entries, TRUE);
+    demux->kidx_entries = NULL;
+  }
+  demux->kidx_stream_id = 0;
+  demux->kidx_next_packet = 0;
+  gst_buffer_replace (&demux->pull_buf, NULL);
+  demux->pull_buf_offset = 0;
+  demux->max_bitrate = 0;
 }
 
 static void
@@ -242,6 +335,18 @@ gst_asf_demux_init (GstASFDemux * demux, GstASFDemuxClass * klass)
   demux->taglist = NULL;
   demux->first_ts = GST_CLOCK_TIME_NONE;
   demux->state = GST_ASF_DEMUX_STATE_HEADER;
+  demux->scan_keyframes = DEFAULT_SCAN_KEYFRAMES;
+  demux->kidx_lock = g_mutex_new ();
+}
+
+static void
+gst_asf_demux_finalize (GObject * object)
+{
+  GstASFDemux *demux = GST_ASF_DEMUX (object);
+
+  g_mutex_free (demux->kidx_lock);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 static gboolean
@@ -281,6 +386,7 @@ gst_asf_demux_activate_pull (GstPad * pad, gboolean active)
     return gst_pad_start_task (pad, (GstTaskFunction) gst_asf_demux_loop,
         demux);
   } else {
+    gst_asf_demux_stop_keyframe_scan (demux);
     return gst_pad_stop_task (pad);
   }
 }
@@ -354,16 +460,263 @@ gst_asf_demux_sink_event (GstPad * pad, GstEvent * event)
   return ret;
 }
 
+/* returns the number of keyframe index entries with a timestamp <= @ts */
+static guint
+gst_asf_demux_keyframe_index_search (GstASFDemux * demux, GstClockTime ts)
+{
+  guint lo = 0, hi = demux->kidx_entries->len;
+
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    if (g_array_index (demux->kidx_entries, AsfKeyframeEntry, mid).ts <= ts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void
+gst_asf_demux_add_keyframe_entry (GstASFDemux * demux, AsfStream * stream,
+    GstClockTime ts, guint64 packet)
+{
+  AsfKeyframeEntry entry;
+  guint idx, len;
+
+  if (demux->sidx_num_entries > 0 || !GST_CLOCK_TIME_IS_VALID (ts))
+    return;
+
+  g_mutex_lock (demux->kidx_lock);
+
+  /* index the key frames of the first video stream, or of the first stream
+   * if there is no video */
+  if (demux->kidx_stream_id == 0) {
+    guint i;
+
+    demux->kidx_stream_id = demux->stream[0].id;
+    for (i = 0; i < demux->num_streams; ++i) {
+      if (demux->stream[i].is_video) {
+        demux->kidx_stream_id = demux->stream[i].id;
+        break;
+      }
+    }
+    GST_DEBUG_OBJECT (demux, "building keyframe index for stream %u",
+        demux->kidx_stream_id);
+  }
+
+  if (stream->id != demux->kidx_stream_id)
+    goto done;
+
+  if (demux->kidx_entries == NULL) {
+    demux->kidx_entries = g_array_new (FALSE, FALSE,
+        sizeof (AsfKeyframeEntry));
+  }
+
+  idx = gst_asf_demux_keyframe_index_search (demux, ts);
+  len = demux->kidx_entries->len;
+
+  /* keep the index sparse, this also drops entries we already have */
+  if (idx > 0) {
+    AsfKeyframeEntry *prev;
+
+    prev = &g_array_index (demux->kidx_entries, AsfKeyframeEntry, idx - 1);
+    if (ts - prev->ts < GST_ASF_DEMUX_KIDX_MIN_INTERVAL || prev->packet > packet)
+      goto done;
+  }
+  if (idx < len) {
+    AsfKeyframeEntry *next;
+
+    next = &g_array_index (demux->kidx_entries, AsfKeyframeEntry, idx);
+    if (next->ts - ts < GST_ASF_DEMUX_KIDX_MIN_INTERVAL || next->packet < packet)
+      goto done;
+  }
+
+  entry.ts = ts;
+  entry.packet = packet;
+
+  GST_LOG_OBJECT (demux, "keyframe at %" GST_TIME_FORMAT " in packet %u",
+      GST_TIME_ARGS (ts), entry.packet);
+
+  if (idx == len)
+    g_array_append_val (demux->kidx_entries, entry);
+  else
+    g_array_insert_val (demux->kidx_entries, idx, entry);
+
+done:
+  g_mutex_unlock (demux->kidx_lock);
+}
+
+/* extend the keyframe index by scanning the payload headers of the packets
+ * following the ones already indexed. Runs in a low priority thread of its
+ * own when the scan-keyframes property is set, so the streaming task never
+ * waits for it; the packets are pulled in large sequential spans directly
+ * and not through the span the task is reading. */
+static gpointer
+gst_asf_demux_scan_keyframes (GstASFDemux * demux)
+{
+  GstBuffer *buf, *packet;
+  guint64 off, next;
+  guint i, num, max_num;
+
+  GST_DEBUG_OBJECT (demux, "keyframe scan started");
+
+  max_num = MAX (GST_ASF_DEMUX_KIDX_SCAN_SPAN / demux->packet_size, 1);
+
+  g_mutex_lock (demux->kidx_lock);
+  while (!demux->kidx_stop && demux->scan_keyframes &&
+      demux->kidx_next_packet < demux->num_packets) {
+    next = demux->kidx_next_packet;
+    g_mutex_unlock (demux->kidx_lock);
+
+    num = MIN (max_num, demux->num_packets - next);
+    off = demux->data_offset + next * demux->packet_size;
+    if (!gst_asf_demux_pull_data (demux, off, num * demux->packet_size, &buf,
+            NULL)) {
+      g_mutex_lock (demux->kidx_lock);
+      break;
+    }
+
+    /* adding the entries takes the lock */
+    for (i = 0; i < num; ++i) {
+      packet = gst_buffer_create_sub (buf, i * demux->packet_size,
+          demux->packet_size);
+      /* broken packets are skipped just like while parsing */
+      if (!gst_asf_demux_scan_packet (demux, packet, next + i)) {
+        GST_DEBUG_OBJECT (demux, "could not scan packet %u",
+            (guint) (next + i));
+      }
+      gst_buffer_unref (packet);
+    }
+    gst_buffer_unref (buf);
+
+    g_mutex_lock (demux->kidx_lock);
+    /* the streaming task may have parsed past us in the meantime */
+    demux->kidx_next_packet = MAX (demux->kidx_next_packet, next + num);
+  }
+
+  if (demux->kidx_next_packet >= demux->num_packets) {
+    GST_DEBUG_OBJECT (demux, "keyframe index complete, %u entries",
+        demux->kidx_entries ? demux->kidx_entries->len : 0);
+  }
+  g_mutex_unlock (demux->kidx_lock);
+
+  return NULL;
+}
+
+/* called from the streaming task. The thread is only started once per
+ * activation or seek, if it stops early because of a pull error the index
+ * stays incomplete and seeking falls back to estimating */
+static void
+gst_asf_demux_start_keyframe_scan (GstASFDemux * demux)
+{
+  GError *err = NULL;
+
+  if (demux->kidx_thread != NULL || demux->sidx_num_entries > 0 ||
+      demux->packet_size == 0 || !GST_CLOCK_TIME_IS_VALID (demux->first_ts))
+    return;
+
+  g_mutex_lock (demux->kidx_lock);
+  if (demux->kidx_next_packet < demux->num_packets) {
+    demux->kidx_stop = FALSE;
+    demux->kidx_thread =
+        g_thread_create_full ((GThreadFunc) gst_asf_demux_scan_keyframes,
+        demux, 0, TRUE, FALSE, G_THREAD_PRIORITY_LOW, &err);
+    if (demux->kidx_thread == NULL) {
+      GST_WARNING_OBJECT (demux, "could not start keyframe scan: %s",
+          err->message);
+      g_error_free (err);
+    }
+  }
+  g_mutex_unlock (demux->kidx_lock);
+}
+
+/* must not be called from the scanning thread */
+static void
+gst_asf_demux_stop_keyframe_scan (GstASFDemux * demux)
+{
+  GThread *thread;
+
+  g_mutex_lock (demux->kidx_lock);
+  thread = demux->kidx_thread;
+  demux->kidx_thread = NULL;
+  demux->kidx_stop = TRUE;
+  g_mutex_unlock (demux->kidx_lock);
+
+  if (thread != NULL) {
+    g_thread_join (thread);
+    GST_DEBUG_OBJECT (demux, "keyframe scan stopped");
+  }
+}
+
+/* look up @seek_time in the keyframe index. Only works if the indexed part
+ * of the file reaches past @seek_time, otherwise we don't know if there is
+ * a closer key frame and the caller falls back to estimating */
 static gboolean
-gst_asf_demux_seek_index_lookup (GstASFDemux * demux, guint * packet,
+gst_asf_demux_keyframe_index_lookup (GstASFDemux * demux, guint * packet,
     GstClockTime seek_time, GstClockTime * p_idx_time)
 {
+  AsfKeyframeEntry *entry;
   GstClockTime idx_time;
   guint idx;
 
-  if (demux->sidx_num_entries == 0 || demux->sidx_interval == 0)
+  /* timestamps in the index are relative to the first timestamp */
+  if (demux->streaming || !GST_CLOCK_TIME_IS_VALID (demux->first_ts))
     return FALSE;
 
+  g_mutex_lock (demux->kidx_lock);
+
+  if (demux->kidx_entries == NULL || demux->kidx_entries->len == 0)
+    goto not_found;
+
+  idx = gst_asf_demux_keyframe_index_search (demux, seek_time);
+  if (demux->kidx_next_packet < demux->num_packets &&
+      (idx == demux->kidx_entries->len ||
+          g_array_index (demux->kidx_entries, AsfKeyframeEntry,
+              idx).packet >= demux->kidx_next_packet)) {
+    GST_DEBUG_OBJECT (demux, "%" GST_TIME_FORMAT " not covered by keyframe "
+        "index yet", GST_TIME_ARGS (seek_time));
+    goto not_found;
+  }
+
+  if (idx > 0) {
+    entry = &g_array_index (demux->kidx_entries, AsfKeyframeEntry, idx - 1);
+    *packet = entry->packet;
+    idx_time = entry->ts;
+  } else {
+    /* before the first key frame, start from the beginning */
+    *packet = 0;
+    idx_time = 0;
+  }
+
+  GST_DEBUG_OBJECT (demux, "%" GST_TIME_FORMAT " => packet %u at %"
+      GST_TIME_FORMAT " (keyframe index)", GST_TIME_ARGS (seek_time), *packet,
+      GST_TIME_ARGS (idx_time));
+
+  g_mutex_unlock (demux->kidx_lock);
+
+  if (p_idx_time)
+    *p_idx_time = idx_time;
+
+  return TRUE;
+
+not_found:
+  g_mutex_unlock (demux->kidx_lock);
+  return FALSE;
+}
+
+static gboolean
+gst_asf_demux_seek_index_lookup (GstASFDemux * demux, guint * packet,
+    GstClockTime seek_time, GstClockTime * p_idx_time)
+{
+  GstClockTime idx_time;
+  guint idx;
+
+  if (demux->sidx_num_entries == 0 || demux->sidx_interval == 0) {
+    return gst_asf_demux_keyframe_index_lookup (demux, packet, seek_time,
+        p_idx_time);
+  }
+
   idx = (guint) (seek_time / demux->sidx_interval);
 
   /* FIXME: seek beyond end of file should result in immediate EOS from
@@ -412,16 +765,11 @@ gst_asf_demux_reset_stream_state_after_discont (GstASFDemux * demux)
     demux->stream[n].discont = TRUE;
     demux->stream[n].last_flow = GST_FLOW_OK;
 
-    while (demux->stream[n].payloads->len > 0) {
-      AsfPayload *payload;
-      guint last;
-
-      last = demux->stream[n].payloads->len - 1;
-      payload = &g_array_index (demux->stream[n].payloads, AsfPayload, last);
-      gst_buffer_replace (&payload->buf, NULL);
-      g_array_remove_index (demux->stream[n].payloads, last);
-    }
+    asf_payload_queue_clear (demux->stream[n].payloads);
   }
+
+  /* the segment may have changed as well */
+  demux->stream_heap_dirty = TRUE;
 }
 
 static gboolean
@@ -469,6 +817,9 @@ gst_asf_demux_handle_seek_event (GstASFDemux * demux, GstEvent * event)
     return gst_pad_push_event (demux->sinkpad, event);
   }
 
+  /* the scanning thread pulls too, get it out of the way of the flush */
+  gst_asf_demux_stop_keyframe_scan (demux);
+
   /* unlock the streaming thread */
   if (flush) {
     gst_pad_push_event (demux->sinkpad, gst_event_new_flush_start ());
@@ -777,6 +1128,90 @@ gst_asf_demux_pull_data (GstASFDemux * demux, guint64 offset, guint size,
   return TRUE;
 }
 
+/* number of packets to read in one go in pull mode */
+static guint
+gst_asf_demux_get_pull_span (GstASFDemux * demux)
+{
+  guint64 span;
+  guint num;
+
+  if (demux->max_bitrate > 0) {
+    span = gst_util_uint64_scale (demux->max_bitrate / 8,
+        GST_ASF_DEMUX_PULL_SPAN_TIME, GST_SECOND);
+    span = CLAMP (span, GST_ASF_DEMUX_PULL_SPAN_MIN,
+        GST_ASF_DEMUX_PULL_SPAN_MAX);
+  } else {
+    span = GST_ASF_DEMUX_PULL_SPAN_MAX;
+  }
+
+  num = MAX (span / demux->packet_size, 1);
+
+  /* don't read past the last packet */
+  if (demux->num_packets > 0 && demux->packet + num > demux->num_packets)
+    num = MAX (demux->num_packets - demux->packet, 1);
+
+  return num;
+}
+
+/* get the packet at @offset, reading a span of packets from upstream if the
+ * packet isn't part of the last span read */
+static gboolean
+gst_asf_demux_pull_packet (GstASFDemux * demux, guint64 offset,
+    GstBuffer ** p_buf, GstFlowReturn * p_flow)
+{
+  GstBuffer *span;
+  GstFlowReturn flow;
+  guint size;
+
+  if (demux->pull_buf != NULL && offset >= demux->pull_buf_offset &&
+      offset + demux->packet_size <=
+      demux->pull_buf_offset + GST_BUFFER_SIZE (demux->pull_buf)) {
+    *p_buf = gst_buffer_create_sub (demux->pull_buf,
+        offset - demux->pull_buf_offset, demux->packet_size);
+    if (p_flow)
+      *p_flow = GST_FLOW_OK;
+    return TRUE;
+  }
+
+  gst_buffer_replace (&demux->pull_buf, NULL);
+
+  size = gst_asf_demux_get_pull_span (demux) * demux->packet_size;
+
+  GST_LOG_OBJECT (demux, "pulling span at %" G_GUINT64_FORMAT "+%u",
+      offset, size);
+
+  span = NULL;
+  flow = gst_pad_pull_range (demux->sinkpad, offset, size, &span);
+
+  if (p_flow)
+    *p_flow = flow;
+
+  if (flow != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (demux, "flow %s pulling span at %" G_GUINT64_FORMAT
+        "+%u", gst_flow_get_name (flow), offset, size);
+    *p_buf = NULL;
+    return FALSE;
+  }
+
+  /* the span may be cut short at the end of the file, as long as there is
+   * a whole packet in it we can go on */
+  if (GST_BUFFER_SIZE (span) < demux->packet_size) {
+    GST_DEBUG_OBJECT (demux, "short read pulling span at %" G_GUINT64_FORMAT
+        "+%u (got only %u bytes)", offset, size, GST_BUFFER_SIZE (span));
+    gst_buffer_unref (span);
+    if (p_flow)
+      *p_flow = GST_FLOW_UNEXPECTED;
+    *p_buf = NULL;
+    return FALSE;
+  }
+
+  demux->pull_buf = span;
+  demux->pull_buf_offset = offset;
+
+  *p_buf = gst_buffer_create_sub (span, 0, demux->packet_size);
+  return TRUE;
+}
+
 static void
 gst_asf_demux_pull_indices (GstASFDemux * demux)
 {
@@ -957,17 +1392,15 @@ all_streams_prerolled (GstASFDemux * demux)
   for (i = 0; i < demux->num_streams; ++i) {
     AsfPayload *last_payload;
     AsfStream *stream;
-    guint last_idx;
 
     stream = &demux->stream[i];
-    if (stream->payloads->len == 0) {
+    if (asf_payload_queue_get_length (stream->payloads) == 0) {
       ++num_no_data;
       GST_LOG_OBJECT (stream->pad, "no data queued");
       continue;
     }
 
-    last_idx = stream->payloads->len - 1;
-    last_payload = &g_array_index (stream->payloads, AsfPayload, last_idx);
+    last_payload = asf_payload_queue_peek_tail (stream->payloads);
 
     GST_LOG_OBJECT (stream->pad, "checking if %" GST_TIME_FORMAT " > %"
         GST_TIME_FORMAT, GST_TIME_ARGS (last_payload->ts),
@@ -1039,7 +1472,7 @@ gst_asf_demux_check_activate_streams (GstASFDemux * demux, gboolean force)
   for (i = 0; i < demux->num_streams; ++i) {
     AsfStream *stream = &demux->stream[i];
 
-    if (stream->payloads->len > 0) {
+    if (asf_payload_queue_get_length (stream->payloads) > 0) {
       /* we don't check mutual exclusion stuff here; either we have data for
        * a stream, then we active it, or we don't, then we'll ignore it */
       GST_LOG_OBJECT (stream->pad, "is prerolled - activate!");
@@ -1055,59 +1488,164 @@ gst_asf_demux_check_activate_streams (GstASFDemux * demux, gboolean force)
   return TRUE;
 }
 
-/* returns the stream that has a complete payload with the lowest timestamp
- * queued, or NULL (we push things by timestamp because during the internal
- * prerolling we might accumulate more data then the external queues can take,
- * so we'd lock up if we pushed all accumulated data for stream N in one go) */
-static AsfStream *
-gst_asf_demux_find_stream_with_complete_payload (GstASFDemux * demux)
+/* whether a stream has a complete payload at the head of its queue that may
+ * be pushed. Don't push any data until we have at least one payload that
+ * falls within the current segment. This way we can remove out-of-segment
+ * payloads that don't need to be decoded after a seek, sending only data
+ * from the keyframe directly before our segment start */
+static gboolean
+gst_asf_demux_stream_can_push (GstASFDemux * demux, AsfStream * stream)
+{
+  AsfPayload *payload;
+
+  if (stream->payloads == NULL ||
+      asf_payload_queue_get_length (stream->payloads) == 0)
+    return FALSE;
+
+  payload = asf_payload_queue_peek_tail (stream->payloads);
+  if (GST_CLOCK_TIME_IS_VALID (payload->ts) &&
+      payload->ts < demux->segment.start) {
+    GST_LOG_OBJECT (stream->pad, "Last queued payload has timestamp %"
+        GST_TIME_FORMAT " which is before our segment start %"
+        GST_TIME_FORMAT ", not pushing yet", GST_TIME_ARGS (payload->ts),
+        GST_TIME_ARGS (demux->segment.start));
+    return FALSE;
+  }
+
+  return gst_asf_payload_is_complete (asf_payload_queue_peek_head
+      (stream->payloads));
+}
+
+/* heap order: timestamp of the head payload, then stream order */
+static inline gboolean
+gst_asf_demux_stream_heap_less (AsfStream * a, AsfStream * b)
+{
+  GstClockTime ts_a, ts_b;
+
+  ts_a = asf_payload_queue_peek_head (a->payloads)->ts;
+  ts_b = asf_payload_queue_peek_head (b->payloads)->ts;
+
+  if (ts_a != ts_b)
+    return ts_a < ts_b;
+
+  return a < b;
+}
+
+static inline void
+gst_asf_demux_stream_heap_set (GstASFDemux * demux, guint idx,
+    AsfStream * stream)
+{
+  demux->stream_heap[idx] = stream;
+  stream->heap_idx = idx;
+}
+
+static void
+gst_asf_demux_stream_heap_sift_up (GstASFDemux * demux, guint idx)
+{
+  AsfStream *stream = demux->stream_heap[idx];
+
+  while (idx > 0) {
+    guint parent = (idx - 1) / 2;
+
+    if (!gst_asf_demux_stream_heap_less (stream, demux->stream_heap[parent]))
+      break;
+    gst_asf_demux_stream_heap_set (demux, idx, demux->stream_heap[parent]);
+    idx = parent;
+  }
+  gst_asf_demux_stream_heap_set (demux, idx, stream);
+}
+
+static void
+gst_asf_demux_stream_heap_sift_down (GstASFDemux * demux, guint idx)
+{
+  AsfStream *stream = demux->stream_heap[idx];
+  guint len = demux->stream_heap_len;
+
+  for (;;) {
+    guint child = 2 * idx + 1;
+
+    if (child >= len)
+      break;
+    if (child + 1 < len && gst_asf_demux_stream_heap_less (demux->stream_heap
+            [child + 1], demux->stream_heap[child]))
+      ++child;
+    if (!gst_asf_demux_stream_heap_less (demux->stream_heap[child], stream))
+      break;
+    gst_asf_demux_stream_heap_set (demux, idx, demux->stream_heap[child]);
+    idx = child;
+  }
+  gst_asf_demux_stream_heap_set (demux, idx, stream);
+}
+
+static void
+gst_asf_demux_rebuild_stream_heap (GstASFDemux * demux)
 {
-  AsfPayload *best_payload = NULL;
-  AsfStream *best_stream = NULL;
   guint i;
 
+  demux->stream_heap_len = 0;
   for (i = 0; i < demux->num_streams; ++i) {
-    AsfStream *stream;
-
-    stream = &demux->stream[i];
+    AsfStream *stream = &demux->stream[i];
 
-    /* Don't push any data until we have at least one payload that falls within
-     * the current segment. This way we can remove out-of-segment payloads that
-     * don't need to be decoded after a seek, sending only data from the
-     * keyframe directly before our segment start */
-    if (stream->payloads->len > 0) {
-      AsfPayload *payload;
-      guint last_idx;
-
-      last_idx = stream->payloads->len - 1;
-      payload = &g_array_index (stream->payloads, AsfPayload, last_idx);
-      if (GST_CLOCK_TIME_IS_VALID (payload->ts) &&
-          payload->ts < demux->segment.start) {
-        GST_DEBUG_OBJECT (stream->pad, "Last queued payload has timestamp %"
-            GST_TIME_FORMAT " which is before our segment start %"
-            GST_TIME_FORMAT ", not pushing yet", GST_TIME_ARGS (payload->ts),
-            GST_TIME_ARGS (demux->segment.start));
-        continue;
-      }
+    stream->heap_idx = -1;
+    if (gst_asf_demux_stream_can_push (demux, stream)) {
+      gst_asf_demux_stream_heap_set (demux, demux->stream_heap_len, stream);
+      ++demux->stream_heap_len;
     }
+  }
 
-    /* Now see if there's a complete payload queued for this stream */
-    if (stream->payloads->len > 0) {
-      AsfPayload *payload;
+  for (i = demux->stream_heap_len / 2; i > 0; --i)
+    gst_asf_demux_stream_heap_sift_down (demux, i - 1);
 
-      payload = &g_array_index (stream->payloads, AsfPayload, 0);
-      if (!gst_asf_payload_is_complete (payload))
-        continue;
+  demux->stream_heap_dirty = FALSE;
+}
 
-      /* ... and whether its timestamp is lower than the current best */
-      if (best_stream == NULL || best_payload->ts > payload->ts) {
-        best_stream = stream;
-        best_payload = payload;
-      }
+/* called whenever the payload queue of a stream changed */
+void
+gst_asf_demux_update_stream_heap (GstASFDemux * demux, AsfStream * stream)
+{
+  gint idx = stream->heap_idx;
+
+  /* will be rebuilt completely before it's used next */
+  if (demux->stream_heap_dirty)
+    return;
+
+  if (!gst_asf_demux_stream_can_push (demux, stream)) {
+    AsfStream *last;
+
+    if (idx < 0)
+      return;
+
+    stream->heap_idx = -1;
+    last = demux->stream_heap[--demux->stream_heap_len];
+    if (last != stream) {
+      gst_asf_demux_stream_heap_set (demux, idx, last);
+      gst_asf_demux_stream_heap_sift_up (demux, idx);
+      gst_asf_demux_stream_heap_sift_down (demux, last->heap_idx);
     }
+  } else if (idx < 0) {
+    gst_asf_demux_stream_heap_set (demux, demux->stream_heap_len, stream);
+    ++demux->stream_heap_len;
+    gst_asf_demux_stream_heap_sift_up (demux, stream->heap_idx);
+  } else {
+    gst_asf_demux_stream_heap_sift_up (demux, idx);
+    gst_asf_demux_stream_heap_sift_down (demux, stream->heap_idx);
   }
+}
 
-  return best_stream;
+/* returns the stream that has a complete payload with the lowest timestamp
+ * queued, or NULL (we push things by timestamp because during the internal
+ * prerolling we might accumulate more data then the external queues can take,
+ * so we'd lock up if we pushed all accumulated data for stream N in one go) */
+static AsfStream *
+gst_asf_demux_find_stream_with_complete_payload (GstASFDemux * demux)
+{
+  if (demux->stream_heap_dirty)
+    gst_asf_demux_rebuild_stream_heap (demux);
+
+  if (demux->stream_heap_len == 0)
+    return NULL;
+
+  return demux->stream_heap[0];
 }
 
 static GstFlowReturn
@@ -1144,7 +1682,7 @@ gst_asf_demux_push_complete_payloads (GstASFDemux * demux, gboolean force)
   while ((stream = gst_asf_demux_find_stream_with_complete_payload (demux))) {
     AsfPayload *payload;
 
-    payload = &g_array_index (stream->payloads, AsfPayload, 0);
+    payload = asf_payload_queue_peek_head (stream->payloads);
 
     /* Do we have tags pending for this stream? */
     if (stream->pending_tags) {
@@ -1185,9 +1723,12 @@ gst_asf_demux_push_complete_payloads (GstASFDemux * demux, gboolean force)
         GST_TIME_ARGS (GST_BUFFER_DURATION (payload->buf)),
         GST_BUFFER_SIZE (payload->buf));
 
+    gst_element_stats_output (&demux->stats, payload->buf);
+    GST_PROBE_PUSH (demux, payload->buf);
     stream->last_flow = gst_pad_push (stream->pad, payload->buf);
     payload->buf = NULL;
-    g_array_remove_index (stream->payloads, 0);
+    asf_payload_queue_remove_head (stream->payloads);
+    gst_asf_demux_update_stream_heap (demux, stream);
   }
 
   return gst_asf_demux_aggregate_flow_return (demux);
@@ -1198,6 +1739,7 @@ gst_asf_demux_loop (GstASFDemux * demux)
 {
   GstFlowReturn flow;
   GstBuffer *buf = NULL;
+  GstClockTime start;
   guint64 off;
 
   if (demux->state == GST_ASF_DEMUX_STATE_HEADER) {
@@ -1219,7 +1761,7 @@ gst_asf_demux_loop (GstASFDemux * demux)
 
   off = demux->data_offset + (demux->packet * demux->packet_size);
 
-  if (!gst_asf_demux_pull_data (demux, off, demux->packet_size, &buf, &flow)) {
+  if (!gst_asf_demux_pull_packet (demux, off, &buf, &flow)) {
     GST_DEBUG_OBJECT (demux, "got flow %s", gst_flow_get_name (flow));
     if (flow == GST_FLOW_UNEXPECTED)
       goto eos;
@@ -1230,6 +1772,9 @@ gst_asf_demux_loop (GstASFDemux * demux)
       goto read_failed;
   }
 
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&demux->stats, buf);
+
   /* FIXME: maybe we should just skip broken packets and error out only
    * after a few broken packets in a row? */
   if (!gst_asf_demux_parse_packet (demux, buf))
@@ -1237,7 +1782,17 @@ gst_asf_demux_loop (GstASFDemux * demux)
 
   gst_buffer_unref (buf);
 
+  /* the keyframe index now covers this packet too */
+  g_mutex_lock (demux->kidx_lock);
+  if (demux->packet == demux->kidx_next_packet)
+    ++demux->kidx_next_packet;
+  g_mutex_unlock (demux->kidx_lock);
+
   flow = gst_asf_demux_push_complete_payloads (demux, FALSE);
+  gst_element_stats_stop (&demux->stats, start);
+
+  if (demux->scan_keyframes)
+    gst_asf_demux_start_keyframe_scan (demux);
 
   ++demux->packet;
 
@@ -1316,6 +1871,7 @@ read_failed:
 parse_error:
   {
     gst_buffer_unref (buf);
+    gst_element_stats_dropped (&demux->stats);
     GST_ELEMENT_ERROR (demux, STREAM, DEMUX, (NULL),
         ("Error parsing ASF packet %u", (guint) demux->packet));
     gst_asf_demux_send_event_unlocked (demux, gst_event_new_eos ());
@@ -1329,9 +1885,13 @@ gst_asf_demux_chain (GstPad * pad, GstBuffer * buf)
 {
   GstFlowReturn ret = GST_FLOW_OK;
   GstASFDemux *demux;
+  GstClockTime start;
 
   demux = GST_ASF_DEMUX (GST_PAD_PARENT (pad));
 
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&demux->stats, buf);
+
   GST_LOG_OBJECT (demux, "buffer: size=%u, offset=%" G_GINT64_FORMAT,
       GST_BUFFER_SIZE (buf), GST_BUFFER_OFFSET (buf));
 
@@ -1362,6 +1922,7 @@ gst_asf_demux_chain (GstPad * pad, GstBuffer * buf)
          * after a few broken packets in a row? */
         if (!gst_asf_demux_parse_packet (demux, buf)) {
           GST_WARNING_OBJECT (demux, "Parse error");
+          gst_element_stats_dropped (&demux->stats);
         }
 
         gst_buffer_unref (buf);
@@ -1379,6 +1940,8 @@ gst_asf_demux_chain (GstPad * pad, GstBuffer * buf)
   if (ret != GST_FLOW_OK)
     GST_DEBUG_OBJECT (demux, "flow: %s", gst_flow_get_name (ret));
 
+  gst_element_stats_stop (&demux->stats, start);
+
   return ret;
 }
 
@@ -1648,7 +2211,8 @@ gst_asf_demux_setup_pad (GstASFDemux * demux, GstPad * src_pad,
   stream->pending_tags = tags;
   stream->discont = TRUE;
 
-  stream->payloads = g_array_new (FALSE, FALSE, sizeof (AsfPayload));
+  stream->payloads = asf_payload_queue_new ();
+  stream->heap_idx = -1;
 
   GST_INFO ("Created pad %s for stream %u with caps %" GST_PTR_FORMAT,
       GST_PAD_NAME (src_pad), demux->num_streams, caps);
@@ -2329,7 +2893,7 @@ gst_asf_demux_process_file (GstASFDemux * demux, guint8 * data, guint64 size)
 {
   guint64 file_size, creation_time, packets_count;
   guint64 play_time, send_time, preroll;
-  guint32 flags, min_pktsize, max_pktsize, min_bitrate;
+  guint32 flags, min_pktsize, max_pktsize, max_bitrate;
 
   if (size < (16 + 8 + 8 + 8 + 8 + 8 + 8 + 4 + 4 + 4 + 4))
     goto not_enough_data;
@@ -2344,7 +2908,7 @@ gst_asf_demux_process_file (GstASFDemux * demux, guint8 * data, guint64 size)
   flags = gst_asf_demux_get_uint32 (&data, &size);
   min_pktsize = gst_asf_demux_get_uint32 (&data, &size);
   max_pktsize = gst_asf_demux_get_uint32 (&data, &size);
-  min_bitrate = gst_asf_demux_get_uint32 (&data, &size);
+  max_bitrate = gst_asf_demux_get_uint32 (&data, &size);
 
   demux->broadcast = !!(flags & 0x01);
   demux->seekable = !!(flags & 0x02);
@@ -2362,6 +2926,7 @@ gst_asf_demux_process_file (GstASFDemux * demux, guint8 * data, guint64 size)
     goto non_fixed_packet_size;
 
   demux->packet_size = max_pktsize;
+  demux->max_bitrate = max_bitrate;
 
   /* FIXME: do we need send_time as well? what is it? */
   if ((play_time * 100) >= (preroll * GST_MSECOND))
@@ -3158,11 +3723,11 @@ gst_asf_demux_descramble_buffer (GstASFDemux * demux, AsfStream * stream,
     row = off / demux->span;
     col = off % demux->span;
     idx = row + col * demux->ds_packet_size / demux->ds_chunk_size;
-    GST_DEBUG ("idx=%u, row=%u, col=%u, off=%u, ds_chunk_size=%u", idx, row,
-        col, off, demux->ds_chunk_size);
-    GST_DEBUG ("scrambled buffer size=%u, span=%u, packet_size=%u",
+    GST_HOT_DEBUG ("idx=%u, row=%u, col=%u, off=%u, ds_chunk_size=%u", idx,
+        row, col, off, demux->ds_chunk_size);
+    GST_HOT_DEBUG ("scrambled buffer size=%u, span=%u, packet_size=%u",
         GST_BUFFER_SIZE (scrambled_buffer), demux->span, demux->ds_packet_size);
-    GST_DEBUG ("GST_BUFFER_SIZE (scrambled_buffer) = %u",
+    GST_HOT_DEBUG ("GST_BUFFER_SIZE (scrambled_buffer) = %u",
         GST_BUFFER_SIZE (scrambled_buffer));
     sub_buffer =
         gst_buffer_create_sub (scrambled_buffer, idx * demux->ds_chunk_size,
@@ -3171,6 +3736,8 @@ gst_asf_demux_descramble_buffer (GstASFDemux * demux, AsfStream * stream,
       descrambled_buffer = sub_buffer;
     } else {
       descrambled_buffer = gst_buffer_join (descrambled_buffer, sub_buffer);
+      gst_element_stats_copy (&demux->stats,
+          GST_BUFFER_SIZE (descrambled_buffer));
     }
   }
 
@@ -3348,6 +3915,9 @@ gst_asf_demux_change_state (GstElement * element, GstStateChange transition)
       demux->index_offset = 0;
       break;
     }
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_element_stats_reset (&demux->stats);
+      break;
     default:
       break;
   }
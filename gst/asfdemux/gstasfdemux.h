@@ -23,6 +23,7 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
+#include <gst/gst-element-stats.h>
 
 #include "asfheaders.h"
 
@@ -45,6 +46,8 @@ GST_DEBUG_CATEGORY_EXTERN (asfdemux_dbg);
 typedef struct _GstASFDemux GstASFDemux;
 typedef struct _GstASFDemuxClass GstASFDemuxClass;
 
+typedef struct _AsfPayloadQueue AsfPayloadQueue;
+
 typedef struct {
   AsfPayloadExtensionID   id : 16;  /* extension ID; the :16 makes sure the
                                      * struct gets packed into 4 bytes       */
@@ -104,13 +107,21 @@ typedef struct
 
   /* for new parsing code */
   GstFlowReturn   last_flow; /* last flow return */
-  GArray         *payloads;  /* pending payloads */
+  AsfPayloadQueue *payloads; /* pending payloads */
+  gint            heap_idx;  /* position in the stream heap, or -1 */
 
   /* extended stream properties (optional) */
   AsfStreamExtProps  ext_props;
 
 } AsfStream;
 
+/* entry of the keyframe index built when there is no simple index */
+typedef struct
+{
+  GstClockTime  ts;                /* timestamp of the key frame           */
+  guint32       packet;            /* packet the key frame starts in       */
+} AsfKeyframeEntry;
+
 typedef enum {
   GST_ASF_DEMUX_STATE_HEADER,
   GST_ASF_DEMUX_STATE_DATA
@@ -154,9 +165,16 @@ struct _GstASFDemux {
   AsfStream            stream[GST_ASF_DEMUX_NUM_STREAMS];
   gboolean             activated_streams;
 
+  /* streams with a complete payload ready to be pushed, as a min-heap on the
+   * timestamp of that payload */
+  AsfStream           *stream_heap[GST_ASF_DEMUX_NUM_STREAMS];
+  guint                stream_heap_len;
+  gboolean             stream_heap_dirty; /* needs rebuilding before use */
+
   GstClockTime         first_ts;        /* first timestamp found        */
 
   guint32              packet_size;
+  guint32              max_bitrate;     /* from the file properties, or 0 */
   guint32              timestamp;       /* in milliseconds              */
   guint64              play_time;
 
@@ -172,6 +190,10 @@ struct _GstASFDemux {
   gboolean             segment_running;  /* if we've started the current segment    */
   gboolean             streaming;        /* TRUE if we are operating chain-based    */
 
+  /* pull mode: span of whole packets read ahead, handed out as sub-buffers */
+  GstBuffer           *pull_buf;
+  guint64              pull_buf_offset;  /* file offset of pull_buf             */
+
   /* Descrambler settings */
   guint8               span;
   guint16              ds_packet_size;
@@ -185,6 +207,18 @@ struct _GstASFDemux {
   GstClockTime         sidx_interval;    /* interval between entries in ns */
   guint                sidx_num_entries; /* number of index entries        */
   guint32             *sidx_entries;     /* packet number for each entry   */
+
+  /* keyframe index, built while parsing and scanning packets in pull mode
+   * when there's no simple index */
+  GArray              *kidx_entries;     /* AsfKeyframeEntry, sorted by ts  */
+  guint16              kidx_stream_id;   /* indexed stream, or 0 if unset   */
+  guint64              kidx_next_packet; /* all packets before are indexed  */
+  gboolean             scan_keyframes;   /* scan ahead for the index        */
+  GMutex              *kidx_lock;        /* protects the kidx_* fields      */
+  GThread             *kidx_thread;      /* scanning ahead, or NULL         */
+  gboolean             kidx_stop;        /* tells kidx_thread to stop       */
+
+  GstElementStats      stats;            /* for the "stats" property        */
 };
 
 struct _GstASFDemuxClass {
@@ -195,6 +229,14 @@ GType           gst_asf_demux_get_type (void);
 
 AsfStream     * gst_asf_demux_get_stream (GstASFDemux * demux, guint16 id);
 
+void            gst_asf_demux_update_stream_heap (GstASFDemux * demux,
+                                                  AsfStream * stream);
+
+void            gst_asf_demux_add_keyframe_entry (GstASFDemux * demux,
+                                                  AsfStream * stream,
+                                                  GstClockTime ts,
+                                                  guint64 packet);
+
 G_END_DECLS
 
 #endif /* __ASF_DEMUX_H__ */
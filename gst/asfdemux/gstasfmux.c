@@ -30,44 +30,43 @@
  *   -- truth hurts.
  */
 
-/* stream does NOT work on Windows Media Player (does work on
- * other (Linux-based) players, because we do not specify bitrate
- */
+/* Data packets have a fixed size and carry as many payloads as fit, media
+ * objects that don't fit are fragmented over several packets. At EOS a
+ * simple index object is written and the header is rewritten with the real
+ * sizes and durations, unless the streamable property is set, in which case
+ * the header is only written once with the broadcast flag set. */
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#include <stdlib.h>
 #include <string.h>
 
-#include <gst/video/video.h>
-
 /* for audio codec IDs */
 #include <gst/riff/riff-ids.h>
 
 #include "asfheaders.h"
 #include "gstasfmux.h"
 
+GST_DEBUG_CATEGORY_STATIC (asfmux_debug);
+#define GST_CAT_DEFAULT asfmux_debug
+
 /* elementfactory information */
-static GstElementDetails gst_asfmux_details = {
-  "Asf multiplexer",
-  "Codec/Muxer",
-  "Muxes audio and video streams into an asf stream",
-  "Ronald Bultje <rbultje@ronald.bitfreak.net>",
-};
+static const GstElementDetails gst_asfmux_details =
+GST_ELEMENT_DETAILS ("ASF muxer",
+    "Codec/Muxer",
+    "Muxes audio and video streams into an ASF stream",
+    "Ronald Bultje <rbultje@ronald.bitfreak.net>");
 
-/* AsfMux signals and args */
 enum
 {
-  /* FILL ME */
-  LAST_SIGNAL
+  PROP_0,
+  PROP_PACKET_SIZE,
+  PROP_STREAMABLE
 };
 
-enum
-{
-  ARG_0
-};
+#define DEFAULT_PACKET_SIZE  3200
+#define DEFAULT_STREAMABLE   FALSE
 
 static GstStaticPadTemplate gst_asfmux_src_template =
 GST_STATIC_PAD_TEMPLATE ("src",
@@ -80,117 +79,94 @@ static GstStaticPadTemplate gst_asfmux_videosink_template =
     GST_STATIC_PAD_TEMPLATE ("video_%d",
     GST_PAD_SINK,
     GST_PAD_REQUEST,
-    GST_STATIC_CAPS ("video/x-raw-yuv, "
-        "format = (fourcc) { YUY2, I420 }, "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
-        "image/jpeg, "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
+    GST_STATIC_CAPS ("video/x-wmv, "
+        "wmvversion = (int) [ 1, 3 ], "
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
+        "video/x-msmpeg, "
+        "msmpegversion = (int) [ 41, 43 ], "
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
         "video/x-divx, "
         "divxversion = (int) [ 3, 5 ], "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
         "video/x-xvid, "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
         "video/x-3ivx, "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
-        "video/x-msmpeg, "
-        "msmpegversion = (int) [ 41, 43 ], "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
-        "video/mpeg, "
-        "mpegversion = (int) 1,"
-        "systemstream = (boolean) false,"
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
         "video/x-h263, "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], "
-        "framerate = (double) [ 1, MAX ]; "
-        "video/x-dv, "
-        "systemstream = (boolean) false,"
-        "width = (int) 720,"
-        "height = (int) { 576, 480 };"
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
+        "image/jpeg, "
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
         "video/x-huffyuv, "
-        "width = (int) [ 1, MAX], "
-        "height = (int) [ 1, MAX], " "framerate = (double) [ 1, MAX ]")
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]; "
+        "video/x-raw-yuv, "
+        "format = (fourcc) { YUY2, I420 }, "
+        "width = (int) [ 1, MAX ], "
+        "height = (int) [ 1, MAX ]")
     );
 
 static GstStaticPadTemplate gst_asfmux_audiosink_template =
     GST_STATIC_PAD_TEMPLATE ("audio_%d",
     GST_PAD_SINK,
     GST_PAD_REQUEST,
-    GST_STATIC_CAPS ("audio/x-raw-int, "
+    GST_STATIC_CAPS ("audio/x-wma, "
+        "wmaversion = (int) [ 1, 3 ], "
+        "rate = (int) [ 1, MAX ], "
+        "channels = (int) [ 1, MAX ]; "
+        "audio/mpeg, "
+        "mpegversion = (int) 1, "
+        "layer = (int) [ 1, 3 ], "
+        "rate = (int) [ 1000, 96000 ], "
+        "channels = (int) [ 1, 2 ]; "
+        "audio/x-ac3, "
+        "rate = (int) [ 1000, 96000 ], "
+        "channels = (int) [ 1, 6 ]; "
+        "audio/x-raw-int, "
         "endianness = (int) LITTLE_ENDIAN, "
         "signed = (boolean) { true, false }, "
         "width = (int) { 8, 16 }, "
         "depth = (int) { 8, 16 }, "
         "rate = (int) [ 1000, 96000 ], "
-        "channels = (int) [ 1, 2]; "
-        "audio/mpeg, "
-        "mpegversion = (int) 1, "
-        "layer = (int) { 1, 3 }, "
-        "rate = (int) [ 1000, 96000 ], "
-        "channels = (int) [ 1, 2]; "
-        "audio/x-vorbis, "
-        "rate = (int) [ 1000, 96000 ], "
-        "channels = (int) [ 1, 2]; "
-        "audio/x-ac3, "
-        "rate = (int) [ 1000, 96000 ], " "channels = (int) [ 1, 2]")
+        "channels = (int) [ 1, 2 ]")
     );
 
-#define GST_ASF_PACKET_SIZE 3200
-#define GST_ASF_PACKET_HEADER_SIZE 12
-#define GST_ASF_FRAME_HEADER_SIZE 17
+/* error correction data, length type flags, property flags, padding length,
+ * send time, duration and payload flags */
+#define GST_ASF_PACKET_HEADER_SIZE (3 + 1 + 1 + 2 + 4 + 2 + 1)
+/* stream number, media object number, offset into media object, replicated
+ * data length, replicated data (media object size and presentation time) and
+ * payload length */
+#define GST_ASF_FRAME_HEADER_SIZE (1 + 1 + 4 + 1 + 8 + 2)
+/* the number of payloads is stored in 6 bits */
+#define GST_ASF_MAX_PAYLOADS 63
+
+#define GST_ASF_DATA_OBJECT_SIZE 50
+#define GST_ASF_INDEX_INTERVAL GST_SECOND
 
-static void gst_asfmux_base_init (gpointer g_class);
-static void gst_asfmux_class_init (GstAsfMuxClass * klass);
-static void gst_asfmux_init (GstAsfMux * asfmux);
+/* ASF times are in 100ns units */
+#define GST_TIME_TO_ASF(t) ((t) / (GST_SECOND / 10000000))
 
-static void gst_asfmux_loop (GstElement * element);
-static gboolean gst_asfmux_handle_event (GstPad * pad, GstEvent * event);
 static GstPad *gst_asfmux_request_new_pad (GstElement * element,
     GstPadTemplate * templ, const gchar * name);
+static void gst_asfmux_release_pad (GstElement * element, GstPad * pad);
+static GstFlowReturn gst_asfmux_collected (GstCollectPads * pads,
+    GstAsfMux * asfmux);
+static void gst_asfmux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_asfmux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_asfmux_finalize (GObject * object);
 static GstStateChangeReturn gst_asfmux_change_state (GstElement * element,
     GstStateChange transition);
 
-static GstElementClass *parent_class = NULL;
-
-/*static guint gst_asfmux_signals[LAST_SIGNAL] = { 0 }; */
-
-GType
-gst_asfmux_get_type (void)
-{
-  static GType asfmux_type = 0;
-
-  if (!asfmux_type) {
-    static const GTypeInfo asfmux_info = {
-      sizeof (GstAsfMuxClass),
-      gst_asfmux_base_init,
-      NULL,
-      (GClassInitFunc) gst_asfmux_class_init,
-      NULL,
-      NULL,
-      sizeof (GstAsfMux),
-      0,
-      (GInstanceInitFunc) gst_asfmux_init,
-    };
-
-    asfmux_type = g_type_register_static (GST_TYPE_ELEMENT,
-        "GstAsfMux", &asfmux_info, 0);
-  }
-  return asfmux_type;
-}
+GST_BOILERPLATE (GstAsfMux, gst_asfmux, GstElement, GST_TYPE_ELEMENT);
 
 static void
 gst_asfmux_base_init (gpointer g_class)
@@ -209,102 +185,183 @@ gst_asfmux_base_init (gpointer g_class)
 static void
 gst_asfmux_class_init (GstAsfMuxClass * klass)
 {
+  GObjectClass *gobject_class;
   GstElementClass *gstelement_class;
 
+  gobject_class = (GObjectClass *) klass;
   gstelement_class = (GstElementClass *) klass;
 
-  parent_class = g_type_class_peek_parent (klass);
-
-  gstelement_class->request_new_pad = gst_asfmux_request_new_pad;
-  gstelement_class->change_state = gst_asfmux_change_state;
+  gobject_class->set_property = gst_asfmux_set_property;
+  gobject_class->get_property = gst_asfmux_get_property;
+  gobject_class->finalize = gst_asfmux_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PACKET_SIZE,
+      g_param_spec_uint ("packet-size", "Packet size",
+          "Size of the data packets in bytes", 256, G_MAXUINT16,
+          DEFAULT_PACKET_SIZE, G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_STREAMABLE,
+      g_param_spec_boolean ("streamable", "Streamable",
+          "Write a live stream, don't seek back to update the header and "
+          "don't write an index", DEFAULT_STREAMABLE, G_PARAM_READWRITE));
+
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_asfmux_request_new_pad);
+  gstelement_class->release_pad = GST_DEBUG_FUNCPTR (gst_asfmux_release_pad);
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_asfmux_change_state);
+
+  GST_DEBUG_CATEGORY_INIT (asfmux_debug, "asfmux", 0, "ASF muxer");
 }
 
-static const GstEventMask *
-gst_asfmux_get_event_masks (GstPad * pad)
+static void gst_asfmux_stream_free (GstAsfMuxStream * stream);
+
+static void
+gst_asfmux_reset (GstAsfMux * asfmux)
 {
-  static const GstEventMask gst_asfmux_sink_event_masks[] = {
-    {GST_EVENT_EOS, 0},
-    {0,}
-  };
+  gint n, num;
 
-  return gst_asfmux_sink_event_masks;
+  asfmux->write_header = TRUE;
+  asfmux->header_size = 0;
+  gst_buffer_replace (&asfmux->packet, NULL);
+  asfmux->packet_pos = 0;
+  asfmux->packet_frames = 0;
+  asfmux->num_packets = 0;
+  asfmux->duration = 0;
+
+  asfmux->index_stream = NULL;
+  if (asfmux->index)
+    g_array_set_size (asfmux->index, 0);
+  asfmux->have_keyframe = FALSE;
+  asfmux->max_packet_count = 0;
+
+  /* drop the streams whose pads were released while muxing, the remaining
+   * ones can be renumbered now that there's no header yet */
+  for (n = 0, num = 0; n < asfmux->num_outputs; n++) {
+    GstAsfMuxStream *stream = asfmux->output[n];
+
+    if (stream->released) {
+      gst_asfmux_stream_free (stream);
+      g_free (stream);
+      continue;
+    }
+    stream->number = num + 1;
+    stream->seqnum = 0;
+    stream->bytes = 0;
+    asfmux->output[num++] = stream;
+  }
+  asfmux->num_outputs = num;
 }
 
 static void
-gst_asfmux_init (GstAsfMux * asfmux)
+gst_asfmux_init (GstAsfMux * asfmux, GstAsfMuxClass * klass)
 {
-  gint n;
-
   asfmux->srcpad =
       gst_pad_new_from_static_template (&gst_asfmux_src_template, "src");
+  gst_pad_use_fixed_caps (asfmux->srcpad);
   gst_element_add_pad (GST_ELEMENT (asfmux), asfmux->srcpad);
 
-  GST_OBJECT_FLAG_SET (GST_ELEMENT (asfmux), GST_ELEMENT_EVENT_AWARE);
+  asfmux->collect = gst_collect_pads_new ();
+  gst_collect_pads_set_function (asfmux->collect,
+      (GstCollectPadsFunction) GST_DEBUG_FUNCPTR (gst_asfmux_collected),
+      asfmux);
 
   asfmux->num_outputs = asfmux->num_video = asfmux->num_audio = 0;
-  memset (&asfmux->output, 0, sizeof (asfmux->output));
-  for (n = 0; n < MAX_ASF_OUTPUTS; n++) {
-    asfmux->output[n].index = n;
-    asfmux->output[n].connected = FALSE;
+  asfmux->packet_size = DEFAULT_PACKET_SIZE;
+  asfmux->streamable = DEFAULT_STREAMABLE;
+  asfmux->index = g_array_new (FALSE, FALSE, sizeof (GstAsfMuxIndexEntry));
+
+  gst_asfmux_reset (asfmux);
+}
+
+static void
+gst_asfmux_finalize (GObject * object)
+{
+  GstAsfMux *asfmux = GST_ASFMUX (object);
+
+  gst_asfmux_reset (asfmux);
+  gst_object_unref (asfmux->collect);
+  g_array_free (asfmux->index, TRUE);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_asfmux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAsfMux *asfmux = GST_ASFMUX (object);
+
+  switch (prop_id) {
+    case PROP_PACKET_SIZE:
+      asfmux->packet_size = g_value_get_uint (value);
+      break;
+    case PROP_STREAMABLE:
+      asfmux->streamable = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
   }
-  asfmux->write_header = TRUE;
-  asfmux->packet = NULL;
-  asfmux->num_packets = 0;
-  asfmux->sequence = 0;
+}
+
+static void
+gst_asfmux_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstAsfMux *asfmux = GST_ASFMUX (object);
+
+  switch (prop_id) {
+    case PROP_PACKET_SIZE:
+      g_value_set_uint (value, asfmux->packet_size);
+      break;
+    case PROP_STREAMABLE:
+      g_value_set_boolean (value, asfmux->streamable);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_asfmux_set_codec_data (GstAsfMuxStream * stream, GstStructure * structure)
+{
+  const GValue *value;
 
-  gst_element_set_loop_function (GST_ELEMENT (asfmux), gst_asfmux_loop);
+  gst_buffer_replace (&stream->codec_data, NULL);
+  value = gst_structure_get_value (structure, "codec_data");
+  if (value != NULL && G_VALUE_TYPE (value) == GST_TYPE_BUFFER)
+    stream->codec_data = gst_buffer_ref (gst_value_get_buffer (value));
 }
 
-static GstPadLinkReturn
-gst_asfmux_vidsink_link (GstPad * pad, const GstCaps * caps)
+static gboolean
+gst_asfmux_vidsink_setcaps (GstPad * pad, GstCaps * caps)
 {
   GstAsfMux *asfmux;
-  GstAsfMuxStream *stream = NULL;
+  GstAsfMuxStream *stream;
   GstStructure *structure;
-  gint n;
   const gchar *mimetype;
-  gint w, h;
-  gboolean ret;
+  guint32 format = 0;
+  guint extra;
+  gint w, h, bitrate;
 
   asfmux = GST_ASFMUX (gst_pad_get_parent (pad));
+  stream = (GstAsfMuxStream *) gst_pad_get_element_private (pad);
 
-  for (n = 0; n < asfmux->num_outputs; n++) {
-    if (asfmux->output[n].pad == pad) {
-      stream = &asfmux->output[n];
-      break;
-    }
-  }
-  g_assert (n < asfmux->num_outputs);
-  g_assert (stream != NULL);
-  g_assert (stream->type == ASF_STREAM_VIDEO);
-
-  GST_DEBUG ("asfmux: video sinkconnect triggered on %s",
-      gst_pad_get_name (pad));
+  GST_DEBUG_OBJECT (asfmux, "%s:%s, caps %" GST_PTR_FORMAT,
+      GST_DEBUG_PAD_NAME (pad), caps);
 
   structure = gst_caps_get_structure (caps, 0);
 
-  /* global */
-  ret = gst_structure_get_int (structure, "width", &w);
-  ret &= gst_structure_get_int (structure, "height", &h);
+  if (!gst_structure_get_int (structure, "width", &w) ||
+      !gst_structure_get_int (structure, "height", &h))
+    goto refuse_caps;
 
-  if (!ret)
-    return GST_PAD_LINK_REFUSED;
-
-  stream->header.video.stream.width = w;
-  stream->header.video.stream.height = h;
-  stream->header.video.stream.unknown = 2;
-  stream->header.video.stream.size = 40;
-  stream->bitrate = 0;          /* TODO */
+  stream->header.video.format.depth = 24;
+  stream->header.video.format.planes = 1;
 
   mimetype = gst_structure_get_name (structure);
   if (!strcmp (mimetype, "video/x-raw-yuv")) {
-    guint32 format;
-
-    ret = gst_structure_get_fourcc (structure, "format", &format);
-    if (!ret)
-      return GST_PAD_LINK_REFUSED;
-
-    stream->header.video.format.tag = format;
+    gst_structure_get_fourcc (structure, "format", &format);
     switch (format) {
       case GST_MAKE_FOURCC ('Y', 'U', 'Y', '2'):
         stream->header.video.format.depth = 16;
@@ -315,149 +372,163 @@ gst_asfmux_vidsink_link (GstPad * pad, const GstCaps * caps)
         stream->header.video.format.planes = 3;
         break;
     }
+  } else if (!strcmp (mimetype, "video/x-wmv")) {
+    gint wmvversion = 0;
 
-    goto done;
-  } else {
-    stream->header.video.format.depth = 24;
-    stream->header.video.format.planes = 1;
-    stream->header.video.format.tag = 0;
-
-    /* find format */
-    if (!strcmp (mimetype, "video/x-huffyuv")) {
-      stream->header.video.format.tag = GST_MAKE_FOURCC ('H', 'F', 'Y', 'U');
-    } else if (!strcmp (mimetype, "image/jpeg")) {
-      stream->header.video.format.tag = GST_MAKE_FOURCC ('M', 'J', 'P', 'G');
-    } else if (!strcmp (mimetype, "video/x-divx")) {
-      gint divxversion;
-
-      gst_structure_get_int (structure, "divxversion", &divxversion);
-      switch (divxversion) {
-        case 3:
-          stream->header.video.format.tag =
-              GST_MAKE_FOURCC ('D', 'I', 'V', '3');
-          break;
-        case 4:
-          stream->header.video.format.tag =
-              GST_MAKE_FOURCC ('D', 'I', 'V', 'X');
-          break;
-        case 5:
-          stream->header.video.format.tag =
-              GST_MAKE_FOURCC ('D', 'X', '5', '0');
-          break;
-      }
-    } else if (!strcmp (mimetype, "video/x-xvid")) {
-      stream->header.video.format.tag = GST_MAKE_FOURCC ('X', 'V', 'I', 'D');
-    } else if (!strcmp (mimetype, "video/x-3ivx")) {
-      stream->header.video.format.tag = GST_MAKE_FOURCC ('3', 'I', 'V', '2');
-    } else if (!strcmp (mimetype, "video/x-msmpeg")) {
-      gint msmpegversion;
-
-      gst_structure_get_int (structure, "msmpegversion", &msmpegversion);
-      switch (msmpegversion) {
-        case 41:
-          stream->header.video.format.tag =
-              GST_MAKE_FOURCC ('M', 'P', 'G', '4');
+    /* VC-1 and friends carry their fourcc in the caps */
+    if (!gst_structure_get_fourcc (structure, "format", &format)) {
+      gst_structure_get_int (structure, "wmvversion", &wmvversion);
+      switch (wmvversion) {
+        case 1:
+          format = GST_MAKE_FOURCC ('W', 'M', 'V', '1');
           break;
-        case 42:
-          stream->header.video.format.tag =
-              GST_MAKE_FOURCC ('M', 'P', '4', '2');
+        case 2:
+          format = GST_MAKE_FOURCC ('W', 'M', 'V', '2');
           break;
-        case 43:
-          stream->header.video.format.tag =
-              GST_MAKE_FOURCC ('M', 'P', '4', '3');
+        case 3:
+          format = GST_MAKE_FOURCC ('W', 'M', 'V', '3');
           break;
       }
-    } else if (!strcmp (mimetype, "video/x-dv")) {
-      stream->header.video.format.tag = GST_MAKE_FOURCC ('D', 'V', 'S', 'D');
-    } else if (!strcmp (mimetype, "video/x-h263")) {
-      stream->header.video.format.tag = GST_MAKE_FOURCC ('H', '2', '6', '3');
-    } else if (!strcmp (mimetype, "video/mpeg")) {
-      stream->header.video.format.tag = GST_MAKE_FOURCC ('M', 'P', 'E', 'G');
     }
-
-    if (!stream->header.video.format.tag) {
-      return GST_PAD_LINK_REFUSED;
+  } else if (!strcmp (mimetype, "video/x-huffyuv")) {
+    format = GST_MAKE_FOURCC ('H', 'F', 'Y', 'U');
+  } else if (!strcmp (mimetype, "image/jpeg")) {
+    format = GST_MAKE_FOURCC ('M', 'J', 'P', 'G');
+  } else if (!strcmp (mimetype, "video/x-divx")) {
+    gint divxversion = 0;
+
+    gst_structure_get_int (structure, "divxversion", &divxversion);
+    switch (divxversion) {
+      case 3:
+        format = GST_MAKE_FOURCC ('D', 'I', 'V', '3');
+        break;
+      case 4:
+        format = GST_MAKE_FOURCC ('D', 'I', 'V', 'X');
+        break;
+      case 5:
+        format = GST_MAKE_FOURCC ('D', 'X', '5', '0');
+        break;
     }
-
-    goto done;
+  } else if (!strcmp (mimetype, "video/x-xvid")) {
+    format = GST_MAKE_FOURCC ('X', 'V', 'I', 'D');
+  } else if (!strcmp (mimetype, "video/x-3ivx")) {
+    format = GST_MAKE_FOURCC ('3', 'I', 'V', '2');
+  } else if (!strcmp (mimetype, "video/x-msmpeg")) {
+    gint msmpegversion = 0;
+
+    gst_structure_get_int (structure, "msmpegversion", &msmpegversion);
+    switch (msmpegversion) {
+      case 41:
+        format = GST_MAKE_FOURCC ('M', 'P', 'G', '4');
+        break;
+      case 42:
+        format = GST_MAKE_FOURCC ('M', 'P', '4', '2');
+        break;
+      case 43:
+        format = GST_MAKE_FOURCC ('M', 'P', '4', '3');
+        break;
+    }
+  } else if (!strcmp (mimetype, "video/x-h263")) {
+    format = GST_MAKE_FOURCC ('H', '2', '6', '3');
   }
-/*  return GST_PAD_LINK_REFUSED; */
-
-done:
-  stream->bitrate = 1024 * 1024;
-  stream->header.video.format.size = stream->header.video.stream.size;
-  stream->header.video.format.width = stream->header.video.stream.width;
-  stream->header.video.format.height = stream->header.video.stream.height;
-  stream->header.video.format.image_size = stream->header.video.stream.width *
-      stream->header.video.stream.height;
+
+  if (format == 0)
+    goto refuse_caps;
+
+  gst_asfmux_set_codec_data (stream, structure);
+  extra = stream->codec_data ? GST_BUFFER_SIZE (stream->codec_data) : 0;
+
+  if (gst_structure_get_int (structure, "bitrate", &bitrate))
+    stream->bitrate = bitrate;
+
+  stream->header.video.stream.width = w;
+  stream->header.video.stream.height = h;
+  stream->header.video.stream.unknown = 2;
+  stream->header.video.stream.size = 40 + extra;
+
+  stream->header.video.format.tag = format;
+  stream->header.video.format.size = 40 + extra;
+  stream->header.video.format.width = w;
+  stream->header.video.format.height = h;
+  stream->header.video.format.image_size = w * h;
   stream->header.video.format.xpels_meter = 0;
   stream->header.video.format.ypels_meter = 0;
   stream->header.video.format.num_colors = 0;
   stream->header.video.format.imp_colors = 0;
 
-  return GST_PAD_LINK_OK;
+  stream->configured = TRUE;
+
+  gst_object_unref (asfmux);
+  return TRUE;
+
+refuse_caps:
+  {
+    GST_WARNING_OBJECT (asfmux, "pad %s refused caps %" GST_PTR_FORMAT,
+        GST_PAD_NAME (pad), caps);
+    gst_object_unref (asfmux);
+    return FALSE;
+  }
 }
 
-static GstPadLinkReturn
-gst_asfmux_audsink_link (GstPad * pad, const GstCaps * caps)
+static gboolean
+gst_asfmux_audsink_setcaps (GstPad * pad, GstCaps * caps)
 {
   GstAsfMux *asfmux;
-  GstAsfMuxStream *stream = NULL;
-  gint n;
-  const gchar *mimetype;
-  gint rate, channels;
-  gboolean ret;
+  GstAsfMuxStream *stream;
   GstStructure *structure;
+  const gchar *mimetype;
+  gint rate, channels, bitrate = 0;
 
   asfmux = GST_ASFMUX (gst_pad_get_parent (pad));
+  stream = (GstAsfMuxStream *) gst_pad_get_element_private (pad);
 
-  for (n = 0; n < asfmux->num_outputs; n++) {
-    if (asfmux->output[n].pad == pad) {
-      stream = &asfmux->output[n];
-      break;
-    }
-  }
-  g_assert (n < asfmux->num_outputs);
-  g_assert (stream != NULL);
-  g_assert (stream->type == ASF_STREAM_AUDIO);
-
-  GST_DEBUG ("asfmux: audio sink_link triggered on %s", gst_pad_get_name (pad));
+  GST_DEBUG_OBJECT (asfmux, "%s:%s, caps %" GST_PTR_FORMAT,
+      GST_DEBUG_PAD_NAME (pad), caps);
 
   structure = gst_caps_get_structure (caps, 0);
 
   /* we want these for all */
-  ret = gst_structure_get_int (structure, "channels", &channels);
-  ret &= gst_structure_get_int (structure, "rate", &rate);
+  if (!gst_structure_get_int (structure, "channels", &channels) ||
+      !gst_structure_get_int (structure, "rate", &rate))
+    goto refuse_caps;
 
-  if (!ret)
-    return GST_PAD_LINK_REFUSED;
+  gst_structure_get_int (structure, "bitrate", &bitrate);
 
   stream->header.audio.sample_rate = rate;
   stream->header.audio.channels = channels;
+  stream->header.audio.codec_tag = 0;
 
   mimetype = gst_structure_get_name (structure);
   if (!strcmp (mimetype, "audio/x-raw-int")) {
-    gint block, size;
+    gint width = 16, depth = 16;
 
     stream->header.audio.codec_tag = GST_RIFF_WAVE_FORMAT_PCM;
 
-    gst_structure_get_int (structure, "width", &block);
-    gst_structure_get_int (structure, "depth", &size);
-
-    stream->header.audio.block_align = block;
-    stream->header.audio.word_size = size;
-    stream->header.audio.size = 0;
+    gst_structure_get_int (structure, "width", &width);
+    gst_structure_get_int (structure, "depth", &depth);
 
-    /* set some more info straight */
-    stream->header.audio.block_align /= 8;
-    stream->header.audio.block_align *= stream->header.audio.channels;
-    stream->header.audio.byte_rate = stream->header.audio.block_align *
-        stream->header.audio.sample_rate;
-    goto done;
+    stream->header.audio.block_align = (width / 8) * channels;
+    stream->header.audio.word_size = depth;
+    stream->header.audio.byte_rate = stream->header.audio.block_align * rate;
   } else {
-    stream->header.audio.codec_tag = 0;
+    gint block_align = 1;
+
+    if (!strcmp (mimetype, "audio/x-wma")) {
+      gint wmaversion = 0;
 
-    if (!strcmp (mimetype, "audio/mpeg")) {
+      gst_structure_get_int (structure, "wmaversion", &wmaversion);
+      switch (wmaversion) {
+        case 1:
+          stream->header.audio.codec_tag = GST_RIFF_WAVE_FORMAT_WMAV1;
+          break;
+        case 2:
+          stream->header.audio.codec_tag = GST_RIFF_WAVE_FORMAT_WMAV2;
+          break;
+        case 3:
+          stream->header.audio.codec_tag = GST_RIFF_WAVE_FORMAT_WMAV3;
+          break;
+      }
+    } else if (!strcmp (mimetype, "audio/mpeg")) {
       gint layer = 3;
 
       gst_structure_get_int (structure, "layer", &layer);
@@ -470,72 +541,59 @@ gst_asfmux_audsink_link (GstPad * pad, const GstCaps * caps)
           stream->header.audio.codec_tag = GST_RIFF_WAVE_FORMAT_MPEGL12;
           break;
       }
-    } else if (!strcmp (mimetype, "audio/x-vorbis")) {
-      stream->header.audio.codec_tag = GST_RIFF_WAVE_FORMAT_VORBIS3;
     } else if (!strcmp (mimetype, "audio/x-ac3")) {
       stream->header.audio.codec_tag = GST_RIFF_WAVE_FORMAT_A52;
     }
 
-    stream->header.audio.block_align = 1;
-    stream->header.audio.byte_rate = 8 * 1024;
-    stream->header.audio.word_size = 16;
-    stream->header.audio.size = 0;
+    gst_structure_get_int (structure, "block_align", &block_align);
 
-    if (!stream->header.audio.codec_tag) {
-      return GST_PAD_LINK_REFUSED;
+    /* without a bitrate the byte rate is measured while muxing and filled in
+     * when rewriting the header, which a streamable file doesn't get */
+    if (bitrate <= 0) {
+      if (asfmux->streamable)
+        goto no_bitrate;
+      GST_DEBUG_OBJECT (asfmux, "no bitrate in caps, estimating byte rate");
+      bitrate = 0;
     }
 
-    goto done;
+    stream->header.audio.block_align = block_align;
+    stream->header.audio.byte_rate = bitrate / 8;
+    stream->header.audio.word_size = 16;
   }
-/*  return GST_PAD_LINK_REFUSED; */
 
-done:
-  stream->bitrate = stream->header.audio.byte_rate * 8;
-  return GST_PAD_LINK_OK;
-}
+  if (!stream->header.audio.codec_tag)
+    goto refuse_caps;
 
-static void
-gst_asfmux_pad_link (GstPad * pad, GstPad * peer, gpointer data)
-{
-  GstAsfMux *asfmux;
-  GstAsfMuxStream *stream = NULL;
-  gint n;
+  gst_asfmux_set_codec_data (stream, structure);
+  stream->header.audio.size =
+      stream->codec_data ? GST_BUFFER_SIZE (stream->codec_data) : 0;
 
-  asfmux = GST_ASFMUX (gst_pad_get_parent (pad));
+  stream->bitrate = stream->header.audio.byte_rate * 8;
+  stream->configured = TRUE;
 
-  for (n = 0; n < asfmux->num_outputs; n++) {
-    if (asfmux->output[n].pad == pad) {
-      stream = &asfmux->output[n];
-      break;
-    }
-  }
-  g_assert (n < asfmux->num_outputs);
-  g_assert (stream != NULL);
-  g_assert (stream->connected == FALSE);
+  gst_object_unref (asfmux);
+  return TRUE;
 
-  stream->connected = TRUE;
+no_bitrate:
+  {
+    GST_WARNING_OBJECT (asfmux, "pad %s: need a bitrate in the caps for "
+        "streamable output", GST_PAD_NAME (pad));
+    gst_object_unref (asfmux);
+    return FALSE;
+  }
+refuse_caps:
+  {
+    GST_WARNING_OBJECT (asfmux, "pad %s refused caps %" GST_PTR_FORMAT,
+        GST_PAD_NAME (pad), caps);
+    gst_object_unref (asfmux);
+    return FALSE;
+  }
 }
 
 static void
-gst_asfmux_pad_unlink (GstPad * pad, GstPad * peer, gpointer data)
+gst_asfmux_stream_free (GstAsfMuxStream * stream)
 {
-  GstAsfMux *asfmux;
-  GstAsfMuxStream *stream = NULL;
-  gint n;
-
-  asfmux = GST_ASFMUX (gst_pad_get_parent (pad));
-
-  for (n = 0; n < asfmux->num_outputs; n++) {
-    if (asfmux->output[n].pad == pad) {
-      stream = &asfmux->output[n];
-      break;
-    }
-  }
-  g_assert (n < asfmux->num_outputs);
-  g_assert (stream != NULL);
-  g_assert (stream->connected == TRUE);
-
-  stream->connected = FALSE;
+  gst_buffer_replace (&stream->codec_data, NULL);
 }
 
 static GstPad *
@@ -543,10 +601,11 @@ gst_asfmux_request_new_pad (GstElement * element,
     GstPadTemplate * templ, const gchar * req_name)
 {
   GstAsfMux *asfmux;
+  GstAsfMuxStream *stream;
   GstPad *newpad;
+  GstPadSetCapsFunction setcapsfunc;
   gchar *padname;
-  GstPadLinkFunction linkfunc;
-  GstAsfMuxStream *stream;
+  gint type;
   GstElementClass *klass = GST_ELEMENT_GET_CLASS (element);
 
   g_return_val_if_fail (templ != NULL, NULL);
@@ -555,216 +614,144 @@ gst_asfmux_request_new_pad (GstElement * element,
 
   asfmux = GST_ASFMUX (element);
 
-  stream = &asfmux->output[asfmux->num_outputs++];
-  stream->queue = NULL;
-  stream->time = 0;
-  stream->connected = FALSE;
-  stream->eos = FALSE;
-  stream->seqnum = 0;
+  if (!asfmux->write_header) {
+    GST_WARNING_OBJECT (asfmux, "can't add new pads after the header was "
+        "written");
+    return NULL;
+  }
+
+  if (asfmux->num_outputs == MAX_ASF_OUTPUTS) {
+    GST_WARNING_OBJECT (asfmux, "too many streams");
+    return NULL;
+  }
 
   if (templ == gst_element_class_get_pad_template (klass, "audio_%d")) {
     padname = g_strdup_printf ("audio_%02d", asfmux->num_audio++);
-    stream->type = ASF_STREAM_AUDIO;
-    linkfunc = gst_asfmux_audsink_link;
+    type = ASF_STREAM_AUDIO;
+    setcapsfunc = GST_DEBUG_FUNCPTR (gst_asfmux_audsink_setcaps);
   } else if (templ == gst_element_class_get_pad_template (klass, "video_%d")) {
     padname = g_strdup_printf ("video_%02d", asfmux->num_video++);
-    stream->type = ASF_STREAM_VIDEO;
-    linkfunc = gst_asfmux_vidsink_link;
+    type = ASF_STREAM_VIDEO;
+    setcapsfunc = GST_DEBUG_FUNCPTR (gst_asfmux_vidsink_setcaps);
   } else {
     g_warning ("asfmux: this is not our template!\n");
     return NULL;
   }
 
   newpad = gst_pad_new_from_template (templ, padname);
-  stream->pad = newpad;
   g_free (padname);
 
-  g_signal_connect (newpad, "linked",
-      G_CALLBACK (gst_asfmux_pad_link), (gpointer) asfmux);
-  g_signal_connect (newpad, "unlinked",
-      G_CALLBACK (gst_asfmux_pad_unlink), (gpointer) asfmux);
-  gst_pad_set_link_function (newpad, linkfunc);
+  stream = (GstAsfMuxStream *) gst_collect_pads_add_pad_full (asfmux->collect,
+      newpad, sizeof (GstAsfMuxStream),
+      (GstCollectDataDestroyNotify) gst_asfmux_stream_free);
+  stream->type = type;
+  stream->number = asfmux->num_outputs + 1;
+  stream->configured = FALSE;
+  stream->released = FALSE;
+  stream->seqnum = 0;
+  stream->bitrate = 0;
+  stream->bytes = 0;
+  stream->codec_data = NULL;
+  asfmux->output[asfmux->num_outputs++] = stream;
+
+  gst_pad_set_element_private (newpad, stream);
+  gst_pad_set_setcaps_function (newpad, setcapsfunc);
   gst_element_add_pad (element, newpad);
-  gst_pad_set_event_mask_function (newpad, gst_asfmux_get_event_masks);
 
   return newpad;
 }
 
-/* can we seek? If not, we assume we're streamable */
-static gboolean
-gst_asfmux_can_seek (GstAsfMux * asfmux)
-{
-#if 0
-  const GstEventMask *masks =
-      gst_pad_get_event_masks (GST_PAD_PEER (asfmux->srcpad));
-
-  /* this is for stream or file-storage */
-  while (masks != NULL && masks->type != 0) {
-    if (masks->type == GST_EVENT_SEEK) {
-      return TRUE;
-    } else {
-      masks++;
-    }
-  }
-
-  return FALSE;
-#endif
-  return TRUE;
-}
-
-static gboolean
-gst_asfmux_is_stream (GstAsfMux * asfmux)
-{
-  /* this is for RTP */
-  return FALSE;                 /*!gst_asfmux_can_seek (asfmux) */
-}
-
-/* handle events (search) */
-static gboolean
-gst_asfmux_handle_event (GstPad * pad, GstEvent * event)
-{
-  GstAsfMux *asfmux;
-  GstEventType type;
-  gint n;
-
-  asfmux = GST_ASFMUX (gst_pad_get_parent (pad));
-
-  type = event ? GST_EVENT_TYPE (event) : GST_EVENT_UNKNOWN;
-
-  switch (type) {
-    case GST_EVENT_EOS:
-      /* is this allright? */
-      for (n = 0; n < asfmux->num_outputs; n++) {
-        if (asfmux->output[n].pad == pad) {
-          asfmux->output[n].eos = TRUE;
-          break;
-        }
-      }
-      if (n == asfmux->num_outputs) {
-        g_warning ("Unknown pad for EOS!");
-      }
-      break;
-    default:
-      break;
-  }
-
-  return TRUE;
-}
-
-/* fill the internal queue for each available pad */
 static void
-gst_asfmux_fill_queue (GstAsfMux * asfmux)
+gst_asfmux_release_pad (GstElement * element, GstPad * pad)
 {
-  GstBuffer *buffer;
+  GstAsfMux *asfmux = GST_ASFMUX (element);
+  GstAsfMuxStream *stream, *copy;
   gint n;
 
+  stream = (GstAsfMuxStream *) gst_pad_get_element_private (pad);
+
   for (n = 0; n < asfmux->num_outputs; n++) {
-    GstAsfMuxStream *stream = &asfmux->output[n];
-
-    while (stream->queue == NULL &&
-        stream->pad != NULL &&
-        stream->connected == TRUE &&
-        GST_PAD_IS_USABLE (stream->pad) && stream->eos == FALSE) {
-      buffer = GST_BUFFER (gst_pad_pull (stream->pad));
-      if (GST_IS_EVENT (buffer)) {
-        gst_asfmux_handle_event (stream->pad, GST_EVENT (buffer));
-      } else {
-        stream->queue = buffer;
-      }
+    if (asfmux->output[n] != stream)
+      continue;
+
+    if (asfmux->write_header) {
+      memmove (&asfmux->output[n], &asfmux->output[n + 1],
+          (asfmux->num_outputs - n - 1) * sizeof (GstAsfMuxStream *));
+      asfmux->num_outputs--;
+    } else {
+      /* the header already describes this stream and the other streams were
+       * muxed with their numbers, keep a copy of it for rewriting the header
+       * at EOS until the next reset */
+      GST_DEBUG_OBJECT (asfmux, "keeping stream %u of released pad %s",
+          stream->number, GST_PAD_NAME (pad));
+      copy = g_memdup (stream, sizeof (GstAsfMuxStream));
+      memset (&copy->collect, 0, sizeof (GstCollectData));
+      copy->codec_data = NULL;
+      gst_buffer_replace (&copy->codec_data, stream->codec_data);
+      copy->released = TRUE;
+      if (asfmux->index_stream == stream)
+        asfmux->index_stream = copy;
+      asfmux->output[n] = copy;
     }
+    break;
   }
-}
 
-static guint
-gst_asfmux_packet_remaining (GstAsfMux * asfmux)
-{
-  guint position;
-
-  if (asfmux->packet != NULL) {
-    position = GST_BUFFER_SIZE (asfmux->packet);
-  } else {
-    position = 0;
+  /* renumber, stream numbers have to be contiguous in the header */
+  if (asfmux->write_header) {
+    for (n = 0; n < asfmux->num_outputs; n++)
+      asfmux->output[n]->number = n + 1;
   }
 
-  return GST_ASF_PACKET_SIZE - GST_ASF_PACKET_HEADER_SIZE - 2 - position;
+  gst_collect_pads_remove_pad (asfmux->collect, pad);
+  gst_element_remove_pad (element, pad);
 }
 
-static void
-gst_asfmux_put_buffer (GstBuffer * packet, guint8 * data, guint length)
+static inline void
+gst_asfmux_put_byte (guint8 ** p_data, guint8 data)
 {
-  if ((GST_BUFFER_MAXSIZE (packet) - GST_BUFFER_SIZE (packet)) >= length) {
-    guint8 *pos = GST_BUFFER_DATA (packet) + GST_BUFFER_SIZE (packet);
-
-    memcpy (pos, data, length);
-    GST_BUFFER_SIZE (packet) += length;
-  } else {
-    g_warning ("Buffer too small");
-  }
+  GST_WRITE_UINT8 (*p_data, data);
+  *p_data += 1;
 }
 
-static void
-gst_asfmux_put_byte (GstBuffer * packet, guint8 data)
+static inline void
+gst_asfmux_put_le16 (guint8 ** p_data, guint16 data)
 {
-  if ((GST_BUFFER_MAXSIZE (packet) - GST_BUFFER_SIZE (packet)) >= sizeof (data)) {
-    guint8 *pos = GST_BUFFER_DATA (packet) + GST_BUFFER_SIZE (packet);
-
-    *(guint8 *) pos = data;
-    GST_BUFFER_SIZE (packet) += 1;
-  } else {
-    g_warning ("Buffer too small");
-  }
+  GST_WRITE_UINT16_LE (*p_data, data);
+  *p_data += 2;
 }
 
-static void
-gst_asfmux_put_le16 (GstBuffer * packet, guint16 data)
+static inline void
+gst_asfmux_put_le32 (guint8 ** p_data, guint32 data)
 {
-  if ((GST_BUFFER_MAXSIZE (packet) - GST_BUFFER_SIZE (packet)) >= sizeof (data)) {
-    guint8 *pos = GST_BUFFER_DATA (packet) + GST_BUFFER_SIZE (packet);
-
-    *(guint16 *) pos = GUINT16_TO_LE (data);
-    GST_BUFFER_SIZE (packet) += 2;
-  } else {
-    g_warning ("Buffer too small");
-  }
+  GST_WRITE_UINT32_LE (*p_data, data);
+  *p_data += 4;
 }
 
-static void
-gst_asfmux_put_le32 (GstBuffer * packet, guint32 data)
+static inline void
+gst_asfmux_put_le64 (guint8 ** p_data, guint64 data)
 {
-  if ((GST_BUFFER_MAXSIZE (packet) - GST_BUFFER_SIZE (packet)) >= sizeof (data)) {
-    guint8 *pos = GST_BUFFER_DATA (packet) + GST_BUFFER_SIZE (packet);
-
-    *(guint32 *) pos = GUINT32_TO_LE (data);
-    GST_BUFFER_SIZE (packet) += 4;
-  } else {
-    g_warning ("Buffer too small");
-  }
+  GST_WRITE_UINT64_LE (*p_data, data);
+  *p_data += 8;
 }
 
 static void
-gst_asfmux_put_le64 (GstBuffer * packet, guint64 data)
+gst_asfmux_put_buffer (guint8 ** p_data, const guint8 * data, guint length)
 {
-  if ((GST_BUFFER_MAXSIZE (packet) - GST_BUFFER_SIZE (packet)) >= sizeof (data)) {
-    guint8 *pos = GST_BUFFER_DATA (packet) + GST_BUFFER_SIZE (packet);
-
-    *(guint64 *) pos = GUINT64_TO_LE (data);
-    GST_BUFFER_SIZE (packet) += 8;
-  } else {
-    g_warning ("Buffer too small");
-  }
+  memcpy (*p_data, data, length);
+  *p_data += length;
 }
 
 static void
-gst_asfmux_put_time (GstBuffer * packet, guint64 time)
+gst_asfmux_put_time (guint8 ** p_data, guint64 time)
 {
-  gst_asfmux_put_le64 (packet, time + G_GINT64_CONSTANT (116444736000000000));
+  gst_asfmux_put_le64 (p_data, time + G_GINT64_CONSTANT (116444736000000000));
 }
 
 static void
-gst_asfmux_put_guid (GstBuffer * packet, ASFGuidHash * hash, guint8 id)
+gst_asfmux_put_guid (guint8 ** p_data, const ASFGuidHash * hash, guint8 id)
 {
   gint n = 0;
-  ASFGuid *guid;
+  const ASFGuid *guid;
 
   /* find GUID */
   while (hash[n].obj_id != id && hash[n].obj_id != ASF_OBJ_UNDEFINED) {
@@ -772,525 +759,634 @@ gst_asfmux_put_guid (GstBuffer * packet, ASFGuidHash * hash, guint8 id)
   }
   guid = &hash[n].guid;
 
-  gst_asfmux_put_le32 (packet, guid->v1);
-  gst_asfmux_put_le32 (packet, guid->v2);
-  gst_asfmux_put_le32 (packet, guid->v3);
-  gst_asfmux_put_le32 (packet, guid->v4);
+  gst_asfmux_put_le32 (p_data, guid->v1);
+  gst_asfmux_put_le32 (p_data, guid->v2);
+  gst_asfmux_put_le32 (p_data, guid->v3);
+  gst_asfmux_put_le32 (p_data, guid->v4);
 }
 
+/* the file ID, all zeroes */
 static void
-gst_asfmux_put_string (GstBuffer * packet, const gchar * str)
+gst_asfmux_put_file_id (guint8 ** p_data)
 {
-  gunichar2 *utf16_str = g_utf8_to_utf16 (str, strlen (str), NULL, NULL, NULL);
-  gint i, len = strlen (str);
+  memset (*p_data, 0, 16);
+  *p_data += 16;
+}
+
+/* writes the length of @str in UTF-16 characters, including the
+ * terminating 0, followed by the string. A string that isn't valid UTF-8
+ * is written as an empty one. */
+static void
+gst_asfmux_put_string (guint8 ** p_data, const gchar * str)
+{
+  gunichar2 *utf16_str;
+  glong i, len = 0;
 
-  /* this is not an off-by-one-bug, we need the terminating /0 too */
-  for (i = 0; i <= len; i++) {
-    gst_asfmux_put_le16 (packet, utf16_str[i]);
+  utf16_str = g_utf8_to_utf16 (str, -1, NULL, &len, NULL);
+  if (utf16_str == NULL) {
+    GST_WARNING ("string '%s' is not valid UTF-8, writing it empty", str);
+    len = 0;
   }
 
+  gst_asfmux_put_le16 (p_data, len + 1);
+  for (i = 0; i < len; i++)
+    gst_asfmux_put_le16 (p_data, utf16_str[i]);
+  gst_asfmux_put_le16 (p_data, 0);
+
   g_free (utf16_str);
 }
 
 static void
-gst_asfmux_put_flush (GstAsfMux * asfmux)
+gst_asfmux_put_codec_data (guint8 ** p_data, GstAsfMuxStream * stream)
 {
-  gst_pad_push (asfmux->srcpad, GST_DATA (gst_event_new_flush ()));
+  if (stream->codec_data) {
+    gst_asfmux_put_buffer (p_data, GST_BUFFER_DATA (stream->codec_data),
+        GST_BUFFER_SIZE (stream->codec_data));
+  }
 }
 
-/* write an asf chunk (only used in streaming case) */
 static void
-gst_asfmux_put_chunk (GstBuffer * packet,
-    GstAsfMux * asfmux, guint16 type, guint length, gint flags)
+gst_asfmux_put_wav_header (guint8 ** p_data, asf_stream_audio * hdr)
 {
-  gst_asfmux_put_le16 (packet, type);
-  gst_asfmux_put_le16 (packet, length + 8);
-  gst_asfmux_put_le32 (packet, asfmux->sequence++);
-  gst_asfmux_put_le16 (packet, flags);
-  gst_asfmux_put_le16 (packet, length + 8);
+  gst_asfmux_put_le16 (p_data, hdr->codec_tag);
+  gst_asfmux_put_le16 (p_data, hdr->channels);
+  gst_asfmux_put_le32 (p_data, hdr->sample_rate);
+  gst_asfmux_put_le32 (p_data, hdr->byte_rate);
+  gst_asfmux_put_le16 (p_data, hdr->block_align);
+  gst_asfmux_put_le16 (p_data, hdr->word_size);
+  gst_asfmux_put_le16 (p_data, hdr->size);
 }
 
 static void
-gst_asfmux_put_wav_header (GstBuffer * packet, asf_stream_audio * hdr)
+gst_asfmux_put_vid_header (guint8 ** p_data, asf_stream_video * hdr)
 {
-  gst_asfmux_put_le16 (packet, hdr->codec_tag);
-  gst_asfmux_put_le16 (packet, hdr->channels);
-  gst_asfmux_put_le32 (packet, hdr->sample_rate);
-  gst_asfmux_put_le32 (packet, hdr->byte_rate);
-  gst_asfmux_put_le16 (packet, hdr->block_align);
-  gst_asfmux_put_le16 (packet, hdr->word_size);
-  gst_asfmux_put_le16 (packet, hdr->size);
+  gst_asfmux_put_le32 (p_data, hdr->width);
+  gst_asfmux_put_le32 (p_data, hdr->height);
+  gst_asfmux_put_byte (p_data, hdr->unknown);
+  gst_asfmux_put_le16 (p_data, hdr->size);
 }
 
 static void
-gst_asfmux_put_vid_header (GstBuffer * packet, asf_stream_video * hdr)
+gst_asfmux_put_bmp_header (guint8 ** p_data, asf_stream_video_format * hdr)
 {
-  gst_asfmux_put_le32 (packet, hdr->width);
-  gst_asfmux_put_le32 (packet, hdr->height);
-  gst_asfmux_put_byte (packet, hdr->unknown);
-  gst_asfmux_put_le16 (packet, hdr->size);
+  gst_asfmux_put_le32 (p_data, hdr->size);
+  gst_asfmux_put_le32 (p_data, hdr->width);
+  gst_asfmux_put_le32 (p_data, hdr->height);
+  gst_asfmux_put_le16 (p_data, hdr->planes);
+  gst_asfmux_put_le16 (p_data, hdr->depth);
+  gst_asfmux_put_le32 (p_data, hdr->tag);
+  gst_asfmux_put_le32 (p_data, hdr->image_size);
+  gst_asfmux_put_le32 (p_data, hdr->xpels_meter);
+  gst_asfmux_put_le32 (p_data, hdr->ypels_meter);
+  gst_asfmux_put_le32 (p_data, hdr->num_colors);
+  gst_asfmux_put_le32 (p_data, hdr->imp_colors);
 }
 
+/* init object header, the size is filled in by _end_header() */
+static guint8 *
+gst_asfmux_put_header (guint8 ** p_data, const ASFGuidHash * hash, guint8 id)
+{
+  guint8 *start = *p_data;
+
+  gst_asfmux_put_guid (p_data, hash, id);
+  gst_asfmux_put_le64 (p_data, 24);
+  return start;
+}
+
+/* update object size */
 static void
-gst_asfmux_put_bmp_header (GstBuffer * packet, asf_stream_video_format * hdr)
+gst_asfmux_end_header (guint8 * start, guint8 * end)
 {
-  gst_asfmux_put_le32 (packet, hdr->size);
-  gst_asfmux_put_le32 (packet, hdr->width);
-  gst_asfmux_put_le32 (packet, hdr->height);
-  gst_asfmux_put_le16 (packet, hdr->planes);
-  gst_asfmux_put_le16 (packet, hdr->depth);
-  gst_asfmux_put_le32 (packet, hdr->tag);
-  gst_asfmux_put_le32 (packet, hdr->image_size);
-  gst_asfmux_put_le32 (packet, hdr->xpels_meter);
-  gst_asfmux_put_le32 (packet, hdr->ypels_meter);
-  gst_asfmux_put_le32 (packet, hdr->num_colors);
-  gst_asfmux_put_le32 (packet, hdr->imp_colors);
+  GST_WRITE_UINT64_LE (start + 16, end - start);
 }
 
-/* init header */
 static guint
-gst_asfmux_put_header (GstBuffer * packet, ASFGuidHash * hash, guint8 id)
+gst_asfmux_get_stream_bitrate (GstAsfMux * asfmux, GstAsfMuxStream * stream)
 {
-  guint pos = GST_BUFFER_SIZE (packet);
+  guint64 measured = 0;
+
+  if (asfmux->duration > 0) {
+    measured = gst_util_uint64_scale (stream->bytes * 8, GST_SECOND,
+        asfmux->duration);
+  }
 
-  gst_asfmux_put_guid (packet, hash, id);
-  gst_asfmux_put_le64 (packet, 24);
-  return pos;
+  return MAX (stream->bitrate, measured);
 }
 
-/* update header size */
-static void
-gst_asfmux_end_header (GstBuffer * packet, guint pos)
+static guint
+gst_asfmux_get_bitrate (GstAsfMux * asfmux)
 {
-  guint cur = GST_BUFFER_SIZE (packet);
+  guint bitrate = 0;
+  gint n;
+
+  for (n = 0; n < asfmux->num_outputs; n++)
+    bitrate += gst_asfmux_get_stream_bitrate (asfmux, asfmux->output[n]);
 
-  GST_BUFFER_SIZE (packet) = pos + sizeof (ASFGuid);
-  gst_asfmux_put_le64 (packet, cur - pos);
-  GST_BUFFER_SIZE (packet) = cur;
+  return bitrate;
 }
 
-static void
-gst_asfmux_file_start (GstAsfMux * asfmux, guint64 file_size, guint64 data_size)
+/* creates the header object followed by the start of the data object. The
+ * size doesn't depend on anything but the streams and their caps, so the
+ * rewritten header at EOS fits exactly in place of the first one */
+static GstBuffer *
+gst_asfmux_make_header (GstAsfMux * asfmux)
 {
-  GstBuffer *header = gst_buffer_new_and_alloc (4096);
-  guint bitrate;
-  guint header_offset, header_pos, header_size;
+  GstBuffer *header;
+  guint8 *data, *start, *header_start, *obj;
+  guint64 file_size, duration;
+  guint alloc_size, flags;
   gint n;
-  guint64 duration;
 
-  bitrate = 0;
+  alloc_size = 1024;
   for (n = 0; n < asfmux->num_outputs; n++) {
-    GstAsfMuxStream *stream = &asfmux->output[n];
-
-    bitrate += stream->bitrate;
+    alloc_size += 256;
+    if (asfmux->output[n]->codec_data)
+      alloc_size += GST_BUFFER_SIZE (asfmux->output[n]->codec_data);
   }
 
-  GST_BUFFER_SIZE (header) = 0;
-  if (asfmux->packet != NULL) {
-    duration = GST_BUFFER_DURATION (asfmux->packet) +
-        GST_BUFFER_TIMESTAMP (asfmux->packet);
-  } else {
-    duration = 0;
-  }
+  header = gst_buffer_new_and_alloc (alloc_size);
+  start = data = GST_BUFFER_DATA (header);
 
-  if (gst_asfmux_is_stream (asfmux)) {
-    /* start of stream (length will be patched later) */
-    gst_asfmux_put_chunk (header, asfmux, 0x4824, 0, 0xc00);
-  }
-
-  gst_asfmux_put_guid (header, asf_object_guids, ASF_OBJ_HEADER);
-  /* header length, will be patched after */
-  gst_asfmux_put_le64 (header, ~0);
-  /* number of chunks in header */
-  gst_asfmux_put_le32 (header, 3 + /*has_title + */ asfmux->num_outputs);
-  gst_asfmux_put_byte (header, 1);      /* ??? */
-  gst_asfmux_put_byte (header, 2);      /* ??? */
-
-  /* file header */
-  header_offset = GST_BUFFER_SIZE (header);
-  header_pos = gst_asfmux_put_header (header, asf_object_guids, ASF_OBJ_FILE);
-  gst_asfmux_put_guid (header, asf_object_guids, ASF_OBJ_UNDEFINED);
-  gst_asfmux_put_le64 (header, file_size);
-  gst_asfmux_put_time (header, 0);
-  gst_asfmux_put_le64 (header, asfmux->num_packets);    /* number of packets */
-  gst_asfmux_put_le64 (header, duration / (GST_SECOND / 10000000));     /* end time stamp (in 100ns units) */
-  gst_asfmux_put_le64 (header, duration / (GST_SECOND / 10000000));     /* duration (in 100ns units) */
-  gst_asfmux_put_le64 (header, 0);      /* start time stamp */
-  gst_asfmux_put_le32 (header, gst_asfmux_can_seek (asfmux) ? 0x02 : 0x01);     /* seekable or streamable */
-  gst_asfmux_put_le32 (header, GST_ASF_PACKET_SIZE);    /* packet size */
-  gst_asfmux_put_le32 (header, GST_ASF_PACKET_SIZE);    /* packet size */
-  gst_asfmux_put_le32 (header, bitrate);        /* Nominal data rate in bps */
-  gst_asfmux_end_header (header, header_pos);
-
-  /* unknown headers */
-  header_pos = gst_asfmux_put_header (header, asf_object_guids, ASF_OBJ_HEAD1);
-  gst_asfmux_put_guid (header, asf_object_guids, ASF_OBJ_HEAD2);
-  gst_asfmux_put_le32 (header, 6);
-  gst_asfmux_put_le16 (header, 0);
-  gst_asfmux_end_header (header, header_pos);
-
-  /* title and other infos */
-#if 0
-  if (has_title) {
-    header_pos =
-        gst_asfmux_put_header (header, asf_object_guids, ASF_OBJ_COMMENT);
-    gst_asfmux_put_le16 (header, 2 * (strlen (title) + 1));
-    gst_asfmux_put_le16 (header, 2 * (strlen (author) + 1));
-    gst_asfmux_put_le16 (header, 2 * (strlen (copyright) + 1));
-    gst_asfmux_put_le16 (header, 2 * (strlen (comment) + 1));
-    gst_asfmux_put_le16 (header, 0);    /* rating */
-    gst_asfmux_put_string (header, title);
-    gst_asfmux_put_string (header, author);
-    gst_asfmux_put_string (header, copyright);
-    gst_asfmux_put_string (header, comment);
-    gst_asfmux_end_header (header, header_pos);
+  if (asfmux->streamable) {
+    flags = 0x01;               /* broadcast */
+    file_size = 0;
+    duration = 0;
+  } else {
+    flags = 0x02;               /* seekable */
+    file_size = asfmux->header_size + GST_ASF_DATA_OBJECT_SIZE +
+        asfmux->num_packets * asfmux->packet_size;
+    if (asfmux->index->len > 0)
+      file_size += 24 + 16 + 8 + 4 + 4 + asfmux->index->len * 6;
+    duration = GST_TIME_TO_ASF (asfmux->duration);
   }
-#endif
 
-  /* stream headers */
+  header_start = gst_asfmux_put_header (&data, asf_object_guids,
+      ASF_OBJ_HEADER);
+  /* number of objects in header */
+  gst_asfmux_put_le32 (&data, 3 + asfmux->num_outputs);
+  gst_asfmux_put_byte (&data, 1);       /* reserved */
+  gst_asfmux_put_byte (&data, 2);       /* reserved */
+
+  /* file properties */
+  obj = gst_asfmux_put_header (&data, asf_object_guids, ASF_OBJ_FILE);
+  gst_asfmux_put_file_id (&data);
+  gst_asfmux_put_le64 (&data, file_size);
+  gst_asfmux_put_time (&data, 0);
+  gst_asfmux_put_le64 (&data, asfmux->streamable ? 0 : asfmux->num_packets);
+  gst_asfmux_put_le64 (&data, duration);        /* play duration */
+  gst_asfmux_put_le64 (&data, duration);        /* send duration */
+  gst_asfmux_put_le64 (&data, 0);       /* preroll */
+  gst_asfmux_put_le32 (&data, flags);
+  gst_asfmux_put_le32 (&data, asfmux->packet_size);     /* min packet size */
+  gst_asfmux_put_le32 (&data, asfmux->packet_size);     /* max packet size */
+  gst_asfmux_put_le32 (&data, gst_asfmux_get_bitrate (asfmux));
+  gst_asfmux_end_header (obj, data);
+
+  /* header extension, empty */
+  obj = gst_asfmux_put_header (&data, asf_object_guids, ASF_OBJ_HEAD1);
+  gst_asfmux_put_guid (&data, asf_object_guids, ASF_OBJ_HEAD2);
+  gst_asfmux_put_le16 (&data, 6);
+  gst_asfmux_put_le32 (&data, 0);
+  gst_asfmux_end_header (obj, data);
+
+  /* stream properties */
   for (n = 0; n < asfmux->num_outputs; n++) {
-    GstAsfMuxStream *stream = &asfmux->output[n];
-    guint obj_size = 0;
+    GstAsfMuxStream *stream = asfmux->output[n];
+    guint extra, obj_size = 0;
 
-    stream->seqnum = 0;
-    header_pos =
-        gst_asfmux_put_header (header, asf_object_guids, ASF_OBJ_STREAM);
+    extra = stream->codec_data ? GST_BUFFER_SIZE (stream->codec_data) : 0;
+
+    obj = gst_asfmux_put_header (&data, asf_object_guids, ASF_OBJ_STREAM);
 
     switch (stream->type) {
       case ASF_STREAM_AUDIO:
-        obj_size = 18;
-        gst_asfmux_put_guid (header, asf_stream_guids, ASF_STREAM_AUDIO);
-        gst_asfmux_put_guid (header, asf_correction_guids, ASF_CORRECTION_OFF);
+        obj_size = 18 + extra;
+        gst_asfmux_put_guid (&data, asf_stream_guids, ASF_STREAM_AUDIO);
         break;
       case ASF_STREAM_VIDEO:
-        obj_size = 11 + 40;
-        gst_asfmux_put_guid (header, asf_stream_guids, ASF_STREAM_VIDEO);
-        gst_asfmux_put_guid (header, asf_correction_guids, ASF_CORRECTION_OFF);
+        obj_size = 11 + 40 + extra;
+        gst_asfmux_put_guid (&data, asf_stream_guids, ASF_STREAM_VIDEO);
         break;
       default:
-        g_assert (0);
+        g_assert_not_reached ();
     }
+    gst_asfmux_put_guid (&data, asf_correction_guids, ASF_CORRECTION_OFF);
 
-    gst_asfmux_put_le64 (header, 0);    /* offset */
-    gst_asfmux_put_le32 (header, obj_size);     /* wav header len */
-    gst_asfmux_put_le32 (header, 0);    /* additional data len */
-    gst_asfmux_put_le16 (header, n + 1);        /* stream number */
-    gst_asfmux_put_le32 (header, 0);    /* ??? */
+    gst_asfmux_put_le64 (&data, 0);     /* time offset */
+    gst_asfmux_put_le32 (&data, obj_size);      /* type specific data len */
+    gst_asfmux_put_le32 (&data, 0);     /* error correction data len */
+    gst_asfmux_put_le16 (&data, stream->number);        /* flags */
+    gst_asfmux_put_le32 (&data, 0);     /* reserved */
 
     switch (stream->type) {
-      case ASF_STREAM_AUDIO:
-        gst_asfmux_put_wav_header (header, &stream->header.audio);
+      case ASF_STREAM_AUDIO:{
+        asf_stream_audio audio = stream->header.audio;
+
+        /* no bitrate in the caps, use what we measured so far */
+        if (audio.byte_rate == 0)
+          audio.byte_rate = gst_asfmux_get_stream_bitrate (asfmux, stream) / 8;
+        gst_asfmux_put_wav_header (&data, &audio);
         break;
+      }
       case ASF_STREAM_VIDEO:
-        gst_asfmux_put_vid_header (header, &stream->header.video.stream);
-        gst_asfmux_put_bmp_header (header, &stream->header.video.format);
+        gst_asfmux_put_vid_header (&data, &stream->header.video.stream);
+        gst_asfmux_put_bmp_header (&data, &stream->header.video.format);
         break;
     }
+    gst_asfmux_put_codec_data (&data, stream);
 
-    gst_asfmux_end_header (header, header_pos);
+    gst_asfmux_end_header (obj, data);
   }
 
-  /* media comments */
-  header_pos =
-      gst_asfmux_put_header (header, asf_object_guids, ASF_OBJ_CODEC_COMMENT);
-  gst_asfmux_put_guid (header, asf_object_guids, ASF_OBJ_CODEC_COMMENT1);
-  gst_asfmux_put_le32 (header, asfmux->num_outputs);
+  /* codec list */
+  obj = gst_asfmux_put_header (&data, asf_object_guids, ASF_OBJ_CODEC_COMMENT);
+  gst_asfmux_put_guid (&data, asf_object_guids, ASF_OBJ_CODEC_COMMENT1);
+  gst_asfmux_put_le32 (&data, asfmux->num_outputs);
   for (n = 0; n < asfmux->num_outputs; n++) {
-    GstAsfMuxStream *stream = &asfmux->output[n];
-    const char codec[] = "Unknown codec";
+    GstAsfMuxStream *stream = asfmux->output[n];
+    const gchar codec[] = "Unknown codec";
 
-    gst_asfmux_put_le16 (header, stream->index + 1);
-    /* Isn't this wrong? This is UTF16! */
-    gst_asfmux_put_le16 (header, strlen (codec) + 1);
-    gst_asfmux_put_string (header, codec);
-    gst_asfmux_put_le16 (header, 0);    /* no parameters */
-
-    /* id */
+    /* type, name (length in characters), empty description, codec id */
     switch (stream->type) {
       case ASF_STREAM_AUDIO:
-        gst_asfmux_put_le16 (header, 2);
-        gst_asfmux_put_le16 (header, stream->header.audio.codec_tag);
+        gst_asfmux_put_le16 (&data, 2);
+        gst_asfmux_put_string (&data, codec);
+        gst_asfmux_put_le16 (&data, 0);
+        gst_asfmux_put_le16 (&data, 2);
+        gst_asfmux_put_le16 (&data, stream->header.audio.codec_tag);
         break;
       case ASF_STREAM_VIDEO:
-        gst_asfmux_put_le16 (header, 4);
-        gst_asfmux_put_le32 (header, stream->header.video.format.tag);
+        gst_asfmux_put_le16 (&data, 1);
+        gst_asfmux_put_string (&data, codec);
+        gst_asfmux_put_le16 (&data, 0);
+        gst_asfmux_put_le16 (&data, 4);
+        gst_asfmux_put_le32 (&data, stream->header.video.format.tag);
         break;
       default:
-        g_assert (0);
+        g_assert_not_reached ();
     }
   }
-  gst_asfmux_end_header (header, header_pos);
+  gst_asfmux_end_header (obj, data);
+
+  gst_asfmux_end_header (header_start, data);
 
-  /* patch the header size fields */
-  header_pos = GST_BUFFER_SIZE (header);
-  header_size = header_pos - header_offset;
-  if (gst_asfmux_is_stream (asfmux)) {
-    header_size += 8 + 30 + 50;
+  /* data object, followed by packets of packet_size */
+  gst_asfmux_put_guid (&data, asf_object_guids, ASF_OBJ_DATA);
+  gst_asfmux_put_le64 (&data, asfmux->streamable ? 0 :
+      GST_ASF_DATA_OBJECT_SIZE + asfmux->num_packets * asfmux->packet_size);
+  gst_asfmux_put_file_id (&data);
+  gst_asfmux_put_le64 (&data, asfmux->streamable ? 0 : asfmux->num_packets);
+  gst_asfmux_put_byte (&data, 1);       /* reserved */
+  gst_asfmux_put_byte (&data, 1);       /* reserved */
 
-    GST_BUFFER_SIZE (header) = header_offset - 10 - 30;
-    gst_asfmux_put_le16 (header, header_size);
-    GST_BUFFER_SIZE (header) = header_offset - 2 - 30;
-    gst_asfmux_put_le16 (header, header_size);
+  g_assert (data - start <= alloc_size);
+  GST_BUFFER_SIZE (header) = data - start;
 
-    header_size -= 8 + 30 + 50;
+  return header;
+}
+
+static GstFlowReturn
+gst_asfmux_push (GstAsfMux * asfmux, GstBuffer * buf)
+{
+  gst_buffer_set_caps (buf, GST_PAD_CAPS (asfmux->srcpad));
+  return gst_pad_push (asfmux->srcpad, buf);
+}
+
+static GstFlowReturn
+gst_asfmux_file_start (GstAsfMux * asfmux)
+{
+  GstBuffer *header;
+  GstCaps *caps;
+  gint n;
+
+  /* index the key frames of the first video stream, or the first stream */
+  for (n = 0; n < asfmux->num_outputs; n++) {
+    if (asfmux->output[n]->type == ASF_STREAM_VIDEO) {
+      asfmux->index_stream = asfmux->output[n];
+      break;
+    }
   }
-  header_size += 24 + 6;
-  GST_BUFFER_SIZE (header) = header_offset - 14;
-  gst_asfmux_put_le64 (header, header_size);
-  GST_BUFFER_SIZE (header) = header_pos;
-
-  /* movie chunk, followed by packets of packet_size */
-  asfmux->data_offset = GST_BUFFER_SIZE (header);
-  gst_asfmux_put_guid (header, asf_object_guids, ASF_OBJ_DATA);
-  gst_asfmux_put_le64 (header, data_size);
-  gst_asfmux_put_guid (header, asf_object_guids, ASF_OBJ_UNDEFINED);
-  gst_asfmux_put_le64 (header, asfmux->num_packets);    /* nb packets */
-  gst_asfmux_put_byte (header, 1);      /* ??? */
-  gst_asfmux_put_byte (header, 1);      /* ??? */
-
-  gst_pad_push (asfmux->srcpad, GST_DATA (header));
+  if (asfmux->index_stream == NULL && asfmux->num_outputs > 0)
+    asfmux->index_stream = asfmux->output[0];
+
+  caps = gst_caps_copy (gst_pad_get_pad_template_caps (asfmux->srcpad));
+  gst_pad_set_caps (asfmux->srcpad, caps);
+  gst_caps_unref (caps);
+
+  gst_pad_push_event (asfmux->srcpad,
+      gst_event_new_new_segment (FALSE, 1.0, GST_FORMAT_BYTES, 0, -1, 0));
+
+  header = gst_asfmux_make_header (asfmux);
+  asfmux->header_size = GST_BUFFER_SIZE (header) - GST_ASF_DATA_OBJECT_SIZE;
   asfmux->write_header = FALSE;
+
+  GST_DEBUG_OBJECT (asfmux, "writing header of %u bytes",
+      GST_BUFFER_SIZE (header));
+
+  return gst_asfmux_push (asfmux, header);
 }
 
-static void
-gst_asfmux_file_stop (GstAsfMux * asfmux)
+/* write the simple index, one entry per index interval giving the packet
+ * with the last key frame at or before that time */
+static GstFlowReturn
+gst_asfmux_write_index (GstAsfMux * asfmux)
 {
-  if (gst_asfmux_is_stream (asfmux)) {
-    /* send EOS chunk */
-    GstBuffer *footer = gst_buffer_new_and_alloc (16);
-
-    GST_BUFFER_SIZE (footer) = 0;
-    gst_asfmux_put_chunk (footer, asfmux, 0x4524, 0, 0);        /* end of stream */
-    gst_pad_push (asfmux->srcpad, GST_DATA (footer));
-  } else if (gst_asfmux_can_seek (asfmux)) {
-    /* rewrite an updated header */
-    gint64 filesize;
-    GstFormat fmt = GST_FORMAT_BYTES;
-    GstEvent *event;
-
-    gst_pad_query (asfmux->srcpad, GST_QUERY_POSITION, &fmt, &filesize);
-    event = gst_event_new_seek (GST_SEEK_METHOD_SET | GST_FORMAT_BYTES, 0);
-    gst_pad_push (asfmux->srcpad, GST_DATA (event));
-    gst_asfmux_file_start (asfmux, filesize, filesize - asfmux->data_offset);
-    event =
-        gst_event_new_seek (GST_SEEK_METHOD_SET | GST_FORMAT_BYTES, filesize);
-    gst_pad_push (asfmux->srcpad, GST_DATA (event));
+  GstBuffer *buf;
+  guint8 *data, *obj;
+  guint i;
+
+  if (!asfmux->have_keyframe)
+    return GST_FLOW_OK;
+
+  /* complete the index up to the end of the file */
+  while (asfmux->index->len * GST_ASF_INDEX_INTERVAL <= asfmux->duration)
+    g_array_append_val (asfmux->index, asfmux->keyframe);
+  asfmux->max_packet_count = MAX (asfmux->max_packet_count,
+      asfmux->keyframe.count);
+
+  buf = gst_buffer_new_and_alloc (24 + 16 + 8 + 4 + 4 + asfmux->index->len * 6);
+  data = GST_BUFFER_DATA (buf);
+
+  obj = gst_asfmux_put_header (&data, asf_object_guids, ASF_OBJ_SIMPLE_INDEX);
+  gst_asfmux_put_file_id (&data);
+  gst_asfmux_put_le64 (&data, GST_TIME_TO_ASF (GST_ASF_INDEX_INTERVAL));
+  gst_asfmux_put_le32 (&data, asfmux->max_packet_count);
+  gst_asfmux_put_le32 (&data, asfmux->index->len);
+  for (i = 0; i < asfmux->index->len; i++) {
+    GstAsfMuxIndexEntry *entry;
+
+    entry = &g_array_index (asfmux->index, GstAsfMuxIndexEntry, i);
+    gst_asfmux_put_le32 (&data, entry->packet);
+    gst_asfmux_put_le16 (&data, entry->count);
   }
+  gst_asfmux_end_header (obj, data);
+
+  GST_DEBUG_OBJECT (asfmux, "writing index with %u entries",
+      asfmux->index->len);
 
-  gst_asfmux_put_flush (asfmux);
+  return gst_asfmux_push (asfmux, buf);
 }
 
-static GstBuffer *
-gst_asfmux_packet_header (GstAsfMux * asfmux)
+static GstFlowReturn
+gst_asfmux_file_stop (GstAsfMux * asfmux)
 {
-  GstBuffer *packet = asfmux->packet, *header;
-  guint flags, padsize = gst_asfmux_packet_remaining (asfmux);
+  GstFlowReturn ret;
+  GstBuffer *header;
 
-  header = gst_buffer_new_and_alloc (GST_ASF_PACKET_HEADER_SIZE + 2 + 12);
-  GST_BUFFER_SIZE (header) = 0;
+  if (asfmux->streamable)
+    return GST_FLOW_OK;
 
-  if (gst_asfmux_is_stream (asfmux)) {
-    gst_asfmux_put_chunk (header, asfmux, 0x4424, GST_ASF_PACKET_SIZE, 0);
-  }
+  ret = gst_asfmux_write_index (asfmux);
+  if (ret != GST_FLOW_OK)
+    return ret;
 
-  gst_asfmux_put_byte (header, 0x82);
-  gst_asfmux_put_le16 (header, 0);
+  /* seek back and rewrite the header with the real sizes */
+  gst_pad_push_event (asfmux->srcpad,
+      gst_event_new_new_segment (FALSE, 1.0, GST_FORMAT_BYTES, 0, -1, 0));
 
-  flags = 0x01;                 /* nb segments present */
-  if (padsize > 0) {
-    if (padsize < 256) {
-      flags |= 0x08;
-    } else {
-      flags |= 0x10;
-    }
-  }
-  gst_asfmux_put_byte (header, flags);  /* flags */
-  gst_asfmux_put_byte (header, 0x5d);
-  if (flags & 0x10) {
-    gst_asfmux_put_le16 (header, padsize - 2);
-  } else if (flags & 0x08) {
-    gst_asfmux_put_byte (header, padsize - 1);
-  }
-  gst_asfmux_put_le32 (header,
-      GST_BUFFER_TIMESTAMP (packet) / (GST_SECOND / 1000));
-  gst_asfmux_put_le16 (header,
-      GST_BUFFER_DURATION (packet) / (GST_SECOND / 1000));
-  gst_asfmux_put_byte (header, asfmux->packet_frames | 0x80);
+  header = gst_asfmux_make_header (asfmux);
+  GST_DEBUG_OBJECT (asfmux, "rewriting header, %" G_GUINT64_FORMAT " packets",
+      asfmux->num_packets);
 
-  return header;
+  return gst_asfmux_push (asfmux, header);
 }
 
 static void
-gst_asfmux_frame_header (GstAsfMux * asfmux,
-    GstAsfMuxStream * stream,
-    guint position, guint length, guint total, guint64 time, gboolean key)
+gst_asfmux_packet_new (GstAsfMux * asfmux)
 {
-  /* fill in some values for the packet */
-  if (!GST_CLOCK_TIME_IS_VALID (GST_BUFFER_TIMESTAMP (asfmux->packet))) {
-    GST_BUFFER_TIMESTAMP (asfmux->packet) = time;
-  }
-  GST_BUFFER_DURATION (asfmux->packet) =
-      time - GST_BUFFER_TIMESTAMP (asfmux->packet);
-
-  gst_asfmux_put_byte (asfmux->packet, (stream->index + 1) | 0x80);     //(key ? 0x80 : 0));
-  gst_asfmux_put_byte (asfmux->packet, stream->seqnum);
-  gst_asfmux_put_le32 (asfmux->packet, position);
-  gst_asfmux_put_byte (asfmux->packet, 0x08);
-  gst_asfmux_put_le32 (asfmux->packet, total);
-  gst_asfmux_put_le32 (asfmux->packet, time / (GST_SECOND / 1000));     /* time in ms */
-  gst_asfmux_put_le16 (asfmux->packet, length);
+  asfmux->packet = gst_buffer_new_and_alloc (asfmux->packet_size);
+  asfmux->packet_pos = GST_ASF_PACKET_HEADER_SIZE;
+  asfmux->packet_frames = 0;
+  asfmux->packet_ts = GST_CLOCK_TIME_NONE;
+  asfmux->packet_end = GST_CLOCK_TIME_NONE;
 }
 
-static void
-gst_asfmux_frame_buffer (GstAsfMux * asfmux, guint8 * data, guint length)
+/* fill in the packet header and padding and push the packet out */
+static GstFlowReturn
+gst_asfmux_packet_flush (GstAsfMux * asfmux)
 {
-  gst_asfmux_put_buffer (asfmux->packet, data, length);
-  asfmux->packet_frames++;
+  GstBuffer *packet = asfmux->packet;
+  guint8 *data = GST_BUFFER_DATA (packet);
+  guint padding = asfmux->packet_size - asfmux->packet_pos;
+  GstClockTime duration = asfmux->packet_end - asfmux->packet_ts;
+
+  gst_asfmux_put_byte (&data, 0x82);    /* error correction present */
+  gst_asfmux_put_le16 (&data, 0);
+  gst_asfmux_put_byte (&data, 0x11);    /* multiple payloads, WORD padding */
+  gst_asfmux_put_byte (&data, 0x5d);    /* property flags */
+  gst_asfmux_put_le16 (&data, padding);
+  gst_asfmux_put_le32 (&data, asfmux->packet_ts / GST_MSECOND);
+  gst_asfmux_put_le16 (&data, MIN (duration / GST_MSECOND, G_MAXUINT16));
+  gst_asfmux_put_byte (&data, asfmux->packet_frames | 0x80);    /* WORD len */
+
+  memset (GST_BUFFER_DATA (packet) + asfmux->packet_pos, 0, padding);
+
+  GST_BUFFER_TIMESTAMP (packet) = asfmux->packet_ts;
+  GST_BUFFER_DURATION (packet) = duration;
+  GST_BUFFER_OFFSET (packet) = asfmux->header_size + GST_ASF_DATA_OBJECT_SIZE +
+      asfmux->num_packets * asfmux->packet_size;
+
+  GST_LOG_OBJECT (asfmux, "pushing packet %" G_GUINT64_FORMAT " with %u "
+      "payloads and %u bytes of padding", asfmux->num_packets,
+      asfmux->packet_frames, padding);
+
+  asfmux->num_packets++;
+  asfmux->packet = NULL;
+
+  return gst_asfmux_push (asfmux, packet);
 }
 
+/* a new key frame of the index stream starts in @packet */
 static void
-gst_asfmux_packet_flush (GstAsfMux * asfmux)
+gst_asfmux_index_add_keyframe (GstAsfMux * asfmux, GstClockTime ts,
+    guint32 packet)
 {
-  GstBuffer *header, *packet = asfmux->packet;
-  guint header_size;
-
-  /* packet header */
-  header = gst_asfmux_packet_header (asfmux);
-  header_size = GST_BUFFER_SIZE (header);
-  if (!gst_asfmux_can_seek (asfmux)) {
-    header_size -= 12;          /* hack... bah */
+  if (asfmux->streamable)
+    return;
+
+  /* intervals before this key frame point to the previous one */
+  if (asfmux->have_keyframe) {
+    while (asfmux->index->len * GST_ASF_INDEX_INTERVAL < ts)
+      g_array_append_val (asfmux->index, asfmux->keyframe);
+    asfmux->max_packet_count = MAX (asfmux->max_packet_count,
+        asfmux->keyframe.count);
   }
 
-  /* Clear out the padding bytes */
-  memset (GST_BUFFER_DATA (packet) + GST_BUFFER_SIZE (packet), 0,
-      GST_BUFFER_MAXSIZE (packet) - GST_BUFFER_SIZE (packet));
-  GST_BUFFER_SIZE (packet) = GST_ASF_PACKET_SIZE - header_size;
-
-  /* send packet over */
-  gst_pad_push (asfmux->srcpad, GST_DATA (header));
-  gst_pad_push (asfmux->srcpad, GST_DATA (packet));
-  gst_asfmux_put_flush (asfmux);
-  asfmux->num_packets++;
-  asfmux->packet_frames = 0;
-
-  /* reset packet */
-  asfmux->packet = NULL;
+  asfmux->have_keyframe = TRUE;
+  asfmux->keyframe.packet = packet;
+  asfmux->keyframe.count = 1;
 }
 
-static void
-gst_asfmux_write_buffer (GstAsfMux * asfmux,
-    GstAsfMuxStream * stream, GstBuffer * buffer)
+static GstFlowReturn
+gst_asfmux_write_buffer (GstAsfMux * asfmux, GstAsfMuxStream * stream,
+    GstBuffer * buffer)
 {
-  guint position = 0, to_write, size = GST_BUFFER_SIZE (buffer), remaining;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime ts;
+  guint position = 0, size = GST_BUFFER_SIZE (buffer);
+  gboolean key;
 
-  while (position < size) {
-    remaining = gst_asfmux_packet_remaining (asfmux);
-    if (remaining <= GST_ASF_FRAME_HEADER_SIZE) {
-      gst_asfmux_packet_flush (asfmux);
-      continue;
-    } else if (remaining >= (GST_ASF_FRAME_HEADER_SIZE + size - position)) {
-      to_write = size - position;
-    } else {
-      to_write = remaining - GST_ASF_FRAME_HEADER_SIZE;
-    }
+  ts = GST_BUFFER_TIMESTAMP (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    ts = asfmux->duration;
 
-    if (asfmux->packet == NULL) {
-      asfmux->packet_frames = 0;
-      asfmux->packet = gst_buffer_new_and_alloc (GST_ASF_PACKET_SIZE);
-      GST_BUFFER_SIZE (asfmux->packet) = 0;
+  key = stream->type == ASF_STREAM_AUDIO ||
+      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  while (position < size || size == 0) {
+    guint8 *data;
+    guint remaining, to_write;
+
+    if (asfmux->packet == NULL)
+      gst_asfmux_packet_new (asfmux);
+
+    remaining = asfmux->packet_size - asfmux->packet_pos;
+    if (remaining <= GST_ASF_FRAME_HEADER_SIZE ||
+        asfmux->packet_frames == GST_ASF_MAX_PAYLOADS) {
+      if ((ret = gst_asfmux_packet_flush (asfmux)) != GST_FLOW_OK)
+        break;
+      continue;
     }
 
-    /* write frame header plus data in this packet */
-    gst_asfmux_frame_header (asfmux, stream, position, to_write, size,
-        GST_BUFFER_TIMESTAMP (buffer),
-        GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_KEY_UNIT));
-    gst_asfmux_frame_buffer (asfmux, GST_BUFFER_DATA (buffer) + position,
+    to_write = MIN (size - position, remaining - GST_ASF_FRAME_HEADER_SIZE);
+
+    if (position == 0 && key && stream == asfmux->index_stream)
+      gst_asfmux_index_add_keyframe (asfmux, ts, asfmux->num_packets);
+
+    if (!GST_CLOCK_TIME_IS_VALID (asfmux->packet_ts))
+      asfmux->packet_ts = ts;
+    asfmux->packet_end = MAX (ts, asfmux->packet_ts);
+
+    /* payload header and data go straight into the packet */
+    data = GST_BUFFER_DATA (asfmux->packet) + asfmux->packet_pos;
+    gst_asfmux_put_byte (&data, stream->number | (key ? 0x80 : 0));
+    gst_asfmux_put_byte (&data, stream->seqnum);
+    gst_asfmux_put_le32 (&data, position);
+    gst_asfmux_put_byte (&data, 8);
+    gst_asfmux_put_le32 (&data, size);
+    gst_asfmux_put_le32 (&data, ts / GST_MSECOND);
+    gst_asfmux_put_le16 (&data, to_write);
+    gst_asfmux_put_buffer (&data, GST_BUFFER_DATA (buffer) + position,
         to_write);
 
+    asfmux->packet_pos += GST_ASF_FRAME_HEADER_SIZE + to_write;
+    asfmux->packet_frames++;
+
+    if (key && stream == asfmux->index_stream && asfmux->have_keyframe) {
+      asfmux->keyframe.count =
+          asfmux->num_packets - asfmux->keyframe.packet + 1;
+    }
+
     position += to_write;
+    if (size == 0)
+      break;
   }
 
   stream->seqnum++;
+  stream->bytes += size;
+
+  if (GST_BUFFER_DURATION_IS_VALID (buffer))
+    ts += GST_BUFFER_DURATION (buffer);
+  asfmux->duration = MAX (asfmux->duration, ts);
+
+  return ret;
 }
 
-/* take the oldest buffer in our internal queue and push-it */
-static gboolean
-gst_asfmux_do_one_buffer (GstAsfMux * asfmux)
+static GstFlowReturn
+gst_asfmux_collected (GstCollectPads * pads, GstAsfMux * asfmux)
 {
-  gint n, chosen = -1;
-
-  /* find the earliest buffer */
-  for (n = 0; n < asfmux->num_outputs; n++) {
-    if (asfmux->output[n].queue != NULL) {
-      if (chosen == -1 ||
-          GST_BUFFER_TIMESTAMP (asfmux->output[n].queue) <
-          GST_BUFFER_TIMESTAMP (asfmux->output[chosen].queue)) {
-        chosen = n;
-      }
+  GstAsfMuxStream *best = NULL;
+  GstClockTime best_time = GST_CLOCK_TIME_NONE;
+  GstFlowReturn ret;
+  GstBuffer *buf;
+  GSList *walk;
+
+  if (G_UNLIKELY (asfmux->write_header)) {
+    gint n;
+
+    for (n = 0; n < asfmux->num_outputs; n++) {
+      if (!asfmux->output[n]->configured)
+        goto not_negotiated;
     }
-  }
 
-  if (chosen == -1) {
-    /* simply finish off the file and send EOS */
-    gst_asfmux_file_stop (asfmux);
-    gst_pad_push (asfmux->srcpad, GST_DATA (gst_event_new (GST_EVENT_EOS)));
-    gst_element_set_eos (GST_ELEMENT (asfmux));
-    return FALSE;
+    if ((ret = gst_asfmux_file_start (asfmux)) != GST_FLOW_OK)
+      return ret;
   }
 
-  /* do this buffer */
-  gst_asfmux_write_buffer (asfmux, &asfmux->output[chosen],
-      asfmux->output[chosen].queue);
+  /* find the earliest buffer */
+  for (walk = pads->data; walk != NULL; walk = g_slist_next (walk)) {
+    GstAsfMuxStream *stream = (GstAsfMuxStream *) walk->data;
+    GstClockTime time;
 
-  /* update stream info after buffer push */
-  gst_buffer_unref (asfmux->output[chosen].queue);
-  asfmux->output[chosen].time =
-      GST_BUFFER_TIMESTAMP (asfmux->output[chosen].queue);
-  asfmux->output[chosen].queue = NULL;
+    buf = gst_collect_pads_peek (pads, (GstCollectData *) stream);
+    if (buf == NULL)
+      continue;
 
-  return TRUE;
-}
+    time = GST_BUFFER_TIMESTAMP (buf);
+    gst_buffer_unref (buf);
 
-static void
-gst_asfmux_loop (GstElement * element)
-{
-  GstAsfMux *asfmux;
+    if (best == NULL || (GST_CLOCK_TIME_IS_VALID (time) &&
+            (!GST_CLOCK_TIME_IS_VALID (best_time) || time < best_time))) {
+      best = stream;
+      best_time = time;
+    }
+  }
 
-  asfmux = GST_ASFMUX (element);
+  if (best == NULL) {
+    /* simply finish off the file and send EOS */
+    if (asfmux->packet && asfmux->packet_frames > 0) {
+      if ((ret = gst_asfmux_packet_flush (asfmux)) != GST_FLOW_OK)
+        return ret;
+    }
+    if ((ret = gst_asfmux_file_stop (asfmux)) != GST_FLOW_OK)
+      return ret;
+    gst_pad_push_event (asfmux->srcpad, gst_event_new_eos ());
+    return GST_FLOW_UNEXPECTED;
+  }
 
-  /* first fill queue (some elements only set caps when
-   * flowing data), then write header */
-  gst_asfmux_fill_queue (asfmux);
+  buf = gst_collect_pads_pop (pads, (GstCollectData *) best);
+  ret = gst_asfmux_write_buffer (asfmux, best, buf);
+  gst_buffer_unref (buf);
 
-  if (asfmux->write_header == TRUE) {
-    /* indeed, these are fake values. We need this so that
-     * players will read the file. Without these fake values,
-     * the players will mark the file as invalid and stop */
-    gst_asfmux_file_start (asfmux, 0xFFFFFFFF, 0xFFFFFFFF);
-  }
+  return ret;
 
-  gst_asfmux_do_one_buffer (asfmux);
+not_negotiated:
+  {
+    GST_ELEMENT_ERROR (asfmux, CORE, NEGOTIATION, (NULL),
+        ("received data before caps on all streams"));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
 }
 
 static GstStateChangeReturn
 gst_asfmux_change_state (GstElement * element, GstStateChange transition)
 {
   GstAsfMux *asfmux;
-
-  g_return_val_if_fail (GST_IS_ASFMUX (element), GST_STATE_CHANGE_FAILURE);
+  GstStateChangeReturn ret;
 
   asfmux = GST_ASFMUX (element);
 
   switch (transition) {
-    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
-      for (n = 0; n < asfmux->num_outputs; n++) {
-        asfmux->output[n].eos = FALSE;
-      }
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_asfmux_reset (asfmux);
+      gst_collect_pads_start (asfmux->collect);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_collect_pads_stop (asfmux->collect);
+      break;
+    default:
       break;
   }
 
-  if (GST_ELEMENT_CLASS (parent_class)->change_state)
-    return GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_asfmux_reset (asfmux);
+      break;
+    default:
+      break;
+  }
 
-  return GST_STATE_CHANGE_SUCCESS;
+  return ret;
 }
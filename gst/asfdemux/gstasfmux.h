@@ -17,16 +17,16 @@
  * Boston, MA 02111-1307, USA.
  */
 
+
 #ifndef __GST_ASFMUX_H__
 #define __GST_ASFMUX_H__
 
 #include <gst/gst.h>
+#include <gst/base/gstcollectpads.h>
 
 #include "asfheaders.h"
 
-#ifdef __cplusplus
-extern "C" {
-#endif /* __cplusplus */
+G_BEGIN_DECLS
 
 #define GST_TYPE_ASFMUX \
   (gst_asfmux_get_type())
@@ -41,16 +41,21 @@ extern "C" {
 
 #define MAX_ASF_OUTPUTS 16
 
-typedef struct _GstAsfMuxStream {
-  guint index;
+typedef struct _GstAsfMux GstAsfMux;
+typedef struct _GstAsfMuxClass GstAsfMuxClass;
 
-  gint type; /* ASF_STREAM_VIDEO/AUDIO */
-  GstPad *pad;
-  guint64 time;
-  GstBuffer *queue;
-  gboolean connected, eos;
-  guint seqnum;
-  guint bitrate;
+typedef struct _GstAsfMuxStream {
+  GstCollectData collect;       /* we extend the CollectData */
+
+  gint type;                    /* ASF_STREAM_VIDEO/AUDIO */
+  guint number;                 /* stream number, 1..MAX_ASF_OUTPUTS */
+  gboolean configured;          /* TRUE once we got caps */
+  gboolean released;            /* pad released after the header was written,
+                                 * only kept for the header at EOS */
+  guint8 seqnum;                /* media object number */
+  guint bitrate;                /* from the caps, or 0 */
+  guint64 bytes;                /* bytes muxed, to estimate the bitrate */
+  GstBuffer *codec_data;        /* extra data after the format header */
 
   union {
     asf_stream_audio        audio;
@@ -61,30 +66,51 @@ typedef struct _GstAsfMuxStream {
   } header;
 } GstAsfMuxStream;
 
-typedef struct _GstAsfMux {
+/* entry of the simple index */
+typedef struct {
+  guint32 packet;
+  guint16 count;
+} GstAsfMuxIndexEntry;
+
+struct _GstAsfMux {
   GstElement element;
 
   /* pads */
   GstPad *srcpad;
-  GstAsfMuxStream output[MAX_ASF_OUTPUTS];
+  GstCollectPads *collect;
+  GstAsfMuxStream *output[MAX_ASF_OUTPUTS];
   guint num_outputs, num_video, num_audio;
+
+  /* properties */
+  guint packet_size;
+  gboolean streamable;          /* don't seek back to update the header */
+
   gboolean write_header;
+  guint header_size;            /* size of everything before the packets */
 
-  /* packet */
+  /* packet being filled; allocated at packet_size and written in place */
   GstBuffer *packet;
-  guint num_packets, packet_frames;
-  guint sequence;
-  guint64 data_offset;
-} GstAsfMux;
-
-typedef struct _GstAsfMuxClass {
+  guint packet_pos;             /* where the next payload goes */
+  guint packet_frames;          /* number of payloads in the packet */
+  GstClockTime packet_ts;       /* send time of the packet */
+  GstClockTime packet_end;      /* time of the last payload in the packet */
+  guint64 num_packets;
+  GstClockTime duration;
+
+  /* simple index, built while muxing */
+  GstAsfMuxStream *index_stream;
+  GArray *index;                /* GstAsfMuxIndexEntry per index interval */
+  gboolean have_keyframe;
+  GstAsfMuxIndexEntry keyframe; /* last key frame of index_stream */
+  guint16 max_packet_count;
+};
+
+struct _GstAsfMuxClass {
   GstElementClass parent_class;
-} GstAsfMuxClass;
+};
 
-GType gst_asfmux_get_type(void);
+GType gst_asfmux_get_type (void);
 
-#ifdef __cplusplus
-}
-#endif /* __cplusplus */
+G_END_DECLS
 
 #endif /* __GST_ASFMUX_H__ */
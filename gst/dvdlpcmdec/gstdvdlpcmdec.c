@@ -26,6 +26,11 @@
 #include <string.h>
 
 #include "gstdvdlpcmdec.h"
+#include "gstdvdlpcmunpack.h"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 GST_DEBUG_CATEGORY_STATIC (dvdlpcm_debug);
 #define GST_CAT_DEFAULT dvdlpcm_debug
@@ -60,7 +65,13 @@ GST_STATIC_PAD_TEMPLATE ("src",
         "rate = (int) { 32000, 44100, 48000, 96000 }, "
         "channels = (int) [ 1, 8 ], "
         "endianness = (int) { BIG_ENDIAN }, "
-        "depth = (int) { 16, 24 }, " "signed = (boolean) { true }")
+        "depth = (int) { 16, 24 }, " "signed = (boolean) { true }; "
+        "audio/x-raw-int, "
+        "width = (int) 32, "
+        "rate = (int) { 32000, 44100, 48000, 96000 }, "
+        "channels = (int) [ 1, 8 ], "
+        "endianness = (int) BYTE_ORDER, "
+        "depth = (int) 32, " "signed = (boolean) { true }")
     );
 
 /* DvdLpcmDec signals and args */
@@ -70,12 +81,61 @@ enum
   LAST_SIGNAL
 };
 
+#define DEFAULT_OUTPUT_32BIT   FALSE
+
 enum
 {
-  ARG_0
-      /* FILL ME */
+  ARG_0,
+  ARG_OUTPUT_32BIT
+};
+
+/* How the 20 and 24 bit sample groups are rearranged, see
+ * gstdvdlpcmunpack.h. Every group holds 4 samples, the top 16 bits of each
+ * come first, followed by the low 8 (or 4) bits of all of them. */
+#define C(x) { x, GST_DVDLPCM_COPY }
+#define H(x) { x, GST_DVDLPCM_HI_NIBBLE }
+#define L(x) { x, GST_DVDLPCM_LO_NIBBLE }
+#define Z { -1, GST_DVDLPCM_COPY }
+
+static const GstDvdLpcmLayout layout_24_to_24 = { 12, 12, {
+        C (0), C (1), C (8), C (2), C (3), C (9),
+        C (4), C (5), C (10), C (6), C (7), C (11)}
+};
+
+static const GstDvdLpcmLayout layout_20_to_24 = { 10, 12, {
+        C (0), C (1), H (8), C (2), C (3), L (8),
+        C (4), C (5), H (9), C (6), C (7), L (9)}
 };
 
+/* 32 bit samples are in host byte order */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define S32(hi,mid,lo) Z, lo, C (mid), C (hi)
+#else
+#define S32(hi,mid,lo) C (hi), C (mid), lo, Z
+#endif
+
+static const GstDvdLpcmLayout layout_24_to_32 = { 12, 16, {
+        S32 (0, 1, C (8)), S32 (2, 3, C (9)),
+        S32 (4, 5, C (10)), S32 (6, 7, C (11))}
+};
+
+static const GstDvdLpcmLayout layout_20_to_32 = { 10, 16, {
+        S32 (0, 1, H (8)), S32 (2, 3, L (8)),
+        S32 (4, 5, H (9)), S32 (6, 7, L (9))}
+};
+
+#undef S32
+#undef C
+#undef H
+#undef L
+#undef Z
+
+typedef void (*GstDvdLpcmUnpackFunc) (guint8 * dest, const guint8 * src,
+    guint groups);
+
+/* picked in class_init, NULL when we only have the C code */
+static GstDvdLpcmUnpackSimdFunc unpack_simd = NULL;
+
 static void gst_dvdlpcmdec_base_init (gpointer g_class);
 static void gst_dvdlpcmdec_class_init (GstDvdLpcmDecClass * klass);
 static void gst_dvdlpcmdec_init (GstDvdLpcmDec * dvdlpcmdec);
@@ -85,6 +145,10 @@ static GstFlowReturn gst_dvdlpcmdec_chain_raw (GstPad * pad,
 static GstFlowReturn gst_dvdlpcmdec_chain_dvd (GstPad * pad,
     GstBuffer * buffer);
 static gboolean gst_dvdlpcmdec_setcaps (GstPad * pad, GstCaps * caps);
+static void gst_dvdlpcmdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_dvdlpcmdec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 static gboolean dvdlpcmdec_sink_event (GstPad * pad, GstEvent * event);
 
 static GstStateChangeReturn gst_dvdlpcmdec_change_state (GstElement * element,
@@ -129,16 +193,90 @@ gst_dvdlpcmdec_base_init (gpointer g_class)
   gst_element_class_set_details (element_class, &gst_dvdlpcmdec_details);
 }
 
+#if defined(__aarch64__)
+/* NEON is always there on AArch64, and its table lookup takes the whole
+ * 48 byte input block at once */
+static guint
+gst_dvdlpcm_unpack_neon (const GstDvdLpcmLayout * layout, guint8 * dest,
+    const guint8 * src, guint groups)
+{
+  uint8x16_t copy[4], lo[4], keep[4], nibble;
+  guint8 c[16], l[16], k[16];
+  guint out_regs, done = 0;
+  guint i, j;
+
+  out_regs = layout->out_size * GST_DVDLPCM_BLOCK_GROUPS / 16;
+
+  for (j = 0; j < out_regs; j++) {
+    for (i = 0; i < 16; i++) {
+      guint8 op, idx;
+
+      /* out of range indices give 0 */
+      idx = gst_dvdlpcm_layout_index (layout, j * 16 + i, &op);
+      c[i] = (op == GST_DVDLPCM_LO_NIBBLE) ? 0xff : idx;
+      l[i] = (op == GST_DVDLPCM_LO_NIBBLE) ? idx : 0xff;
+      k[i] = (op == GST_DVDLPCM_HI_NIBBLE) ? 0xf0 : 0xff;
+    }
+    copy[j] = vld1q_u8 (c);
+    lo[j] = vld1q_u8 (l);
+    keep[j] = vld1q_u8 (k);
+  }
+  nibble = vdupq_n_u8 (0x0f);
+
+  while (groups - done >= GST_DVDLPCM_BLOCK_GROUPS &&
+      (groups - done) * layout->in_size >= 48) {
+    uint8x16x3_t in;
+
+    in.val[0] = vld1q_u8 (src);
+    in.val[1] = vld1q_u8 (src + 16);
+    in.val[2] = vld1q_u8 (src + 32);
+
+    for (j = 0; j < out_regs; j++) {
+      uint8x16_t a, b;
+
+      a = vandq_u8 (vqtbl3q_u8 (in, copy[j]), keep[j]);
+      b = vshlq_n_u8 (vandq_u8 (vqtbl3q_u8 (in, lo[j]), nibble), 4);
+      vst1q_u8 (dest + j * 16, vorrq_u8 (a, b));
+    }
+
+    src += GST_DVDLPCM_BLOCK_GROUPS * layout->in_size;
+    dest += GST_DVDLPCM_BLOCK_GROUPS * layout->out_size;
+    done += GST_DVDLPCM_BLOCK_GROUPS;
+  }
+
+  return done;
+}
+#endif
+
 static void
 gst_dvdlpcmdec_class_init (GstDvdLpcmDecClass * klass)
 {
+  GObjectClass *gobject_class;
   GstElementClass *gstelement_class;
 
+  gobject_class = (GObjectClass *) klass;
   gstelement_class = (GstElementClass *) klass;
 
   parent_class = g_type_class_peek_parent (klass);
 
+  gobject_class->set_property = gst_dvdlpcmdec_set_property;
+  gobject_class->get_property = gst_dvdlpcmdec_get_property;
+
+  g_object_class_install_property (gobject_class, ARG_OUTPUT_32BIT,
+      g_param_spec_boolean ("output-32bit", "Output 32 bit",
+          "Output 20 and 24 bit samples as 32 bit integers in host byte order "
+          "(applied on the next format change)", DEFAULT_OUTPUT_32BIT,
+          G_PARAM_READWRITE));
+
   gstelement_class->change_state = gst_dvdlpcmdec_change_state;
+
+#if defined(__aarch64__)
+  unpack_simd = gst_dvdlpcm_unpack_neon;
+#elif defined(HAVE_SSSE3)
+  if (gst_dvdlpcm_have_ssse3 ())
+    unpack_simd = gst_dvdlpcm_unpack_ssse3;
+#endif
+  GST_DEBUG ("using %s unpack code", unpack_simd ? "SIMD" : "C");
 }
 
 static void
@@ -172,16 +310,87 @@ gst_dvdlpcmdec_init (GstDvdLpcmDec * dvdlpcmdec)
   gst_pad_use_fixed_caps (dvdlpcmdec->srcpad);
   gst_element_add_pad (GST_ELEMENT (dvdlpcmdec), dvdlpcmdec->srcpad);
 
+  dvdlpcmdec->output_32bit = DEFAULT_OUTPUT_32BIT;
+
   gst_dvdlpcm_reset (dvdlpcmdec);
 }
 
+static void
+gst_dvdlpcmdec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDvdLpcmDec *dvdlpcmdec = GST_DVDLPCMDEC (object);
+
+  switch (prop_id) {
+    case ARG_OUTPUT_32BIT:
+      dvdlpcmdec->output_32bit = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_dvdlpcmdec_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstDvdLpcmDec *dvdlpcmdec = GST_DVDLPCMDEC (object);
+
+  switch (prop_id) {
+    case ARG_OUTPUT_32BIT:
+      g_value_set_boolean (value, dvdlpcmdec->output_32bit);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Picks the output width for the current input width and sets the
+ * matching caps on the src pad */
+static gboolean
+gst_dvdlpcmdec_set_outcaps (GstDvdLpcmDec * dvdlpcmdec)
+{
+  GstCaps *src_caps;
+  gboolean res;
+  gint endianness;
+
+  /* Output width is the input width rounded up to the nearest byte, or
+   * 32 bits if asked for */
+  if (dvdlpcmdec->width == 16)
+    dvdlpcmdec->out_width = 16;
+  else if (dvdlpcmdec->output_32bit)
+    dvdlpcmdec->out_width = 32;
+  else
+    dvdlpcmdec->out_width = 24;
+
+  endianness = (dvdlpcmdec->out_width == 32) ? G_BYTE_ORDER : G_BIG_ENDIAN;
+
+  src_caps = gst_caps_new_simple ("audio/x-raw-int",
+      "rate", G_TYPE_INT, dvdlpcmdec->rate,
+      "channels", G_TYPE_INT, dvdlpcmdec->channels,
+      "endianness", G_TYPE_INT, endianness,
+      "depth", G_TYPE_INT, dvdlpcmdec->out_width,
+      "width", G_TYPE_INT, dvdlpcmdec->out_width,
+      "signed", G_TYPE_BOOLEAN, TRUE, NULL);
+
+  GST_DEBUG_OBJECT (dvdlpcmdec, "Set rate %d, channels %d, width %d (out %d)",
+      dvdlpcmdec->rate, dvdlpcmdec->channels, dvdlpcmdec->width,
+      dvdlpcmdec->out_width);
+
+  res = gst_pad_set_caps (dvdlpcmdec->srcpad, src_caps);
+  gst_caps_unref (src_caps);
+
+  return res;
+}
+
 static gboolean
 gst_dvdlpcmdec_setcaps (GstPad * pad, GstCaps * caps)
 {
   GstStructure *structure;
   gboolean res = TRUE;
   GstDvdLpcmDec *dvdlpcmdec;
-  GstCaps *src_caps;
 
   g_return_val_if_fail (caps != NULL, FALSE);
   g_return_val_if_fail (pad != NULL, FALSE);
@@ -210,26 +419,8 @@ gst_dvdlpcmdec_setcaps (GstPad * pad, GstCaps * caps)
   if (!res)
     goto caps_parse_error;
 
-  /* Output width is the input width rounded up to the nearest byte */
-  if (dvdlpcmdec->width == 20)
-    dvdlpcmdec->out_width = 24;
-  else
-    dvdlpcmdec->out_width = dvdlpcmdec->width;
-
-  /* Build caps to set on the src pad, which we know from the incoming caps */
-  src_caps = gst_caps_new_simple ("audio/x-raw-int",
-      "rate", G_TYPE_INT, dvdlpcmdec->rate,
-      "channels", G_TYPE_INT, dvdlpcmdec->channels,
-      "endianness", G_TYPE_INT, G_BIG_ENDIAN,
-      "depth", G_TYPE_INT, dvdlpcmdec->out_width,
-      "width", G_TYPE_INT, dvdlpcmdec->out_width,
-      "signed", G_TYPE_BOOLEAN, TRUE, NULL);
-
-  GST_DEBUG_OBJECT (dvdlpcmdec, "Set rate %d, channels %d, width %d (out %d)",
-      dvdlpcmdec->rate, dvdlpcmdec->channels, dvdlpcmdec->width,
-      dvdlpcmdec->out_width);
-
-  if (!gst_pad_set_caps (dvdlpcmdec->srcpad, src_caps)) {
+  /* Set caps on the src pad, which we know from the incoming caps */
+  if (!gst_dvdlpcmdec_set_outcaps (dvdlpcmdec)) {
     GST_DEBUG_OBJECT (dvdlpcmdec, "Failed to set caps!");
     res = FALSE;
   } else {
@@ -237,8 +428,6 @@ gst_dvdlpcmdec_setcaps (GstPad * pad, GstCaps * caps)
         caps);
   }
 
-  gst_caps_unref (src_caps);
-
 done:
   gst_object_unref (dvdlpcmdec);
 
@@ -303,15 +492,12 @@ parse_header (GstDvdLpcmDec * dec, guint32 header)
   switch (header & 0xC000) {
     case 0x8000:
       dec->width = 24;
-      dec->out_width = 24;
       break;
     case 0x4000:
       dec->width = 20;
-      dec->out_width = 24;
       break;
     default:
       dec->width = 16;
-      dec->out_width = 16;
       break;
   }
 
@@ -382,27 +568,12 @@ gst_dvdlpcmdec_chain_dvd (GstPad * pad, GstBuffer * buf)
 
   /* see if we have a new header */
   if (header != dvdlpcmdec->header) {
-    GstCaps *src_caps;
-
     parse_header (dvdlpcmdec, header);
 
-    /* Build caps to set on the src pad from what we've just parsed */
-    src_caps = gst_caps_new_simple ("audio/x-raw-int",
-        "rate", G_TYPE_INT, dvdlpcmdec->rate,
-        "channels", G_TYPE_INT, dvdlpcmdec->channels,
-        "endianness", G_TYPE_INT, G_BIG_ENDIAN,
-        "depth", G_TYPE_INT, dvdlpcmdec->out_width,
-        "width", G_TYPE_INT, dvdlpcmdec->out_width,
-        "signed", G_TYPE_BOOLEAN, TRUE, NULL);
-
-    GST_DEBUG_OBJECT (dvdlpcmdec, "Set rate %d, channels %d, width %d",
-        dvdlpcmdec->rate, dvdlpcmdec->channels, dvdlpcmdec->width);
-
-    if (!gst_pad_set_caps (dvdlpcmdec->srcpad, src_caps))
+    /* Set caps on the src pad from what we've just parsed */
+    if (!gst_dvdlpcmdec_set_outcaps (dvdlpcmdec))
       goto negotiation_failed;
 
-    gst_caps_unref (src_caps);
-
     dvdlpcmdec->header = header;
   }
 
@@ -508,6 +679,111 @@ negotiation_failed:
   }
 }
 
+/* Copy 20-bit LPCM format to 24-bit buffers, with 0x00 in the lowest
+ * nibble. Note that the first 2 bytes are already correct */
+static void
+unpack_20_to_24 (guint8 * dest, const guint8 * src, guint groups)
+{
+  guint i;
+
+  for (i = 0; i < groups; i++) {
+    dest[0] = src[0];
+    dest[1] = src[1];
+    dest[2] = src[8] & 0xf0;
+    dest[3] = src[2];
+    dest[4] = src[3];
+    dest[5] = (src[8] & 0x0f) << 4;
+    dest[6] = src[4];
+    dest[7] = src[5];
+    dest[8] = src[9] & 0xf0;
+    dest[9] = src[6];
+    dest[10] = src[7];
+    dest[11] = (src[9] & 0x0f) << 4;
+
+    src += 10;
+    dest += 12;
+  }
+}
+
+/* Rearrange 24-bit LPCM format in-place, dest is the same as src. Note
+ * that the first 2 and last byte are already correct */
+static void
+unpack_24_to_24 (guint8 * dest, const guint8 * src, guint groups)
+{
+  guint i;
+
+  for (i = 0; i < groups; i++) {
+    guint8 tmp;
+
+    tmp = dest[10];
+    dest[10] = dest[7];
+    dest[7] = dest[5];
+    dest[5] = dest[9];
+    dest[9] = dest[6];
+    dest[6] = dest[4];
+    dest[4] = dest[3];
+    dest[3] = dest[2];
+    dest[2] = dest[8];
+    dest[8] = tmp;
+
+    dest += 12;
+  }
+}
+
+#define S32(hi,mid,lo) \
+  (((guint32) (hi) << 24) | ((guint32) (mid) << 16) | ((guint32) (lo) << 8))
+
+static void
+unpack_20_to_32 (guint8 * dest, const guint8 * src, guint groups)
+{
+  guint32 *out = (guint32 *) dest;
+  guint i;
+
+  for (i = 0; i < groups; i++) {
+    out[0] = S32 (src[0], src[1], src[8] & 0xf0);
+    out[1] = S32 (src[2], src[3], (src[8] & 0x0f) << 4);
+    out[2] = S32 (src[4], src[5], src[9] & 0xf0);
+    out[3] = S32 (src[6], src[7], (src[9] & 0x0f) << 4);
+
+    src += 10;
+    out += 4;
+  }
+}
+
+static void
+unpack_24_to_32 (guint8 * dest, const guint8 * src, guint groups)
+{
+  guint32 *out = (guint32 *) dest;
+  guint i;
+
+  for (i = 0; i < groups; i++) {
+    out[0] = S32 (src[0], src[1], src[8]);
+    out[1] = S32 (src[2], src[3], src[9]);
+    out[2] = S32 (src[4], src[5], src[10]);
+    out[3] = S32 (src[6], src[7], src[11]);
+
+    src += 12;
+    out += 4;
+  }
+}
+
+#undef S32
+
+/* Unpacks as many groups as possible with the SIMD code and leaves the
+ * rest to the C version */
+static void
+gst_dvdlpcmdec_unpack (const GstDvdLpcmLayout * layout,
+    GstDvdLpcmUnpackFunc func, guint8 * dest, const guint8 * src, guint groups)
+{
+  guint done = 0;
+
+  if (unpack_simd)
+    done = unpack_simd (layout, dest, src, groups);
+
+  func (dest + done * layout->out_size, src + done * layout->in_size,
+      groups - done);
+}
+
 static GstFlowReturn
 gst_dvdlpcmdec_chain_raw (GstPad * pad, GstBuffer * buf)
 {
@@ -544,86 +820,57 @@ gst_dvdlpcmdec_chain_raw (GstPad * pad, GstBuffer * buf)
       break;
     }
     case 20:
+    case 24:
     {
-      /* Allocate a new buffer and copy 20-bit width to 24-bit */
-      gint64 samples = size * 8 / 20;
-      gint64 count = size / 10;
-      gint64 i;
-      guint8 *src;
-      guint8 *dest;
+      guint count, in_size;
+      const GstDvdLpcmLayout *layout;
+      GstDvdLpcmUnpackFunc func;
       GstBuffer *outbuf;
       GstCaps *bufcaps = GST_PAD_CAPS (dvdlpcmdec->srcpad);
 
+      in_size = (dvdlpcmdec->width == 20) ? 10 : 12;
+      count = size / in_size;
+      samples = count * 4 / dvdlpcmdec->channels;
+
+      if (dvdlpcmdec->out_width == 32) {
+        if (dvdlpcmdec->width == 20) {
+          layout = &layout_20_to_32;
+          func = unpack_20_to_32;
+        } else {
+          layout = &layout_24_to_32;
+          func = unpack_24_to_32;
+        }
+      } else {
+        if (dvdlpcmdec->width == 20) {
+          layout = &layout_20_to_24;
+          func = unpack_20_to_24;
+        } else {
+          /* Rearrange 24-bit LPCM format in-place */
+          buf = gst_buffer_make_writable (buf);
+          data = GST_BUFFER_DATA (buf);
+
+          gst_dvdlpcmdec_unpack (&layout_24_to_24, unpack_24_to_24, data,
+              data, count);
+          break;
+        }
+      }
+
+      /* Allocate a new buffer and unpack into it */
       ret = gst_pad_alloc_buffer_and_set_caps (dvdlpcmdec->srcpad, 0,
-          samples * 3, bufcaps, &outbuf);
+          count * layout->out_size, bufcaps, &outbuf);
 
       if (ret != GST_FLOW_OK)
         goto buffer_alloc_failed;
 
       gst_buffer_copy_metadata (outbuf, buf, GST_BUFFER_COPY_TIMESTAMPS);
 
-      /* adjust samples so we can calc the new timestamp */
-      samples = samples / dvdlpcmdec->channels;
-
-      src = data;
-      dest = GST_BUFFER_DATA (outbuf);
-
-      /* Copy 20-bit LPCM format to 24-bit buffers, with 0x00 in the lowest 
-       * nibble. Note that the first 2 bytes are already correct */
-      for (i = 0; i < count; i++) {
-        dest[0] = src[0];
-        dest[1] = src[1];
-        dest[2] = src[8] & 0xf0;
-        dest[3] = src[2];
-        dest[4] = src[3];
-        dest[5] = (src[8] & 0x0f) << 4;
-        dest[6] = src[4];
-        dest[7] = src[5];
-        dest[8] = src[9] & 0x0f;
-        dest[9] = src[6];
-        dest[10] = src[7];
-        dest[11] = (src[9] & 0x0f) << 4;
-
-        src += 10;
-        dest += 12;
-      }
+      gst_dvdlpcmdec_unpack (layout, func, GST_BUFFER_DATA (outbuf), data,
+          count);
 
       gst_buffer_unref (buf);
       buf = outbuf;
       break;
     }
-    case 24:
-    {
-      /* Rearrange 24-bit LPCM format in-place. Note that the first 2
-       * and last byte are already correct */
-      guint count = size / 12;
-      gint i;
-      guint8 *src;
-
-      samples = size / dvdlpcmdec->channels / 3;
-
-      /* Ensure our output buffer is writable */
-      buf = gst_buffer_make_writable (buf);
-
-      src = GST_BUFFER_DATA (buf);
-      for (i = 0; i < count; i++) {
-        guint8 tmp;
-
-        tmp = src[10];
-        src[10] = src[7];
-        src[7] = src[5];
-        src[5] = src[9];
-        src[9] = src[6];
-        src[6] = src[4];
-        src[4] = src[3];
-        src[3] = src[2];
-        src[2] = src[8];
-        src[8] = tmp;
-
-        src += 12;
-      }
-      break;
-    }
     default:
       goto invalid_width;
   }
@@ -53,7 +53,10 @@ struct _GstDvdLpcmDec {
   gint dynamic_range;
   gint emphasis;
   gint mute;
-  
+
+  /* properties */
+  gboolean output_32bit;        /* 20/24 bit input as 32 bit host endian */
+
   GstClockTime timestamp;
   GstSegment   segment;
 };
@@ -0,0 +1,113 @@
+/* GStreamer
+ * Copyright (C) <2005> Jan Schmidt <jan@noraisin.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* This file is built with -mssse3, only call into it after
+ * gst_dvdlpcm_have_ssse3() said so. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cpuid.h>
+#include <tmmintrin.h>
+
+#include "gstdvdlpcmunpack.h"
+
+gboolean
+gst_dvdlpcm_have_ssse3 (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+    return FALSE;
+
+  return (ecx & bit_SSSE3) != 0;
+}
+
+guint
+gst_dvdlpcm_unpack_ssse3 (const GstDvdLpcmLayout * layout, guint8 * dest,
+    const guint8 * src, guint groups)
+{
+  __m128i copy[4][3], lo[4][3], keep[4], nibble;
+  guint8 c[16], l[16], k[16];
+  guint out_regs, done = 0;
+  guint i, j, r;
+
+  /* a block is read as three registers and written as three (24 bit) or
+   * four (32 bit) registers */
+  out_regs = layout->out_size * GST_DVDLPCM_BLOCK_GROUPS / 16;
+  g_assert (out_regs <= 4);
+  g_assert (layout->in_size * GST_DVDLPCM_BLOCK_GROUPS <= 48);
+
+  for (j = 0; j < out_regs; j++) {
+    for (r = 0; r < 3; r++) {
+      for (i = 0; i < 16; i++) {
+        guint8 op, idx;
+
+        idx = gst_dvdlpcm_layout_index (layout, j * 16 + i, &op);
+        c[i] = l[i] = 0x80;
+        if (idx >= r * 16 && idx < (r + 1) * 16) {
+          if (op == GST_DVDLPCM_LO_NIBBLE)
+            l[i] = idx - r * 16;
+          else
+            c[i] = idx - r * 16;
+        }
+        k[i] = (op == GST_DVDLPCM_HI_NIBBLE) ? 0xf0 : 0xff;
+      }
+      copy[j][r] = _mm_loadu_si128 ((const __m128i *) c);
+      lo[j][r] = _mm_loadu_si128 ((const __m128i *) l);
+    }
+    keep[j] = _mm_loadu_si128 ((const __m128i *) k);
+  }
+  nibble = _mm_set1_epi8 (0x0f);
+
+  /* all loads of a block happen before its stores, so this also works in
+   * place when input and output groups have the same size. The 20 bit
+   * input is read beyond the block, make sure that's still in the buffer */
+  while (groups - done >= GST_DVDLPCM_BLOCK_GROUPS &&
+      (groups - done) * layout->in_size >= 48) {
+    __m128i in0, in1, in2;
+
+    in0 = _mm_loadu_si128 ((const __m128i *) src);
+    in1 = _mm_loadu_si128 ((const __m128i *) (src + 16));
+    in2 = _mm_loadu_si128 ((const __m128i *) (src + 32));
+
+    for (j = 0; j < out_regs; j++) {
+      __m128i a, b;
+
+      a = _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (in0, copy[j][0]),
+              _mm_shuffle_epi8 (in1, copy[j][1])),
+          _mm_shuffle_epi8 (in2, copy[j][2]));
+      a = _mm_and_si128 (a, keep[j]);
+
+      b = _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (in0, lo[j][0]),
+              _mm_shuffle_epi8 (in1, lo[j][1])),
+          _mm_shuffle_epi8 (in2, lo[j][2]));
+      b = _mm_slli_epi16 (_mm_and_si128 (b, nibble), 4);
+
+      _mm_storeu_si128 ((__m128i *) (dest + j * 16), _mm_or_si128 (a, b));
+    }
+
+    src += GST_DVDLPCM_BLOCK_GROUPS * layout->in_size;
+    dest += GST_DVDLPCM_BLOCK_GROUPS * layout->out_size;
+    done += GST_DVDLPCM_BLOCK_GROUPS;
+  }
+
+  return done;
+}
@@ -0,0 +1,79 @@
+/* GStreamer
+ * Copyright (C) <2005> Jan Schmidt <jan@noraisin.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_DVDLPCM_UNPACK_H__
+#define __GST_DVDLPCM_UNPACK_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* DVD LPCM stores 20 and 24 bit samples in groups of 4 samples: the top 16
+ * bits of each sample first, followed by the remaining bits of all four.
+ * A layout describes how one such group is rearranged, byte by byte, so the
+ * SIMD kernels can build their shuffle masks from it. */
+
+typedef enum {
+  GST_DVDLPCM_COPY,             /* copy the byte */
+  GST_DVDLPCM_HI_NIBBLE,        /* keep the high nibble */
+  GST_DVDLPCM_LO_NIBBLE         /* move the low nibble up */
+} GstDvdLpcmByteOp;
+
+typedef struct {
+  gint8 src;                    /* byte in the input group, -1 for zero */
+  guint8 op;                    /* GstDvdLpcmByteOp */
+} GstDvdLpcmByteMap;
+
+typedef struct {
+  guint in_size;                /* bytes per input group */
+  guint out_size;               /* bytes per output group */
+  GstDvdLpcmByteMap map[16];    /* one entry per output byte */
+} GstDvdLpcmLayout;
+
+/* the SIMD kernels work on this many groups at a time */
+#define GST_DVDLPCM_BLOCK_GROUPS 4
+
+/* input byte of a block that output byte @o of the block is made from, or
+ * 0xff for a zero byte */
+static inline guint8
+gst_dvdlpcm_layout_index (const GstDvdLpcmLayout * layout, guint o,
+    guint8 * op)
+{
+  const GstDvdLpcmByteMap *map = &layout->map[o % layout->out_size];
+
+  *op = map->op;
+  if (map->src < 0)
+    return 0xff;
+  return (o / layout->out_size) * layout->in_size + map->src;
+}
+
+/* the kernels return the number of groups they handled, the rest is left
+ * for the scalar code */
+typedef guint (*GstDvdLpcmUnpackSimdFunc) (const GstDvdLpcmLayout * layout,
+    guint8 * dest, const guint8 * src, guint groups);
+
+#ifdef HAVE_SSSE3
+gboolean gst_dvdlpcm_have_ssse3 (void);
+guint    gst_dvdlpcm_unpack_ssse3 (const GstDvdLpcmLayout * layout,
+    guint8 * dest, const guint8 * src, guint groups);
+#endif
+
+G_END_DECLS
+
+#endif /* __GST_DVDLPCM_UNPACK_H__ */
@@ -24,6 +24,8 @@
 
 #include <string.h>
 
+#include <gst/gst-probes.h>
+
 #include "gstmpegaudioparse.h"
 
 GST_DEBUG_CATEGORY_STATIC (mp3parse_debug);
@@ -96,7 +98,9 @@ enum
 {
   ARG_0,
   ARG_SKIP,
-  ARG_BIT_RATE
+  ARG_BIT_RATE,
+  ARG_FULL_SCAN,
+  ARG_STATS
       /* FILL ME */
 };
 
@@ -108,6 +112,10 @@ static void gst_mp3parse_init (GstMPEGAudioParse * mp3parse,
 
 static gboolean gst_mp3parse_sink_event (GstPad * pad, GstEvent * event);
 static GstFlowReturn gst_mp3parse_chain (GstPad * pad, GstBuffer * buffer);
+static gboolean gst_mp3parse_sink_activate (GstPad * sinkpad);
+static gboolean gst_mp3parse_sink_activate_pull (GstPad * sinkpad,
+    gboolean active);
+static void gst_mp3parse_loop (GstPad * pad);
 static gboolean mp3parse_src_query (GstPad * pad, GstQuery * query);
 static const GstQueryType *mp3parse_get_query_types (GstPad * pad);
 static gboolean mp3parse_src_event (GstPad * pad, GstEvent * event);
@@ -180,7 +188,6 @@ mp3_type_frame_length_from_header (GstMPEGAudioParse * mp3parse, guint32 header,
   gulong mode, samplerate, bitrate, layer, channels, padding, crc;
   gulong version;
   gint lsf, mpg25;
-  GEnumValue *mode_enum;
 
   if (header & (1 << 20)) {
     lsf = (header & (1 << 19)) ? 0 : 1;
@@ -222,14 +229,13 @@ mp3_type_frame_length_from_header (GstMPEGAudioParse * mp3parse, guint32 header,
       break;
   }
 
-  mode_enum =
-      g_enum_get_value (g_type_class_peek (GST_TYPE_MP3_CHANNEL_MODE), mode);
-
-  GST_DEBUG_OBJECT (mp3parse, "Calculated mp3 frame length of %u bytes",
+  GST_HOT_DEBUG_OBJECT (mp3parse, "Calculated mp3 frame length of %u bytes",
       length);
-  GST_DEBUG_OBJECT (mp3parse, "samplerate = %lu, bitrate = %lu, version = %lu, "
-      "layer = %lu, channels = %lu, mode = %s", samplerate, bitrate, version,
-      layer, channels, mode_enum->value_nick);
+  GST_HOT_DEBUG_OBJECT (mp3parse, "samplerate = %lu, bitrate = %lu, "
+      "version = %lu, layer = %lu, channels = %lu, mode = %s", samplerate,
+      bitrate, version, layer, channels,
+      g_enum_get_value (g_type_class_peek (GST_TYPE_MP3_CHANNEL_MODE),
+          mode)->value_nick);
 
   if (put_version)
     *put_version = version;
@@ -249,6 +255,21 @@ mp3_type_frame_length_from_header (GstMPEGAudioParse * mp3parse, guint32 header,
   return length;
 }
 
+/* see http://www.codeproject.com/audio/MPEGAudioInfo.asp */
+static inline gint
+mp3_type_samples_per_frame (guint version, guint layer)
+{
+  if (layer == 1)
+    return 384;
+  else if (layer == 2)
+    return 1152;
+  else if (version == 1)
+    return 1152;
+
+  /* MPEG-2 or "2.5" */
+  return 576;
+}
+
 static GstCaps *
 mp3_caps_create (guint version, guint layer, guint channels, guint samplerate)
 {
@@ -305,6 +326,14 @@ gst_mp3parse_class_init (GstMPEGAudioParseClass * klass)
   g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_BIT_RATE,
       g_param_spec_int ("bitrate", "Bitrate", "Bit Rate",
           G_MININT, G_MAXINT, 0, G_PARAM_READABLE));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_FULL_SCAN,
+      g_param_spec_boolean ("full-scan", "Full scan",
+          "When reading from a random access source, read all frame headers "
+          "to get the exact duration and a complete seek index, instead of "
+          "estimating the duration from a few regions of the file",
+          FALSE, G_PARAM_READWRITE));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_STATS,
+      gst_element_stats_param_spec ());
 
   gstelement_class->change_state = gst_mp3parse_change_state;
 
@@ -384,9 +413,19 @@ gst_mp3parse_reset (GstMPEGAudioParse * mp3parse)
 
     gst_event_replace (eventp, NULL);
   }
+  if (mp3parse->close_segment) {
+    GstEvent **eventp = &mp3parse->close_segment;
+
+    gst_event_replace (eventp, NULL);
+  }
 
   mp3parse->exact_position = FALSE;
   gst_segment_init (&mp3parse->segment, GST_FORMAT_TIME);
+
+  mp3parse->pull_offset = 0;
+  mp3parse->scanned = FALSE;
+  mp3parse->scan_total_time = GST_CLOCK_TIME_NONE;
+  mp3parse->scan_bitrate = 0;
 }
 
 static void
@@ -396,6 +435,10 @@ gst_mp3parse_init (GstMPEGAudioParse * mp3parse, GstMPEGAudioParseClass * klass)
       gst_pad_new_from_static_template (&mp3_sink_template, "sink");
   gst_pad_set_event_function (mp3parse->sinkpad, gst_mp3parse_sink_event);
   gst_pad_set_chain_function (mp3parse->sinkpad, gst_mp3parse_chain);
+  gst_pad_set_activate_function (mp3parse->sinkpad,
+      gst_mp3parse_sink_activate);
+  gst_pad_set_activatepull_function (mp3parse->sinkpad,
+      gst_mp3parse_sink_activate_pull);
   gst_element_add_pad (GST_ELEMENT (mp3parse), mp3parse->sinkpad);
 
   mp3parse->srcpad =
@@ -408,6 +451,7 @@ gst_mp3parse_init (GstMPEGAudioParse * mp3parse, GstMPEGAudioParseClass * klass)
 
   mp3parse->adapter = gst_adapter_new ();
   mp3parse->pending_accurate_seeks_lock = g_mutex_new ();
+  mp3parse->full_scan = FALSE;
 
   gst_mp3parse_reset (mp3parse);
 }
@@ -612,6 +656,9 @@ gst_mp3parse_emit_frame (GstMPEGAudioParse * mp3parse, guint size,
   GstClockTime push_start;
   GstTagList *taglist;
 
+  /* the frame is only copied when it spans several input buffers */
+  if (gst_adapter_available_fast (mp3parse->adapter) < size)
+    gst_element_stats_copy (&mp3parse->stats, size);
   outbuf = gst_adapter_take_buffer (mp3parse->adapter, size);
 
   GST_BUFFER_DURATION (outbuf) =
@@ -772,6 +819,8 @@ gst_mp3parse_emit_frame (GstMPEGAudioParse * mp3parse, guint size,
     push_start = mp3parse->segment.start;
   }
 
+  GST_PROBE_FRAME (mp3parse, size, GST_BUFFER_TIMESTAMP (outbuf));
+
   if (G_UNLIKELY ((GST_CLOCK_TIME_IS_VALID (push_start) &&
               GST_BUFFER_TIMESTAMP_IS_VALID (outbuf) &&
               GST_BUFFER_DURATION_IS_VALID (outbuf) &&
@@ -805,13 +854,17 @@ gst_mp3parse_emit_frame (GstMPEGAudioParse * mp3parse, guint size,
     gst_buffer_unref (outbuf);
     ret = GST_FLOW_UNEXPECTED;
   } else {
-    GST_DEBUG_OBJECT (mp3parse,
+    GST_HOT_DEBUG_OBJECT (mp3parse,
         "pushing buffer of %d bytes, timestamp %" GST_TIME_FORMAT
         ", offset 0x%08" G_GINT64_MODIFIER "x", size,
         GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (outbuf)),
         GST_BUFFER_OFFSET (outbuf));
     mp3parse->segment.last_stop = GST_BUFFER_TIMESTAMP (outbuf);
     /* push any pending segment now */
+    if (mp3parse->close_segment) {
+      gst_pad_push_event (mp3parse->srcpad, mp3parse->close_segment);
+      mp3parse->close_segment = NULL;
+    }
     if (mp3parse->pending_segment) {
       gst_pad_push_event (mp3parse->srcpad, mp3parse->pending_segment);
       mp3parse->pending_segment = NULL;
@@ -832,6 +885,8 @@ gst_mp3parse_emit_frame (GstMPEGAudioParse * mp3parse, guint size,
       mp3parse->discont = FALSE;
     }
 
+    gst_element_stats_output (&mp3parse->stats, outbuf);
+    GST_PROBE_PUSH (mp3parse, outbuf);
     ret = gst_pad_push (mp3parse->srcpad, outbuf);
   }
 
@@ -1160,6 +1215,51 @@ gst_mp3parse_handle_first_frame (GstMPEGAudioParse * mp3parse)
   }
 }
 
+/* how much of the adapter we look at at once when resyncing */
+#define RESYNC_BLOCK_SIZE 4096
+
+/* Skips ahead to the next position that could start a frame: a 0xff byte
+ * followed by the rest of the sync bits, passing head_check(). Everything
+ * before it is flushed in one go. If there is no such position in the
+ * block we looked at, we flush all of it except the last 3 bytes, which
+ * could still be the start of a header. */
+static void
+gst_mp3parse_skip_to_sync (GstMPEGAudioParse * mp3parse)
+{
+  const guint8 *data, *p, *end;
+  guint size, skip;
+
+  size = MIN (gst_adapter_available (mp3parse->adapter), RESYNC_BLOCK_SIZE);
+  if (size < 4)
+    return;
+
+  data = gst_adapter_peek (mp3parse->adapter, size);
+  /* last position a complete header fits at, plus one */
+  end = data + size - 3;
+
+  p = data;
+  while (p < end && (p = memchr (p, 0xff, end - p)) != NULL) {
+    if ((p[1] & 0xe0) == 0xe0 && head_check (mp3parse, GST_READ_UINT32_BE (p)))
+      break;
+    p++;
+  }
+  if (p == NULL)
+    p = end;
+
+  skip = p - data;
+
+  GST_HOT_LOG_OBJECT (mp3parse, "resyncing, skipping %u bytes", skip);
+
+  mp3parse->resyncing = TRUE;
+  if (skip > 0) {
+    gst_adapter_flush (mp3parse->adapter, skip);
+    gst_element_stats_resync (&mp3parse->stats, skip);
+    if (mp3parse->cur_offset != -1)
+      mp3parse->cur_offset += skip;
+    mp3parse->tracked_offset += skip;
+  }
+}
+
 static GstFlowReturn
 gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
 {
@@ -1170,10 +1270,14 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
   int bpf;
   guint available;
   GstClockTime timestamp;
+  GstClockTime start;
 
   mp3parse = GST_MP3PARSE (GST_PAD_PARENT (pad));
 
-  GST_LOG_OBJECT (mp3parse, "buffer of %d bytes", GST_BUFFER_SIZE (buf));
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&mp3parse->stats, buf);
+
+  GST_HOT_LOG_OBJECT (mp3parse, "buffer of %d bytes", GST_BUFFER_SIZE (buf));
 
   timestamp = GST_BUFFER_TIMESTAMP (buf);
 
@@ -1195,7 +1299,7 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
     if (avail == 0 && !GST_CLOCK_TIME_IS_VALID (mp3parse->next_ts))
       mp3parse->next_ts = timestamp;
 
-    GST_LOG_OBJECT (mp3parse, "Have pending ts %" GST_TIME_FORMAT
+    GST_HOT_LOG_OBJECT (mp3parse, "Have pending ts %" GST_TIME_FORMAT
         " to apply in %lld bytes (@ off %lld)",
         GST_TIME_ARGS (mp3parse->pending_ts), avail, mp3parse->pending_offset);
   }
@@ -1212,13 +1316,8 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
     /* search for a possible start byte */
     data = gst_adapter_peek (mp3parse->adapter, 4);
     if (*data != 0xff) {
-      /* It'd be nice to make this efficient, but it's ok for now; this is only
-       * when resyncing */
-      mp3parse->resyncing = TRUE;
-      gst_adapter_flush (mp3parse->adapter, 1);
-      if (mp3parse->cur_offset != -1)
-        mp3parse->cur_offset++;
-      mp3parse->tracked_offset++;
+      /* scan for the next candidate header instead of going byte by byte */
+      gst_mp3parse_skip_to_sync (mp3parse);
       continue;
     }
 
@@ -1265,7 +1364,7 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
 
         data2 = gst_adapter_peek (mp3parse->adapter, bpf + 4);
         header2 = GST_READ_UINT32_BE (data2 + bpf);
-        GST_DEBUG_OBJECT (mp3parse, "header=%08X, header2=%08X, bpf=%d",
+        GST_HOT_DEBUG_OBJECT (mp3parse, "header=%08X, header2=%08X, bpf=%d",
             (unsigned int) header, (unsigned int) header2, bpf);
 
 /* mask the bits which are allowed to differ between frames */
@@ -1282,6 +1381,7 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
            * next position in the stream */
           mp3parse->resyncing = TRUE;
           gst_adapter_flush (mp3parse->adapter, 1);
+          gst_element_stats_resync (&mp3parse->stats, 1);
           if (mp3parse->cur_offset != -1)
             mp3parse->cur_offset++;
           mp3parse->tracked_offset++;
@@ -1291,7 +1391,7 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
 
       /* if we don't have the whole frame... */
       if (available < bpf) {
-        GST_DEBUG_OBJECT (mp3parse, "insufficient data available, need "
+        GST_HOT_DEBUG_OBJECT (mp3parse, "insufficient data available, need "
             "%d bytes, have %d", bpf, available);
         break;
       }
@@ -1310,18 +1410,7 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
       if (layer != mp3parse->layer || version != mp3parse->version) {
         mp3parse->layer = layer;
         mp3parse->version = version;
-
-        /* see http://www.codeproject.com/audio/MPEGAudioInfo.asp */
-        if (mp3parse->layer == 1)
-          mp3parse->spf = 384;
-        else if (mp3parse->layer == 2)
-          mp3parse->spf = 1152;
-        else if (mp3parse->version == 1) {
-          mp3parse->spf = 1152;
-        } else {
-          /* MPEG-2 or "2.5" */
-          mp3parse->spf = 576;
-        }
+        mp3parse->spf = mp3_type_samples_per_frame (version, layer);
       }
 
       mp3parse->bit_rate = bitrate;
@@ -1358,24 +1447,301 @@ gst_mp3parse_chain (GstPad * pad, GstBuffer * buf)
     } else {
       mp3parse->resyncing = TRUE;
       gst_adapter_flush (mp3parse->adapter, 1);
+      gst_element_stats_resync (&mp3parse->stats, 1);
       if (mp3parse->cur_offset != -1)
         mp3parse->cur_offset++;
       mp3parse->tracked_offset++;
-      GST_DEBUG_OBJECT (mp3parse, "wrong header, skipping byte");
+      GST_HOT_DEBUG_OBJECT (mp3parse, "wrong header, skipping byte");
     }
 
     if (GST_FLOW_IS_FATAL (flow))
       break;
   }
 
+  gst_element_stats_stop (&mp3parse->stats, start);
+
   return flow;
 
 header_error:
   GST_ELEMENT_ERROR (mp3parse, STREAM, DECODE,
       ("Invalid MP3 header found"), (NULL));
+  gst_element_stats_stop (&mp3parse->stats, start);
   return GST_FLOW_ERROR;
 }
 
+/* pull mode reads the file in blocks of this size */
+#define PULL_BLOCK_SIZE (64 * 1024)
+/* without full-scan, the duration is estimated from this many regions of
+ * this size, spread over the file */
+#define SCAN_REGIONS 8
+#define SCAN_REGION_SIZE (16 * 1024)
+
+static gboolean
+gst_mp3parse_sink_activate (GstPad * sinkpad)
+{
+  if (gst_pad_check_pull_range (sinkpad)) {
+    return gst_pad_activate_pull (sinkpad, TRUE);
+  } else {
+    return gst_pad_activate_push (sinkpad, TRUE);
+  }
+}
+
+static gboolean
+gst_mp3parse_sink_activate_pull (GstPad * sinkpad, gboolean active)
+{
+  GstMPEGAudioParse *mp3parse = GST_MP3PARSE (GST_PAD_PARENT (sinkpad));
+  gboolean res;
+
+  if (active) {
+    GstEvent *event;
+    GstEvent **eventp;
+
+    mp3parse->pull_mode = TRUE;
+    mp3parse->pull_offset = 0;
+
+    /* nobody upstream sends us a segment, we start with our own */
+    event = gst_event_new_new_segment (FALSE, 1.0, GST_FORMAT_TIME, 0, -1, 0);
+    eventp = &mp3parse->pending_segment;
+    gst_event_replace (eventp, event);
+    gst_event_unref (event);
+
+    res = gst_pad_start_task (sinkpad, (GstTaskFunction) gst_mp3parse_loop,
+        sinkpad);
+  } else {
+    res = gst_pad_stop_task (sinkpad);
+    mp3parse->pull_mode = FALSE;
+  }
+
+  return res;
+}
+
+/* Replaces *buf with the data at pos. Returns FALSE if there is none */
+static gboolean
+gst_mp3parse_scan_pull (GstMPEGAudioParse * mp3parse, gint64 pos, gint64 end,
+    GstBuffer ** buf, gint64 * buf_offset, gint64 * buf_end)
+{
+  if (*buf) {
+    gst_buffer_unref (*buf);
+    *buf = NULL;
+  }
+
+  if (gst_pad_pull_range (mp3parse->sinkpad, pos,
+          MIN (PULL_BLOCK_SIZE, end - pos), buf) != GST_FLOW_OK)
+    return FALSE;
+
+  *buf_offset = pos;
+  *buf_end = pos + GST_BUFFER_SIZE (*buf);
+
+  return GST_BUFFER_SIZE (*buf) > 0;
+}
+
+/* Walks the frame headers between offset and offset + size without looking
+ * at the frame data. Like when resyncing, a frame only counts if the next
+ * header matches; only the last frame of the range is taken as it is.
+ * Returns the number of frames, their size and their duration. With index
+ * set, each frame is also added to the seek table */
+static void
+gst_mp3parse_scan_frames (GstMPEGAudioParse * mp3parse, gint64 offset,
+    gint64 size, gboolean index, guint64 * frames, guint64 * bytes,
+    GstClockTime * duration)
+{
+  GstBuffer *buf = NULL;
+  gint64 buf_offset = 0, buf_end = 0, pos, end;
+
+  *frames = *bytes = 0;
+  *duration = 0;
+
+  pos = offset;
+  end = offset + size;
+
+  while (pos + 4 <= end) {
+    const guint8 *data;
+    guint32 header, header2;
+    guint bpf, version = 0, layer = 0, rate = 0;
+
+    if (pos + 4 > buf_end &&
+        !gst_mp3parse_scan_pull (mp3parse, pos, end, &buf, &buf_offset,
+            &buf_end))
+      break;
+    if (pos + 4 > buf_end)
+      break;
+
+    data = GST_BUFFER_DATA (buf) + (pos - buf_offset);
+    header = GST_READ_UINT32_BE (data);
+
+    if (data[0] != 0xff || (data[1] & 0xe0) != 0xe0 ||
+        !head_check (mp3parse, header) ||
+        !(bpf = mp3_type_frame_length_from_header (mp3parse, header,
+                &version, &layer, NULL, NULL, &rate, NULL, NULL))) {
+      const guint8 *next;
+
+      next = memchr (data + 1, 0xff, buf_end - pos - 1);
+      pos = next ? buf_offset + (next - GST_BUFFER_DATA (buf)) : buf_end;
+      continue;
+    }
+
+    if (pos + bpf + 4 <= end) {
+      /* make sure we have the next header in the block too */
+      if (pos + bpf + 4 > buf_end) {
+        if (!gst_mp3parse_scan_pull (mp3parse, pos, end, &buf, &buf_offset,
+                &buf_end) || pos + bpf + 4 > buf_end)
+          break;
+        data = GST_BUFFER_DATA (buf);
+      }
+
+      header2 = GST_READ_UINT32_BE (data + bpf);
+      if ((header2 & HDRMASK) != (header & HDRMASK)) {
+        pos++;
+        continue;
+      }
+    } else if (pos + bpf > end) {
+      break;
+    }
+
+    if (index && (!mp3parse->seek_table ||
+            mp3parse_seek_table_last_entry (mp3parse)->byte < pos)) {
+      MPEGAudioSeekEntry *entry = mpeg_audio_seek_entry_new ();
+
+      entry->byte = pos;
+      entry->timestamp = *duration;
+      mp3parse->seek_table = g_list_prepend (mp3parse->seek_table, entry);
+    }
+
+    /* same rounding as the timestamps we put on the frames */
+    *frames += 1;
+    *bytes += bpf;
+    *duration += gst_util_uint64_scale (GST_SECOND,
+        mp3_type_samples_per_frame (version, layer), rate);
+
+    pos += bpf;
+  }
+
+  if (buf)
+    gst_buffer_unref (buf);
+}
+
+/* In pull mode we can find the duration before playing: either from all
+ * frames if full-scan is set or the file is small, or from the bitrate of
+ * a few regions spread over the file */
+static void
+gst_mp3parse_scan_duration (GstMPEGAudioParse * mp3parse)
+{
+  guint64 frames, bytes, total_frames = 0, total_bytes_scanned = 0;
+  GstClockTime duration, total_duration = 0;
+  gint64 total_bytes;
+  gboolean full;
+  gint i;
+
+  if (!mp3parse_total_bytes (mp3parse, &total_bytes) || total_bytes <= 0)
+    return;
+
+  full = mp3parse->full_scan ||
+      total_bytes <= SCAN_REGIONS * SCAN_REGION_SIZE;
+
+  if (full) {
+    gst_mp3parse_scan_frames (mp3parse, 0, total_bytes, mp3parse->full_scan,
+        &total_frames, &total_bytes_scanned, &total_duration);
+  } else {
+    for (i = 0; i < SCAN_REGIONS; i++) {
+      gint64 offset = total_bytes * i / SCAN_REGIONS;
+
+      gst_mp3parse_scan_frames (mp3parse, offset, SCAN_REGION_SIZE, FALSE,
+          &frames, &bytes, &duration);
+      total_frames += frames;
+      total_bytes_scanned += bytes;
+      total_duration += duration;
+    }
+  }
+
+  if (total_frames == 0 || total_duration == 0) {
+    GST_DEBUG_OBJECT (mp3parse, "no frames found while scanning");
+    return;
+  }
+
+  mp3parse->scan_bitrate = gst_util_uint64_scale (total_bytes_scanned * 8,
+      GST_SECOND, total_duration);
+  if (full) {
+    mp3parse->scan_total_time = total_duration;
+  } else {
+    mp3parse->scan_total_time = gst_util_uint64_scale (total_bytes,
+        total_duration, total_bytes_scanned);
+  }
+
+  GST_DEBUG_OBJECT (mp3parse, "scanned %" G_GUINT64_FORMAT " frames, "
+      "bitrate %u, duration %" GST_TIME_FORMAT " (%s)", total_frames,
+      mp3parse->scan_bitrate, GST_TIME_ARGS (mp3parse->scan_total_time),
+      full ? "exact" : "estimated");
+
+  gst_element_post_message (GST_ELEMENT (mp3parse),
+      gst_message_new_duration (GST_OBJECT (mp3parse), GST_FORMAT_TIME,
+          mp3parse->scan_total_time));
+}
+
+static void
+gst_mp3parse_loop (GstPad * pad)
+{
+  GstMPEGAudioParse *mp3parse = GST_MP3PARSE (GST_PAD_PARENT (pad));
+  GstFlowReturn flow;
+  GstBuffer *buf = NULL;
+
+  if (G_UNLIKELY (!mp3parse->scanned)) {
+    gst_mp3parse_scan_duration (mp3parse);
+    mp3parse->scanned = TRUE;
+  }
+
+  flow = gst_pad_pull_range (pad, mp3parse->pull_offset, PULL_BLOCK_SIZE,
+      &buf);
+  if (flow != GST_FLOW_OK)
+    goto pause;
+
+  if (GST_BUFFER_SIZE (buf) == 0) {
+    gst_buffer_unref (buf);
+    flow = GST_FLOW_UNEXPECTED;
+    goto pause;
+  }
+
+  GST_BUFFER_OFFSET (buf) = mp3parse->pull_offset;
+  GST_BUFFER_TIMESTAMP (buf) = GST_CLOCK_TIME_NONE;
+  mp3parse->pull_offset += GST_BUFFER_SIZE (buf);
+
+  /* the frames are cut and pushed exactly like in push mode */
+  flow = gst_mp3parse_chain (pad, buf);
+  if (flow != GST_FLOW_OK)
+    goto pause;
+
+  return;
+
+pause:
+  {
+    GST_DEBUG_OBJECT (mp3parse, "pausing task, reason %s",
+        gst_flow_get_name (flow));
+    gst_pad_pause_task (pad);
+
+    if (flow == GST_FLOW_UNEXPECTED) {
+      if (mp3parse->segment.flags & GST_SEEK_FLAG_SEGMENT) {
+        gint64 stop = mp3parse->segment.stop;
+
+        if (stop == -1)
+          stop = mp3parse->segment.last_stop;
+        gst_element_post_message (GST_ELEMENT (mp3parse),
+            gst_message_new_segment_done (GST_OBJECT (mp3parse),
+                GST_FORMAT_TIME, stop));
+      } else {
+        if (mp3parse->frame_count == 0) {
+          GST_ELEMENT_ERROR (mp3parse, STREAM, WRONG_TYPE,
+              ("No valid frames found before end of stream"), (NULL));
+        }
+        gst_pad_push_event (mp3parse->srcpad, gst_event_new_eos ());
+      }
+    } else if (GST_FLOW_IS_FATAL (flow) || flow == GST_FLOW_NOT_LINKED) {
+      GST_ELEMENT_ERROR (mp3parse, STREAM, FAILED, (NULL),
+          ("streaming stopped, reason %s", gst_flow_get_name (flow)));
+      gst_pad_push_event (mp3parse->srcpad, gst_event_new_eos ());
+    }
+    return;
+  }
+}
+
 static gboolean
 head_check (GstMPEGAudioParse * mp3parse, unsigned long head)
 {
@@ -1435,6 +1801,9 @@ gst_mp3parse_set_property (GObject * object, guint prop_id,
     case ARG_SKIP:
       src->skip = g_value_get_int (value);
       break;
+    case ARG_FULL_SCAN:
+      src->full_scan = g_value_get_boolean (value);
+      break;
     default:
       break;
   }
@@ -1456,6 +1825,13 @@ gst_mp3parse_get_property (GObject * object, guint prop_id, GValue * value,
     case ARG_BIT_RATE:
       g_value_set_int (value, src->bit_rate * 1000);
       break;
+    case ARG_FULL_SCAN:
+      g_value_set_boolean (value, src->full_scan);
+      break;
+    case ARG_STATS:
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&src->stats, "mp3parse-stats"));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1470,6 +1846,14 @@ gst_mp3parse_change_state (GstElement * element, GstStateChange transition)
 
   mp3parse = GST_MP3PARSE (element);
 
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_element_stats_reset (&mp3parse->stats);
+      break;
+    default:
+      break;
+  }
+
   result = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
@@ -1521,6 +1905,12 @@ mp3parse_total_time (GstMPEGAudioParse * mp3parse, GstClockTime * total)
     return TRUE;
   }
 
+  /* In pull mode we may have measured it in advance */
+  if (GST_CLOCK_TIME_IS_VALID (mp3parse->scan_total_time)) {
+    *total = mp3parse->scan_total_time;
+    return TRUE;
+  }
+
   /* Calculate time from the measured bitrate */
   if (!mp3parse_total_bytes (mp3parse, &total_bytes))
     return FALSE;
@@ -1600,6 +1990,13 @@ mp3parse_time_to_bytepos (GstMPEGAudioParse * mp3parse, GstClockTime ts,
     return TRUE;
   }
 
+  /* a bitrate measured over the whole file beats the running average */
+  if (mp3parse->scan_bitrate != 0) {
+    *bytepos =
+        gst_util_uint64_scale (ts, mp3parse->scan_bitrate, (8 * GST_SECOND));
+    return TRUE;
+  }
+
   if (mp3parse->avg_bitrate == 0)
     goto no_bitrate;
 
@@ -1682,6 +2079,12 @@ mp3parse_bytepos_to_time (GstMPEGAudioParse * mp3parse,
     return TRUE;
   }
 
+  if (mp3parse->scan_bitrate != 0) {
+    *ts = (GstClockTime) gst_util_uint64_scale (GST_SECOND, bytepos * 8,
+        mp3parse->scan_bitrate);
+    return TRUE;
+  }
+
   /* Cannot convert anything except 0 if we don't have a bitrate yet */
   if (mp3parse->avg_bitrate == 0)
     return FALSE;
@@ -1691,6 +2094,172 @@ mp3parse_bytepos_to_time (GstMPEGAudioParse * mp3parse,
   return TRUE;
 }
 
+/* Looks up where decoding has to start for an accurate seek to @cur: the
+ * indexed frame one bit reservoir before it, or the start of the file if
+ * there is no index yet. @byte_stop is set to the indexed frame after @stop,
+ * or -1 */
+static void
+mp3parse_seek_table_lookup (GstMPEGAudioParse * mp3parse, gint64 cur,
+    gint64 stop, gint64 * byte_cur, gint64 * byte_stop, GstClockTime * start)
+{
+  MPEGAudioSeekEntry *entry = NULL, *start_entry = NULL, *stop_entry = NULL;
+  GList *start_node, *stop_node;
+  gint64 seek_ts;
+
+  if (!mp3parse->seek_table) {
+    *byte_cur = 0;
+    *byte_stop = -1;
+    *start = 0;
+    return;
+  }
+
+  seek_ts = (cur > mp3parse->max_bitreservoir) ?
+      (cur - mp3parse->max_bitreservoir) : 0;
+
+  for (start_node = mp3parse->seek_table; start_node;
+      start_node = start_node->next) {
+    entry = start_node->data;
+
+    if (seek_ts >= entry->timestamp) {
+      start_entry = entry;
+      break;
+    }
+  }
+
+  if (!start_entry)
+    start_entry = mp3parse->seek_table->data;
+  *start = start_entry->timestamp;
+  *byte_cur = start_entry->byte;
+
+  for (stop_node = mp3parse->seek_table; stop_node;
+      stop_node = stop_node->next) {
+    entry = stop_node->data;
+
+    if (stop >= entry->timestamp) {
+      stop_node = stop_node->prev;
+      stop_entry = (stop_node) ? stop_node->data : NULL;
+      break;
+    }
+  }
+
+  if (!stop_entry) {
+    *byte_stop = -1;
+  } else {
+    *byte_stop = stop_entry->byte;
+  }
+}
+
+/* In pull mode we handle TIME seeks ourselves: the byte position comes from
+ * the same seek table, Xing TOC, VBRI or bitrate logic as in push mode and
+ * the loop simply continues reading from there */
+static gboolean
+mp3parse_handle_seek_pull (GstMPEGAudioParse * mp3parse, GstEvent * event)
+{
+  GstFormat format;
+  gdouble rate;
+  GstSeekFlags flags;
+  GstSeekType cur_type, stop_type;
+  gint64 cur, stop;
+  gint64 byte_cur, byte_stop;
+  GstClockTime start = GST_CLOCK_TIME_NONE;
+  GstSegment seeksegment;
+  GstEvent **eventp;
+  gboolean flush, update;
+
+  gst_event_parse_seek (event, &rate, &format, &flags, &cur_type, &cur,
+      &stop_type, &stop);
+
+  if (format != GST_FORMAT_TIME)
+    goto wrong_format;
+  if (rate <= 0.0)
+    goto wrong_rate;
+
+  seeksegment = mp3parse->segment;
+  gst_segment_set_seek (&seeksegment, rate, format, flags, cur_type, cur,
+      stop_type, stop, &update);
+
+  if (flags & GST_SEEK_FLAG_ACCURATE) {
+    mp3parse_seek_table_lookup (mp3parse, seeksegment.start, seeksegment.stop,
+        &byte_cur, &byte_stop, &start);
+  } else if (!mp3parse_time_to_bytepos (mp3parse, seeksegment.start,
+          &byte_cur)) {
+    goto no_pos;
+  }
+
+  GST_DEBUG_OBJECT (mp3parse, "seeking to %" GST_TIME_FORMAT " at byte %"
+      G_GINT64_FORMAT, GST_TIME_ARGS (seeksegment.start), byte_cur);
+
+  flush = ((flags & GST_SEEK_FLAG_FLUSH) != 0);
+
+  if (flush)
+    gst_pad_push_event (mp3parse->srcpad, gst_event_new_flush_start ());
+  else
+    gst_pad_pause_task (mp3parse->sinkpad);
+
+  GST_PAD_STREAM_LOCK (mp3parse->sinkpad);
+
+  if (flush) {
+    gst_pad_push_event (mp3parse->srcpad, gst_event_new_flush_stop ());
+    eventp = &mp3parse->close_segment;
+    gst_event_replace (eventp, NULL);
+  } else if (mp3parse->pending_segment == NULL) {
+    /* close the running segment where we stopped */
+    event = gst_event_new_new_segment_full (TRUE, mp3parse->segment.rate,
+        mp3parse->segment.applied_rate, GST_FORMAT_TIME,
+        mp3parse->segment.start, mp3parse->segment.last_stop,
+        mp3parse->segment.time);
+    eventp = &mp3parse->close_segment;
+    gst_event_replace (eventp, event);
+    gst_event_unref (event);
+  }
+
+  mp3parse->segment = seeksegment;
+
+  gst_adapter_clear (mp3parse->adapter);
+  mp3parse->pull_offset = byte_cur;
+  mp3parse->cur_offset = byte_cur;
+  mp3parse->tracked_offset = 0;
+  mp3parse->pending_ts = GST_CLOCK_TIME_NONE;
+  mp3parse->discont = TRUE;
+
+  /* an index entry is a frame with a known timestamp, anything else is
+   * an estimate that we have to resync from */
+  mp3parse->next_ts = start;
+  mp3parse->exact_position = GST_CLOCK_TIME_IS_VALID (start);
+  mp3parse->resyncing = !mp3parse->exact_position;
+
+  if (seeksegment.flags & GST_SEEK_FLAG_SEGMENT) {
+    gst_element_post_message (GST_ELEMENT (mp3parse),
+        gst_message_new_segment_start (GST_OBJECT (mp3parse),
+            GST_FORMAT_TIME, seeksegment.start));
+  }
+
+  event = gst_event_new_new_segment_full (FALSE, seeksegment.rate,
+      seeksegment.applied_rate, GST_FORMAT_TIME, seeksegment.start,
+      seeksegment.stop, seeksegment.start);
+  eventp = &mp3parse->pending_segment;
+  gst_event_replace (eventp, event);
+  gst_event_unref (event);
+
+  gst_pad_start_task (mp3parse->sinkpad, (GstTaskFunction) gst_mp3parse_loop,
+      mp3parse->sinkpad);
+
+  GST_PAD_STREAM_UNLOCK (mp3parse->sinkpad);
+
+  return TRUE;
+
+wrong_format:
+  GST_DEBUG_OBJECT (mp3parse, "can only seek in TIME format in pull mode");
+  return FALSE;
+wrong_rate:
+  GST_DEBUG_OBJECT (mp3parse, "negative playback rates are not supported");
+  return FALSE;
+no_pos:
+  GST_DEBUG_OBJECT (mp3parse,
+      "Could not determine byte position for desired time");
+  return FALSE;
+}
+
 static gboolean
 mp3parse_handle_seek (GstMPEGAudioParse * mp3parse, GstEvent * event)
 {
@@ -1707,6 +2276,10 @@ mp3parse_handle_seek (GstMPEGAudioParse * mp3parse, GstEvent * event)
   GST_DEBUG_OBJECT (mp3parse, "Performing seek to %" GST_TIME_FORMAT,
       GST_TIME_ARGS (cur));
 
+  /* Upstream only knows about bytes, there's nothing to push it */
+  if (mp3parse->pull_mode)
+    return mp3parse_handle_seek_pull (mp3parse, event);
+
   /* For any format other than TIME, see if upstream handles
    * it directly or fail. For TIME, try upstream, but do it ourselves if
    * it fails upstream */
@@ -1739,53 +2312,8 @@ mp3parse_handle_seek (GstMPEGAudioParse * mp3parse, GstEvent * event)
     gst_segment_set_seek (&seek->segment, rate, GST_FORMAT_TIME,
         flags, cur_type, cur, stop_type, stop, NULL);
 
-    if (!mp3parse->seek_table) {
-      byte_cur = 0;
-      byte_stop = -1;
-      start = 0;
-    } else {
-      MPEGAudioSeekEntry *entry = NULL, *start_entry = NULL, *stop_entry = NULL;
-      GList *start_node, *stop_node;
-      gint64 seek_ts = (cur > mp3parse->max_bitreservoir) ?
-          (cur - mp3parse->max_bitreservoir) : 0;
-
-      for (start_node = mp3parse->seek_table; start_node;
-          start_node = start_node->next) {
-        entry = start_node->data;
-
-        if (seek_ts >= entry->timestamp) {
-          start_entry = entry;
-          break;
-        }
-      }
-
-      if (!start_entry) {
-        start_entry = mp3parse->seek_table->data;
-        start = start_entry->timestamp;
-        byte_cur = start_entry->byte;
-      } else {
-        start = start_entry->timestamp;
-        byte_cur = start_entry->byte;
-      }
-
-      for (stop_node = mp3parse->seek_table; stop_node;
-          stop_node = stop_node->next) {
-        entry = stop_node->data;
-
-        if (stop >= entry->timestamp) {
-          stop_node = stop_node->prev;
-          stop_entry = (stop_node) ? stop_node->data : NULL;
-          break;
-        }
-      }
-
-      if (!stop_entry) {
-        byte_stop = -1;
-      } else {
-        byte_stop = stop_entry->byte;
-      }
-
-    }
+    mp3parse_seek_table_lookup (mp3parse, cur, stop, &byte_cur, &byte_stop,
+        &start);
     event = gst_event_new_seek (rate, GST_FORMAT_BYTES, flags, cur_type,
         byte_cur, stop_type, byte_stop);
     g_mutex_lock (mp3parse->pending_accurate_seeks_lock);
@@ -1914,6 +2442,17 @@ mp3parse_src_query (GstPad * pad, GstQuery * query)
     case GST_QUERY_SEEKING:
       gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
 
+      /* in pull mode we can always seek in TIME ourselves */
+      if (mp3parse->pull_mode) {
+        if (format == GST_FORMAT_TIME) {
+          if (!mp3parse_total_time (mp3parse, &total))
+            total = -1;
+          gst_query_set_seeking (query, GST_FORMAT_TIME, TRUE, 0, total);
+          res = TRUE;
+        }
+        break;
+      }
+
       /* does upstream handle ? */
       if ((peer = gst_pad_get_peer (mp3parse->sinkpad)) != NULL) {
         res = gst_pad_query (peer, query);
@@ -24,6 +24,7 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
+#include <gst/gst-element-stats.h>
 
 G_BEGIN_DECLS
 
@@ -120,10 +121,22 @@ struct _GstMPEGAudioParse {
   GSList *pending_accurate_seeks;
   gboolean exact_position;
 
-  /* pending segment */
+  /* pending segment, and the one closing the running segment before it
+   * after a non-flushing seek */
   GstEvent *pending_segment;
+  GstEvent *close_segment;
   /* pending events */
   GList *pending_events;
+
+  /* pull mode */
+  gboolean pull_mode;
+  gint64 pull_offset;           /* where the next block is read from */
+  gboolean full_scan;           /* walk all headers instead of sampling */
+  gboolean scanned;             /* duration scan done */
+  GstClockTime scan_total_time; /* duration found by the scan */
+  guint scan_bitrate;           /* average bitrate found by the scan */
+
+  GstElementStats stats;        /* for the "stats" property */
 };
 
 struct _GstMPEGAudioParseClass {
@@ -24,6 +24,8 @@
 
 #include <string.h>
 
+#include <gst/gst-probes.h>
+
 #include "gstdvddemux.h"
 
 /* 
@@ -176,8 +178,6 @@ static void gst_dvd_demux_set_cur_subpicture
     (GstDVDDemux * dvd_demux, gint stream_nr);
 
 static void gst_dvd_demux_reset (GstDVDDemux * dvd_demux);
-static void gst_dvd_demux_synchronise_pads (GstMPEGDemux * mpeg_demux,
-    GstClockTime threshold, GstClockTime new_ts);
 static void gst_dvd_demux_sync_stream_to_time (GstMPEGDemux * mpeg_demux,
     GstMPEGStream * stream, GstClockTime last_ts);
 
@@ -251,7 +251,6 @@ gst_dvd_demux_class_init (GstDVDDemuxClass * klass)
   mpeg_demux_class->send_subbuffer = gst_dvd_demux_send_subbuffer;
   mpeg_demux_class->combine_flows = gst_dvd_demux_combine_flows;
   mpeg_demux_class->process_private = gst_dvd_demux_process_private;
-  mpeg_demux_class->synchronise_pads = gst_dvd_demux_synchronise_pads;
   mpeg_demux_class->sync_stream_to_time = gst_dvd_demux_sync_stream_to_time;
 
   klass->get_subpicture_stream = gst_dvd_demux_get_subpicture_stream;
@@ -286,6 +285,9 @@ gst_dvd_demux_init (GstDVDDemux * dvd_demux, GstDVDDemuxClass * klass)
   for (i = 0; i < GST_DVD_DEMUX_NUM_SUBPICTURE_STREAMS; i++) {
     dvd_demux->subpicture_stream[i] = NULL;
   }
+  /* Subpicture streams are synchronised together with the other ones. */
+  gst_mpeg_demux_add_stream_slots (mpeg_demux, dvd_demux->subpicture_stream,
+      GST_DVD_DEMUX_NUM_SUBPICTURE_STREAMS);
 
   /* Directly after starting we operate as if we had just flushed. */
   dvd_demux->segment_filter = TRUE;
@@ -316,6 +318,7 @@ gst_dvd_demux_process_event (GstMPEGParse * mpeg_parse, GstEvent * event)
         /* reset stream synchronization; parent handles other streams */
         gst_mpeg_streams_reset_cur_ts (dvd_demux->subpicture_stream,
             GST_DVD_DEMUX_NUM_SUBPICTURE_STREAMS, 0);
+        gst_mpeg_demux_invalidate_sync (GST_MPEG_DEMUX (dvd_demux));
       }
 
       ret = GST_MPEG_PARSE_CLASS (parent_class)->process_event (mpeg_parse,
@@ -1084,6 +1087,8 @@ gst_dvd_demux_send_subbuffer (GstMPEGDemux * mpeg_demux,
     GST_BUFFER_OFFSET (outbuf) = GST_BUFFER_OFFSET (buffer) + offset;
     gst_buffer_set_caps (outbuf, outstream->caps);
 
+    gst_element_stats_output (&GST_MPEG_PARSE (mpeg_demux)->stats, outbuf);
+    GST_PROBE_PUSH (dvd_demux, outbuf);
     ret = gst_pad_push (outpad, outbuf);
 
     /* this was one of the current_foo pads, which is shadowing one of the
@@ -1182,6 +1187,7 @@ gst_dvd_demux_reset (GstDVDDemux * dvd_demux)
       dvd_demux->subpicture_stream[i] = NULL;
     }
   }
+  gst_mpeg_demux_invalidate_sync (mpeg_demux);
   gst_pad_set_caps (dvd_demux->cur_video, NULL);
   gst_pad_set_caps (dvd_demux->cur_audio, NULL);
   gst_pad_set_caps (dvd_demux->cur_subpicture, NULL);
@@ -1196,33 +1202,6 @@ gst_dvd_demux_reset (GstDVDDemux * dvd_demux)
   mpeg_demux->max_gap_tolerance = 0.05 * GST_SECOND;
 }
 
-static void
-gst_dvd_demux_synchronise_pads (GstMPEGDemux * mpeg_demux,
-    GstClockTime threshold, GstClockTime new_ts)
-{
-  GstDVDDemux *dvd_demux = GST_DVD_DEMUX (mpeg_demux);
-  int i;
-
-  parent_class->synchronise_pads (mpeg_demux, threshold, new_ts);
-
-  for (i = 0; i < GST_DVD_DEMUX_NUM_SUBPICTURE_STREAMS; i++) {
-#ifndef GST_DISABLE_DEBUG
-    if (dvd_demux->subpicture_stream[i]) {
-      GST_LOG_OBJECT (mpeg_demux, "stream: %d, current: %" GST_TIME_FORMAT
-          ", threshold %" GST_TIME_FORMAT, i,
-          GST_TIME_ARGS (dvd_demux->subpicture_stream[i]->cur_ts),
-          GST_TIME_ARGS (threshold));
-    }
-#endif
-    if (dvd_demux->subpicture_stream[i]
-        && (dvd_demux->subpicture_stream[i]->cur_ts < threshold)) {
-      DEMUX_CLASS (mpeg_demux)->sync_stream_to_time (mpeg_demux,
-          dvd_demux->subpicture_stream[i], new_ts);
-      dvd_demux->subpicture_stream[i]->cur_ts = new_ts;
-    }
-  }
-}
-
 static void
 gst_dvd_demux_sync_stream_to_time (GstMPEGDemux * mpeg_demux,
     GstMPEGStream * stream, GstClockTime last_ts)
@@ -21,6 +21,9 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+
+#include <gst/gst-probes.h>
+
 #include "gstmpegdemux.h"
 
 
@@ -129,6 +132,8 @@ static void gst_mpeg_demux_synchronise_pads (GstMPEGDemux * mpeg_demux,
     GstClockTime threshold, GstClockTime new_ts);
 static void gst_mpeg_demux_sync_stream_to_time (GstMPEGDemux * mpeg_demux,
     GstMPEGStream * stream, GstClockTime last_ts);
+static void gst_mpeg_demux_sync_heap_update (GstMPEGDemux * mpeg_demux,
+    GstMPEGStream * stream);
 
 #if 0
 const GstFormat *gst_mpeg_demux_get_src_formats (GstPad * pad);
@@ -230,6 +235,14 @@ gst_mpeg_demux_init (GstMPEGDemux * mpeg_demux, GstMPEGDemuxClass * klass)
   mpeg_demux->max_gap = GST_CLOCK_TIME_NONE;
   mpeg_demux->max_gap_tolerance = GST_CLOCK_TIME_NONE;
 
+  mpeg_demux->n_stream_slots = 0;
+  gst_mpeg_demux_add_stream_slots (mpeg_demux, mpeg_demux->video_stream,
+      GST_MPEG_DEMUX_NUM_VIDEO_STREAMS);
+  gst_mpeg_demux_add_stream_slots (mpeg_demux, mpeg_demux->audio_stream,
+      GST_MPEG_DEMUX_NUM_AUDIO_STREAMS);
+  gst_mpeg_demux_add_stream_slots (mpeg_demux, mpeg_demux->private_stream,
+      GST_MPEG_DEMUX_NUM_PRIVATE_STREAMS);
+
   mpeg_demux->last_pts = -1;
   mpeg_demux->pending_tags = FALSE;
 }
@@ -263,6 +276,7 @@ gst_mpeg_demux_process_event (GstMPEGParse * mpeg_parse, GstEvent * event)
           GST_MPEG_DEMUX_NUM_AUDIO_STREAMS, 0);
       gst_mpeg_streams_reset_cur_ts (demux->private_stream,
           GST_MPEG_DEMUX_NUM_PRIVATE_STREAMS, 0);
+      gst_mpeg_demux_invalidate_sync (demux);
       /* fallthrough */
     default:
       ret = GST_MPEG_PARSE_CLASS (parent_class)->process_event (mpeg_parse,
@@ -328,6 +342,10 @@ gst_mpeg_demux_init_stream (GstMPEGDemux * mpeg_demux,
   str->cur_ts = 0;
   str->scr_offs = 0;
 
+  /* The new stream will be picked up when the heap is rebuilt, once it
+     has been stored in its slot. */
+  gst_mpeg_demux_invalidate_sync (mpeg_demux);
+
   str->last_flow = GST_FLOW_OK;
   str->buffers_sent = 0;
   str->tags = NULL;
@@ -1048,6 +1066,8 @@ gst_mpeg_demux_send_subbuffer (GstMPEGDemux * mpeg_demux,
   } else if (mpeg_parse->current_ts != GST_CLOCK_TIME_NONE)
     outstream->cur_ts = mpeg_parse->current_ts + outstream->scr_offs;
 
+  gst_mpeg_demux_sync_heap_update (mpeg_demux, outstream);
+
   if (size == 0)
     return GST_FLOW_OK;
 
@@ -1097,6 +1117,8 @@ gst_mpeg_demux_send_subbuffer (GstMPEGDemux * mpeg_demux,
         GST_FORMAT_TIME, update_time);
   }
 
+  gst_element_stats_output (&mpeg_parse->stats, outbuf);
+  GST_PROBE_PUSH (mpeg_demux, outbuf);
   ret = gst_pad_push (outstream->pad, outbuf);
   GST_LOG_OBJECT (outstream->pad, "flow: %s", gst_flow_get_name (ret));
   ++outstream->buffers_sent;
@@ -1142,6 +1164,114 @@ gst_mpeg_demux_process_private (GstMPEGDemux * mpeg_demux,
   return ret;
 }
 
+#define SYNC_HEAP_STREAM(demux,i) (*(demux)->sync_heap[(i)])
+
+static void
+gst_mpeg_demux_sync_heap_swap (GstMPEGDemux * mpeg_demux, guint a, guint b)
+{
+  GstMPEGStream **tmp;
+
+  tmp = mpeg_demux->sync_heap[a];
+  mpeg_demux->sync_heap[a] = mpeg_demux->sync_heap[b];
+  mpeg_demux->sync_heap[b] = tmp;
+
+  SYNC_HEAP_STREAM (mpeg_demux, a)->sync_index = a;
+  SYNC_HEAP_STREAM (mpeg_demux, b)->sync_index = b;
+}
+
+static void
+gst_mpeg_demux_sync_heap_sift_up (GstMPEGDemux * mpeg_demux, guint i)
+{
+  while (i > 0) {
+    guint parent = (i - 1) / 2;
+
+    if (SYNC_HEAP_STREAM (mpeg_demux, parent)->cur_ts <=
+        SYNC_HEAP_STREAM (mpeg_demux, i)->cur_ts)
+      break;
+
+    gst_mpeg_demux_sync_heap_swap (mpeg_demux, i, parent);
+    i = parent;
+  }
+}
+
+static void
+gst_mpeg_demux_sync_heap_sift_down (GstMPEGDemux * mpeg_demux, guint i)
+{
+  guint len = mpeg_demux->sync_heap_len;
+
+  for (;;) {
+    guint smallest = i;
+    guint left = 2 * i + 1;
+    guint right = left + 1;
+
+    if (left < len && SYNC_HEAP_STREAM (mpeg_demux, left)->cur_ts <
+        SYNC_HEAP_STREAM (mpeg_demux, smallest)->cur_ts)
+      smallest = left;
+    if (right < len && SYNC_HEAP_STREAM (mpeg_demux, right)->cur_ts <
+        SYNC_HEAP_STREAM (mpeg_demux, smallest)->cur_ts)
+      smallest = right;
+
+    if (smallest == i)
+      break;
+
+    gst_mpeg_demux_sync_heap_swap (mpeg_demux, i, smallest);
+    i = smallest;
+  }
+}
+
+/*
+ * Collect all active streams from the registered slot arrays and
+ * restore the heap property. Only needed after streams were added,
+ * removed or had their cur_ts reset.
+ */
+static void
+gst_mpeg_demux_sync_heap_rebuild (GstMPEGDemux * mpeg_demux)
+{
+  guint s, i, len = 0;
+
+  for (s = 0; s < mpeg_demux->n_stream_slots; s++) {
+    GstMPEGStream **streams = mpeg_demux->stream_slots[s].streams;
+
+    for (i = 0; i < mpeg_demux->stream_slots[s].num; i++) {
+      if (streams[i] == NULL)
+        continue;
+      if (G_UNLIKELY (len == GST_MPEG_DEMUX_MAX_SYNC_STREAMS)) {
+        GST_WARNING_OBJECT (mpeg_demux, "too many streams to synchronise");
+        break;
+      }
+      streams[i]->sync_index = len;
+      mpeg_demux->sync_heap[len++] = &streams[i];
+    }
+  }
+
+  mpeg_demux->sync_heap_len = len;
+  for (i = len / 2; i > 0; i--)
+    gst_mpeg_demux_sync_heap_sift_down (mpeg_demux, i - 1);
+
+  mpeg_demux->sync_heap_dirty = FALSE;
+}
+
+/*
+ * Restore the heap property after the cur_ts of @stream changed.
+ */
+static void
+gst_mpeg_demux_sync_heap_update (GstMPEGDemux * mpeg_demux,
+    GstMPEGStream * stream)
+{
+  guint i = stream->sync_index;
+
+  /* will be sorted out on the next rebuild */
+  if (mpeg_demux->sync_heap_dirty)
+    return;
+
+  if (G_UNLIKELY (i >= mpeg_demux->sync_heap_len ||
+          SYNC_HEAP_STREAM (mpeg_demux, i) != stream))
+    return;
+
+  gst_mpeg_demux_sync_heap_sift_up (mpeg_demux, i);
+  gst_mpeg_demux_sync_heap_sift_down (mpeg_demux, stream->sync_index);
+}
+
 static void
 gst_mpeg_demux_synchronise_pads (GstMPEGDemux * mpeg_demux,
     GstClockTime threshold, GstClockTime new_ts)
@@ -1149,31 +1279,27 @@ gst_mpeg_demux_synchronise_pads (GstMPEGDemux * mpeg_demux,
   /*
    * Send a new-segment event to any pad with cur_ts < threshold to catch it up
    */
-  gint i;
+  guint n;
 
-  for (i = 0; i < GST_MPEG_DEMUX_NUM_VIDEO_STREAMS; i++)
-    if (mpeg_demux->video_stream[i]
-        && mpeg_demux->video_stream[i]->cur_ts < threshold) {
-      CLASS (mpeg_demux)->sync_stream_to_time (mpeg_demux,
-          mpeg_demux->video_stream[i], new_ts);
-      mpeg_demux->video_stream[i]->cur_ts = new_ts;
-    }
+  if (mpeg_demux->sync_heap_dirty)
+    gst_mpeg_demux_sync_heap_rebuild (mpeg_demux);
 
-  for (i = 0; i < GST_MPEG_DEMUX_NUM_AUDIO_STREAMS; i++)
-    if (mpeg_demux->audio_stream[i]
-        && mpeg_demux->audio_stream[i]->cur_ts < threshold) {
-      CLASS (mpeg_demux)->sync_stream_to_time (mpeg_demux,
-          mpeg_demux->audio_stream[i], new_ts);
-      mpeg_demux->audio_stream[i]->cur_ts = new_ts;
-    }
+  /* Only the streams at the top of the heap can be lagging behind. Every
+   * stream is caught up at most once per call. */
+  for (n = 0; n < mpeg_demux->sync_heap_len; n++) {
+    GstMPEGStream *stream = SYNC_HEAP_STREAM (mpeg_demux, 0);
 
-  for (i = 0; i < GST_MPEG_DEMUX_NUM_PRIVATE_STREAMS; i++)
-    if (mpeg_demux->private_stream[i]
-        && mpeg_demux->private_stream[i]->cur_ts < threshold) {
-      CLASS (mpeg_demux)->sync_stream_to_time (mpeg_demux,
-          mpeg_demux->private_stream[i], new_ts);
-      mpeg_demux->private_stream[i]->cur_ts = new_ts;
-    }
+    if (stream->cur_ts >= threshold)
+      break;
+
+    GST_LOG_OBJECT (mpeg_demux, "stream: %d, current: %" GST_TIME_FORMAT
+        ", threshold %" GST_TIME_FORMAT, stream->number,
+        GST_TIME_ARGS (stream->cur_ts), GST_TIME_ARGS (threshold));
+
+    CLASS (mpeg_demux)->sync_stream_to_time (mpeg_demux, stream, new_ts);
+    stream->cur_ts = new_ts;
+    gst_mpeg_demux_sync_heap_sift_down (mpeg_demux, 0);
+  }
 }
 
 /*
@@ -1369,6 +1495,9 @@ gst_mpeg_demux_reset (GstMPEGDemux * mpeg_demux)
       mpeg_demux->private_stream[i] = NULL;
     }
 
+  mpeg_demux->sync_heap_len = 0;
+  gst_mpeg_demux_invalidate_sync (mpeg_demux);
+
   mpeg_demux->in_flush = FALSE;
   mpeg_demux->header_length = 0;
   mpeg_demux->rate_bound = 0;
@@ -1459,6 +1588,36 @@ gst_mpeg_streams_reset_cur_ts (GstMPEGStream * streams[], guint num,
   }
 }
 
+/*
+ * Register an array of stream slots whose streams should be kept in
+ * sync with the others. Subclasses adding their own kinds of streams
+ * call this from their instance init function.
+ */
+void
+gst_mpeg_demux_add_stream_slots (GstMPEGDemux * mpeg_demux,
+    GstMPEGStream * streams[], guint num)
+{
+  guint n = mpeg_demux->n_stream_slots;
+
+  g_return_if_fail (n < GST_MPEG_DEMUX_MAX_STREAM_SLOTS);
+
+  mpeg_demux->stream_slots[n].streams = streams;
+  mpeg_demux->stream_slots[n].num = num;
+  mpeg_demux->n_stream_slots++;
+
+  gst_mpeg_demux_invalidate_sync (mpeg_demux);
+}
+
+/*
+ * Mark the synchronisation heap as out of date, to be called after
+ * streams were created or destroyed or their cur_ts values were reset.
+ */
+void
+gst_mpeg_demux_invalidate_sync (GstMPEGDemux * mpeg_demux)
+{
+  mpeg_demux->sync_heap_dirty = TRUE;
+}
+
 gboolean
 gst_mpeg_demux_plugin_init (GstPlugin * plugin)
 {
@@ -51,6 +51,11 @@ enum {
 #define GST_MPEG_DEMUX_NUM_AUDIO_STREAMS        32
 #define GST_MPEG_DEMUX_NUM_PRIVATE_STREAMS      2
 
+/* Maximum number of stream slot arrays and stream slots that take part
+   in pad synchronisation, including the ones added by subclasses. */
+#define GST_MPEG_DEMUX_MAX_STREAM_SLOTS         4
+#define GST_MPEG_DEMUX_MAX_SYNC_STREAMS         128
+
 /* How to make stream type values. */
 #define GST_MPEG_DEMUX_STREAM_TYPE(kind, serial) \
   (((kind) << 16) + (serial))
@@ -96,6 +101,7 @@ struct _GstMPEGStream {
   gint              size_bound;
   GstClockTime      cur_ts;
   GstClockTimeDiff  scr_offs;
+  guint             sync_index;   /* Position in the synchronisation heap. */
   GstFlowReturn     last_flow;
   guint             buffers_sent;
   GstTagList       *tags;
@@ -144,6 +150,21 @@ struct _GstMPEGDemux {
 
   GstClockTime max_ts;          /* Highest timestamp of all pads. */
   GstPad      *max_pad;         /* Pad with highest timestamp. */
+
+  /* Stream arrays whose streams take part in pad synchronisation. */
+  struct {
+    GstMPEGStream **streams;
+    guint           num;
+  }              stream_slots[GST_MPEG_DEMUX_MAX_STREAM_SLOTS];
+  guint          n_stream_slots;
+
+  /* Min-heap on cur_ts of the slots holding an active stream, so that
+     pad synchronisation only needs to look at the lagging streams. The
+     slots are stored rather than the streams because streams may get
+     reallocated by the get_*_stream functions. */
+  GstMPEGStream **sync_heap[GST_MPEG_DEMUX_MAX_SYNC_STREAMS];
+  guint          sync_heap_len;
+  gboolean       sync_heap_dirty;
 };
 
 struct _GstMPEGDemuxClass {
@@ -212,6 +233,11 @@ void            gst_mpeg_streams_reset_cur_ts    (GstMPEGStream *streams[],
                                                   guint          num,
                                                   GstClockTime   cur_ts);
 
+void            gst_mpeg_demux_add_stream_slots  (GstMPEGDemux  *mpeg_demux,
+                                                  GstMPEGStream *streams[],
+                                                  guint          num);
+void            gst_mpeg_demux_invalidate_sync   (GstMPEGDemux  *mpeg_demux);
+
 GType           gst_mpeg_demux_get_type          (void);
 
 gboolean        gst_mpeg_demux_plugin_init       (GstPlugin *plugin);
@@ -23,6 +23,8 @@
 
 #include <string.h>
 
+#include <gst/gst-probes.h>
+
 #include "gstmpegpacketize.h"
 
 GST_DEBUG_CATEGORY_STATIC (gstmpegpacketize_debug);
@@ -39,7 +41,9 @@ gst_mpeg_packetize_new (GstMPEGPacketizeType type)
   new->cache_head = 0;
   new->cache_tail = 0;
   new->cache_size = 0x4000;
-  new->cache = g_malloc (new->cache_size);
+  new->cache_mem = g_malloc (new->cache_size);
+  new->cache = new->cache_mem;
+  new->cache_buffer = NULL;
   new->cache_byte_pos = 0;
   new->MPEG2 = FALSE;
   new->type = type;
@@ -54,6 +58,17 @@ gst_mpeg_packetize_new (GstMPEGPacketizeType type)
   return new;
 }
 
+/* stop using the data of the buffer we're holding on to as cache */
+static void
+release_cache_buffer (GstMPEGPacketize * packetize)
+{
+  if (packetize->cache_buffer) {
+    gst_buffer_unref (packetize->cache_buffer);
+    packetize->cache_buffer = NULL;
+  }
+  packetize->cache = packetize->cache_mem;
+}
+
 void
 gst_mpeg_packetize_flush_cache (GstMPEGPacketize * packetize)
 {
@@ -64,6 +79,7 @@ gst_mpeg_packetize_flush_cache (GstMPEGPacketize * packetize)
   packetize->resync = TRUE;
   packetize->cache_head = 0;
   packetize->cache_tail = 0;
+  release_cache_buffer (packetize);
 
   GST_DEBUG ("flushed packetize cache");
 }
@@ -73,7 +89,8 @@ gst_mpeg_packetize_destroy (GstMPEGPacketize * packetize)
 {
   g_return_if_fail (packetize != NULL);
 
-  g_free (packetize->cache);
+  release_cache_buffer (packetize);
+  g_free (packetize->cache_mem);
   g_free (packetize);
 }
 
@@ -83,6 +100,20 @@ gst_mpeg_packetize_tell (GstMPEGPacketize * packetize)
   return packetize->cache_byte_pos + packetize->cache_head;
 }
 
+static inline void
+count_copy (GstMPEGPacketize * packetize, guint bytes)
+{
+  if (packetize->stats)
+    gst_element_stats_copy (packetize->stats, bytes);
+}
+
+static inline void
+count_resync (GstMPEGPacketize * packetize, guint bytes)
+{
+  if (packetize->stats)
+    gst_element_stats_resync (packetize->stats, bytes);
+}
+
 void
 gst_mpeg_packetize_put (GstMPEGPacketize * packetize, GstBuffer * buf)
 {
@@ -95,6 +126,37 @@ gst_mpeg_packetize_put (GstMPEGPacketize * packetize, GstBuffer * buf)
         packetize->cache_byte_pos);
   }
 
+  if (cache_len == 0) {
+    /* nothing left over, use the buffer memory directly as cache so
+     * that complete packets can be handed out without copying */
+    packetize->cache_byte_pos += packetize->cache_head;
+    release_cache_buffer (packetize);
+    packetize->cache_buffer = buf;
+    packetize->cache = GST_BUFFER_DATA (buf);
+    packetize->cache_head = 0;
+    packetize->cache_tail = GST_BUFFER_SIZE (buf);
+    return;
+  }
+
+  if (packetize->cache_buffer) {
+    /* a packet continues into the new buffer, move what is left of the
+     * previous one to our own memory first */
+    if (cache_len > packetize->cache_size) {
+      g_free (packetize->cache_mem);
+      do {
+        packetize->cache_size *= 2;
+      } while (cache_len > packetize->cache_size);
+      packetize->cache_mem = g_malloc (packetize->cache_size);
+    }
+    memcpy (packetize->cache_mem, packetize->cache + packetize->cache_head,
+        cache_len);
+    count_copy (packetize, cache_len);
+    release_cache_buffer (packetize);
+    packetize->cache_byte_pos += packetize->cache_head;
+    packetize->cache_head = 0;
+    packetize->cache_tail = cache_len;
+  }
+
   if (cache_len + GST_BUFFER_SIZE (buf) > packetize->cache_size) {
     /* the buffer does not fit into the cache so grow the cache */
 
@@ -110,7 +172,9 @@ gst_mpeg_packetize_put (GstMPEGPacketize * packetize, GstBuffer * buf)
 
     /* copy the data to the beginning of the new cache and update the cache info */
     memcpy (new_cache, packetize->cache + packetize->cache_head, cache_len);
-    g_free (packetize->cache);
+    count_copy (packetize, cache_len);
+    g_free (packetize->cache_mem);
+    packetize->cache_mem = new_cache;
     packetize->cache = new_cache;
     packetize->cache_byte_pos += packetize->cache_head;
     packetize->cache_head = 0;
@@ -130,6 +194,7 @@ gst_mpeg_packetize_put (GstMPEGPacketize * packetize, GstBuffer * buf)
   /* copy the buffer to the cache */
   memcpy (packetize->cache + packetize->cache_tail, GST_BUFFER_DATA (buf),
       GST_BUFFER_SIZE (buf));
+  count_copy (packetize, GST_BUFFER_SIZE (buf));
   packetize->cache_tail += GST_BUFFER_SIZE (buf);
 
   gst_buffer_unref (buf);
@@ -162,10 +227,16 @@ read_cache (GstMPEGPacketize * packetize, guint length, GstBuffer ** outbuf)
   if (length == 0)
     return GST_FLOW_RESEND;
 
-  *outbuf = gst_buffer_new_and_alloc (length);
+  if (packetize->cache_buffer) {
+    *outbuf = gst_buffer_create_sub (packetize->cache_buffer,
+        packetize->cache_head, length);
+  } else {
+    *outbuf = gst_buffer_new_and_alloc (length);
 
-  memcpy (GST_BUFFER_DATA (*outbuf), packetize->cache + packetize->cache_head,
-      length);
+    memcpy (GST_BUFFER_DATA (*outbuf),
+        packetize->cache + packetize->cache_head, length);
+    count_copy (packetize, length);
+  }
   packetize->cache_head += length;
 
   return GST_FLOW_OK;
@@ -249,12 +320,12 @@ parse_chunk (GstMPEGPacketize * packetize, GstBuffer ** outbuf)
 
   code = GST_READ_UINT32_BE (buf + offset);
 
-  GST_DEBUG ("code = %08x", code);
+  GST_HOT_DEBUG ("code = %08x", code);
 
   while ((code & 0xffffff00) != 0x100L) {
     code = (code << 8) | buf[offset++];
 
-    GST_DEBUG ("  code = %08x", code);
+    GST_HOT_DEBUG ("  code = %08x", code);
 
     if (offset == chunksize) {
       chunksize = peek_cache (packetize, offset + 4096, &buf);
@@ -287,15 +358,16 @@ find_start_code (GstMPEGPacketize * packetize)
 
   code = GST_READ_UINT32_BE (buf);
 
-  GST_DEBUG ("code = %08x %p %08x", code, buf, chunksize);
+  GST_HOT_DEBUG ("code = %08x %p %08x", code, buf, chunksize);
 
   while ((code & 0xffffff00) != 0x100L) {
     code = (code << 8) | buf[offset++];
 
-    GST_DEBUG ("  code = %08x %p %08x", code, buf, chunksize);
+    GST_HOT_DEBUG ("  code = %08x %p %08x", code, buf, chunksize);
 
     if (offset == chunksize) {
       skip_cache (packetize, offset);
+      count_resync (packetize, offset);
 
       chunksize = peek_cache (packetize, 4096, &buf);
       if (chunksize == 0)
@@ -307,6 +379,7 @@ find_start_code (GstMPEGPacketize * packetize)
   packetize->id = code & 0xff;
   if (offset > 4) {
     skip_cache (packetize, offset - 4);
+    count_resync (packetize, offset - 4);
   }
   return TRUE;
 }
@@ -322,11 +395,12 @@ gst_mpeg_packetize_read (GstMPEGPacketize * packetize, GstBuffer ** outbuf)
     if (!find_start_code (packetize))
       return GST_FLOW_RESEND;
 
-    GST_DEBUG ("packetize: have chunk 0x%02X", packetize->id);
+    GST_HOT_DEBUG ("packetize: have chunk 0x%02X", packetize->id);
     if (packetize->type == GST_MPEG_PACKETIZE_SYSTEM) {
       if (packetize->resync) {
         if (packetize->id != PACK_START_CODE) {
           skip_cache (packetize, 4);
+          count_resync (packetize, 4);
           continue;
         }
 
@@ -343,6 +417,7 @@ gst_mpeg_packetize_read (GstMPEGPacketize * packetize, GstBuffer ** outbuf)
           if (packetize->MPEG2 && ((packetize->id < 0xBD)
                   || (packetize->id > 0xFE))) {
             skip_cache (packetize, 4);
+            count_resync (packetize, 4);
             g_warning ("packetize: ******** unknown id 0x%02X", packetize->id);
           } else {
             return parse_generic (packetize, outbuf);
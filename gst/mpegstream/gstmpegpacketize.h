@@ -23,6 +23,7 @@
 
 
 #include <gst/gst.h>
+#include <gst/gst-element-stats.h>
 
 G_BEGIN_DECLS
 
@@ -57,13 +58,19 @@ struct _GstMPEGPacketize {
   GstMPEGPacketizeType type;
 
   guint8 *cache;            /* cache for incoming data */
-  guint cache_size;         /* allocated size of the cache */
+  guint8 *cache_mem;        /* memory owned by the cache */
+  guint cache_size;         /* allocated size of cache_mem */
+  GstBuffer *cache_buffer;  /* if not NULL, cache points into this buffer
+                               and packets are handed out as subbuffers */
   guint cache_head;         /* position of the beginning of the data */
   guint cache_tail;         /* position of the end of the data in the cache */
   guint64 cache_byte_pos;   /* byte position of the cache in the MPEG stream */
 
   gboolean MPEG2;
   gboolean resync;
+
+  GstElementStats *stats;   /* if not NULL, copies and skipped bytes are
+                               counted here */
 };
 
 GstMPEGPacketize* gst_mpeg_packetize_new     (GstMPEGPacketizeType type);
@@ -21,6 +21,8 @@
 #include "config.h"
 #endif
 
+#include <gst/gst-probes.h>
+
 #include "gstmpegparse.h"
 #include "gstmpegclock.h"
 
@@ -41,6 +43,36 @@ GST_DEBUG_CATEGORY_EXTERN (GST_CAT_SEEK);
  */
 #define MP_SCR_RATE_HYST 0.08
 
+/* SCR values are 33 bit and wrap around */
+#define MP_SCR_MASK ((G_GUINT64_CONSTANT (1) << 33) - 1)
+/* Minimum time distance between two entries of the SCR index */
+#define MP_SCR_INDEX_INTERVAL (CLOCK_FREQ / 4)
+/* The first pack is used as time reference for the index only if it is
+ * this close to the start of the stream */
+#define MP_SCR_INDEX_MAX_START 65536
+/* A bigger SCR step between two consecutive packs is a discontinuity,
+ * as found in spliced or concatenated streams */
+#define MP_SCR_INDEX_MAX_JUMP (10 * CLOCK_FREQ)
+/* Stop bisecting once the search interval is smaller than this, which
+ * is the size of a DVD pack */
+#define MP_SCR_SEEK_ACCURACY 2048
+/* Amount of data read to find a pack header while bisecting */
+#define MP_SCR_SEEK_READ_SIZE 16384
+/* Amount of data read per iteration in pull mode, a multiple of the
+ * DVD sector size */
+#define MP_PULL_BLOCK_SIZE (2048 * 32)
+
+/* The SCR can jump or restart anywhere in the stream, so the index is
+ * searched on the time since the first pack, which is made continuous
+ * over SCR discontinuities. The raw SCR is kept to place the packs found
+ * while bisecting. */
+typedef struct
+{
+  guint64 scr;                  /* 33 bit SCR of the pack */
+  guint64 time;                 /* MPEG time since the first pack */
+  guint64 offset;               /* Byte offset of the pack start code */
+} GstMPEGParseScrEntry;
+
 /* elementfactory information */
 static GstElementDetails mpeg_parse_details = {
   "MPEG System Parser",
@@ -65,7 +97,8 @@ enum
   ARG_0,
   ARG_MAX_SCR_GAP,
   ARG_BYTE_OFFSET,
-  ARG_TIME_OFFSET
+  ARG_TIME_OFFSET,
+  ARG_STATS
       /* FILL ME */
 };
 
@@ -91,11 +124,14 @@ GST_BOILERPLATE_FULL (GstMPEGParse, gst_mpeg_parse, GstElement,
     GST_TYPE_ELEMENT, _do_init);
 
 static void gst_mpeg_parse_class_init (GstMPEGParseClass * klass);
+static void gst_mpeg_parse_finalize (GObject * object);
 static GstStateChangeReturn gst_mpeg_parse_change_state (GstElement * element,
     GstStateChange transition);
 
 static gboolean gst_mpeg_parse_parse_packhead (GstMPEGParse * mpeg_parse,
     GstBuffer * buffer);
+static gboolean gst_mpeg_parse_get_rate (GstMPEGParse * mpeg_parse,
+    gint64 * rate);
 
 static void gst_mpeg_parse_reset (GstMPEGParse * mpeg_parse);
 
@@ -113,6 +149,15 @@ static void gst_mpeg_parse_pad_added (GstElement * element, GstPad * pad);
 
 static gboolean gst_mpeg_parse_event (GstPad * pad, GstEvent * event);
 static GstFlowReturn gst_mpeg_parse_chain (GstPad * pad, GstBuffer * buf);
+static GstFlowReturn gst_mpeg_parse_process (GstMPEGParse * mpeg_parse,
+    GstBuffer * buffer);
+static void gst_mpeg_parse_loop (GstPad * pad);
+static gboolean gst_mpeg_parse_sink_activate (GstPad * sinkpad);
+static gboolean gst_mpeg_parse_sink_activate_pull (GstPad * sinkpad,
+    gboolean active);
+static gboolean gst_mpeg_parse_convert (GstMPEGParse * mpeg_parse,
+    GstFormat src_format, gint64 src_value, GstFormat * dest_format,
+    gint64 * dest_value);
 
 static void gst_mpeg_parse_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
@@ -149,6 +194,7 @@ gst_mpeg_parse_class_init (GstMPEGParseClass * klass)
 
   gobject_class->get_property = gst_mpeg_parse_get_property;
   gobject_class->set_property = gst_mpeg_parse_set_property;
+  gobject_class->finalize = gst_mpeg_parse_finalize;
 
   gstelement_class->pad_added = gst_mpeg_parse_pad_added;
   gstelement_class->change_state = gst_mpeg_parse_change_state;
@@ -185,6 +231,8 @@ gst_mpeg_parse_class_init (GstMPEGParseClass * klass)
       g_param_spec_uint64 ("time-offset", "Time Offset",
           "Time offset in the stream.",
           0, G_MAXUINT64, G_MAXUINT64, G_PARAM_READABLE));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_STATS,
+      gst_element_stats_param_spec ());
 }
 
 static void
@@ -201,6 +249,12 @@ gst_mpeg_parse_init (GstMPEGParse * mpeg_parse, GstMPEGParseClass * klass)
 
   mpeg_parse->byte_offset = G_MAXUINT64;
 
+  mpeg_parse->scr_index = g_array_new (FALSE, FALSE,
+      sizeof (GstMPEGParseScrEntry));
+
+  mpeg_parse->pull_stop = -1;
+  mpeg_parse->pull_stop_time = GST_CLOCK_TIME_NONE;
+
   gst_mpeg_parse_reset (mpeg_parse);
 
   templ = gst_element_class_get_pad_template (gstelement_class, "sink");
@@ -223,6 +277,20 @@ gst_mpeg_parse_init (GstMPEGParse * mpeg_parse, GstMPEGParseClass * klass)
       GST_DEBUG_FUNCPTR (gst_mpeg_parse_event));
   gst_pad_set_chain_function (mpeg_parse->sinkpad,
       GST_DEBUG_FUNCPTR (gst_mpeg_parse_chain));
+  gst_pad_set_activate_function (mpeg_parse->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mpeg_parse_sink_activate));
+  gst_pad_set_activatepull_function (mpeg_parse->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mpeg_parse_sink_activate_pull));
+}
+
+static void
+gst_mpeg_parse_finalize (GObject * object)
+{
+  GstMPEGParse *mpeg_parse = GST_MPEG_PARSE (object);
+
+  g_array_free (mpeg_parse->scr_index, TRUE);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 #ifdef FIXME
@@ -270,6 +338,9 @@ gst_mpeg_parse_reset (GstMPEGParse * mpeg_parse)
   mpeg_parse->next_scr = 0;
   mpeg_parse->bytes_since_scr = 0;
 
+  mpeg_parse->index_scr = MP_INVALID_SCR;
+  mpeg_parse->index_time = 0;
+
   mpeg_parse->current_ts = 0;
 
   mpeg_parse->do_adjust = TRUE;
@@ -332,6 +403,8 @@ gst_mpeg_parse_send_buffer (GstMPEGParse * mpeg_parse, GstBuffer * buffer,
       GST_TIME_ARGS (time));
 
   gst_buffer_set_caps (buffer, GST_PAD_CAPS (mpeg_parse->srcpad));
+  gst_element_stats_output (&mpeg_parse->stats, buffer);
+  GST_PROBE_PUSH (mpeg_parse, buffer);
   result = gst_pad_push (mpeg_parse->srcpad, buffer);
 
   return result;
@@ -500,23 +573,25 @@ gst_mpeg_parse_pad_added (GstElement * element, GstPad * pad)
   gst_pad_push_event (pad, event);
 }
 
-static gboolean
-gst_mpeg_parse_parse_packhead (GstMPEGParse * mpeg_parse, GstBuffer * buffer)
+/*
+ * Extract the SCR and mux rate values from a pack header. @buf points
+ * to the pack start code and must hold at least 12 bytes for MPEG-1
+ * and 14 bytes for MPEG-2 packs.
+ */
+static void
+gst_mpeg_parse_decode_packhead (const guint8 * buf, gboolean mpeg2,
+    guint64 * scr_out, guint32 * rate_out)
 {
-  guint8 *buf;
-  guint64 prev_scr, scr, diff;
+  guint64 scr;
   guint32 scr1, scr2;
   guint32 new_rate;
-  guint64 offset;
 
-  buf = GST_BUFFER_DATA (buffer);
   buf += 4;
 
   scr1 = GST_READ_UINT32_BE (buf);
   scr2 = GST_READ_UINT32_BE (buf + 4);
 
-  /* Extract the SCR and rate values from the header. */
-  if (GST_MPEG_PACKETIZE_IS_MPEG2 (mpeg_parse->packetize)) {
+  if (mpeg2) {
     guint32 scr_ext;
 
     /* :2=01 ! scr:3 ! marker:1==1 ! scr:15 ! marker:1==1 ! scr:15 */
@@ -529,11 +604,6 @@ gst_mpeg_parse_parse_packhead (GstMPEGParse * mpeg_parse, GstBuffer * buffer)
 
     scr = (scr * 300 + scr_ext % 300) / 300;
 
-    GST_LOG_OBJECT (mpeg_parse, "%" G_GINT64_FORMAT " %d, %08x %08x %"
-        G_GINT64_FORMAT " diff: %" G_GINT64_FORMAT,
-        scr, scr_ext, scr1, scr2, mpeg_parse->bytes_since_scr,
-        scr - mpeg_parse->current_scr);
-
     buf += 6;
     new_rate = (GST_READ_UINT32_BE (buf) & 0xfffffc00) >> 10;
   } else {
@@ -549,7 +619,296 @@ gst_mpeg_parse_parse_packhead (GstMPEGParse * mpeg_parse, GstBuffer * buffer)
     new_rate |= ((gint32) buf[1]) << 7;
     new_rate |= buf[2] >> 1;
   }
-  new_rate *= MP_MUX_RATE_MULT;
+
+  *scr_out = scr;
+  if (rate_out)
+    *rate_out = new_rate * MP_MUX_RATE_MULT;
+}
+
+/* position of the first index entry at or after @offset */
+static guint
+gst_mpeg_parse_find_scr_offset (GArray * index, guint64 offset)
+{
+  guint lo = 0, hi = index->len;
+
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    if (g_array_index (index, GstMPEGParseScrEntry, mid).offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/*
+ * Get the index time of a pack with SCR @scr that follows the pack of
+ * @prev without a discontinuity, and that lies before @max_time. Returns
+ * FALSE if the SCR does not fit, meaning there is a discontinuity between
+ * the two packs.
+ */
+static gboolean
+gst_mpeg_parse_scr_entry_time (const GstMPEGParseScrEntry * prev,
+    guint64 scr, guint64 max_time, guint64 * time)
+{
+  guint64 delta = (scr - prev->scr) & MP_SCR_MASK;
+
+  /* more than half the SCR range ahead means the SCR went back */
+  if (delta > MP_SCR_MASK / 2 || prev->time + delta > max_time)
+    return FALSE;
+
+  *time = prev->time + delta;
+  return TRUE;
+}
+
+/*
+ * Get the index time of the pack at @offset from the index entries
+ * surrounding it. Only works inside the indexed region.
+ */
+static gboolean
+gst_mpeg_parse_scr_index_lookup (GstMPEGParse * mpeg_parse, guint64 scr,
+    guint64 offset, guint64 * time)
+{
+  GArray *index = mpeg_parse->scr_index;
+  GstMPEGParseScrEntry *next = NULL;
+  guint pos;
+
+  if (index->len == 0) {
+    /* the first pack of the stream is the time reference */
+    if (offset > MP_SCR_INDEX_MAX_START)
+      return FALSE;
+    *time = 0;
+    return TRUE;
+  }
+
+  pos = gst_mpeg_parse_find_scr_offset (index, offset);
+  if (pos < index->len) {
+    next = &g_array_index (index, GstMPEGParseScrEntry, pos);
+    if (next->offset == offset) {
+      *time = next->time;
+      return TRUE;
+    }
+  }
+  if (pos == 0)
+    return FALSE;
+
+  return gst_mpeg_parse_scr_entry_time (&g_array_index (index,
+          GstMPEGParseScrEntry, pos - 1), scr,
+      next ? next->time : G_MAXUINT64, time);
+}
+
+/*
+ * Remember the pack at @offset. The index is kept sorted on byte offset,
+ * with non-decreasing times, and is thinned out so that consecutive
+ * entries are at least MP_SCR_INDEX_INTERVAL apart.
+ */
+static void
+gst_mpeg_parse_add_scr_entry (GstMPEGParse * mpeg_parse, guint64 scr,
+    guint64 time, guint64 offset)
+{
+  GArray *index = mpeg_parse->scr_index;
+  GstMPEGParseScrEntry entry;
+  guint pos;
+
+  pos = gst_mpeg_parse_find_scr_offset (index, offset);
+
+  if (pos < index->len) {
+    GstMPEGParseScrEntry *next = &g_array_index (index,
+        GstMPEGParseScrEntry, pos);
+
+    if (next->offset == offset || next->time < time ||
+        next->time - time < MP_SCR_INDEX_INTERVAL)
+      return;
+  }
+  if (pos > 0) {
+    GstMPEGParseScrEntry *prev = &g_array_index (index,
+        GstMPEGParseScrEntry, pos - 1);
+
+    if (time < prev->time || time - prev->time < MP_SCR_INDEX_INTERVAL)
+      return;
+  }
+
+  entry.scr = scr & MP_SCR_MASK;
+  entry.time = time;
+  entry.offset = offset;
+  g_array_insert_val (index, pos, entry);
+}
+
+/*
+ * Find the index entries surrounding @time. Returns FALSE if @time lies
+ * before the first entry. @next is set to NULL if @time lies beyond the
+ * last entry.
+ */
+static gboolean
+gst_mpeg_parse_find_scr_entries (GstMPEGParse * mpeg_parse, guint64 time,
+    GstMPEGParseScrEntry ** prev, GstMPEGParseScrEntry ** next)
+{
+  GArray *index = mpeg_parse->scr_index;
+  guint lo = 0, hi = index->len;
+
+  /* find the first entry with a time bigger than the wanted one */
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+
+    if (g_array_index (index, GstMPEGParseScrEntry, mid).time <= time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == 0)
+    return FALSE;
+
+  *prev = &g_array_index (index, GstMPEGParseScrEntry, lo - 1);
+  *next = (lo < index->len) ?
+      &g_array_index (index, GstMPEGParseScrEntry, lo) : NULL;
+
+  return TRUE;
+}
+
+/*
+ * Read the first pack header at or after @offset using pull_range and
+ * return its SCR and exact offset.
+ */
+static gboolean
+gst_mpeg_parse_pull_packhead (GstMPEGParse * mpeg_parse, guint64 offset,
+    guint64 * pack_offset, guint64 * scr)
+{
+  GstBuffer *buf = NULL;
+  const guint8 *data;
+  guint size, i;
+  gboolean res = FALSE;
+
+  if (gst_pad_pull_range (mpeg_parse->sinkpad, offset, MP_SCR_SEEK_READ_SIZE,
+          &buf) != GST_FLOW_OK)
+    return FALSE;
+
+  data = GST_BUFFER_DATA (buf);
+  size = GST_BUFFER_SIZE (buf);
+
+  for (i = 0; i + 14 <= size; i++) {
+    if (data[i] != 0x00 || data[i + 1] != 0x00 || data[i + 2] != 0x01 ||
+        data[i + 3] != PACK_START_CODE)
+      continue;
+
+    if ((data[i + 4] & 0xc0) == 0x40) {
+      gst_mpeg_parse_decode_packhead (data + i, TRUE, scr, NULL);
+    } else if ((data[i + 4] & 0xf0) == 0x20) {
+      gst_mpeg_parse_decode_packhead (data + i, FALSE, scr, NULL);
+    } else {
+      continue;
+    }
+
+    *pack_offset = offset + i;
+    res = TRUE;
+    break;
+  }
+
+  gst_buffer_unref (buf);
+  return res;
+}
+
+/*
+ * Convert a stream time to the byte offset of the pack carrying it,
+ * using the SCR index. When the sink pad operates in pull mode the
+ * position is refined by bisecting on the SCR values of the pack
+ * headers, so that it ends up within one pack of the target. Bisecting
+ * stops early at a discontinuity that is not in the index yet.
+ */
+static gboolean
+gst_mpeg_parse_scr_index_time_to_bytes (GstMPEGParse * mpeg_parse,
+    GstClockTime time, gint64 * bytes)
+{
+  GstMPEGParseScrEntry *prev, *next, lo, hi;
+  guint64 target;
+
+  if (mpeg_parse->scr_index->len == 0)
+    return FALSE;
+
+  /* index times count from the first pack of the stream */
+  target = GSTTIME_TO_MPEGTIME (time);
+
+  if (!gst_mpeg_parse_find_scr_entries (mpeg_parse, target, &prev, &next))
+    return FALSE;
+
+  lo = *prev;
+
+  if (next != NULL) {
+    hi = *next;
+  } else {
+    GstFormat fmt = GST_FORMAT_BYTES;
+    gint64 total, rate;
+
+    /* past the indexed region, estimate the upper bound */
+    if (!gst_pad_query_peer_duration (mpeg_parse->sinkpad, &fmt, &total) ||
+        total <= lo.offset)
+      return FALSE;
+    if (GST_PAD_ACTIVATE_MODE (mpeg_parse->sinkpad) != GST_ACTIVATE_PULL) {
+      if (!gst_mpeg_parse_get_rate (mpeg_parse, &rate))
+        return FALSE;
+      *bytes = MIN (total, lo.offset +
+          MPEGTIME_TO_GSTTIME (target - lo.time) * rate / GST_SECOND);
+      return TRUE;
+    }
+    hi.offset = total;
+    hi.time = G_MAXUINT64;
+  }
+
+  if (GST_PAD_ACTIVATE_MODE (mpeg_parse->sinkpad) == GST_ACTIVATE_PULL) {
+    while (hi.offset - lo.offset > MP_SCR_SEEK_ACCURACY) {
+      GstMPEGParseScrEntry pack;
+
+      if (!gst_mpeg_parse_pull_packhead (mpeg_parse,
+              (lo.offset + hi.offset) / 2, &pack.offset, &pack.scr) ||
+          pack.offset >= hi.offset || pack.offset == lo.offset)
+        break;
+
+      if (!gst_mpeg_parse_scr_entry_time (&lo, pack.scr, hi.time,
+              &pack.time)) {
+        GST_DEBUG_OBJECT (mpeg_parse, "SCR discontinuity between %"
+            G_GUINT64_FORMAT " and %" G_GUINT64_FORMAT, lo.offset,
+            hi.offset);
+        break;
+      }
+
+      gst_mpeg_parse_add_scr_entry (mpeg_parse, pack.scr, pack.time,
+          pack.offset);
+
+      if (pack.time <= target)
+        lo = pack;
+      else
+        hi = pack;
+    }
+    GST_DEBUG_OBJECT (mpeg_parse, "bisected to pack at %" G_GUINT64_FORMAT
+        " with time %" G_GUINT64_FORMAT " for target %" G_GUINT64_FORMAT,
+        lo.offset, lo.time, target);
+    *bytes = lo.offset;
+  } else if (hi.time > lo.time) {
+    /* interpolate between the two surrounding index entries */
+    *bytes = lo.offset + gst_util_uint64_scale (target - lo.time,
+        hi.offset - lo.offset, hi.time - lo.time);
+  } else {
+    *bytes = lo.offset;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_mpeg_parse_parse_packhead (GstMPEGParse * mpeg_parse, GstBuffer * buffer)
+{
+  guint64 prev_scr, scr, diff, pack_scr;
+  guint32 new_rate;
+  guint64 offset;
+
+  /* Extract the SCR and rate values from the header. */
+  gst_mpeg_parse_decode_packhead (GST_BUFFER_DATA (buffer),
+      GST_MPEG_PACKETIZE_IS_MPEG2 (mpeg_parse->packetize), &scr, &new_rate);
+
+  GST_LOG_OBJECT (mpeg_parse, "SCR %" G_GUINT64_FORMAT ", %"
+      G_GUINT64_FORMAT " bytes since last, diff: %" G_GINT64_FORMAT,
+      scr, mpeg_parse->bytes_since_scr, scr - mpeg_parse->current_scr);
 
   /* Deal with SCR overflow */
   if (mpeg_parse->current_scr != MP_INVALID_SCR) {
@@ -643,6 +1002,29 @@ gst_mpeg_parse_parse_packhead (GstMPEGParse * mpeg_parse, GstBuffer * buffer)
         gst_mpeg_parse_signals[SIGNAL_REACHED_OFFSET], 0);
   }
 
+  /* Remember where this pack lives for seeking. Packs parsed one after
+   * the other continue the index time of the previous one, also over a
+   * discontinuity, otherwise the index time is taken from the index. */
+  pack_scr = mpeg_parse->current_scr & MP_SCR_MASK;
+  if (mpeg_parse->index_scr != MP_INVALID_SCR) {
+    guint64 step = (pack_scr - mpeg_parse->index_scr) & MP_SCR_MASK;
+
+    if (step > MP_SCR_INDEX_MAX_JUMP) {
+      GST_DEBUG_OBJECT (mpeg_parse, "SCR discontinuity from %"
+          G_GUINT64_FORMAT " to %" G_GUINT64_FORMAT, mpeg_parse->index_scr,
+          pack_scr);
+      step = 0;
+    }
+    mpeg_parse->index_scr = pack_scr;
+    mpeg_parse->index_time += step;
+  } else if (gst_mpeg_parse_scr_index_lookup (mpeg_parse, pack_scr,
+          offset - GST_BUFFER_SIZE (buffer), &mpeg_parse->index_time)) {
+    mpeg_parse->index_scr = pack_scr;
+  }
+  if (mpeg_parse->index_scr != MP_INVALID_SCR)
+    gst_mpeg_parse_add_scr_entry (mpeg_parse, pack_scr,
+        mpeg_parse->index_time, offset - GST_BUFFER_SIZE (buffer));
+
   /* Update index if any. */
   if (mpeg_parse->index && GST_INDEX_IS_WRITABLE (mpeg_parse->index)) {
     gst_index_add_association (mpeg_parse->index, mpeg_parse->index_id,
@@ -708,11 +1090,219 @@ static GstFlowReturn
 gst_mpeg_parse_chain (GstPad * pad, GstBuffer * buffer)
 {
   GstMPEGParse *mpeg_parse = GST_MPEG_PARSE (GST_PAD_PARENT (pad));
+
+  return gst_mpeg_parse_process (mpeg_parse, buffer);
+}
+
+static void
+gst_mpeg_parse_loop (GstPad * pad)
+{
+  GstMPEGParse *mpeg_parse = GST_MPEG_PARSE (GST_PAD_PARENT (pad));
+  GstFlowReturn ret;
+  GstBuffer *buffer = NULL;
+  guint64 offset = mpeg_parse->pull_offset;
+  guint size;
+
+  /* packets past the stop time are cut in _process(), the byte offset is
+   * only used when the packs cannot be placed in the index */
+  if (mpeg_parse->pull_stop != (guint64) - 1 &&
+      offset >= mpeg_parse->pull_stop &&
+      mpeg_parse->index_scr == MP_INVALID_SCR) {
+    ret = GST_FLOW_UNEXPECTED;
+    goto pause;
+  }
+
+  /* read up to the next block boundary, so that reads stay aligned after
+   * seeking to a pack in the middle of a block */
+  size = MP_PULL_BLOCK_SIZE - (offset % MP_PULL_BLOCK_SIZE);
+
+  ret = gst_pad_pull_range (pad, offset, size, &buffer);
+  if (ret != GST_FLOW_OK)
+    goto pause;
+
+  GST_LOG_OBJECT (mpeg_parse, "pulled %u bytes at offset %" G_GUINT64_FORMAT,
+      GST_BUFFER_SIZE (buffer), offset);
+
+  if (GST_BUFFER_SIZE (buffer) == 0) {
+    gst_buffer_unref (buffer);
+    ret = GST_FLOW_UNEXPECTED;
+    goto pause;
+  }
+
+  GST_BUFFER_OFFSET (buffer) = offset;
+  mpeg_parse->pull_offset = offset + GST_BUFFER_SIZE (buffer);
+
+  ret = gst_mpeg_parse_process (mpeg_parse, buffer);
+  if (ret != GST_FLOW_OK)
+    goto pause;
+
+  return;
+
+pause:
+  {
+    GST_INFO_OBJECT (mpeg_parse, "pausing task, reason %s",
+        gst_flow_get_name (ret));
+    gst_pad_pause_task (pad);
+
+    if (ret == GST_FLOW_UNEXPECTED && mpeg_parse->pull_segment) {
+      GstClockTime stop = mpeg_parse->pull_stop_time;
+
+      if (!GST_CLOCK_TIME_IS_VALID (stop))
+        stop = MPEGTIME_TO_GSTTIME (mpeg_parse->index_time);
+      gst_element_post_message (GST_ELEMENT (mpeg_parse),
+          gst_message_new_segment_done (GST_OBJECT (mpeg_parse),
+              GST_FORMAT_TIME, stop));
+    } else if (ret == GST_FLOW_UNEXPECTED) {
+      CLASS (mpeg_parse)->process_event (mpeg_parse, gst_event_new_eos ());
+    } else if (GST_FLOW_IS_FATAL (ret) || ret == GST_FLOW_NOT_LINKED) {
+      GST_ELEMENT_ERROR (mpeg_parse, STREAM, FAILED, (NULL),
+          ("stream stopped, reason %s", gst_flow_get_name (ret)));
+      CLASS (mpeg_parse)->process_event (mpeg_parse, gst_event_new_eos ());
+    }
+  }
+}
+
+static gboolean
+gst_mpeg_parse_sink_activate (GstPad * sinkpad)
+{
+  if (gst_pad_check_pull_range (sinkpad)) {
+    GST_DEBUG_OBJECT (sinkpad, "activating pull");
+    return gst_pad_activate_pull (sinkpad, TRUE);
+  } else {
+    GST_DEBUG_OBJECT (sinkpad, "activating push");
+    return gst_pad_activate_push (sinkpad, TRUE);
+  }
+}
+
+static gboolean
+gst_mpeg_parse_sink_activate_pull (GstPad * sinkpad, gboolean active)
+{
+  GstMPEGParse *mpeg_parse = GST_MPEG_PARSE (GST_PAD_PARENT (sinkpad));
+
+  if (active) {
+    mpeg_parse->pull_offset = 0;
+    mpeg_parse->pull_stop = -1;
+    mpeg_parse->pull_stop_time = GST_CLOCK_TIME_NONE;
+    mpeg_parse->pull_segment = FALSE;
+    return gst_pad_start_task (sinkpad,
+        (GstTaskFunction) gst_mpeg_parse_loop, sinkpad);
+  } else {
+    return gst_pad_stop_task (sinkpad);
+  }
+}
+
+/*
+ * Seek in pull mode: look up the byte offset ourselves and move the
+ * read position, instead of sending a byte seek upstream.
+ */
+static gboolean
+gst_mpeg_parse_perform_seek (GstMPEGParse * mpeg_parse, GstPad * pad,
+    GstEvent * event)
+{
+  GstFormat format, conv;
+  GstSeekFlags flags;
+  GstSeekType cur_type, stop_type;
+  gint64 cur, stop, start_offset, stop_offset = -1;
+  gdouble rate;
+  gboolean flush;
+
+  gst_event_parse_seek (event, &rate, &format, &flags, &cur_type,
+      &cur, &stop_type, &stop);
+
+  if (rate <= 0.0 || cur_type != GST_SEEK_TYPE_SET ||
+      (stop_type != GST_SEEK_TYPE_SET && stop_type != GST_SEEK_TYPE_NONE)) {
+    GST_DEBUG_OBJECT (mpeg_parse, "unsupported seek");
+    return FALSE;
+  }
+
+  /* Bring the positions to time. */
+  conv = GST_FORMAT_TIME;
+  if (!gst_pad_query_convert (pad, format, cur, &conv, &cur))
+    return FALSE;
+  if (stop_type == GST_SEEK_TYPE_SET && stop != -1) {
+    conv = GST_FORMAT_TIME;
+    if (!gst_pad_query_convert (pad, format, stop, &conv, &stop))
+      return FALSE;
+  } else {
+    stop = -1;
+  }
+
+  flush = ((flags & GST_SEEK_FLAG_FLUSH) != 0);
+
+  if (flush) {
+    CLASS (mpeg_parse)->send_event (mpeg_parse, gst_event_new_flush_start ());
+  } else {
+    gst_pad_pause_task (mpeg_parse->sinkpad);
+  }
+
+  /* wait for the streaming thread to stop */
+  GST_PAD_STREAM_LOCK (mpeg_parse->sinkpad);
+
+  conv = GST_FORMAT_BYTES;
+  if (!gst_mpeg_parse_scr_index_time_to_bytes (mpeg_parse, cur, &start_offset)
+      && !gst_mpeg_parse_convert (mpeg_parse, GST_FORMAT_TIME, cur, &conv,
+          &start_offset))
+    start_offset = 0;
+  if (stop != -1) {
+    conv = GST_FORMAT_BYTES;
+    if (!gst_mpeg_parse_scr_index_time_to_bytes (mpeg_parse, stop,
+            &stop_offset) && !gst_mpeg_parse_convert (mpeg_parse,
+            GST_FORMAT_TIME, stop, &conv, &stop_offset))
+      stop_offset = -1;
+  }
+
+  GST_DEBUG_OBJECT (mpeg_parse, "seeking to %" GST_TIME_FORMAT
+      ", byte offset %" G_GINT64_FORMAT, GST_TIME_ARGS (cur), start_offset);
+
+  if (flush) {
+    /* This also resets our state and the packetizer. */
+    CLASS (mpeg_parse)->process_event (mpeg_parse, gst_event_new_flush_stop ());
+  } else {
+    /* close the running segment where we stopped. The streaming thread
+     * is stopped, so it still goes out before the new segment */
+    if (!mpeg_parse->pending_newsegment && CLASS (mpeg_parse)->send_event) {
+      GstSegment *seg = &mpeg_parse->current_segment;
+
+      CLASS (mpeg_parse)->send_event (mpeg_parse,
+          gst_event_new_new_segment (TRUE, seg->rate, GST_FORMAT_TIME,
+              seg->start, GST_CLOCK_TIME_IS_VALID (seg->last_stop) ?
+              seg->last_stop : seg->stop, seg->time));
+    }
+    gst_mpeg_parse_reset (mpeg_parse);
+    gst_mpeg_packetize_flush_cache (mpeg_parse->packetize);
+  }
+
+  mpeg_parse->pull_offset = MAX (start_offset, 0);
+  mpeg_parse->pull_stop = stop_offset;
+  mpeg_parse->pull_stop_time = stop;
+  mpeg_parse->pull_segment = ((flags & GST_SEEK_FLAG_SEGMENT) != 0);
+
+  if (mpeg_parse->pull_segment) {
+    gst_element_post_message (GST_ELEMENT (mpeg_parse),
+        gst_message_new_segment_start (GST_OBJECT (mpeg_parse),
+            GST_FORMAT_TIME, cur));
+  }
+
+  gst_pad_start_task (mpeg_parse->sinkpad,
+      (GstTaskFunction) gst_mpeg_parse_loop, mpeg_parse->sinkpad);
+
+  GST_PAD_STREAM_UNLOCK (mpeg_parse->sinkpad);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_mpeg_parse_process (GstMPEGParse * mpeg_parse, GstBuffer * buffer)
+{
   GstFlowReturn result;
   guint id;
   gboolean mpeg2;
   GstClockTime time;
   guint64 size;
+  GstClockTime start;
+
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&mpeg_parse->stats, buffer);
 
   if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT)) {
     GST_DEBUG_OBJECT (mpeg_parse, "buffer with DISCONT flag set");
@@ -735,7 +1325,8 @@ gst_mpeg_parse_chain (GstPad * pad, GstBuffer * buffer)
     id = GST_MPEG_PACKETIZE_ID (mpeg_parse->packetize);
     mpeg2 = GST_MPEG_PACKETIZE_IS_MPEG2 (mpeg_parse->packetize);
 
-    GST_LOG_OBJECT (mpeg_parse, "have chunk 0x%02X", id);
+    GST_HOT_LOG_OBJECT (mpeg_parse, "have chunk 0x%02X", id);
+    GST_PROBE_PACKET (mpeg_parse, id, GST_BUFFER_SIZE (buffer));
 
     switch (id) {
       case ISO11172_END_START_CODE:
@@ -796,6 +1387,19 @@ gst_mpeg_parse_chain (GstPad * pad, GstBuffer * buffer)
       gst_caps_unref (caps);
     }
 
+    /* Stop at the first packet of a pack past the seek stop position,
+     * which is in index time like the start position. */
+    if (GST_CLOCK_TIME_IS_VALID (mpeg_parse->pull_stop_time) &&
+        mpeg_parse->index_scr != MP_INVALID_SCR &&
+        MPEGTIME_TO_GSTTIME (mpeg_parse->index_time) >=
+        mpeg_parse->pull_stop_time) {
+      GST_DEBUG_OBJECT (mpeg_parse, "reached stop position %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (mpeg_parse->pull_stop_time));
+      gst_buffer_unref (buffer);
+      result = GST_FLOW_UNEXPECTED;
+      break;
+    }
+
     /* Send the buffer. */
     g_return_val_if_fail (mpeg_parse->current_scr != MP_INVALID_SCR,
         GST_FLOW_OK);
@@ -849,6 +1453,8 @@ gst_mpeg_parse_chain (GstPad * pad, GstBuffer * buffer)
     GST_DEBUG_OBJECT (mpeg_parse, "flow: %s", gst_flow_get_name (result));
   }
 
+  gst_element_stats_stop (&mpeg_parse->stats, start);
+
   return result;
 }
 
@@ -1159,9 +1765,12 @@ normal_seek (GstMPEGParse * mpeg_parse, GstPad * pad, GstEvent * event)
     if (!gst_pad_query_convert (pad, format, offset, &conv, &start_position)) {
       goto done;
     }
-    /* And convert to bytes on sinkpad. */
+    /* And convert to bytes, using the SCR index if we can, which is
+     * a lot more accurate than the average rate for VBR streams. */
     conv = GST_FORMAT_BYTES;
-    if (!gst_pad_query_convert (mpeg_parse->sinkpad, GST_FORMAT_TIME,
+    if (!gst_mpeg_parse_scr_index_time_to_bytes (mpeg_parse, start_position,
+            &start_position) &&
+        !gst_pad_query_convert (mpeg_parse->sinkpad, GST_FORMAT_TIME,
             start_position, &conv, &start_position)) {
       goto done;
     }
@@ -1179,9 +1788,11 @@ normal_seek (GstMPEGParse * mpeg_parse, GstPad * pad, GstEvent * event)
     if (!gst_pad_query_convert (pad, format, offset, &conv, &end_position)) {
       goto done;
     }
-    /* And convert to bytes on sinkpad. */
+    /* And convert to bytes. */
     conv = GST_FORMAT_BYTES;
-    if (!gst_pad_query_convert (mpeg_parse->sinkpad, GST_FORMAT_TIME,
+    if (!gst_mpeg_parse_scr_index_time_to_bytes (mpeg_parse, end_position,
+            &end_position) &&
+        !gst_pad_query_convert (mpeg_parse->sinkpad, GST_FORMAT_TIME,
             end_position, &conv, &end_position)) {
       goto done;
     }
@@ -1211,6 +1822,11 @@ gst_mpeg_parse_handle_src_event (GstPad * pad, GstEvent * event)
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_SEEK:
     {
+      if (GST_PAD_ACTIVATE_MODE (mpeg_parse->sinkpad) == GST_ACTIVATE_PULL) {
+        res = gst_mpeg_parse_perform_seek (mpeg_parse, pad, event);
+        gst_event_unref (event);
+        goto done;
+      }
 #ifdef FIXME
       /* First try to use the index if we have one. */
       if (mpeg_parse->index) {
@@ -1258,7 +1874,12 @@ gst_mpeg_parse_change_state (GstElement * element, GstStateChange transition)
       if (!mpeg_parse->packetize) {
         mpeg_parse->packetize =
             gst_mpeg_packetize_new (GST_MPEG_PACKETIZE_SYSTEM);
+        mpeg_parse->packetize->stats = &mpeg_parse->stats;
       }
+      gst_element_stats_reset (&mpeg_parse->stats);
+
+      /* A new stream, forget the SCR index of the previous one. */
+      g_array_set_size (mpeg_parse->scr_index, 0);
 
       /* Initialize parser state */
       gst_mpeg_parse_reset (mpeg_parse);
@@ -1302,6 +1923,11 @@ gst_mpeg_parse_get_property (GObject * object, guint prop_id, GValue * value,
     case ARG_TIME_OFFSET:
       g_value_set_uint64 (value, mpeg_parse->current_ts);
       break;
+    case ARG_STATS:
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&mpeg_parse->stats,
+              "mpegparse-stats"));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
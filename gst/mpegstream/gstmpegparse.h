@@ -95,6 +95,20 @@ struct _GstMPEGParse
   gint index_id;
 
   guint64 byte_offset;
+
+  /* Sorted SCR -> byte offset table built from the parsed pack
+     headers, used for accurate seeking in VBR streams. */
+  GArray *scr_index;
+  guint64 index_scr;            /* 33 bit SCR of the last parsed pack */
+  guint64 index_time;           /* Index time of the last parsed pack */
+
+  /* Pull mode operation */
+  guint64 pull_offset;          /* Next byte offset to read */
+  guint64 pull_stop;            /* Byte offset to stop at, or -1 */
+  GstClockTime pull_stop_time;  /* Stream time to stop at, or -1 */
+  gboolean pull_segment;        /* Post SEGMENT_DONE instead of EOS */
+
+  GstElementStats stats;        /* for the "stats" property */
 };
 
 struct _GstMPEGParseClass
@@ -86,44 +86,77 @@ gst_asm_operator_eval (GstASMOp optype, gfloat left, gfloat right)
   return result;
 }
 
-static gfloat
-gst_asm_node_evaluate (GstASMNode * node, GHashTable * vars)
+typedef enum
 {
-  gfloat result = 0.0;
+  GST_ASM_INSTR_PUSH,           /* push value */
+  GST_ASM_INSTR_LOAD,           /* push the variable in slot */
+  GST_ASM_INSTR_OP              /* replace the top two by op applied to them */
+} GstASMInstrType;
+
+struct _GstASMInstr
+{
+  GstASMInstrType type;
+  GstASMOp op;
+  guint slot;
+  gfloat value;
+};
+
+static guint
+gst_asm_rule_book_var_slot (GstASMRuleBook * book, const gchar * varname)
+{
+  guint i;
+
+  for (i = 0; i < book->vars->len; i++) {
+    if (!strcmp (g_ptr_array_index (book->vars, i), varname))
+      return i;
+  }
+  g_ptr_array_add (book->vars, g_strdup (varname));
 
-  if (node == NULL)
-    return 0.0;
+  return i;
+}
+
+/* appends the postfix code for @node to @code, returns the stack depth it
+ * needs */
+static guint
+gst_asm_node_compile (GstASMNode * node, GstASMRuleBook * book, GArray * code)
+{
+  GstASMInstr instr = { GST_ASM_INSTR_PUSH, 0, 0, 0.0 };
+  guint depth = 1;
+
+  if (node == NULL) {
+    g_array_append_val (code, instr);
+    return depth;
+  }
 
   switch (node->type) {
     case GST_ASM_NODE_VARIABLE:
-    {
-      gchar *val;
-
-      val = g_hash_table_lookup (vars, node->data.varname);
-      if (val)
-        result = (gfloat) atof (val);
+      instr.type = GST_ASM_INSTR_LOAD;
+      instr.slot = gst_asm_rule_book_var_slot (book, node->data.varname);
       break;
-    }
     case GST_ASM_NODE_INTEGER:
-      result = (gfloat) node->data.intval;
+      instr.value = (gfloat) node->data.intval;
       break;
     case GST_ASM_NODE_FLOAT:
-      result = node->data.floatval;
+      instr.value = node->data.floatval;
       break;
     case GST_ASM_NODE_OPERATOR:
     {
-      gfloat left, right;
+      guint left, right;
 
-      left = gst_asm_node_evaluate (node->left, vars);
-      right = gst_asm_node_evaluate (node->right, vars);
+      left = gst_asm_node_compile (node->left, book, code);
+      right = gst_asm_node_compile (node->right, book, code);
+      depth = MAX (left, right + 1);
 
-      result = gst_asm_operator_eval (node->data.optype, left, right);
+      instr.type = GST_ASM_INSTR_OP;
+      instr.op = node->data.optype;
       break;
     }
     default:
       break;
   }
-  return result;
+  g_array_append_val (code, instr);
+
+  return depth;
 }
 
 #define IS_SPACE(p) (((p) == ' ') || ((p) == '\n') || \
@@ -420,7 +453,8 @@ gst_asm_rule_new (void)
   GstASMRule *rule;
 
   rule = g_new (GstASMRule, 1);
-  rule->root = NULL;
+  rule->code_start = 0;
+  rule->code_len = 0;
   rule->props = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 
   return rule;
@@ -430,8 +464,6 @@ static void
 gst_asm_rule_free (GstASMRule * rule)
 {
   g_hash_table_destroy (rule->props);
-  if (rule->root)
-    gst_asm_node_free (rule->root);
   g_free (rule);
 }
 
@@ -462,12 +494,12 @@ gst_asm_scan_parse_operand (GstASMScan * scan)
     case GST_ASM_TOKEN_INT:
       node = gst_asm_node_new ();
       node->type = GST_ASM_NODE_INTEGER;
-      node->data.intval = (gfloat) atof (scan->val);
+      node->data.intval = atoi (scan->val);
       break;
     case GST_ASM_TOKEN_FLOAT:
       node = gst_asm_node_new ();
       node->type = GST_ASM_NODE_FLOAT;
-      node->data.floatval = atoi (scan->val);
+      node->data.floatval = (gfloat) atof (scan->val);
       break;
     case GST_ASM_TOKEN_LPAREN:
       gst_asm_scan_next_token (scan);
@@ -553,15 +585,24 @@ gst_asm_scan_parse_property (GstASMRule * rule, GstASMScan * scan)
 }
 
 static GstASMRule *
-gst_asm_scan_parse_rule (GstASMScan * scan)
+gst_asm_scan_parse_rule (GstASMScan * scan, GstASMRuleBook * book,
+    GArray * code)
 {
   GstASMRule *rule;
+  GstASMNode *root;
 
   rule = gst_asm_rule_new ();
 
   if (scan->token == GST_ASM_TOKEN_HASH) {
     gst_asm_scan_next_token (scan);
-    rule->root = gst_asm_scan_parse_condition (scan);
+    root = gst_asm_scan_parse_condition (scan);
+    if (root) {
+      rule->code_start = code->len;
+      book->max_stack = MAX (book->max_stack,
+          gst_asm_node_compile (root, book, code));
+      rule->code_len = code->len - rule->code_start;
+      gst_asm_node_free (root);
+    }
     if (scan->token == GST_ASM_TOKEN_COMMA)
       gst_asm_scan_next_token (scan);
   }
@@ -577,17 +618,33 @@ gst_asm_scan_parse_rule (GstASMScan * scan)
   return rule;
 }
 
-gboolean
-gst_asm_rule_evaluate (GstASMRule * rule, GHashTable * vars)
+static gboolean
+gst_asm_rule_evaluate (GstASMRule * rule, const GstASMInstr * code,
+    const gfloat * values, gfloat * stack)
 {
-  gboolean res;
-
-  if (rule->root) {
-    res = (gboolean) gst_asm_node_evaluate (rule->root, vars);
-  } else
-    res = TRUE;
-
-  return res;
+  const GstASMInstr *instr, *end;
+  guint sp = 0;
+
+  if (rule->code_len == 0)
+    return TRUE;
+
+  instr = code + rule->code_start;
+  for (end = instr + rule->code_len; instr < end; instr++) {
+    switch (instr->type) {
+      case GST_ASM_INSTR_PUSH:
+        stack[sp++] = instr->value;
+        break;
+      case GST_ASM_INSTR_LOAD:
+        stack[sp++] = values[instr->slot];
+        break;
+      case GST_ASM_INSTR_OP:
+        sp--;
+        stack[sp - 1] =
+            gst_asm_operator_eval (instr->op, stack[sp - 1], stack[sp]);
+        break;
+    }
+  }
+  return (gboolean) stack[0];
 }
 
 GstASMRuleBook *
@@ -597,15 +654,18 @@ gst_asm_rule_book_new (const gchar * rulebook)
   GstASMRule *rule = NULL;
   GstASMScan *scan;
   GstASMToken token;
+  GArray *code;
 
   book = g_new0 (GstASMRuleBook, 1);
   book->rulebook = rulebook;
+  book->vars = g_ptr_array_new ();
+  code = g_array_new (FALSE, FALSE, sizeof (GstASMInstr));
 
   scan = gst_asm_scan_new (book->rulebook);
   gst_asm_scan_next_token (scan);
 
   do {
-    rule = gst_asm_scan_parse_rule (scan);
+    rule = gst_asm_scan_parse_rule (scan, book, code);
     if (rule) {
       book->rules = g_list_append (book->rules, rule);
       book->n_rules++;
@@ -615,6 +675,8 @@ gst_asm_rule_book_new (const gchar * rulebook)
 
   gst_asm_scan_free (scan);
 
+  book->code = (GstASMInstr *) g_array_free (code, FALSE);
+
   return book;
 }
 
@@ -635,12 +697,29 @@ gst_asm_rule_book_free (GstASMRuleBook * book)
     gst_asm_rule_free (rule);
   }
   g_list_free (book->rules);
+  g_ptr_array_foreach (book->vars, (GFunc) g_free, NULL);
+  g_ptr_array_free (book->vars, TRUE);
+  g_free (book->code);
   g_free (book);
 }
 
-gint
-gst_asm_rule_book_match (GstASMRuleBook * book, GHashTable * vars,
-    gint * rulematches)
+static void
+gst_asm_rule_book_load_vars (GstASMRuleBook * book, GHashTable * vars,
+    gfloat * values)
+{
+  guint i;
+
+  for (i = 0; i < book->vars->len; i++) {
+    const gchar *val;
+
+    val = g_hash_table_lookup (vars, g_ptr_array_index (book->vars, i));
+    values[i] = val ? (gfloat) atof (val) : 0.0;
+  }
+}
+
+static gint
+gst_asm_rule_book_run (GstASMRuleBook * book, const gfloat * values,
+    gfloat * stack, gint * rulematches)
 {
   GList *walk;
   gint i, n = 0;
@@ -648,22 +727,144 @@ gst_asm_rule_book_match (GstASMRuleBook * book, GHashTable * vars,
   for (walk = book->rules, i = 0; walk; walk = g_list_next (walk), i++) {
     GstASMRule *rule = (GstASMRule *) walk->data;
 
-    if (gst_asm_rule_evaluate (rule, vars)) {
+    if (gst_asm_rule_evaluate (rule, book->code, values, stack)) {
       rulematches[n++] = i;
+      if (n == MAX_RULEMATCHES)
+        break;
     }
   }
   return n;
 }
 
-#ifdef TEST
 gint
-main (gint argc, gchar * argv[])
+gst_asm_rule_book_match (GstASMRuleBook * book, GHashTable * vars,
+    gint * rulematches)
+{
+  gfloat *values, *stack;
+
+  values = g_newa (gfloat, book->vars->len + 1);
+  stack = g_newa (gfloat, book->max_stack + 1);
+
+  gst_asm_rule_book_load_vars (book, vars, values);
+
+  return gst_asm_rule_book_run (book, values, stack, rulematches);
+}
+
+/* Matches the rules for each of @values in turn as the value of @varname,
+ * the other variables are taken from @vars. The matches for values[i] are
+ * stored in n_matches[i] and rulematches[i * MAX_RULEMATCHES] onwards. */
+void
+gst_asm_rule_book_match_values (GstASMRuleBook * book, GHashTable * vars,
+    const gchar * varname, const gfloat * values, guint n_values,
+    gint * n_matches, gint * rulematches)
+{
+  gfloat *slots, *stack;
+  gint slot = -1;
+  guint i;
+
+  slots = g_newa (gfloat, book->vars->len + 1);
+  stack = g_newa (gfloat, book->max_stack + 1);
+
+  gst_asm_rule_book_load_vars (book, vars, slots);
+  for (i = 0; i < book->vars->len; i++) {
+    if (!strcmp (g_ptr_array_index (book->vars, i), varname)) {
+      slot = i;
+      break;
+    }
+  }
+
+  for (i = 0; i < n_values; i++) {
+    if (slot >= 0)
+      slots[slot] = values[i];
+    n_matches[i] = gst_asm_rule_book_run (book, slots, stack,
+        rulematches + i * MAX_RULEMATCHES);
+  }
+}
+
+#ifdef TEST
+#define BENCH_BOOKS 2000
+#define BENCH_VALUES 4096
+
+static void
+print_matches (const gchar * rules, GHashTable * vars)
 {
   GstASMRuleBook *book;
   gint rulematch[MAX_RULEMATCHES];
-  GHashTable *vars;
   gint i, n;
 
+  book = gst_asm_rule_book_new (rules);
+  n = gst_asm_rule_book_match (book, vars, rulematch);
+  gst_asm_rule_book_free (book);
+
+  g_print ("%d rules matched\n", n);
+  for (i = 0; i < n; i++) {
+    g_print ("rule %d matched\n", rulematch[i]);
+  }
+}
+
+/* times parsing the rule book, and matching it against a sweep of
+ * bandwidths one by one and in one batch */
+static void
+bench_rules (const gchar * name, const gchar * rules, GHashTable * vars)
+{
+  GstASMRuleBook *book;
+  GTimer *timer;
+  gfloat *values;
+  gint *n_matches, *rulematches;
+  gint rulematch[MAX_RULEMATCHES];
+  gdouble parse, single, batch;
+  guint i, total = 0;
+
+  values = g_new (gfloat, BENCH_VALUES);
+  n_matches = g_new (gint, BENCH_VALUES);
+  rulematches = g_new (gint, BENCH_VALUES * MAX_RULEMATCHES);
+  for (i = 0; i < BENCH_VALUES; i++)
+    values[i] = i * 100.0;
+
+  timer = g_timer_new ();
+  for (i = 0; i < BENCH_BOOKS; i++)
+    gst_asm_rule_book_free (gst_asm_rule_book_new (rules));
+  parse = g_timer_elapsed (timer, NULL);
+
+  book = gst_asm_rule_book_new (rules);
+
+  g_timer_start (timer);
+  for (i = 0; i < BENCH_VALUES; i++) {
+    gchar val[G_ASCII_DTOSTR_BUF_SIZE];
+
+    g_ascii_dtostr (val, sizeof (val), values[i]);
+    g_hash_table_insert (vars, "Bandwidth", val);
+    total += gst_asm_rule_book_match (book, vars, rulematch);
+  }
+  single = g_timer_elapsed (timer, NULL);
+  g_hash_table_remove (vars, "Bandwidth");
+
+  g_timer_start (timer);
+  gst_asm_rule_book_match_values (book, vars, "Bandwidth", values,
+      BENCH_VALUES, n_matches, rulematches);
+  batch = g_timer_elapsed (timer, NULL);
+
+  for (i = 0; i < BENCH_VALUES; i++)
+    total -= n_matches[i];
+  if (total != 0)
+    g_print ("%s: batch and single matches differ\n", name);
+
+  g_print ("%s: %u rules, parse %.2f us, match %.3f us, batch %.3f us\n",
+      name, book->n_rules, parse * 1e6 / BENCH_BOOKS,
+      single * 1e6 / BENCH_VALUES, batch * 1e6 / BENCH_VALUES);
+
+  gst_asm_rule_book_free (book);
+  g_timer_destroy (timer);
+  g_free (rulematches);
+  g_free (n_matches);
+  g_free (values);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  GHashTable *vars;
+
   static const gchar rules1[] =
       "#($Bandwidth < 67959),TimestampDelivery=T,DropByN=T,"
       "priority=9;#($Bandwidth >= 67959) && ($Bandwidth < 167959),"
@@ -682,33 +883,13 @@ main (gint argc, gchar * argv[])
   vars = g_hash_table_new (g_str_hash, g_str_equal);
   g_hash_table_insert (vars, "Bandwidth", "300000");
 
-  book = gst_asm_rule_book_new (rules1);
-  n = gst_asm_rule_book_match (book, vars, rulematch);
-  gst_asm_rule_book_free (book);
-
-  g_print ("%d rules matched\n", n);
-  for (i = 0; i < n; i++) {
-    g_print ("rule %d matched\n", rulematch[i]);
-  }
-
-  book = gst_asm_rule_book_new (rules2);
-  n = gst_asm_rule_book_match (book, vars, rulematch);
-  gst_asm_rule_book_free (book);
-
-  g_print ("%d rules matched\n", n);
-  for (i = 0; i < n; i++) {
-    g_print ("rule %d matched\n", rulematch[i]);
-  }
-
-  book = gst_asm_rule_book_new (rules3);
-  n = gst_asm_rule_book_match (book, vars, rulematch);
-  gst_asm_rule_book_free (book);
+  print_matches (rules1, vars);
+  print_matches (rules2, vars);
+  print_matches (rules3, vars);
 
-
-  g_print ("%d rules matched\n", n);
-  for (i = 0; i < n; i++) {
-    g_print ("rule %d matched\n", rulematch[i]);
-  }
+  bench_rules ("rules1", rules1, vars);
+  bench_rules ("rules2", rules2, vars);
+  bench_rules ("rules3", rules3, vars);
 
   g_hash_table_destroy (vars);
 
@@ -29,6 +29,7 @@ G_BEGIN_DECLS
 typedef struct _GstASMNode GstASMNode;
 typedef struct _GstASMRule GstASMRule;
 typedef struct _GstASMRuleBook GstASMRuleBook;
+typedef struct _GstASMInstr GstASMInstr;
 
 typedef enum {
   GST_ASM_TOKEN_NONE,
@@ -93,7 +94,9 @@ struct _GstASMNode {
 };
 
 struct _GstASMRule {
-  GstASMNode *root;
+  /* the condition, as a range of the rule book program */
+  guint       code_start;
+  guint       code_len;
   GHashTable *props;
 };
 
@@ -102,6 +105,12 @@ struct _GstASMRuleBook {
 
   guint        n_rules;
   GList       *rules;
+
+  /* the conditions of all rules compiled to one postfix program, with the
+   * variables resolved to slots */
+  GstASMInstr *code;
+  guint        max_stack;
+  GPtrArray   *vars;
 };
 
 G_END_DECLS
@@ -111,5 +120,9 @@ void              gst_asm_rule_book_free    (GstASMRuleBook *book);
 
 gint              gst_asm_rule_book_match   (GstASMRuleBook *book, GHashTable *vars, 
 		                             gint *rulematches);
+void              gst_asm_rule_book_match_values (GstASMRuleBook *book, GHashTable *vars,
+                                             const gchar *varname, const gfloat *values,
+                                             guint n_values, gint *n_matches,
+                                             gint *rulematches);
 
 #endif /* __GST_ASM_RULES_H__ */
@@ -19,6 +19,47 @@
 
 #include "gstrdtbuffer.h"
 
+static GstBufferClass *rdt_buffer_parent_class;
+
+static void
+gst_rdt_buffer_finalize (GstRDTBuffer * buffer)
+{
+  gst_buffer_unref (buffer->parent);
+
+  GST_MINI_OBJECT_CLASS (rdt_buffer_parent_class)->finalize (GST_MINI_OBJECT_CAST
+      (buffer));
+}
+
+static void
+gst_rdt_buffer_class_init (gpointer g_class, gpointer class_data)
+{
+  GstMiniObjectClass *mini_object_class = GST_MINI_OBJECT_CLASS (g_class);
+
+  rdt_buffer_parent_class = g_type_class_peek_parent (g_class);
+
+  mini_object_class->finalize =
+      (GstMiniObjectFinalizeFunction) gst_rdt_buffer_finalize;
+}
+
+GType
+gst_rdt_buffer_get_type (void)
+{
+  static GType rdt_buffer_type = 0;
+
+  if (G_UNLIKELY (rdt_buffer_type == 0)) {
+    static const GTypeInfo rdt_buffer_info = {
+      sizeof (GstRDTBufferClass),
+      NULL, NULL,
+      gst_rdt_buffer_class_init,
+      NULL, NULL, sizeof (GstRDTBuffer), 0, NULL,
+    };
+
+    rdt_buffer_type = g_type_register_static (GST_TYPE_BUFFER, "GstRDTBuffer",
+        &rdt_buffer_info, 0);
+  }
+  return rdt_buffer_type;
+}
+
 gboolean
 gst_rdt_buffer_validate_data (guint8 * data, guint len)
 {
@@ -48,6 +89,47 @@ gst_rdt_buffer_get_packet_count (GstBuffer * buffer)
   return count;
 }
 
+static gboolean
+read_data_header (GstRDTPacket * packet, const guint8 * data)
+{
+  guint header;
+  guint8 asm_rule_number;
+
+  /* skip seq_no and header bits, and the length if it's included */
+  header = (data[0] & 0x80) ? 5 : 3;
+
+  /* flags and asm_rule_number, then the timestamp */
+  if (header + 5 > packet->length)
+    return FALSE;
+  packet->flags = data[header];
+  asm_rule_number = data[header] & 0x3f;
+  packet->timestamp = GST_READ_UINT32_BE (&data[header + 1]);
+  header += 5;
+
+  packet->stream_id = (data[0] & 0x3e) >> 1;
+  if (packet->stream_id == 31) {
+    if (header + 2 > packet->length)
+      return FALSE;
+    /* stream_id_expansion */
+    packet->stream_id = GST_READ_UINT16_BE (&data[header]);
+    header += 2;
+  }
+  if (data[0] & 0x40) {
+    /* skip total_reliable */
+    header += 2;
+  }
+  if (asm_rule_number == 63) {
+    /* skip asm_rule_number_expansion */
+    header += 2;
+  }
+  if (header > packet->length)
+    return FALSE;
+
+  packet->header = header;
+
+  return TRUE;
+}
+
 static gboolean
 read_packet_header (GstRDTPacket * packet)
 {
@@ -159,8 +241,10 @@ read_packet_header (GstRDTPacket * packet)
     /* we have a fixed length */
     packet->length = length;
   } else if (length_offset != -1) {
-    /* we can read the length from an offset */
-    packet->length = GST_READ_UINT16_BE (&data[length_offset]);
+    /* we can read the length from an offset, if the packet has it */
+    if (offset + length_offset + 2 > size)
+      goto invalid_length;
+    packet->length = GST_READ_UINT16_BE (&data[offset + length_offset]);
   } else {
     /* length is remainder of packet */
     packet->length = size - offset;
@@ -170,6 +254,12 @@ read_packet_header (GstRDTPacket * packet)
   if (packet->length + offset > size)
     goto invalid_length;
 
+  /* parse the rest of a data packet header now, so that the getters don't
+   * have to */
+  if (GST_RDT_IS_DATA_TYPE (packet->type) &&
+      !read_data_header (packet, &data[offset]))
+    goto invalid_length;
+
   return TRUE;
 
   /* ERRORS */
@@ -192,6 +282,18 @@ gst_rdt_buffer_get_first_packet (GstBuffer * buffer, GstRDTPacket * packet)
   g_return_val_if_fail (GST_IS_BUFFER (buffer), FALSE);
   g_return_val_if_fail (packet != NULL, FALSE);
 
+  /* a buffer made from a single packet already has its header parsed */
+  if (GST_IS_RDT_BUFFER (buffer)) {
+    GstRDTBuffer *rdt = GST_RDT_BUFFER_CAST (buffer);
+
+    if (rdt->packet.length == GST_BUFFER_SIZE (buffer)) {
+      *packet = rdt->packet;
+      packet->buffer = buffer;
+      packet->offset = 0;
+      return TRUE;
+    }
+  }
+
   /* init to 0 */
   packet->buffer = buffer;
   packet->offset = 0;
@@ -254,17 +356,25 @@ gst_rdt_packet_get_length (GstRDTPacket * packet)
 GstBuffer *
 gst_rdt_packet_to_buffer (GstRDTPacket * packet)
 {
-  GstBuffer *result;
+  GstRDTBuffer *result;
 
   g_return_val_if_fail (packet != NULL, NULL);
   g_return_val_if_fail (packet->type != GST_RDT_TYPE_INVALID, NULL);
 
-  result =
-      gst_buffer_create_sub (packet->buffer, packet->offset, packet->length);
+  /* a subbuffer that keeps the parsed header with it */
+  result = (GstRDTBuffer *) gst_mini_object_new (GST_TYPE_RDT_BUFFER);
+  result->parent = gst_buffer_ref (packet->buffer);
+  result->packet = *packet;
+  result->packet.buffer = NULL;
+  result->packet.offset = 0;
+
+  GST_BUFFER_DATA (result) = GST_BUFFER_DATA (packet->buffer) + packet->offset;
+  GST_BUFFER_SIZE (result) = packet->length;
+  GST_BUFFER_FLAG_SET (result, GST_BUFFER_FLAG_READONLY);
   /* timestamp applies to all packets in this buffer */
   GST_BUFFER_TIMESTAMP (result) = GST_BUFFER_TIMESTAMP (packet->buffer);
 
-  return result;
+  return GST_BUFFER_CAST (result);
 }
 
 gint
@@ -276,79 +386,24 @@ gst_rdt_buffer_compare_seqnum (guint16 seqnum1, guint16 seqnum2)
 guint16
 gst_rdt_packet_data_get_seq (GstRDTPacket * packet)
 {
-  guint header;
-  guint8 *bufdata;
-  guint bufsize;
-  guint16 result;
-
   g_return_val_if_fail (packet != NULL, FALSE);
   g_return_val_if_fail (GST_RDT_IS_DATA_TYPE (packet->type), FALSE);
 
-  bufdata = GST_BUFFER_DATA (packet->buffer);
-  bufsize = GST_BUFFER_SIZE (packet->buffer);
-
-  /* skip header bits */
-  header = packet->offset + 1;
-
-  /* read seq_no */
-  result = GST_READ_UINT16_BE (&bufdata[header]);
-
-  return result;
+  /* the seq_no is where the type of other packets is */
+  return packet->type;
 }
 
 gboolean
 gst_rdt_packet_data_peek_data (GstRDTPacket * packet, guint8 ** data,
     guint * size)
 {
-  guint header;
-  guint8 *bufdata;
-  guint bufsize;
-  gboolean length_included_flag;
-  gboolean need_reliable_flag;
-  guint8 stream_id;
-  guint8 asm_rule_number;
-
   g_return_val_if_fail (packet != NULL, FALSE);
   g_return_val_if_fail (GST_RDT_IS_DATA_TYPE (packet->type), FALSE);
 
-  bufdata = GST_BUFFER_DATA (packet->buffer);
-  bufsize = GST_BUFFER_SIZE (packet->buffer);
-
-  header = packet->offset;
-
-  length_included_flag = (bufdata[header] & 0x80) == 0x80;
-  need_reliable_flag = (bufdata[header] & 0x40) == 0x40;
-  stream_id = (bufdata[header] & 0x3e) >> 1;
-
-  /* skip seq_no and header bits */
-  header += 3;
-
-  if (length_included_flag) {
-    /* skip length */
-    header += 2;
-  }
-  asm_rule_number = (bufdata[header] & 0x3f);
-
-  /* skip timestamp and asm_rule_number */
-  header += 5;
-
-  if (stream_id == 0x1f) {
-    /* skip stream_id_expansion */
-    header += 2;
-  }
-  if (need_reliable_flag) {
-    /* skip total_reliable */
-    header += 2;
-  }
-  if (asm_rule_number == 63) {
-    /* skip asm_rule_number_expansion */
-    header += 2;
-  }
-
   if (data)
-    *data = &bufdata[header];
+    *data = GST_BUFFER_DATA (packet->buffer) + packet->offset + packet->header;
   if (size)
-    *size = packet->length - (header - packet->offset);
+    *size = packet->length - packet->header;
 
   return TRUE;
 }
@@ -356,102 +411,26 @@ gst_rdt_packet_data_peek_data (GstRDTPacket * packet, guint8 ** data,
 guint16
 gst_rdt_packet_data_get_stream_id (GstRDTPacket * packet)
 {
-  guint16 result;
-  guint header;
-  gboolean length_included_flag;
-  guint8 *bufdata;
-  guint bufsize;
-
   g_return_val_if_fail (packet != NULL, 0);
   g_return_val_if_fail (GST_RDT_IS_DATA_TYPE (packet->type), 0);
 
-  bufdata = GST_BUFFER_DATA (packet->buffer);
-  bufsize = GST_BUFFER_SIZE (packet->buffer);
-
-  header = packet->offset;
-
-  length_included_flag = (bufdata[header] & 0x80) == 0x80;
-  result = (bufdata[header] & 0x3e) >> 1;
-  if (result == 31) {
-    /* skip seq_no and header bits */
-    header += 3;
-
-    if (length_included_flag) {
-      /* skip length */
-      header += 2;
-    }
-    /* skip asm_rule_number and timestamp */
-    header += 5;
-
-    /* stream_id_expansion */
-    result = GST_READ_UINT16_BE (&bufdata[header]);
-  }
-  return result;
+  return packet->stream_id;
 }
 
 guint32
 gst_rdt_packet_data_get_timestamp (GstRDTPacket * packet)
 {
-  guint32 result;
-  guint header;
-  gboolean length_included_flag;
-  guint8 *bufdata;
-  guint bufsize;
-
   g_return_val_if_fail (packet != NULL, 0);
   g_return_val_if_fail (GST_RDT_IS_DATA_TYPE (packet->type), 0);
 
-  bufdata = GST_BUFFER_DATA (packet->buffer);
-  bufsize = GST_BUFFER_SIZE (packet->buffer);
-
-  header = packet->offset;
-
-  length_included_flag = (bufdata[header] & 0x80) == 0x80;
-
-  /* skip seq_no and header bits */
-  header += 3;
-
-  if (length_included_flag) {
-    /* skip length */
-    header += 2;
-  }
-  /* skip asm_rule_number */
-  header += 1;
-
-  /* get timestamp */
-  result = GST_READ_UINT32_BE (&bufdata[header]);
-
-  return result;
+  return packet->timestamp;
 }
 
 guint8
 gst_rdt_packet_data_get_flags (GstRDTPacket * packet)
 {
-  guint8 result;
-  guint header;
-  gboolean length_included_flag;
-  guint8 *bufdata;
-  guint bufsize;
-
   g_return_val_if_fail (packet != NULL, 0);
   g_return_val_if_fail (GST_RDT_IS_DATA_TYPE (packet->type), 0);
 
-  bufdata = GST_BUFFER_DATA (packet->buffer);
-  bufsize = GST_BUFFER_SIZE (packet->buffer);
-
-  header = packet->offset;
-
-  length_included_flag = (bufdata[header] & 0x80) == 0x80;
-
-  /* skip seq_no and header bits */
-  header += 3;
-
-  if (length_included_flag) {
-    /* skip length */
-    header += 2;
-  }
-  /* get flags */
-  result = bufdata[header];
-
-  return result;
+  return packet->flags;
 }
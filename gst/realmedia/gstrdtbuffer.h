@@ -86,8 +86,44 @@ struct _GstRDTPacket
   /*< private >*/
   GstRDTType   type;         /* type of current packet */
   guint16      length;       /* length of current packet in bytes */
+
+  /* data packet header, parsed along with the type */
+  guint16      header;       /* length of the header in bytes */
+  guint16      stream_id;
+  guint8       flags;
+  guint32      timestamp;
 };
 
+typedef struct _GstRDTBuffer GstRDTBuffer;
+typedef struct _GstRDTBufferClass GstRDTBufferClass;
+
+#define GST_TYPE_RDT_BUFFER       (gst_rdt_buffer_get_type())
+#define GST_IS_RDT_BUFFER(obj)    (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RDT_BUFFER))
+#define GST_RDT_BUFFER_CAST(obj)  ((GstRDTBuffer *)(obj))
+
+/**
+ * GstRDTBuffer:
+ *
+ * The buffer made by gst_rdt_packet_to_buffer(). It carries the parsed
+ * header of its packet so that gst_rdt_buffer_get_first_packet() on it
+ * doesn't parse the header again.
+ */
+struct _GstRDTBuffer
+{
+  GstBuffer     buffer;
+
+  /*< private >*/
+  GstBuffer    *parent;
+  GstRDTPacket  packet;
+};
+
+struct _GstRDTBufferClass
+{
+  GstBufferClass buffer_class;
+};
+
+GType           gst_rdt_buffer_get_type           (void);
+
 /* validate buffers */
 gboolean        gst_rdt_buffer_validate_data      (guint8 *data, guint len);
 gboolean        gst_rdt_buffer_validate           (GstBuffer *buffer);
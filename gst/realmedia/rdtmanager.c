@@ -52,10 +52,16 @@
 
 /* #define HAVE_RTCP */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "gstrdtbuffer.h"
 #include "rdtmanager.h"
 #include "rdtjitterbuffer.h"
 
+#include <gst/gst-probes.h>
+
 GST_DEBUG_CATEGORY_STATIC (rdtmanager_debug);
 #define GST_CAT_DEFAULT (rdtmanager_debug)
 
@@ -88,7 +94,8 @@ enum
 enum
 {
   PROP_0,
-  PROP_LATENCY
+  PROP_LATENCY,
+  PROP_STATS
 };
 
 static GstStaticPadTemplate gst_rdt_manager_recv_rtp_sink_template =
@@ -217,6 +224,11 @@ struct _GstRDTManagerSession
   /* some accounting */
   guint64 num_late;
   guint64 num_duplicates;
+
+  /* the counters have a single writer each: the sink pad's streaming
+   * thread and the src pad task */
+  GstElementStats in_stats;
+  GstElementStats out_stats;
 };
 
 /* find a session with the given id */
@@ -246,7 +258,10 @@ create_session (GstRDTManager * rdtmanager, gint id)
   sess->jbuf = rdt_jitter_buffer_new ();
   sess->jbuf_lock = g_mutex_new ();
   sess->jbuf_cond = g_cond_new ();
+  /* the stats getter walks the sessions with the object lock */
+  GST_OBJECT_LOCK (rdtmanager);
   rdtmanager->sessions = g_slist_prepend (rdtmanager->sessions, sess);
+  GST_OBJECT_UNLOCK (rdtmanager);
 
   return sess;
 }
@@ -431,6 +446,8 @@ gst_rdt_manager_class_init (GstRDTManagerClass * g_class)
       g_param_spec_uint ("latency", "Buffer latency in ms",
           "Amount of ms to buffer", 0, G_MAXUINT, DEFAULT_LATENCY_MS,
           G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      gst_element_stats_param_spec ());
 
   /**
    * GstRDTManager::request-pt-map:
@@ -623,15 +640,27 @@ gst_rdt_manager_handle_data_packet (GstRDTManagerSession * session,
 
   res = GST_FLOW_OK;
 
-  seqnum = 0;
-  GST_DEBUG_OBJECT (rdtmanager,
+  seqnum = gst_rdt_packet_data_get_seq (packet);
+  GST_HOT_DEBUG_OBJECT (rdtmanager,
       "Received packet #%d at time %" GST_TIME_FORMAT, seqnum,
       GST_TIME_ARGS (timestamp));
 
   buffer = gst_rdt_packet_to_buffer (packet);
+  GST_PROBE_PACKET (rdtmanager, session->id, GST_BUFFER_SIZE (buffer));
 
   JBUF_LOCK_CHECK (session, out_flushing);
 
+  /* a packet before the last one we pushed out is still queued and pushed,
+   * the demuxer has to deal with it, but we keep track of it */
+  if (session->last_popped_seqnum != -1 &&
+      gst_rdt_buffer_compare_seqnum (seqnum,
+          session->last_popped_seqnum) >= 0) {
+    GST_DEBUG_OBJECT (rdtmanager, "Packet #%d is late, #%d was pushed",
+        seqnum, session->last_popped_seqnum);
+    session->num_late++;
+    gst_element_stats_late (&session->in_stats);
+  }
+
   /* insert the packet into the queue now, FIXME, use seqnum */
   if (!rdt_jitter_buffer_insert (session->jbuf, buffer, timestamp,
           session->clock_rate, &tail))
@@ -659,6 +688,7 @@ duplicate:
     GST_WARNING_OBJECT (rdtmanager, "Duplicate packet #%d detected, dropping",
         seqnum);
     session->num_duplicates++;
+    gst_element_stats_dropped (&session->in_stats);
     gst_buffer_unref (buffer);
     goto finished;
   }
@@ -742,18 +772,22 @@ gst_rdt_manager_chain_rdt (GstPad * pad, GstBuffer * buffer)
   guint32 ssrc;
   guint8 pt;
   gboolean more;
+  GstClockTime start;
 
   rdtmanager = GST_RDT_MANAGER (GST_PAD_PARENT (pad));
 
-  GST_DEBUG_OBJECT (rdtmanager, "got RDT packet");
+  GST_HOT_DEBUG_OBJECT (rdtmanager, "got RDT packet");
+
+  start = gst_element_stats_start ();
 
   ssrc = 0;
   pt = 0;
 
-  GST_DEBUG_OBJECT (rdtmanager, "SSRC %08x, PT %d", ssrc, pt);
+  GST_HOT_DEBUG_OBJECT (rdtmanager, "SSRC %08x, PT %d", ssrc, pt);
 
   /* find session */
   session = gst_pad_get_element_private (pad);
+  gst_element_stats_input (&session->in_stats, buffer);
 
   /* see if we have the pad */
   if (!session->active) {
@@ -782,15 +816,15 @@ gst_rdt_manager_chain_rdt (GstPad * pad, GstBuffer * buffer)
     GstRDTType type;
 
     type = gst_rdt_packet_get_type (&packet);
-    GST_DEBUG_OBJECT (rdtmanager, "Have packet of type %04x", type);
+    GST_HOT_DEBUG_OBJECT (rdtmanager, "Have packet of type %04x", type);
 
     if (GST_RDT_IS_DATA_TYPE (type)) {
-      GST_DEBUG_OBJECT (rdtmanager, "We have a data packet");
+      GST_HOT_DEBUG_OBJECT (rdtmanager, "We have a data packet");
       res = gst_rdt_manager_handle_data_packet (session, timestamp, &packet);
     } else {
       switch (type) {
         default:
-          GST_DEBUG_OBJECT (rdtmanager, "Ignoring packet");
+          GST_HOT_DEBUG_OBJECT (rdtmanager, "Ignoring packet");
           break;
       }
     }
@@ -802,6 +836,8 @@ gst_rdt_manager_chain_rdt (GstPad * pad, GstBuffer * buffer)
 
   gst_buffer_unref (buffer);
 
+  gst_element_stats_stop (&session->in_stats, start);
+
   return res;
 }
 
@@ -813,13 +849,14 @@ gst_rdt_manager_loop (GstPad * pad)
   GstRDTManagerSession *session;
   GstBuffer *buffer;
   GstFlowReturn result;
+  GstRDTPacket packet;
 
   rdtmanager = GST_RDT_MANAGER (GST_PAD_PARENT (pad));
 
   session = gst_pad_get_element_private (pad);
 
   JBUF_LOCK_CHECK (session, flushing);
-  GST_DEBUG_OBJECT (rdtmanager, "Peeking item");
+  GST_HOT_DEBUG_OBJECT (rdtmanager, "Peeking item");
   while (TRUE) {
     /* always wait if we are blocked */
     if (!session->blocked) {
@@ -838,7 +875,10 @@ gst_rdt_manager_loop (GstPad * pad)
 
   buffer = rdt_jitter_buffer_pop (session->jbuf);
 
-  GST_DEBUG_OBJECT (rdtmanager, "Got item %p", buffer);
+  GST_HOT_DEBUG_OBJECT (rdtmanager, "Got item %p", buffer);
+
+  if (gst_rdt_buffer_get_first_packet (buffer, &packet))
+    session->last_popped_seqnum = gst_rdt_packet_data_get_seq (&packet);
 
   if (session->discont) {
     GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
@@ -848,6 +888,8 @@ gst_rdt_manager_loop (GstPad * pad)
   gst_buffer_set_caps (buffer, GST_PAD_CAPS (session->recv_rtp_src));
   JBUF_UNLOCK (session);
 
+  gst_element_stats_output (&session->out_stats, buffer);
+  GST_PROBE_PUSH (rdtmanager, buffer);
   result = gst_pad_push (session->recv_rtp_src, buffer);
   if (result != GST_FLOW_OK)
     goto pause;
@@ -1076,6 +1118,25 @@ gst_rdt_manager_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_LATENCY:
       g_value_set_uint (value, src->latency);
       break;
+    case PROP_STATS:
+    {
+      GstElementStats total;
+      GSList *walk;
+
+      /* the counters are kept per session and thread, sum them up */
+      memset (&total, 0, sizeof (GstElementStats));
+      GST_OBJECT_LOCK (src);
+      for (walk = src->sessions; walk; walk = g_slist_next (walk)) {
+        GstRDTManagerSession *sess = (GstRDTManagerSession *) walk->data;
+
+        gst_element_stats_accumulate (&sess->in_stats, &total);
+        gst_element_stats_accumulate (&sess->out_stats, &total);
+      }
+      GST_OBJECT_UNLOCK (src);
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&total, "rdtmanager-stats"));
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1101,6 +1162,20 @@ gst_rdt_manager_change_state (GstElement * element, GstStateChange transition)
   rdtmanager = GST_RDT_MANAGER (element);
 
   switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+    {
+      GSList *walk;
+
+      GST_OBJECT_LOCK (rdtmanager);
+      for (walk = rdtmanager->sessions; walk; walk = g_slist_next (walk)) {
+        GstRDTManagerSession *sess = (GstRDTManagerSession *) walk->data;
+
+        gst_element_stats_reset (&sess->in_stats);
+        gst_element_stats_reset (&sess->out_stats);
+      }
+      GST_OBJECT_UNLOCK (rdtmanager);
+      break;
+    }
     default:
       break;
   }
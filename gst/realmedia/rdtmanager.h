@@ -44,6 +44,7 @@
 #define __GST_RDT_MANAGER_H__
 
 #include <gst/gst.h>
+#include <gst/gst-element-stats.h>
 
 G_BEGIN_DECLS
 
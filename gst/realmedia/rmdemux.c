@@ -31,6 +31,8 @@
 #include "rmdemux.h"
 #include "rmutils.h"
 
+#include <gst/gst-probes.h>
+
 #include <string.h>
 #include <ctype.h>
 
@@ -42,7 +44,21 @@
 
 #define MAX_FRAGS 256
 
+/* number of released superblock buffers we keep around for reuse per
+ * stream */
+#define MAX_DESCRAMBLE_POOL 4
+
+#define DEFAULT_PUSH_SUPERBLOCKS FALSE
+
+enum
+{
+  PROP_0,
+  PROP_PUSH_SUPERBLOCKS,
+  PROP_STATS
+};
+
 typedef struct _GstRMDemuxIndex GstRMDemuxIndex;
+typedef struct _GstRMDemuxBufferPool GstRMDemuxBufferPool;
 
 struct _GstRMDemuxStream
 {
@@ -80,6 +96,13 @@ struct _GstRMDemuxStream
   guint subpackets_needed;      /* subpackets needed for descrambling    */
   GPtrArray *subpackets;        /* array containing subpacket GstBuffers */
 
+  /* interleaving table for cook/atrac, maps the n-th leaf of the incoming
+   * superblock to its position in the descrambled output, precomputed once
+   * when the stream is added */
+  guint *interleave;
+  guint n_leaves;
+  GstRMDemuxBufferPool *descramble_pool;        /* superblock output buffers */
+
   /* Variables needed for fixing timestamps. */
   GstClockTime next_ts, last_ts;
   guint16 next_seq, last_seq;
@@ -136,6 +159,10 @@ static void gst_rmdemux_class_init (GstRMDemuxClass * klass);
 static void gst_rmdemux_base_init (GstRMDemuxClass * klass);
 static void gst_rmdemux_init (GstRMDemux * rmdemux);
 static void gst_rmdemux_finalize (GObject * object);
+static void gst_rmdemux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_rmdemux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 static GstStateChangeReturn gst_rmdemux_change_state (GstElement * element,
     GstStateChange transition);
 static GstFlowReturn gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer);
@@ -171,6 +198,10 @@ static void gst_rmdemux_parse_indx_data (GstRMDemux * rmdemux,
     const guint8 * data, int length);
 static void gst_rmdemux_stream_clear_cached_subpackets (GstRMDemux * rmdemux,
     GstRMDemuxStream * stream);
+static void gst_rmdemux_stream_setup_interleave (GstRMDemux * rmdemux,
+    GstRMDemuxStream * stream);
+static void gst_rmdemux_stream_free_descramble_pool (GstRMDemuxStream *
+    stream);
 static GstRMDemuxStream *gst_rmdemux_get_stream_by_id (GstRMDemux * rmdemux,
     int id);
 
@@ -226,6 +257,56 @@ gst_rmdemux_class_init (GstRMDemuxClass * klass)
       0, "Demuxer for Realmedia streams");
 
   gobject_class->finalize = gst_rmdemux_finalize;
+  gobject_class->set_property = gst_rmdemux_set_property;
+  gobject_class->get_property = gst_rmdemux_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PUSH_SUPERBLOCKS,
+      g_param_spec_boolean ("push-superblocks", "Push superblocks",
+          "Push descrambled cook/atrac audio as one buffer per superblock "
+          "instead of one buffer per packet (downstream decoder must "
+          "accept this)", DEFAULT_PUSH_SUPERBLOCKS, G_PARAM_READWRITE));
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      gst_element_stats_param_spec ());
+}
+
+static void
+gst_rmdemux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRMDemux *rmdemux = GST_RMDEMUX (object);
+
+  switch (prop_id) {
+    case PROP_PUSH_SUPERBLOCKS:
+      GST_OBJECT_LOCK (rmdemux);
+      rmdemux->push_superblocks = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (rmdemux);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rmdemux_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstRMDemux *rmdemux = GST_RMDEMUX (object);
+
+  switch (prop_id) {
+    case PROP_PUSH_SUPERBLOCKS:
+      GST_OBJECT_LOCK (rmdemux);
+      g_value_set_boolean (value, rmdemux->push_superblocks);
+      GST_OBJECT_UNLOCK (rmdemux);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value,
+          gst_element_stats_get_structure (&rmdemux->stats, "rmdemux-stats"));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static void
@@ -263,6 +344,7 @@ gst_rmdemux_init (GstRMDemux * rmdemux)
   rmdemux->first_ts = GST_CLOCK_TIME_NONE;
   rmdemux->base_ts = GST_CLOCK_TIME_NONE;
   rmdemux->need_newsegment = TRUE;
+  rmdemux->push_superblocks = DEFAULT_PUSH_SUPERBLOCKS;
 }
 
 static gboolean
@@ -702,6 +784,8 @@ gst_rmdemux_reset (GstRMDemux * rmdemux)
       gst_tag_list_free (stream->pending_tags);
     if (stream->subpackets)
       g_ptr_array_free (stream->subpackets, TRUE);
+    gst_rmdemux_stream_free_descramble_pool (stream);
+    g_free (stream->interleave);
     g_free (stream->index);
     g_free (stream);
   }
@@ -734,6 +818,7 @@ gst_rmdemux_change_state (GstElement * element, GstStateChange transition)
       rmdemux->have_pads = FALSE;
       gst_segment_init (&rmdemux->segment, GST_FORMAT_TIME);
       rmdemux->running = FALSE;
+      gst_element_stats_reset (&rmdemux->stats);
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
       break;
@@ -968,9 +1053,14 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
   const guint8 *data;
   guint16 version;
   guint avail;
+  guint resync = 0;
+  GstClockTime start;
 
   GstRMDemux *rmdemux = GST_RMDEMUX (GST_PAD_PARENT (pad));
 
+  start = gst_element_stats_start ();
+  gst_element_stats_input (&rmdemux->stats, buffer);
+
   if (rmdemux->base_ts == -1) {
     rmdemux->base_ts = GST_BUFFER_TIMESTAMP (buffer);
     GST_LOG_OBJECT (rmdemux, "base_ts %" GST_TIME_FORMAT,
@@ -979,13 +1069,13 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
 
   gst_adapter_push (rmdemux->adapter, buffer);
 
-  GST_LOG_OBJECT (rmdemux, "Chaining buffer of size %d",
+  GST_HOT_LOG_OBJECT (rmdemux, "Chaining buffer of size %d",
       GST_BUFFER_SIZE (buffer));
 
   while (TRUE) {
     avail = gst_adapter_available (rmdemux->adapter);
 
-    GST_LOG_OBJECT (rmdemux, "looping in chain, avail %u", avail);
+    GST_HOT_LOG_OBJECT (rmdemux, "looping in chain, avail %u", avail);
     switch (rmdemux->state) {
       case RMDEMUX_STATE_HEADER:
       {
@@ -1007,6 +1097,7 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
           GST_WARNING_OBJECT (rmdemux, "Bogus looking header, unprintable "
               "FOURCC");
           gst_adapter_flush (rmdemux->adapter, 4);
+          resync += 4;
 
           break;
         }
@@ -1170,7 +1261,7 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
 
         data = gst_adapter_peek (rmdemux->adapter, 2);
         version = RMDEMUX_GUINT16_GET (data);
-        GST_LOG_OBJECT (rmdemux, "Data packet with version=%d", version);
+        GST_HOT_LOG_OBJECT (rmdemux, "Data packet with version=%d", version);
 
         if (version == 0 || version == 1) {
           guint16 length;
@@ -1180,12 +1271,13 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
           data = gst_adapter_peek (rmdemux->adapter, 4);
 
           length = RMDEMUX_GUINT16_GET (data + 2);
-          GST_LOG_OBJECT (rmdemux, "Got length %d", length);
+          GST_HOT_LOG_OBJECT (rmdemux, "Got length %d", length);
 
           if (length < 4) {
             GST_LOG_OBJECT (rmdemux, "length too small, dropping");
             /* Invalid, just drop it */
             gst_adapter_flush (rmdemux->adapter, 4);
+            gst_element_stats_dropped (&rmdemux->stats);
           } else {
             GstBuffer *buffer;
 
@@ -1193,8 +1285,8 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
             if (avail < length)
               goto unlock;
 
-            GST_LOG_OBJECT (rmdemux, "we have %u available and we needed %d",
-                avail, length);
+            GST_HOT_LOG_OBJECT (rmdemux,
+                "we have %u available and we needed %d", avail, length);
 
             /* flush version and length */
             gst_adapter_flush (rmdemux->adapter, 4);
@@ -1213,7 +1305,7 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
           gst_adapter_flush (rmdemux->adapter, 2);
 
           if (rmdemux->data_offset == 0) {
-            GST_LOG_OBJECT (rmdemux,
+            GST_HOT_LOG_OBJECT (rmdemux,
                 "No further data, internal demux state EOS");
             rmdemux->state = RMDEMUX_STATE_EOS;
           } else
@@ -1231,6 +1323,9 @@ gst_rmdemux_chain (GstPad * pad, GstBuffer * buffer)
   }
 
 unlock:
+  if (resync > 0)
+    gst_element_stats_resync (&rmdemux->stats, resync);
+  gst_element_stats_stop (&rmdemux->stats, start);
   return ret;
 }
 
@@ -1392,15 +1487,14 @@ gst_rmdemux_add_stream (GstRMDemux * rmdemux, GstRMDemuxStream * stream)
       case GST_RM_AUD_ATRC:
         codec_name = "Sony ATRAC3";
         stream_caps = gst_caps_new_simple ("audio/x-vnd.sony.atrac3", NULL);
+        gst_rmdemux_stream_setup_interleave (rmdemux, stream);
         break;
 
         /* RealAudio G2 audio */
       case GST_RM_AUD_COOK:
         codec_name = "Real Audio G2 (Cook)";
         version = 8;
-        stream->needs_descrambling = TRUE;
-        stream->subpackets_needed = stream->height;
-        stream->subpackets = NULL;
+        gst_rmdemux_stream_setup_interleave (rmdemux, stream);
         break;
 
         /* RALF is lossless */
@@ -1889,15 +1983,265 @@ gst_rmdemux_stream_clear_cached_subpackets (GstRMDemux * rmdemux,
   g_ptr_array_set_size (stream->subpackets, 0);
 }
 
+/* cook and atrac use the same generic interleaver: the superblock is made of
+ * @height packets of @packet_size bytes, each split into leaves of
+ * @leaf_size bytes that are spread over the whole superblock. The position
+ * of every leaf only depends on the stream parameters, so we compute the
+ * mapping once here instead of for every leaf of every superblock. */
+static void
+gst_rmdemux_stream_setup_interleave (GstRMDemux * rmdemux,
+    GstRMDemuxStream * stream)
+{
+  guint height = stream->height;
+  guint leaf_size = stream->leaf_size;
+  guint packet_size = stream->packet_size;
+  guint leaves_per_packet, p, x;
+
+  if (height == 0 || leaf_size == 0 || packet_size < leaf_size ||
+      packet_size % leaf_size != 0) {
+    GST_WARNING_OBJECT (rmdemux, "invalid interleaver parameters: "
+        "packet_size = %u, leaf_size = %u, height = %u, not descrambling",
+        packet_size, leaf_size, height);
+    return;
+  }
+
+  leaves_per_packet = packet_size / leaf_size;
+
+  stream->n_leaves = height * leaves_per_packet;
+  stream->interleave = g_new (guint, stream->n_leaves);
+
+  for (p = 0; p < height; ++p) {
+    for (x = 0; x < leaves_per_packet; ++x) {
+      stream->interleave[p * leaves_per_packet + x] =
+          height * x + ((height + 1) / 2) * (p % 2) + (p / 2);
+    }
+  }
+
+  GST_DEBUG_OBJECT (rmdemux, "packet_size = %u, leaf_size = %u, height = %u, "
+      "%u leaves per superblock", packet_size, leaf_size, height,
+      stream->n_leaves);
+
+  stream->needs_descrambling = TRUE;
+  stream->subpackets_needed = height;
+  stream->subpackets = NULL;
+}
+
+/* The memory of superblock output buffers comes back to the pool of their
+ * stream when downstream releases them: the finalize function of the
+ * buffer puts it back in the pool instead of freeing it. The pool doesn't
+ * hold on to the buffers it handed out, so downstream gets them writable.
+ * Buffers that are out keep the pool alive after their stream is gone. */
+struct _GstRMDemuxBufferPool
+{
+  gint refcount;
+  GMutex *lock;
+  GSList *memory;               /* released blocks of size bytes */
+  guint n_memory;
+  guint size;
+  gboolean flushing;
+};
+
+typedef struct
+{
+  GstBuffer buffer;
+
+  GstRMDemuxBufferPool *pool;
+} GstRMDemuxBuffer;
+
+typedef struct
+{
+  GstBufferClass buffer_class;
+} GstRMDemuxBufferClass;
+
+static GstBufferClass *rmdemux_buffer_parent_class;
+
+static GType gst_rmdemux_buffer_get_type (void);
+
+static GstRMDemuxBufferPool *
+gst_rmdemux_buffer_pool_new (void)
+{
+  GstRMDemuxBufferPool *pool;
+
+  pool = g_new0 (GstRMDemuxBufferPool, 1);
+  pool->refcount = 1;
+  pool->lock = g_mutex_new ();
+
+  return pool;
+}
+
+static void
+gst_rmdemux_buffer_pool_unref (GstRMDemuxBufferPool * pool)
+{
+  if (!g_atomic_int_dec_and_test (&pool->refcount))
+    return;
+
+  g_mutex_free (pool->lock);
+  g_free (pool);
+}
+
+/* frees the released memory of @pool */
+static void
+gst_rmdemux_buffer_pool_clear (GstRMDemuxBufferPool * pool)
+{
+  g_slist_foreach (pool->memory, (GFunc) g_free, NULL);
+  g_slist_free (pool->memory);
+  pool->memory = NULL;
+  pool->n_memory = 0;
+}
+
+static void
+gst_rmdemux_buffer_finalize (GstRMDemuxBuffer * rmbuf)
+{
+  GstRMDemuxBufferPool *pool = rmbuf->pool;
+  GstBuffer *buf = GST_BUFFER_CAST (rmbuf);
+  gboolean recycle;
+
+  /* only when nobody replaced or resized the memory */
+  g_mutex_lock (pool->lock);
+  recycle = !pool->flushing && pool->n_memory < MAX_DESCRAMBLE_POOL &&
+      GST_BUFFER_SIZE (buf) == pool->size &&
+      GST_BUFFER_DATA (buf) == GST_BUFFER_MALLOCDATA (buf);
+  if (recycle) {
+    pool->memory = g_slist_prepend (pool->memory, GST_BUFFER_MALLOCDATA (buf));
+    pool->n_memory++;
+    /* so the parent class doesn't free it */
+    GST_BUFFER_MALLOCDATA (buf) = NULL;
+  }
+  g_mutex_unlock (pool->lock);
+
+  rmbuf->pool = NULL;
+  gst_rmdemux_buffer_pool_unref (pool);
+
+  GST_MINI_OBJECT_CLASS (rmdemux_buffer_parent_class)->finalize
+      (GST_MINI_OBJECT_CAST (rmbuf));
+}
+
+static void
+gst_rmdemux_buffer_class_init (gpointer g_class, gpointer class_data)
+{
+  GstMiniObjectClass *mini_object_class = GST_MINI_OBJECT_CLASS (g_class);
+
+  rmdemux_buffer_parent_class = g_type_class_peek_parent (g_class);
+
+  mini_object_class->finalize =
+      (GstMiniObjectFinalizeFunction) gst_rmdemux_buffer_finalize;
+}
+
+static GType
+gst_rmdemux_buffer_get_type (void)
+{
+  static GType rmdemux_buffer_type = 0;
+
+  if (G_UNLIKELY (rmdemux_buffer_type == 0)) {
+    static const GTypeInfo rmdemux_buffer_info = {
+      sizeof (GstRMDemuxBufferClass),
+      NULL, NULL,
+      gst_rmdemux_buffer_class_init,
+      NULL, NULL, sizeof (GstRMDemuxBuffer), 0, NULL,
+    };
+
+    rmdemux_buffer_type = g_type_register_static (GST_TYPE_BUFFER,
+        "GstRMDemuxBuffer", &rmdemux_buffer_info, 0);
+  }
+  return rmdemux_buffer_type;
+}
+
+/* a buffer of @size, with released memory from @pool if there is some */
+static GstBuffer *
+gst_rmdemux_buffer_pool_get (GstRMDemuxBufferPool * pool, guint size)
+{
+  GstRMDemuxBuffer *rmbuf;
+  GstBuffer *buf;
+  guint8 *memory = NULL;
+
+  g_mutex_lock (pool->lock);
+  if (size != pool->size) {
+    gst_rmdemux_buffer_pool_clear (pool);
+    pool->size = size;
+  } else if (pool->memory) {
+    memory = pool->memory->data;
+    pool->memory = g_slist_delete_link (pool->memory, pool->memory);
+    pool->n_memory--;
+  }
+  g_mutex_unlock (pool->lock);
+
+  if (memory == NULL)
+    memory = g_malloc (size);
+
+  rmbuf = (GstRMDemuxBuffer *) gst_mini_object_new (gst_rmdemux_buffer_get_type
+      ());
+  g_atomic_int_inc (&pool->refcount);
+  rmbuf->pool = pool;
+
+  buf = GST_BUFFER_CAST (rmbuf);
+  GST_BUFFER_MALLOCDATA (buf) = memory;
+  GST_BUFFER_DATA (buf) = memory;
+  GST_BUFFER_SIZE (buf) = size;
+
+  return buf;
+}
+
+static void
+gst_rmdemux_stream_free_descramble_pool (GstRMDemuxStream * stream)
+{
+  GstRMDemuxBufferPool *pool = stream->descramble_pool;
+
+  if (pool == NULL)
+    return;
+
+  /* buffers still downstream are freed when they come back */
+  g_mutex_lock (pool->lock);
+  pool->flushing = TRUE;
+  gst_rmdemux_buffer_pool_clear (pool);
+  g_mutex_unlock (pool->lock);
+
+  gst_rmdemux_buffer_pool_unref (pool);
+  stream->descramble_pool = NULL;
+}
+
+/* Gets a superblock sized output buffer. Downstream allocates it if it
+ * has an allocator, otherwise it comes from our pool, which recycles the
+ * buffers downstream released. */
+static GstFlowReturn
+gst_rmdemux_stream_get_descramble_buffer (GstRMDemuxStream * stream,
+    guint size, GstBuffer ** buf)
+{
+  GstPad *peer;
+  gboolean has_alloc = FALSE;
+
+  peer = gst_pad_get_peer (stream->pad);
+  if (peer) {
+    has_alloc = (GST_PAD_BUFFERALLOCFUNC (peer) != NULL);
+    gst_object_unref (peer);
+  }
+
+  if (has_alloc) {
+    return gst_pad_alloc_buffer_and_set_caps (stream->pad,
+        GST_BUFFER_OFFSET_NONE, size, GST_PAD_CAPS (stream->pad), buf);
+  }
+
+  if (stream->descramble_pool == NULL)
+    stream->descramble_pool = gst_rmdemux_buffer_pool_new ();
+
+  *buf = gst_rmdemux_buffer_pool_get (stream->descramble_pool, size);
+  gst_buffer_set_caps (*buf, GST_PAD_CAPS (stream->pad));
+
+  return GST_FLOW_OK;
+}
+
 static GstFlowReturn
 gst_rmdemux_descramble_cook_audio (GstRMDemux * rmdemux,
     GstRMDemuxStream * stream)
 {
-  GstFlowReturn ret;
+  GstFlowReturn ret = GST_FLOW_OK;
   GstBuffer *outbuf;
   guint packet_size = stream->packet_size;
   guint height = stream->subpackets->len;
   guint leaf_size = stream->leaf_size;
+  guint leaves_per_packet;
+  const guint *interleave;
+  guint8 *out_data;
+  gboolean push_superblocks;
   guint p, x;
 
   g_assert (stream->height == height);
@@ -1905,28 +2249,56 @@ gst_rmdemux_descramble_cook_audio (GstRMDemux * rmdemux,
   GST_LOG ("packet_size = %u, leaf_size = %u, height= %u", packet_size,
       leaf_size, height);
 
-  ret = gst_pad_alloc_buffer_and_set_caps (stream->pad,
-      GST_BUFFER_OFFSET_NONE, height * packet_size,
-      GST_PAD_CAPS (stream->pad), &outbuf);
+  for (p = 0; p < height; ++p) {
+    GstBuffer *b = g_ptr_array_index (stream->subpackets, p);
 
+    if (GST_BUFFER_SIZE (b) < packet_size) {
+      GST_WARNING_OBJECT (rmdemux, "subpacket %u too small (%u < %u), "
+          "discarding superblock", p, GST_BUFFER_SIZE (b), packet_size);
+      goto done;
+    }
+  }
+
+  ret = gst_rmdemux_stream_get_descramble_buffer (stream,
+      height * packet_size, &outbuf);
   if (ret != GST_FLOW_OK)
     goto done;
+  out_data = GST_BUFFER_DATA (outbuf);
+  interleave = stream->interleave;
+  leaves_per_packet = packet_size / leaf_size;
 
   for (p = 0; p < height; ++p) {
     GstBuffer *b = g_ptr_array_index (stream->subpackets, p);
-    guint8 *b_data = GST_BUFFER_DATA (b);
+    const guint8 *b_data = GST_BUFFER_DATA (b);
 
     if (p == 0)
       GST_BUFFER_TIMESTAMP (outbuf) = GST_BUFFER_TIMESTAMP (b);
 
-    for (x = 0; x < packet_size / leaf_size; ++x) {
-      guint idx;
-
-      idx = height * x + ((height + 1) / 2) * (p % 2) + (p / 2);
-      /* GST_LOG ("%3u => %3u", (height * p) + x, idx); */
-      memcpy (GST_BUFFER_DATA (outbuf) + leaf_size * idx, b_data, leaf_size);
+    for (x = 0; x < leaves_per_packet; ++x) {
+      memcpy (out_data + leaf_size * interleave[x], b_data, leaf_size);
       b_data += leaf_size;
     }
+    interleave += leaves_per_packet;
+  }
+  gst_element_stats_copy (&rmdemux->stats, GST_BUFFER_SIZE (outbuf));
+
+  GST_OBJECT_LOCK (rmdemux);
+  push_superblocks = rmdemux->push_superblocks;
+  GST_OBJECT_UNLOCK (rmdemux);
+
+  if (push_superblocks) {
+    GST_LOG_OBJECT (rmdemux, "pushing superblock timestamp %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (outbuf)));
+
+    if (stream->discont) {
+      GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DISCONT);
+      stream->discont = FALSE;
+    }
+
+    gst_element_stats_output (&rmdemux->stats, outbuf);
+    GST_PROBE_PUSH (rmdemux, outbuf);
+    ret = gst_pad_push (stream->pad, outbuf);
+    goto done;
   }
 
   /* some decoders, such as realaudiodec, need to be fed in packet units */
@@ -1944,6 +2316,8 @@ gst_rmdemux_descramble_cook_audio (GstRMDemux * rmdemux,
     }
 
     gst_buffer_set_caps (subbuf, GST_PAD_CAPS (stream->pad));
+    gst_element_stats_output (&rmdemux->stats, subbuf);
+    GST_PROBE_PUSH (rmdemux, subbuf);
     ret = gst_pad_push (stream->pad, subbuf);
     if (ret != GST_FLOW_OK)
       break;
@@ -1974,6 +2348,8 @@ gst_rmdemux_descramble_dnet_audio (GstRMDemux * rmdemux,
     GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
     stream->discont = FALSE;
   }
+  gst_element_stats_output (&rmdemux->stats, buf);
+  GST_PROBE_PUSH (rmdemux, buf);
   return gst_pad_push (stream->pad, buf);
 }
 
@@ -2015,6 +2391,8 @@ gst_rmdemux_descramble_mp4a_audio (GstRMDemux * rmdemux,
       GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
       stream->discont = FALSE;
     }
+    gst_element_stats_output (&rmdemux->stats, outbuf);
+    GST_PROBE_PUSH (rmdemux, outbuf);
     res = gst_pad_push (stream->pad, outbuf);
     if (res != GST_FLOW_OK)
       break;
@@ -2051,6 +2429,7 @@ gst_rmdemux_handle_scrambled_packet (GstRMDemux * rmdemux,
       ret = gst_rmdemux_descramble_dnet_audio (rmdemux, stream);
       break;
     case GST_RM_AUD_COOK:
+    case GST_RM_AUD_ATRC:
       ret = gst_rmdemux_descramble_cook_audio (rmdemux, stream);
       break;
     case GST_RM_AUD_RAAC:
@@ -2130,7 +2509,7 @@ gst_rmdemux_fix_timestamp (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
     case 0:
     case 1:
     {
-      GST_LOG_OBJECT (rmdemux, "I frame %d", frame_type);
+      GST_HOT_LOG_OBJECT (rmdemux, "I frame %d", frame_type);
       /* I frame */
       if (stream->next_ts == -1)
         stream->next_ts = timestamp;
@@ -2144,7 +2523,7 @@ gst_rmdemux_fix_timestamp (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
     }
     case 2:
     {
-      GST_LOG_OBJECT (rmdemux, "P frame");
+      GST_HOT_LOG_OBJECT (rmdemux, "P frame");
       /* P frame */
       timestamp = stream->last_ts = stream->next_ts;
       if (seq < stream->next_seq)
@@ -2157,7 +2536,7 @@ gst_rmdemux_fix_timestamp (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
     }
     case 3:
     {
-      GST_LOG_OBJECT (rmdemux, "B frame");
+      GST_HOT_LOG_OBJECT (rmdemux, "B frame");
       /* B frame */
       if (seq < stream->last_seq) {
         timestamp =
@@ -2172,7 +2551,7 @@ gst_rmdemux_fix_timestamp (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
   }
 
 done:
-  GST_LOG_OBJECT (rmdemux,
+  GST_HOT_LOG_OBJECT (rmdemux,
       "timestamp %" GST_TIME_FORMAT " -> %" GST_TIME_FORMAT, GST_TIME_ARGS (ts),
       GST_TIME_ARGS (timestamp));
 
@@ -2271,7 +2650,7 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
       size--;
     }
 
-    GST_DEBUG_OBJECT (rmdemux,
+    GST_HOT_DEBUG_OBJECT (rmdemux,
         "seq %d, subseq %d, offset %d, length %d, size %d, header %02x",
         pkg_seqnum, pkg_subseq, pkg_offset, pkg_length, size, pkg_header);
 
@@ -2284,19 +2663,19 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
       else
         fragment_size = pkg_length;
     }
-    GST_DEBUG_OBJECT (rmdemux, "fragment size %d", fragment_size);
+    GST_HOT_DEBUG_OBJECT (rmdemux, "fragment size %d", fragment_size);
 
     /* get the fragment */
     fragment = gst_buffer_create_sub (in, data - base, fragment_size);
 
     if (pkg_subseq == 1) {
-      GST_DEBUG_OBJECT (rmdemux, "start new fragment");
+      GST_HOT_DEBUG_OBJECT (rmdemux, "start new fragment");
       gst_adapter_clear (stream->adapter);
       stream->frag_current = 0;
       stream->frag_count = 0;
       stream->frag_length = pkg_length;
     } else if (pkg_subseq == 0) {
-      GST_DEBUG_OBJECT (rmdemux, "non fragmented packet");
+      GST_HOT_DEBUG_OBJECT (rmdemux, "non fragmented packet");
       stream->frag_current = 0;
       stream->frag_count = 0;
       stream->frag_length = fragment_size;
@@ -2311,7 +2690,7 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
     if (stream->frag_count > MAX_FRAGS)
       goto too_many_fragments;
 
-    GST_DEBUG_OBJECT (rmdemux, "stored fragment in adapter %d/%d",
+    GST_HOT_DEBUG_OBJECT (rmdemux, "stored fragment in adapter %d/%d",
         stream->frag_current, stream->frag_length);
 
     /* flush fragment when complete */
@@ -2333,7 +2712,7 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
        */
       header_size = 1 + (8 * (stream->frag_count));
 
-      GST_DEBUG_OBJECT (rmdemux,
+      GST_HOT_DEBUG_OBJECT (rmdemux,
           "fragmented completed. count %d, header_size %u", stream->frag_count,
           header_size);
 
@@ -2354,6 +2733,7 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
       /* copy packet data after the header now */
       gst_adapter_copy (stream->adapter, outdata, 0, avail);
       gst_adapter_flush (stream->adapter, avail);
+      gst_element_stats_copy (&rmdemux->stats, avail);
 
       stream->frag_current = 0;
       stream->frag_count = 0;
@@ -2375,7 +2755,7 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
 
       GST_BUFFER_TIMESTAMP (out) = timestamp;
 
-      GST_LOG_OBJECT (rmdemux, "pushing timestamp %" GST_TIME_FORMAT,
+      GST_HOT_LOG_OBJECT (rmdemux, "pushing timestamp %" GST_TIME_FORMAT,
           GST_TIME_ARGS (timestamp));
 
       if (stream->discont) {
@@ -2383,6 +2763,8 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
         stream->discont = FALSE;
       }
 
+      gst_element_stats_output (&rmdemux->stats, out);
+      GST_PROBE_PUSH (rmdemux, out);
       ret = gst_pad_push (stream->pad, out);
       ret = gst_rmdemux_combine_flows (rmdemux, stream, ret);
       if (ret != GST_FLOW_OK)
@@ -2393,7 +2775,7 @@ gst_rmdemux_parse_video_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
     data += fragment_size;
     size -= fragment_size;
   }
-  GST_DEBUG_OBJECT (rmdemux, "%d bytes left", size);
+  GST_HOT_DEBUG_OBJECT (rmdemux, "%d bytes left", size);
 
   gst_buffer_unref (in);
 
@@ -2438,6 +2820,7 @@ gst_rmdemux_parse_audio_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
     goto alloc_failed;
 
   memcpy (GST_BUFFER_DATA (buffer), (guint8 *) data, size);
+  gst_element_stats_copy (&rmdemux->stats, size);
 
   if (rmdemux->first_ts != -1 && timestamp > rmdemux->first_ts)
     timestamp -= rmdemux->first_ts;
@@ -2450,11 +2833,11 @@ gst_rmdemux_parse_audio_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
   GST_BUFFER_TIMESTAMP (buffer) = timestamp;
 
   if (stream->needs_descrambling) {
-    GST_LOG_OBJECT (rmdemux, "descramble timestamp %" GST_TIME_FORMAT,
+    GST_HOT_LOG_OBJECT (rmdemux, "descramble timestamp %" GST_TIME_FORMAT,
         GST_TIME_ARGS (timestamp));
     ret = gst_rmdemux_handle_scrambled_packet (rmdemux, stream, buffer, key);
   } else {
-    GST_LOG_OBJECT (rmdemux,
+    GST_HOT_LOG_OBJECT (rmdemux,
         "Pushing buffer of size %d, timestamp %" GST_TIME_FORMAT "to pad %s",
         GST_BUFFER_SIZE (buffer), GST_TIME_ARGS (timestamp),
         GST_PAD_NAME (stream->pad));
@@ -2463,6 +2846,8 @@ gst_rmdemux_parse_audio_packet (GstRMDemux * rmdemux, GstRMDemuxStream * stream,
       GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
       stream->discont = FALSE;
     }
+    gst_element_stats_output (&rmdemux->stats, buffer);
+    GST_PROBE_PUSH (rmdemux, buffer);
     ret = gst_pad_push (stream->pad, buffer);
   }
   return ret;
@@ -2504,9 +2889,10 @@ gst_rmdemux_parse_packet (GstRMDemux * rmdemux, GstBuffer * in, guint16 version)
 
   gst_segment_set_last_stop (&rmdemux->segment, GST_FORMAT_TIME, timestamp);
 
-  GST_LOG_OBJECT (rmdemux, "Parsing a packet for stream=%d, timestamp=%"
+  GST_HOT_LOG_OBJECT (rmdemux, "Parsing a packet for stream=%d, timestamp=%"
       GST_TIME_FORMAT ", size %u, version=%d, ts=%u", id,
       GST_TIME_ARGS (timestamp), size, version, ts);
+  GST_PROBE_PACKET (rmdemux, id, size);
 
   if (rmdemux->first_ts == GST_CLOCK_TIME_NONE) {
     GST_DEBUG_OBJECT (rmdemux, "First timestamp: %" GST_TIME_FORMAT,
@@ -2530,7 +2916,7 @@ gst_rmdemux_parse_packet (GstRMDemux * rmdemux, GstBuffer * in, guint16 version)
     size -= 1;
   }
   key = (flags & 0x02) != 0;
-  GST_DEBUG_OBJECT (rmdemux, "flags %d, Keyframe %d", flags, key);
+  GST_HOT_DEBUG_OBJECT (rmdemux, "flags %d, Keyframe %d", flags, key);
 
   if (rmdemux->need_newsegment) {
     GstEvent *event;
@@ -2583,6 +2969,7 @@ unknown_stream:
   {
     GST_WARNING_OBJECT (rmdemux, "No stream for stream id %d in parsing "
         "data packet", id);
+    gst_element_stats_dropped (&rmdemux->stats);
     return GST_FLOW_OK;
   }
 }
@@ -23,6 +23,7 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
+#include <gst/gst-element-stats.h>
 
 G_BEGIN_DECLS
 
@@ -122,6 +123,10 @@ struct _GstRMDemux {
   guint32 object_id;
   guint32 size;
   guint16 object_version;
+
+  /* properties */
+  gboolean push_superblocks;
+  GstElementStats stats;
 };
 
 struct _GstRMDemuxClass {
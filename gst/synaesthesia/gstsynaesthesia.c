@@ -394,8 +394,7 @@ gst_synaesthesia_chain (GstPad * pad, GstBuffer * buffer)
         (const guint16 *) gst_adapter_peek (synaesthesia->adapter,
         bytesperread);
     GstBuffer *outbuf;
-    guchar *out_frame;
-    guint i;
+    guint i, size;
 
     /* deinterleave */
     for (i = 0; i < FFT_BUFFER_SIZE; i++) {
@@ -403,22 +402,35 @@ gst_synaesthesia_chain (GstPad * pad, GstBuffer * buffer)
       synaesthesia->datain[1][i] = *data++;
     }
 
+    size = synaesthesia->width * synaesthesia->height * 4;
     ret =
         gst_pad_alloc_buffer_and_set_caps (synaesthesia->srcpad,
-        GST_BUFFER_OFFSET_NONE,
-        synaesthesia->width * synaesthesia->height * 4,
-        GST_PAD_CAPS (synaesthesia->srcpad), &outbuf);
+        GST_BUFFER_OFFSET_NONE, size, GST_PAD_CAPS (synaesthesia->srcpad),
+        &outbuf);
 
     /* no buffer allocated, we don't care why. */
     if (ret != GST_FLOW_OK)
       break;
 
+    /* we render a frame of our own size and format, so only use the
+     * downstream buffer if it is one */
+    if (GST_BUFFER_SIZE (outbuf) != size || GST_BUFFER_CAPS (outbuf) == NULL ||
+        !gst_caps_is_equal (GST_BUFFER_CAPS (outbuf),
+            GST_PAD_CAPS (synaesthesia->srcpad))) {
+      GST_DEBUG_OBJECT (synaesthesia, "downstream buffer of size %u with "
+          "caps %" GST_PTR_FORMAT " doesn't fit, using our own",
+          GST_BUFFER_SIZE (outbuf), GST_BUFFER_CAPS (outbuf));
+      gst_buffer_unref (outbuf);
+      outbuf = gst_buffer_new_and_alloc (size);
+      gst_buffer_set_caps (outbuf, GST_PAD_CAPS (synaesthesia->srcpad));
+    }
+
     GST_BUFFER_TIMESTAMP (outbuf) = synaesthesia->next_ts;
     GST_BUFFER_DURATION (outbuf) = synaesthesia->frame_duration;
 
-    out_frame = (guchar *)
-        synaesthesia_update (synaesthesia->si, synaesthesia->datain);
-    memcpy (GST_BUFFER_DATA (outbuf), out_frame, GST_BUFFER_SIZE (outbuf));
+    /* render straight into the downstream buffer */
+    synaesthesia_update (synaesthesia->si, synaesthesia->datain,
+        (guint32 *) GST_BUFFER_DATA (outbuf));
 
     ret = gst_pad_push (synaesthesia->srcpad, outbuf);
     outbuf = NULL;
@@ -37,6 +37,10 @@
 #include <string.h>
 #include <assert.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef G_OS_WIN32
 #ifndef M_PI
 #define M_PI  3.14159265358979323846
@@ -54,6 +58,10 @@
 #define brTotTargetLow 5000
 #define brTotTargetHigh 15000
 
+#if FFT_BUFFER_SIZE_LOG % 2
+#error "the radix-4 FFT needs FFT_BUFFER_SIZE to be a power of 4"
+#endif
+
 #define BOUND(x) ((x) > 255 ? 255 : (x))
 #define PEAKIFY(x) BOUND((x) - (x)*(255-(x))/255/2)
 
@@ -66,16 +74,11 @@ struct syn_instance
   unsigned int brightFactor;
 
   /* data */
-  unsigned char *output;
-  guint32 *display;
-  gint16 pcmt_l[FFT_BUFFER_SIZE];
-  gint16 pcmt_r[FFT_BUFFER_SIZE];
-  gint16 pcm_l[FFT_BUFFER_SIZE];
-  gint16 pcm_r[FFT_BUFFER_SIZE];
-  double fftout_l[FFT_BUFFER_SIZE];
-  double fftout_r[FFT_BUFFER_SIZE];
-  double corr_l[FFT_BUFFER_SIZE];
-  double corr_r[FFT_BUFFER_SIZE];
+  unsigned char *output;        /* 2 bytes per pixel, faded after drawing */
+  float fftout_l[FFT_BUFFER_SIZE];
+  float fftout_r[FFT_BUFFER_SIZE];
+  float corr_l[FFT_BUFFER_SIZE];
+  float corr_r[FFT_BUFFER_SIZE];
   int clarity[FFT_BUFFER_SIZE]; /* Surround sound */
 
   /* pre calculated values */
@@ -86,14 +89,13 @@ struct syn_instance
 
 /* Shared lookup tables for the FFT */
 static double fftmult[FFT_BUFFER_SIZE / 2 + 1];
-static double cosTable[FFT_BUFFER_SIZE];
-static double negSinTable[FFT_BUFFER_SIZE];
-static int bitReverse[FFT_BUFFER_SIZE];
+static float cosTable[FFT_BUFFER_SIZE];
+static float negSinTable[FFT_BUFFER_SIZE];
+static int digitReverse[FFT_BUFFER_SIZE];
 /* Shared lookup tables for colors */
 static int scaleDown[256];
 static guint32 colEq[256];
 
-static void synaes_fft (double *x, double *y);
 static void synaescope_coreGo (syn_instance * si);
 
 static inline void
@@ -132,60 +134,29 @@ static void
 synaescope_coreGo (syn_instance * si)
 {
   int i, j;
-  register guint32 *ptr;
-  register guint32 *end;
   long int brtot = 0;
 
-  memcpy (si->pcm_l, si->pcmt_l, sizeof (si->pcm_l));
-  memcpy (si->pcm_r, si->pcmt_r, sizeof (si->pcm_r));
-
-  for (i = 0; i < FFT_BUFFER_SIZE; i++) {
-    si->fftout_l[i] = si->pcm_l[i];
-    si->fftout_r[i] = si->pcm_r[i];
-  }
-
-  synaes_fft (si->fftout_l, si->fftout_r);
+  synaesthesia_fft (si->fftout_l, si->fftout_r);
 
   for (i = 0 + 1; i < FFT_BUFFER_SIZE; i++) {
-    double x1 = si->fftout_l[bitReverse[i]];
-    double y1 = si->fftout_r[bitReverse[i]];
-    double x2 = si->fftout_l[bitReverse[FFT_BUFFER_SIZE - i]];
-    double y2 = si->fftout_r[bitReverse[FFT_BUFFER_SIZE - i]];
-    double aa, bb;
-
-    si->corr_l[i] = sqrt (aa = (x1 + x2) * (x1 + x2) + (y1 - y2) * (y1 - y2));
-    si->corr_r[i] = sqrt (bb = (x1 - x2) * (x1 - x2) + (y1 + y2) * (y1 + y2));
+    float x1 = si->fftout_l[digitReverse[i]];
+    float y1 = si->fftout_r[digitReverse[i]];
+    float x2 = si->fftout_l[digitReverse[FFT_BUFFER_SIZE - i]];
+    float y2 = si->fftout_r[digitReverse[FFT_BUFFER_SIZE - i]];
+    float aa, bb;
+
+    si->corr_l[i] = sqrtf (aa = (x1 + x2) * (x1 + x2) + (y1 - y2) * (y1 - y2));
+    si->corr_r[i] = sqrtf (bb = (x1 - x2) * (x1 - x2) + (y1 + y2) * (y1 + y2));
     si->clarity[i] = (int) (
         ((x1 + x2) * (x1 - x2) + (y1 + y2) * (y1 - y2)) / (aa + bb) * 256);
   }
 
-  /* Asger Alstrupt's optimized 32 bit fade */
-  /* (alstrup@diku.dk) */
-  ptr = (guint32 *) si->output;
-  end = (guint32 *) (si->output + si->resx * si->resy * 2);
-  do {
-    /*Bytewize version was: *(ptr++) -= *ptr+(*ptr>>1)>>4; */
-    if (*ptr) {
-      if (*ptr & 0xf0f0f0f0) {
-        *ptr = *ptr - ((*ptr & 0xf0f0f0f0) >> 4) - ((*ptr & 0xe0e0e0e0) >> 5);
-      } else {
-        *ptr = (*ptr * 14 >> 4) & 0x0f0f0f0f;
-        /*Should be 29/32 to be consistent. Who cares. This is totally */
-        /* hacked anyway.  */
-        /*unsigned char *subptr = (unsigned char*)(ptr++); */
-        /*subptr[0] = (int)subptr[0] * 29 / 32; */
-        /*subptr[1] = (int)subptr[0] * 29 / 32; */
-        /*subptr[2] = (int)subptr[0] * 29 / 32; */
-        /*subptr[3] = (int)subptr[0] * 29 / 32; */
-      }
-    }
-    ptr++;
-  } while (ptr < end);
+  /* the fade of the previous frame was done while blitting it */
 
   for (i = 1; i < FFT_BUFFER_SIZE / 2; i++) {
     if (si->corr_l[i] > 0 || si->corr_r[i] > 0) {
       int br1, br2;
-      double fc = si->corr_l[i] + si->corr_r[i];
+      float fc = si->corr_l[i] + si->corr_r[i];
       int br = (int) (fc * i * si->brightFactor2);
       int px = (int) (si->corr_r[i] * si->resx / fc);
       int py = si->heightAdd - i / si->heightFactor;
@@ -250,61 +221,177 @@ synaescope_coreGo (syn_instance * si)
 }
 
 
-static void
-synaescope32 (syn_instance * si)
+/* Asger Alstrupt's optimized 32 bit fade */
+/* (alstrup@diku.dk) */
+static inline guint32
+fade (guint32 w)
 {
-  unsigned char *outptr;
-  int i;
+  /*Bytewize version was: *(ptr++) -= *ptr+(*ptr>>1)>>4; */
+  if (w & 0xf0f0f0f0)
+    return w - ((w & 0xf0f0f0f0) >> 4) - ((w & 0xe0e0e0e0) >> 5);
 
-  synaescope_coreGo (si);
+  /*Should be 29/32 to be consistent. Who cares. This is totally */
+  /* hacked anyway.  */
+  return (w * 14 >> 4) & 0x0f0f0f0f;
+}
+
+#ifdef __SSE2__
+/* PEAKIFY of 8 values of at most 300; x * (255 - x) / 510 is done as a
+ * multiply by 16449 / 2^23, which is exact for the range we get */
+static inline __m128i
+peakify_sse2 (__m128i x)
+{
+  __m128i v;
 
-  outptr = si->output;
-  for (i = 0; i < si->resx * si->resy; i++) {
-    si->display[i] = colEq[(outptr[0] >> 4) + (outptr[1] & 0xf0)];
-    outptr += 2;
+  x = _mm_min_epi16 (x, _mm_set1_epi16 (255));
+  v = _mm_mullo_epi16 (x, _mm_sub_epi16 (_mm_set1_epi16 (255), x));
+  v = _mm_srli_epi16 (_mm_mulhi_epu16 (v, _mm_set1_epi16 (16449)), 7);
+
+  return _mm_sub_epi16 (x, v);
+}
+
+/* Does 8 pixels at a time, returns how many pixels it did. The colours are
+ * computed instead of looked up in colEq, the fade is the same as fade() but
+ * without branches */
+static guint
+blit_fade_sse2 (unsigned char *output, guint32 * display, guint pixels)
+{
+  const __m128i nib = _mm_set1_epi16 (0x000f);
+  guint i;
+
+  for (i = 0; i + 8 <= pixels; i += 8) {
+    __m128i v, lo, hi, r, g, b, gb, mask, f1, f2;
+
+    v = _mm_loadu_si128 ((__m128i *) (output + i * 2));
+
+    /* colour: lo is output[0] >> 4, hi is output[1] >> 4 */
+    lo = _mm_and_si128 (_mm_srli_epi16 (v, 4), nib);
+    hi = _mm_srli_epi16 (v, 12);
+    r = peakify_sse2 (_mm_slli_epi16 (hi, 4));
+    b = peakify_sse2 (_mm_slli_epi16 (lo, 4));
+    g = peakify_sse2 (_mm_add_epi16 (_mm_slli_epi16 (lo, 4),
+            _mm_slli_epi16 (hi, 2)));
+    gb = _mm_or_si128 (b, _mm_slli_epi16 (g, 8));
+    _mm_storeu_si128 ((__m128i *) (display + i), _mm_unpacklo_epi16 (gb, r));
+    _mm_storeu_si128 ((__m128i *) (display + i + 4),
+        _mm_unpackhi_epi16 (gb, r));
+
+    /* fade, per 32 bit word: b - (b >> 4) - (b >> 5) if any byte has bits
+     * in the high nibble, else b * 14 >> 4, which is b - ((b + 7) >> 3) */
+    mask = _mm_cmpeq_epi32 (_mm_and_si128 (v, _mm_set1_epi8 (0xf0)),
+        _mm_setzero_si128 ());
+    f1 = _mm_sub_epi8 (v, _mm_and_si128 (_mm_srli_epi16 (v, 4),
+            _mm_set1_epi8 (0x0f)));
+    f1 = _mm_sub_epi8 (f1, _mm_and_si128 (_mm_srli_epi16 (v, 5),
+            _mm_set1_epi8 (0x07)));
+    f2 = _mm_add_epi8 (v, _mm_set1_epi8 (7));
+    f2 = _mm_sub_epi8 (v, _mm_and_si128 (_mm_srli_epi16 (f2, 3),
+            _mm_set1_epi8 (0x1f)));
+    v = _mm_or_si128 (_mm_and_si128 (mask, f2), _mm_andnot_si128 (mask, f1));
+    _mm_storeu_si128 ((__m128i *) (output + i * 2), v);
   }
+
+  return i;
 }
+#endif
+
+/* Converts the frame in output to xRGB in display and fades it for the next
+ * frame in the same pass. The SIMD version is only used with simd set */
+void
+synaesthesia_blit_fade (unsigned char *output, guint32 * display,
+    guint pixels, gboolean simd)
+{
+  unsigned char *outptr;
+  guint i = 0;
+
+#ifdef __SSE2__
+  if (simd)
+    i = blit_fade_sse2 (output, display, pixels);
+#endif
+
+  outptr = output + i * 2;
+  for (; i + 2 <= pixels; i += 2) {
+    guint32 w;
+
+    display[i] = colEq[(outptr[0] >> 4) + (outptr[1] & 0xf0)];
+    display[i + 1] = colEq[(outptr[2] >> 4) + (outptr[3] & 0xf0)];
+
+    memcpy (&w, outptr, 4);
+    w = fade (w);
+    memcpy (outptr, &w, 4);
+
+    outptr += 4;
+  }
+  if (i < pixels) {
+    guint32 w = 0;
+
+    display[i] = colEq[(outptr[0] >> 4) + (outptr[1] & 0xf0)];
 
+    memcpy (&w, outptr, 2);
+    w = fade (w);
+    memcpy (outptr, &w, 2);
+  }
+}
 
 static int
-bitReverser (int i)
+digitReverser (int i)
 {
   int sum = 0;
   int j;
 
-  for (j = 0; j < FFT_BUFFER_SIZE_LOG; j++) {
-    sum = (i & 1) + sum * 2;
-    i >>= 1;
+  for (j = 0; j < FFT_BUFFER_SIZE_LOG; j += 2) {
+    sum = (i & 3) + sum * 4;
+    i >>= 2;
   }
 
   return sum;
 }
 
-static void
-synaes_fft (double *x, double *y)
+/* Radix-4 decimation in frequency FFT, the result is in base 4 digit
+ * reversed order */
+void
+synaesthesia_fft (float *x, float *y)
 {
-  int n2 = FFT_BUFFER_SIZE;
-  int n1;
-  int twoToTheK;
+  int n, q, stride;
   int j;
 
-  for (twoToTheK = 1; twoToTheK < FFT_BUFFER_SIZE; twoToTheK *= 2) {
-    n1 = n2;
-    n2 /= 2;
-    for (j = 0; j < n2; j++) {
-      double c = cosTable[j * twoToTheK & (FFT_BUFFER_SIZE - 1)];
-      double s = negSinTable[j * twoToTheK & (FFT_BUFFER_SIZE - 1)];
+  for (n = FFT_BUFFER_SIZE, stride = 1; n > 1; n /= 4, stride *= 4) {
+    q = n / 4;
+    for (j = 0; j < q; j++) {
+      float c1 = cosTable[j * stride];
+      float s1 = negSinTable[j * stride];
+      float c2 = cosTable[2 * j * stride];
+      float s2 = negSinTable[2 * j * stride];
+      float c3 = cosTable[3 * j * stride];
+      float s3 = negSinTable[3 * j * stride];
       int i;
 
-      for (i = j; i < FFT_BUFFER_SIZE; i += n1) {
-        int l = i + n2;
-        double xt = x[i] - x[l];
-        double yt = y[i] - y[l];
-
-        x[i] = (x[i] + x[l]);
-        y[i] = (y[i] + y[l]);
-        x[l] = xt * c - yt * s;
-        y[l] = xt * s + yt * c;
+      for (i = j; i < FFT_BUFFER_SIZE; i += n) {
+        int i1 = i + q, i2 = i + 2 * q, i3 = i + 3 * q;
+        float t0r = x[i] + x[i2], t0i = y[i] + y[i2];
+        float t1r = x[i] - x[i2], t1i = y[i] - y[i2];
+        float t2r = x[i1] + x[i3], t2i = y[i1] + y[i3];
+        /* (x[i1] - x[i3]) * -i */
+        float t3r = y[i1] - y[i3], t3i = x[i3] - x[i1];
+        float ur, ui;
+
+        x[i] = t0r + t2r;
+        y[i] = t0i + t2i;
+
+        ur = t1r + t3r;
+        ui = t1i + t3i;
+        x[i1] = ur * c1 - ui * s1;
+        y[i1] = ur * s1 + ui * c1;
+
+        ur = t0r - t2r;
+        ui = t0i - t2i;
+        x[i2] = ur * c2 - ui * s2;
+        y[i2] = ur * s2 + ui * c2;
+
+        ur = t1r - t3r;
+        ui = t1i - t3i;
+        x[i3] = ur * c3 - ui * s3;
+        y[i3] = ur * s3 + ui * c3;
       }
     }
   }
@@ -314,22 +401,22 @@ static void
 synaescope_set_data (syn_instance * si, gint16 data[2][FFT_BUFFER_SIZE])
 {
   int i;
-  gint16 *newset_l = si->pcmt_l;
-  gint16 *newset_r = si->pcmt_r;
 
   for (i = 0; i < FFT_BUFFER_SIZE; i++) {
-    newset_l[i] = data[0][i];
-    newset_r[i] = data[1][i];
+    si->fftout_l[i] = data[0][i];
+    si->fftout_r[i] = data[1][i];
   }
 }
 
-
-guint32 *
-synaesthesia_update (syn_instance * si, gint16 data[2][FFT_BUFFER_SIZE])
+/* Renders the next frame into display, which has room for resx * resy
+ * xRGB pixels */
+void
+synaesthesia_update (syn_instance * si, gint16 data[2][FFT_BUFFER_SIZE],
+    guint32 * display)
 {
   synaescope_set_data (si, data);
-  synaescope32 (si);
-  return si->display;
+  synaescope_coreGo (si);
+  synaesthesia_blit_fade (si->output, display, si->resx * si->resy, TRUE);
 }
 
 void
@@ -341,7 +428,7 @@ synaesthesia_init ()
   if (inited)
     return;
 
-  for (i = 0; i <= FFT_BUFFER_SIZE / 2 + 1; i++) {
+  for (i = 0; i < FFT_BUFFER_SIZE / 2 + 1; i++) {
     double mult = (double) 128 / ((FFT_BUFFER_SIZE * 16384) ^ 2);
 
     /* Result now guaranteed (well, almost) to be in range 0..128 */
@@ -358,7 +445,7 @@ synaesthesia_init ()
   for (i = 0; i < FFT_BUFFER_SIZE; i++) {
     negSinTable[i] = -sin (M_PI * 2 / FFT_BUFFER_SIZE * i);
     cosTable[i] = cos (M_PI * 2 / FFT_BUFFER_SIZE * i);
-    bitReverse[i] = bitReverser (i);
+    digitReverse[i] = digitReverser (i);
   }
 
   for (i = 0; i < 256; i++)
@@ -379,25 +466,21 @@ gboolean
 synaesthesia_resize (syn_instance * si, guint resx, guint resy)
 {
   unsigned char *output = NULL;
-  guint32 *display = NULL;
   double actualHeight;
 
   /* FIXME: FFT_BUFFER_SIZE is reated to resy, right now we get black borders on
    * top and below
    */
 
-  output = g_try_new (unsigned char, 2 * resx * resy);
-  display = g_try_new (guint32, resx * resy);
-  if (!output || !display)
-    goto Error;
+  output = g_try_new0 (unsigned char, 2 * resx * resy);
+  if (!output)
+    return FALSE;
 
   g_free (si->output);
-  g_free (si->display);
 
   si->resx = resx;
   si->resy = resy;
   si->output = output;
-  si->display = display;
 
   /* factors for height scaling
    * the bigger FFT_BUFFER_SIZE, the more finegrained steps we have
@@ -417,11 +500,6 @@ synaesthesia_resize (syn_instance * si, guint resx, guint resy)
       sqrt (actualHeight * si->resx / (320.0 * 200.0));
 
   return TRUE;
-
-Error:
-  g_free (output);
-  g_free (display);
-  return FALSE;
 }
 
 syn_instance *
@@ -450,7 +528,6 @@ synaesthesia_close (syn_instance * si)
   g_return_if_fail (si != NULL);
 
   g_free (si->output);
-  g_free (si->display);
 
   g_free (si);
 }
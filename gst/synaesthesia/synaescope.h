@@ -36,7 +36,13 @@ syn_instance *synaesthesia_new (guint resx, guint resy);
 void synaesthesia_close (syn_instance * si);
 
 gboolean synaesthesia_resize (syn_instance * si, guint resx, guint resy);
-guint32 *synaesthesia_update (syn_instance * si,
-    gint16 data[2][FFT_BUFFER_SIZE]);
+void synaesthesia_update (syn_instance * si,
+    gint16 data[2][FFT_BUFFER_SIZE], guint32 * display);
+
+/* the kernels, for the unit test; synaesthesia_init() must have been
+ * called */
+void synaesthesia_fft (float *x, float *y);
+void synaesthesia_blit_fade (unsigned char *output, guint32 * display,
+    guint pixels, gboolean simd);
 
 #endif
@@ -0,0 +1,202 @@
+/* GStreamer
+ *
+ * unit test for the RDT packet parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+
+#include "gstrdtbuffer.h"
+
+static GstBuffer *
+make_buffer (const guint8 * data, guint size)
+{
+  GstBuffer *buf;
+
+  /* exactly @size, so reading past the end shows up in valgrind */
+  buf = gst_buffer_new_and_alloc (size);
+  memcpy (GST_BUFFER_DATA (buf), data, size);
+
+  return buf;
+}
+
+static void
+check_data_packet (GstRDTPacket * packet, guint16 seq, guint16 stream_id,
+    guint8 flags, guint32 timestamp, guint payload_size)
+{
+  guint8 *data;
+  guint size;
+
+  fail_unless_equals_int (gst_rdt_packet_data_get_seq (packet), seq);
+  fail_unless_equals_int (gst_rdt_packet_data_get_stream_id (packet),
+      stream_id);
+  fail_unless_equals_int (gst_rdt_packet_data_get_flags (packet), flags);
+  fail_unless (gst_rdt_packet_data_get_timestamp (packet) == timestamp);
+  fail_unless (gst_rdt_packet_data_peek_data (packet, &data, &size));
+  fail_unless_equals_int (size, payload_size);
+}
+
+GST_START_TEST (test_data_packet)
+{
+  /* stream 3, seq 5, flags 0x02, timestamp 0x12345678, 4 bytes payload */
+  static const guint8 packet_data[] = {
+    0x06, 0x00, 0x05, 0x02, 0x12, 0x34, 0x56, 0x78, 1, 2, 3, 4
+  };
+  GstRDTPacket packet;
+  GstBuffer *buf;
+  guint8 *data;
+
+  buf = make_buffer (packet_data, sizeof (packet_data));
+  fail_unless (gst_rdt_buffer_get_first_packet (buf, &packet));
+  fail_unless_equals_int (gst_rdt_packet_get_length (&packet),
+      sizeof (packet_data));
+  check_data_packet (&packet, 5, 3, 0x02, 0x12345678, 4);
+  fail_unless (gst_rdt_packet_data_peek_data (&packet, &data, NULL));
+  fail_unless (data == GST_BUFFER_DATA (buf) + 8);
+  fail_if (gst_rdt_packet_move_to_next (&packet));
+  gst_buffer_unref (buf);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_stream_id_expansion)
+{
+  /* stream id 31 says the real one follows the timestamp */
+  static const guint8 packet_data[] = {
+    0x3e, 0x00, 0x09, 0x00, 0x00, 0x00, 0x10, 0x00, 0x01, 0x23, 1, 2
+  };
+  static const guint8 truncated[] = {
+    0x3e, 0x00, 0x09, 0x00, 0x00, 0x00, 0x10, 0x00, 0x01
+  };
+  GstRDTPacket packet;
+  GstBuffer *buf;
+
+  buf = make_buffer (packet_data, sizeof (packet_data));
+  fail_unless (gst_rdt_buffer_get_first_packet (buf, &packet));
+  check_data_packet (&packet, 9, 0x123, 0x00, 0x1000, 2);
+  gst_buffer_unref (buf);
+
+  /* the expansion doesn't fit */
+  buf = make_buffer (truncated, sizeof (truncated));
+  fail_if (gst_rdt_buffer_get_first_packet (buf, &packet));
+  gst_buffer_unref (buf);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_packets_with_length)
+{
+  /* two packets of 12 bytes that have their length included */
+  static const guint8 packet_data[] = {
+    0x82, 0x00, 0x07, 0x00, 0x0c, 0x01, 0x00, 0x00, 0x00, 0x20, 1, 2,
+    0x82, 0x00, 0x08, 0x00, 0x0c, 0x01, 0x00, 0x00, 0x00, 0x40, 3, 4
+  };
+  GstRDTPacket packet, cached;
+  GstBuffer *buf, *sub;
+
+  buf = make_buffer (packet_data, sizeof (packet_data));
+  fail_unless_equals_int (gst_rdt_buffer_get_packet_count (buf), 2);
+
+  fail_unless (gst_rdt_buffer_get_first_packet (buf, &packet));
+  fail_unless_equals_int (gst_rdt_packet_get_length (&packet), 12);
+  check_data_packet (&packet, 7, 1, 0x01, 0x20, 2);
+
+  fail_unless (gst_rdt_packet_move_to_next (&packet));
+  check_data_packet (&packet, 8, 1, 0x01, 0x40, 2);
+
+  /* the buffer of a packet carries its parsed header along */
+  sub = gst_rdt_packet_to_buffer (&packet);
+  fail_unless (GST_IS_RDT_BUFFER (sub));
+  fail_unless_equals_int (GST_BUFFER_SIZE (sub), 12);
+  fail_unless (gst_rdt_buffer_get_first_packet (sub, &cached));
+  fail_unless (cached.buffer == sub);
+  fail_unless_equals_int (cached.offset, 0);
+  check_data_packet (&cached, 8, 1, 0x01, 0x40, 2);
+  gst_buffer_unref (sub);
+
+  fail_if (gst_rdt_packet_move_to_next (&packet));
+  gst_buffer_unref (buf);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_truncated)
+{
+  /* the length flag is set, but the length is cut off */
+  static const guint8 no_length[] = { 0x80, 0x00, 0x01, 0x00 };
+  /* the length is larger than the buffer */
+  static const guint8 short_packet[] = {
+    0x80, 0x00, 0x01, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00
+  };
+  /* the header ends in the timestamp */
+  static const guint8 short_header[] = { 0x00, 0x00, 0x01, 0x00, 0x00 };
+  GstRDTPacket packet;
+  GstBuffer *buf;
+
+  buf = make_buffer (no_length, 3);
+  fail_if (gst_rdt_buffer_get_first_packet (buf, &packet));
+  gst_buffer_unref (buf);
+
+  buf = make_buffer (no_length, sizeof (no_length));
+  fail_if (gst_rdt_buffer_get_first_packet (buf, &packet));
+  gst_buffer_unref (buf);
+
+  buf = make_buffer (short_packet, sizeof (short_packet));
+  fail_if (gst_rdt_buffer_get_first_packet (buf, &packet));
+  fail_unless_equals_int (gst_rdt_buffer_get_packet_count (buf), 0);
+  gst_buffer_unref (buf);
+
+  buf = make_buffer (short_header, sizeof (short_header));
+  fail_if (gst_rdt_buffer_get_first_packet (buf, &packet));
+  gst_buffer_unref (buf);
+}
+
+GST_END_TEST;
+
+static Suite *
+rdtbuffer_suite (void)
+{
+  Suite *s = suite_create ("rdtbuffer");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_data_packet);
+  tcase_add_test (tc_chain, test_stream_id_expansion);
+  tcase_add_test (tc_chain, test_packets_with_length);
+  tcase_add_test (tc_chain, test_truncated);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int nf;
+
+  Suite *s = rdtbuffer_suite ();
+  SRunner *sr = srunner_create (s);
+
+  gst_check_init (&argc, &argv);
+
+  srunner_run_all (sr, CK_NORMAL);
+  nf = srunner_ntests_failed (sr);
+  srunner_free (sr);
+
+  return nf;
+}
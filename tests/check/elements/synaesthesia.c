@@ -0,0 +1,406 @@
+/* GStreamer
+ *
+ * unit test for synaesthesia
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <gst/check/gstcheck.h>
+
+#include "synaescope.h"
+
+#define RATE 44100
+#define FPS 60
+#define FRAMES 30
+
+GstPad *srcpad, *sinkpad;
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw-rgb")
+    );
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw-int")
+    );
+
+static GstElement *
+setup_synaesthesia (gint width, gint height)
+{
+  GstElement *synaesthesia;
+  GstPad *pad;
+  GstCaps *caps;
+
+  GST_DEBUG ("setup_synaesthesia");
+
+  synaesthesia = gst_check_setup_element ("synaesthesia");
+
+  /* the sink pad accepts the element's format at the given size only */
+  pad = gst_element_get_static_pad (synaesthesia, "src");
+  caps = gst_caps_copy (gst_pad_get_pad_template_caps (pad));
+  gst_object_unref (pad);
+  gst_caps_set_simple (caps, "width", G_TYPE_INT, width,
+      "height", G_TYPE_INT, height,
+      "framerate", GST_TYPE_FRACTION, FPS, 1, NULL);
+
+  srcpad = gst_check_setup_src_pad (synaesthesia, &srctemplate, NULL);
+  sinkpad = gst_check_setup_sink_pad (synaesthesia, &sinktemplate, caps);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_pad_set_active (sinkpad, TRUE);
+  gst_caps_unref (caps);
+
+  fail_unless (gst_element_set_state (synaesthesia,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE,
+      "could not set to playing");
+
+  return synaesthesia;
+}
+
+static void
+cleanup_synaesthesia (GstElement * synaesthesia)
+{
+  g_list_foreach (buffers, (GFunc) gst_mini_object_unref, NULL);
+  g_list_free (buffers);
+  buffers = NULL;
+
+  GST_DEBUG ("cleanup_synaesthesia");
+  gst_element_set_state (synaesthesia, GST_STATE_NULL);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_check_teardown_src_pad (synaesthesia);
+  gst_check_teardown_sink_pad (synaesthesia);
+  gst_check_teardown_element (synaesthesia);
+}
+
+/* stereo audio with some movement in it, enough for FRAMES frames */
+static GstBuffer *
+make_audio (void)
+{
+  GstBuffer *buffer;
+  GstCaps *caps;
+  gint16 *data;
+  guint samples, i;
+
+  samples = FRAMES * RATE / FPS + 1024;
+  buffer = gst_buffer_new_and_alloc (samples * 2 * sizeof (gint16));
+  data = (gint16 *) GST_BUFFER_DATA (buffer);
+
+  for (i = 0; i < samples; i++) {
+    data[2 * i] = (gint16) g_random_int_range (-16000, 16000);
+    data[2 * i + 1] = (gint16) ((i * 523) % 32000) - 16000;
+  }
+
+  caps = gst_caps_new_simple ("audio/x-raw-int",
+      "rate", G_TYPE_INT, RATE,
+      "channels", G_TYPE_INT, 2,
+      "endianness", G_TYPE_INT, G_BYTE_ORDER,
+      "width", G_TYPE_INT, 16,
+      "depth", G_TYPE_INT, 16, "signed", G_TYPE_BOOLEAN, TRUE, NULL);
+  gst_buffer_set_caps (buffer, caps);
+  gst_caps_unref (caps);
+
+  GST_BUFFER_TIMESTAMP (buffer) = 0;
+
+  return buffer;
+}
+
+/* downstream hands out buffers that are too small */
+static GstFlowReturn
+small_alloc (GstPad * pad, guint64 offset, guint size, GstCaps * caps,
+    GstBuffer ** buf)
+{
+  *buf = gst_buffer_new_and_alloc (size / 2);
+  gst_buffer_set_caps (*buf, caps);
+
+  return GST_FLOW_OK;
+}
+
+/* renders FRAMES frames at the given size */
+static void
+run_render (gint width, gint height)
+{
+  GstElement *synaesthesia;
+  guint frames;
+
+  synaesthesia = setup_synaesthesia (width, height);
+  fail_unless (gst_pad_push (srcpad, make_audio ()) == GST_FLOW_OK);
+
+  frames = g_list_length (buffers);
+  fail_unless (frames >= FRAMES, "got %u frames, wanted %u", frames, FRAMES);
+  fail_unless_equals_int (GST_BUFFER_SIZE (buffers->data), width * height * 4);
+
+  cleanup_synaesthesia (synaesthesia);
+}
+
+GST_START_TEST (test_render)
+{
+  GstElement *synaesthesia;
+  const guint8 *data;
+  guint i, size;
+  gboolean lit = FALSE;
+
+  synaesthesia = setup_synaesthesia (320, 200);
+  fail_unless (gst_pad_push (srcpad, make_audio ()) == GST_FLOW_OK);
+  fail_unless (g_list_length (buffers) >= FRAMES);
+
+  /* something must have been drawn */
+  data = GST_BUFFER_DATA (g_list_last (buffers)->data);
+  size = GST_BUFFER_SIZE (g_list_last (buffers)->data);
+  for (i = 0; i < size && !lit; i++)
+    lit = (data[i] != 0);
+  fail_unless (lit, "nothing was drawn");
+
+  cleanup_synaesthesia (synaesthesia);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_sizes)
+{
+  run_render (64, 48);
+  run_render (320, 200);
+  run_render (322, 202);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_small_alloc)
+{
+  GstElement *synaesthesia;
+
+  synaesthesia = setup_synaesthesia (320, 200);
+  gst_pad_set_bufferalloc_function (sinkpad, small_alloc);
+
+  fail_unless (gst_pad_push (srcpad, make_audio ()) == GST_FLOW_OK);
+  fail_unless (g_list_length (buffers) >= FRAMES);
+  fail_unless_equals_int (GST_BUFFER_SIZE (buffers->data), 320 * 200 * 4);
+
+  cleanup_synaesthesia (synaesthesia);
+}
+
+GST_END_TEST;
+
+/* the kernels, against the plain versions */
+
+static gint
+digit_reverse (gint i)
+{
+  gint j, sum = 0;
+
+  for (j = 0; j < FFT_BUFFER_SIZE_LOG; j += 2) {
+    sum = sum * 4 + (i & 3);
+    i >>= 2;
+  }
+
+  return sum;
+}
+
+GST_START_TEST (test_fft)
+{
+  static gdouble cos_table[FFT_BUFFER_SIZE], sin_table[FFT_BUFFER_SIZE];
+  static gfloat x[FFT_BUFFER_SIZE], y[FFT_BUFFER_SIZE];
+  static gint16 in[2][FFT_BUFFER_SIZE];
+  gdouble err, max_err = 0.0, max_mag = 0.0;
+  gint i, j, k;
+
+  synaesthesia_init ();
+
+  for (i = 0; i < FFT_BUFFER_SIZE; i++) {
+    cos_table[i] = cos (2 * G_PI * i / FFT_BUFFER_SIZE);
+    sin_table[i] = sin (2 * G_PI * i / FFT_BUFFER_SIZE);
+    in[0][i] = (gint16) g_random_int_range (-32768, 32768);
+    in[1][i] = (gint16) g_random_int_range (-32768, 32768);
+    x[i] = in[0][i];
+    y[i] = in[1][i];
+  }
+
+  synaesthesia_fft (x, y);
+
+  /* X[k] = sum x[n] e^(-2 pi i n k / N), in digit reversed order */
+  for (k = 0; k < FFT_BUFFER_SIZE; k++) {
+    gdouble re = 0.0, im = 0.0;
+
+    for (i = 0; i < FFT_BUFFER_SIZE; i++) {
+      gint n = (i * k) % FFT_BUFFER_SIZE;
+
+      re += in[0][i] * cos_table[n] + in[1][i] * sin_table[n];
+      im += in[1][i] * cos_table[n] - in[0][i] * sin_table[n];
+    }
+
+    j = digit_reverse (k);
+    err = hypot (x[j] - re, y[j] - im);
+    max_err = MAX (max_err, err);
+    max_mag = MAX (max_mag, hypot (re, im));
+  }
+
+  GST_INFO ("largest error %g, largest bin %g", max_err, max_mag);
+  /* single against double precision */
+  fail_unless (max_err <= 1e-4 * max_mag, "FFT off by %g", max_err);
+}
+
+GST_END_TEST;
+
+/* random pixels; half of the 32 bit words only have bits in the low
+ * nibbles, the fade treats those differently */
+static void
+fill_pixels (guint8 * output, guint pixels)
+{
+  guint i;
+
+  for (i = 0; i < pixels * 2; i++) {
+    if ((i / 4) % 2)
+      output[i] = g_random_int_range (0, 16);
+    else
+      output[i] = g_random_int_range (0, 256);
+  }
+}
+
+static void
+check_blit_fade (guint pixels)
+{
+  guint8 *output_c, *output_simd;
+  guint32 *display_c, *display_simd;
+  gint pass;
+
+  output_c = g_malloc (pixels * 2);
+  output_simd = g_malloc (pixels * 2);
+  display_c = g_new (guint32, pixels);
+  display_simd = g_new (guint32, pixels);
+
+  fill_pixels (output_c, pixels);
+  memcpy (output_simd, output_c, pixels * 2);
+
+  /* a few passes, so the fade gets down to the small values */
+  for (pass = 0; pass < 8; pass++) {
+    synaesthesia_blit_fade (output_c, display_c, pixels, FALSE);
+    synaesthesia_blit_fade (output_simd, display_simd, pixels, TRUE);
+
+    fail_unless (memcmp (display_c, display_simd, pixels * 4) == 0,
+        "colours differ for %u pixels in pass %d", pixels, pass);
+    fail_unless (memcmp (output_c, output_simd, pixels * 2) == 0,
+        "fade differs for %u pixels in pass %d", pixels, pass);
+  }
+
+  g_free (output_c);
+  g_free (output_simd);
+  g_free (display_c);
+  g_free (display_simd);
+}
+
+GST_START_TEST (test_blit_fade)
+{
+  synaesthesia_init ();
+
+  /* less than, exactly and not a multiple of one SIMD block */
+  check_blit_fade (1);
+  check_blit_fade (7);
+  check_blit_fade (8);
+  check_blit_fade (21);
+  check_blit_fade (64 * 48);
+  check_blit_fade (322 * 202);
+  check_blit_fade (321 * 201);
+}
+
+GST_END_TEST;
+
+/* render time per pixel, so sizes can be compared */
+GST_START_TEST (test_benchmark)
+{
+  static const gint sizes[][2] = {
+    {64, 48}, {320, 200}, {322, 202}, {640, 480}, {1280, 720}
+  };
+  static gint16 data[2][FFT_BUFFER_SIZE];
+  syn_instance *si;
+  guint32 *display;
+  GTimer *timer;
+  gint i, j, frame;
+
+  synaesthesia_init ();
+  timer = g_timer_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    gint width = sizes[i][0], height = sizes[i][1];
+
+    si = synaesthesia_new (width, height);
+    fail_unless (si != NULL);
+    display = g_new (guint32, width * height);
+
+    g_timer_start (timer);
+    for (frame = 0; frame < FRAMES; frame++) {
+      for (j = 0; j < FFT_BUFFER_SIZE; j++) {
+        data[0][j] = (gint16) g_random_int_range (-16000, 16000);
+        data[1][j] = (gint16) (((j + frame) * 523) % 32000) - 16000;
+      }
+      synaesthesia_update (si, data, display);
+    }
+    g_timer_stop (timer);
+
+    GST_INFO ("%dx%d: %.2f ns per pixel", width, height,
+        g_timer_elapsed (timer, NULL) * 1e9 / FRAMES / (width * height));
+
+    g_free (display);
+    synaesthesia_close (si);
+  }
+
+  g_timer_destroy (timer);
+}
+
+GST_END_TEST;
+
+static Suite *
+synaesthesia_suite (void)
+{
+  Suite *s = suite_create ("synaesthesia");
+  TCase *tc_chain = tcase_create ("general");
+  TCase *tc_bench = tcase_create ("benchmark");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_render);
+  tcase_add_test (tc_chain, test_sizes);
+  tcase_add_test (tc_chain, test_small_alloc);
+  tcase_add_test (tc_chain, test_fft);
+  tcase_add_test (tc_chain, test_blit_fade);
+
+  suite_add_tcase (s, tc_bench);
+  tcase_set_timeout (tc_bench, 60);
+  tcase_add_test (tc_bench, test_benchmark);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int nf;
+
+  Suite *s = synaesthesia_suite ();
+  SRunner *sr = srunner_create (s);
+
+  gst_check_init (&argc, &argv);
+
+  srunner_run_all (sr, CK_NORMAL);
+  nf = srunner_ntests_failed (sr);
+  srunner_free (sr);
+
+  return nf;
+}
@@ -0,0 +1,656 @@
+/* GStreamer
+ *
+ * performance regression checks: copies and allocations per buffer for
+ * generated streams pushed through the demuxers, parsers and decoders
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+
+/* Buffers are counted when they are freed, by hooking the finalize function
+ * of GstBuffer; subbuffers and buffer subclasses chain up to it too.
+ * Subbuffers share the memory of their parent, so only buffers that own
+ * their memory count as copies: the input buffers don't, so any other
+ * buffer holding stream data had it copied in. Decoders write their output
+ * into fresh memory, so for them the bytes reaching the sink are taken
+ * off again. Buffers that an element recycles are only counted once, when
+ * they are finally freed. */
+static volatile gint n_buffers_freed = 0;
+static guint64 n_bytes_owned = 0;
+static GStaticMutex owned_lock = G_STATIC_MUTEX_INIT;
+static GstMiniObjectFinalizeFunction buffer_finalize = NULL;
+
+static void
+counting_buffer_finalize (GstMiniObject * obj)
+{
+  GstBuffer *buf = GST_BUFFER_CAST (obj);
+
+  g_atomic_int_inc (&n_buffers_freed);
+  if (GST_BUFFER_MALLOCDATA (buf) != NULL) {
+    g_static_mutex_lock (&owned_lock);
+    n_bytes_owned += GST_BUFFER_SIZE (buf);
+    g_static_mutex_unlock (&owned_lock);
+  }
+  buffer_finalize (obj);
+}
+
+static guint64
+get_bytes_owned (void)
+{
+  guint64 bytes;
+
+  g_static_mutex_lock (&owned_lock);
+  bytes = n_bytes_owned;
+  g_static_mutex_unlock (&owned_lock);
+
+  return bytes;
+}
+
+static void
+hook_buffer_finalize (void)
+{
+  GstMiniObjectClass *klass;
+
+  /* keep the class around, we patched it */
+  klass = GST_MINI_OBJECT_CLASS (g_type_class_ref (GST_TYPE_BUFFER));
+  buffer_finalize = klass->finalize;
+  klass->finalize = counting_buffer_finalize;
+}
+
+/* stream writers */
+
+static void
+put_u8 (GByteArray * s, guint8 val)
+{
+  g_byte_array_append (s, &val, 1);
+}
+
+static void
+put_be16 (GByteArray * s, guint16 val)
+{
+  guint8 tmp[2];
+
+  GST_WRITE_UINT16_BE (tmp, val);
+  g_byte_array_append (s, tmp, 2);
+}
+
+static void
+put_be32 (GByteArray * s, guint32 val)
+{
+  guint8 tmp[4];
+
+  GST_WRITE_UINT32_BE (tmp, val);
+  g_byte_array_append (s, tmp, 4);
+}
+
+static void
+put_le16 (GByteArray * s, guint16 val)
+{
+  guint8 tmp[2];
+
+  GST_WRITE_UINT16_LE (tmp, val);
+  g_byte_array_append (s, tmp, 2);
+}
+
+static void
+put_le32 (GByteArray * s, guint32 val)
+{
+  guint8 tmp[4];
+
+  GST_WRITE_UINT32_LE (tmp, val);
+  g_byte_array_append (s, tmp, 4);
+}
+
+static void
+put_le64 (GByteArray * s, guint64 val)
+{
+  put_le32 (s, (guint32) val);
+  put_le32 (s, (guint32) (val >> 32));
+}
+
+static void
+put_fill (GByteArray * s, guint8 val, guint len)
+{
+  guint old = s->len;
+
+  g_byte_array_set_size (s, old + len);
+  memset (s->data + old, val, len);
+}
+
+static void
+put_string8 (GByteArray * s, const gchar * str)
+{
+  put_u8 (s, strlen (str));
+  g_byte_array_append (s, (const guint8 *) str, strlen (str));
+}
+
+/* MPEG-1 layer III, 128 kbps, 44.1 kHz, stereo: silent 417 byte frames */
+#define MP3_FRAME_SIZE 417
+#define MP3_FRAMES 2000
+
+static void
+put_mp3_frame (GByteArray * s)
+{
+  put_be32 (s, 0xfffb9000);
+  put_fill (s, 0, MP3_FRAME_SIZE - 4);
+}
+
+static GByteArray *
+write_mp3 (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint i;
+
+  for (i = 0; i < MP3_FRAMES; i++)
+    put_mp3_frame (s);
+
+  return s;
+}
+
+/* AC-3, 48 kHz, 128 kbps (frmsizecod 16), 2/0: 512 byte frames */
+#define AC3_FRAME_SIZE 512
+#define AC3_FRAMES 1500
+
+static void
+put_ac3_frame (GByteArray * s)
+{
+  put_be16 (s, 0x0b77);
+  put_be16 (s, 0);              /* crc1 */
+  put_u8 (s, 0x10);             /* fscod 0, frmsizecod 16 */
+  put_u8 (s, 8 << 3);           /* bsid 8, bsmod 0 */
+  put_u8 (s, 2 << 5);           /* acmod 2 */
+  put_fill (s, 0, AC3_FRAME_SIZE - 7);
+}
+
+static GByteArray *
+write_ac3 (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint i;
+
+  for (i = 0; i < AC3_FRAMES; i++)
+    put_ac3_frame (s);
+
+  return s;
+}
+
+/* DVD LPCM, 24 bit stereo; a multiple of the 12 byte sample group */
+#define LPCM_CHUNK_SIZE 4092
+#define LPCM_CHUNKS 256
+
+static GByteArray *
+write_lpcm (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint i;
+
+  g_byte_array_set_size (s, LPCM_CHUNK_SIZE * LPCM_CHUNKS);
+  for (i = 0; i < s->len; i++)
+    s->data[i] = (guint8) (i * 7);
+
+  return s;
+}
+
+/* MPEG-1 program stream: one 2048 byte pack per MP3 frame, each holding
+ * an audio packet and a padding packet, like on a DVD */
+#define PS_PACK_SIZE 2048
+#define PS_MUX_RATE 2500        /* 125000 bytes/s in units of 50 bytes/s */
+
+static void
+put_ps_timestamp (GByteArray * s, guint8 prefix, guint64 ts)
+{
+  put_u8 (s, (prefix << 4) | ((ts >> 29) & 0x0e) | 1);
+  put_u8 (s, ts >> 22);
+  put_u8 (s, ((ts >> 14) & 0xfe) | 1);
+  put_u8 (s, ts >> 7);
+  put_u8 (s, ((ts << 1) & 0xfe) | 1);
+}
+
+static GByteArray *
+write_ps (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint i, start, pad_len;
+  guint64 scr, pts;
+
+  for (i = 0; i < MP3_FRAMES; i++) {
+    start = s->len;
+    scr = gst_util_uint64_scale (start, 90000, PS_MUX_RATE * 50);
+    pts = gst_util_uint64_scale (i, 1152 * 90000, 44100) + 45000;
+
+    put_be32 (s, 0x000001ba);
+    put_ps_timestamp (s, 0x2, scr);
+    put_u8 (s, 0x80 | (PS_MUX_RATE >> 15));
+    put_u8 (s, (PS_MUX_RATE >> 7) & 0xff);
+    put_u8 (s, ((PS_MUX_RATE & 0x7f) << 1) | 1);
+
+    put_be32 (s, 0x000001c0);
+    put_be16 (s, 5 + MP3_FRAME_SIZE);
+    put_ps_timestamp (s, 0x2, pts);
+    put_mp3_frame (s);
+
+    pad_len = PS_PACK_SIZE - (s->len - start) - 6;
+    put_be32 (s, 0x000001be);
+    put_be16 (s, pad_len);
+    put_fill (s, 0xff, pad_len);
+  }
+  put_be32 (s, 0x000001b9);
+
+  return s;
+}
+
+/* ASF with one MP3 stream, one frame per fixed size data packet */
+#define ASF_PACKET_SIZE (9 + 15 + MP3_FRAME_SIZE)
+
+static void
+put_asf_guid (GByteArray * s, guint32 v1, guint32 v2, guint32 v3, guint32 v4)
+{
+  put_le32 (s, v1);
+  put_le32 (s, v2);
+  put_le32 (s, v3);
+  put_le32 (s, v4);
+}
+
+static GByteArray *
+write_asf (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint i;
+
+  /* header object, with file properties and one stream properties object */
+  put_asf_guid (s, 0x75B22630, 0x11CF668E, 0xAA00D9A6, 0x6CCE6200);
+  put_le64 (s, 30 + 104 + 96);
+  put_le32 (s, 2);
+  put_u8 (s, 1);
+  put_u8 (s, 2);
+
+  put_asf_guid (s, 0x8CABDCA1, 0x11CFA947, 0xC000E48E, 0x6553200C);
+  put_le64 (s, 104);
+  put_fill (s, 0, 16);          /* file id */
+  put_le64 (s, 0);              /* file size */
+  put_le64 (s, 0);              /* creation time */
+  put_le64 (s, MP3_FRAMES);
+  put_le64 (s, gst_util_uint64_scale (MP3_FRAMES,
+          G_GUINT64_CONSTANT (1152) * 10000000, 44100));
+  put_le64 (s, 0);              /* send duration */
+  put_le64 (s, 0);              /* preroll */
+  put_le32 (s, 0);              /* flags */
+  put_le32 (s, ASF_PACKET_SIZE);
+  put_le32 (s, ASF_PACKET_SIZE);
+  put_le32 (s, 128000);
+
+  put_asf_guid (s, 0xB7DC0791, 0x11CFA9B7, 0xC000E68E, 0x6553200C);
+  put_le64 (s, 96);
+  put_asf_guid (s, 0xF8699E40, 0x11CF5B4D, 0x8000FDA8, 0x2B445C5F);
+  put_asf_guid (s, 0x20FB5700, 0x11CF5B55, 0x8000FDA8, 0x2B445C5F);
+  put_le64 (s, 0);              /* time offset */
+  put_le32 (s, 18);             /* WAVEFORMATEX */
+  put_le32 (s, 0);              /* error correction data */
+  put_le16 (s, 1);              /* stream number */
+  put_le32 (s, 0);
+  put_le16 (s, 0x0055);         /* MPEG layer 3 */
+  put_le16 (s, 2);
+  put_le32 (s, 44100);
+  put_le32 (s, 16000);
+  put_le16 (s, 1);
+  put_le16 (s, 0);
+  put_le16 (s, 0);
+
+  /* data object */
+  put_asf_guid (s, 0x75B22636, 0x11CF668E, 0xAA00D9A6, 0x6CCE6200);
+  put_le64 (s, 50 + MP3_FRAMES * ASF_PACKET_SIZE);
+  put_fill (s, 0, 16);          /* file id */
+  put_le64 (s, MP3_FRAMES);
+  put_u8 (s, 1);
+  put_u8 (s, 1);
+
+  for (i = 0; i < MP3_FRAMES; i++) {
+    guint32 ms = gst_util_uint64_scale (i, 1152 * 1000, 44100);
+
+    /* no error correction, one payload, byte padding length;
+     * byte replicated data length, dword offset, byte object number */
+    put_u8 (s, 0x08);
+    put_u8 (s, 0x5d);
+    put_u8 (s, 0);              /* padding */
+    put_le32 (s, ms);           /* send time */
+    put_le16 (s, 26);           /* duration */
+
+    put_u8 (s, 0x80 | 1);       /* keyframe, stream 1 */
+    put_u8 (s, i);              /* media object number */
+    put_le32 (s, 0);            /* offset into media object */
+    put_u8 (s, 8);
+    put_le32 (s, MP3_FRAME_SIZE);
+    put_le32 (s, ms);
+    put_mp3_frame (s);
+  }
+
+  return s;
+}
+
+/* RealMedia with one dnet stream, the byte swapped AC-3 that rmdemux
+ * descrambles */
+static void
+put_rm_chunk (GByteArray * s, const gchar * fourcc, guint32 size)
+{
+  g_byte_array_append (s, (const guint8 *) fourcc, 4);
+  put_be32 (s, 10 + size);
+  put_be16 (s, 0);
+}
+
+static GByteArray *
+write_rm (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint i, j, mdpr_len, data_offset, frame;
+
+  mdpr_len = 30 + 1 + 12 + 1 + 20 + 4 + 73;
+  data_offset = 18 + 50 + 10 + mdpr_len;
+
+  put_rm_chunk (s, ".RMF", 8);
+  put_be32 (s, 0);
+  put_be32 (s, 3);
+
+  put_rm_chunk (s, "PROP", 40);
+  put_be32 (s, 128000);
+  put_be32 (s, 128000);
+  put_be32 (s, AC3_FRAME_SIZE);
+  put_be32 (s, AC3_FRAME_SIZE);
+  put_be32 (s, AC3_FRAMES);
+  put_be32 (s, AC3_FRAMES * 32);        /* duration in ms */
+  put_be32 (s, 0);              /* preroll */
+  put_be32 (s, 0);              /* index offset */
+  put_be32 (s, data_offset);
+  put_be16 (s, 1);
+  put_be16 (s, 0);
+
+  put_rm_chunk (s, "MDPR", mdpr_len);
+  put_be16 (s, 0);              /* stream id */
+  put_fill (s, 0, 28);
+  put_string8 (s, "Audio Stream");
+  put_string8 (s, "audio/x-pn-realaudio");
+  put_be32 (s, 73);
+  frame = s->len;
+  put_fill (s, 0, 73);
+  memcpy (s->data + frame, ".ra\xfd", 4);
+  GST_WRITE_UINT16_BE (s->data + frame + 4, 4);
+  GST_WRITE_UINT32_BE (s->data + frame + 24, AC3_FRAME_SIZE);
+  GST_WRITE_UINT16_BE (s->data + frame + 40, 1);
+  GST_WRITE_UINT16_BE (s->data + frame + 44, AC3_FRAME_SIZE);
+  GST_WRITE_UINT16_BE (s->data + frame + 48, 48000);
+  GST_WRITE_UINT16_BE (s->data + frame + 52, 16);
+  GST_WRITE_UINT16_BE (s->data + frame + 54, 2);
+  memcpy (s->data + frame + 62, "dnet", 4);
+
+  put_rm_chunk (s, "DATA", 8 + AC3_FRAMES * (12 + AC3_FRAME_SIZE));
+  put_be32 (s, AC3_FRAMES);
+  put_be32 (s, 0);              /* no next data chunk */
+
+  for (i = 0; i < AC3_FRAMES; i++) {
+    put_be16 (s, 0);
+    put_be16 (s, 12 + AC3_FRAME_SIZE);
+    put_be16 (s, 0);
+    put_be32 (s, i * 32);
+    put_u8 (s, 0);
+    put_u8 (s, 0x02);           /* keyframe */
+
+    frame = s->len;
+    put_ac3_frame (s);
+    for (j = 0; j < AC3_FRAME_SIZE; j += 2) {
+      guint8 tmp = s->data[frame + j];
+
+      s->data[frame + j] = s->data[frame + j + 1];
+      s->data[frame + j + 1] = tmp;
+    }
+  }
+
+  return s;
+}
+
+#ifndef GST_DISABLE_PARSE
+
+/* the runner */
+
+typedef struct
+{
+  const gchar *name;
+  /* the element taking the input is named "first", the fakesink "sink" */
+  const gchar *pipeline;
+  const gchar *caps;
+  GByteArray *(*write) (void);
+  guint chunk_size;
+  /* an element from an optional plugin, the case is skipped without it */
+  const gchar *optional;
+  /* whether the output is decoded rather than a part of the input */
+  gboolean decodes;
+  /* bounds over the second half of the stream, once everything is set up */
+  gdouble max_copied_per_byte;
+  gdouble max_allocs_per_buffer;
+} PerfCase;
+
+#define SINK "fakesink name=sink signal-handoffs=true silent=true " \
+    "sync=false async=false"
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static volatile gint n_out_buffers = 0;
+static guint64 n_out_bytes = 0;
+
+/* called from the streaming thread, which is ours */
+static void
+handoff_cb (GstElement * sink, GstBuffer * buf, GstPad * pad, gpointer data)
+{
+  g_atomic_int_inc (&n_out_buffers);
+  n_out_bytes += GST_BUFFER_SIZE (buf);
+}
+
+static void
+run_case (const PerfCase * pc)
+{
+  GstElement *pipeline, *first, *sink;
+  GstPad *srcpad, *sinkpad;
+  GstCaps *caps;
+  GstBus *bus;
+  GstMessage *msg;
+  GByteArray *stream;
+  GError *error = NULL;
+  GstFlowReturn ret;
+  GstPluginFeature *feature;
+  guint offset, half, in_buffers = 0;
+  guint start_offset = 0, start_in = 0;
+  gint start_allocs = 0, start_out = 0;
+  guint64 start_owned = 0, start_out_bytes = 0;
+  gdouble copied, allocs;
+  guint in_bytes, buffers;
+
+  if (pc->optional) {
+    feature = GST_PLUGIN_FEATURE (gst_element_factory_find (pc->optional));
+    if (feature == NULL) {
+      GST_INFO ("%s: no %s element, skipping", pc->name, pc->optional);
+      return;
+    }
+    gst_object_unref (feature);
+  }
+
+  pipeline = gst_parse_launch (pc->pipeline, &error);
+  fail_unless (error == NULL, "%s: could not create pipeline: %s", pc->name,
+      error ? error->message : "");
+
+  first = gst_bin_get_by_name (GST_BIN (pipeline), "first");
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  fail_unless (first != NULL && sink != NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff_cb), NULL);
+  n_out_buffers = 0;
+  n_out_bytes = 0;
+
+  srcpad = gst_pad_new_from_static_template (&srctemplate, "src");
+  sinkpad = gst_element_get_static_pad (first, "sink");
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+  gst_pad_set_active (srcpad, TRUE);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (pc->caps);
+  stream = pc->write ();
+  half = stream->len / 2;
+
+  gst_pad_push_event (srcpad, gst_event_new_new_segment (FALSE, 1.0,
+          GST_FORMAT_BYTES, 0, -1, 0));
+
+  for (offset = 0; offset < stream->len; offset += pc->chunk_size) {
+    GstBuffer *buf;
+
+    if (start_offset == 0 && offset >= half) {
+      start_offset = offset;
+      start_in = in_buffers;
+      start_owned = get_bytes_owned ();
+      start_out_bytes = n_out_bytes;
+      start_allocs = g_atomic_int_get (&n_buffers_freed);
+      start_out = g_atomic_int_get (&n_out_buffers);
+    }
+
+    /* no copy on our side, the stream outlives the pipeline */
+    buf = gst_buffer_new ();
+    GST_BUFFER_DATA (buf) = stream->data + offset;
+    GST_BUFFER_SIZE (buf) = MIN (pc->chunk_size, stream->len - offset);
+    GST_BUFFER_OFFSET (buf) = offset;
+    gst_buffer_set_caps (buf, caps);
+
+    ret = gst_pad_push (srcpad, buf);
+    fail_unless (ret == GST_FLOW_OK, "%s: push at offset %u returned %s",
+        pc->name, offset, gst_flow_get_name (ret));
+    in_buffers++;
+  }
+
+  /* buffers the elements still hold on to are left out, that's at most
+   * a few frames */
+  copied = get_bytes_owned () - start_owned;
+  if (pc->decodes)
+    copied -= n_out_bytes - start_out_bytes;
+  allocs = g_atomic_int_get (&n_buffers_freed) - start_allocs;
+  in_bytes = stream->len - start_offset;
+  buffers = (in_buffers - start_in) +
+      (g_atomic_int_get (&n_out_buffers) - start_out);
+
+  fail_unless (g_atomic_int_get (&n_out_buffers) > start_out,
+      "%s: nothing came out for the second half of the stream", pc->name);
+
+  gst_pad_push_event (srcpad, gst_event_new_eos ());
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL, "%s: no EOS", pc->name);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS,
+      "%s: error on the bus", pc->name);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  GST_INFO ("%s: %.2f bytes copied per input byte, %.2f buffers allocated "
+      "per buffer", pc->name, copied / in_bytes, allocs / buffers);
+
+  fail_unless (copied / in_bytes <= pc->max_copied_per_byte,
+      "%s: copied %.2f bytes per input byte, at most %.2f allowed",
+      pc->name, copied / in_bytes, pc->max_copied_per_byte);
+  fail_unless (allocs / buffers <= pc->max_allocs_per_buffer,
+      "%s: %.2f buffers allocated per buffer, at most %.2f allowed",
+      pc->name, allocs / buffers, pc->max_allocs_per_buffer);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_pad_set_active (srcpad, FALSE);
+  gst_object_unref (srcpad);
+  gst_object_unref (first);
+  gst_object_unref (sink);
+  gst_object_unref (pipeline);
+  gst_caps_unref (caps);
+  g_byte_array_free (stream, TRUE);
+}
+
+#define MP3_CAPS "audio/mpeg, mpegversion = (int) 1"
+
+static const PerfCase cases[] = {
+  {"mp3parse", "mp3parse name=first ! " SINK, MP3_CAPS,
+      write_mp3, 4096, NULL, FALSE, 2.0, 4.0},
+  {"mad", "mp3parse name=first ! mad ! " SINK, MP3_CAPS,
+      write_mp3, 4096, "mad", TRUE, 3.0, 4.0},
+  {"a52dec", "a52dec name=first ! " SINK, "audio/x-ac3",
+      write_ac3, 4096, "a52dec", TRUE, 3.0, 4.0},
+  {"dvdlpcmdec", "dvdlpcmdec name=first ! " SINK,
+        "audio/x-lpcm, width = (int) 24, rate = (int) 48000, "
+        "channels = (int) 2, dynamic_range = (int) 0, "
+        "emphasis = (boolean) false, mute = (boolean) false",
+      write_lpcm, LPCM_CHUNK_SIZE, NULL, TRUE, 2.0, 4.0},
+  {"mpegdemux", "mpegdemux name=first ! " SINK,
+        "video/mpeg, mpegversion = (int) 1, systemstream = (boolean) true",
+      write_ps, 4096, NULL, FALSE, 2.0, 4.0},
+  {"asfdemux", "asfdemux name=first ! " SINK, "video/x-ms-asf",
+      write_asf, 4096, NULL, FALSE, 2.0, 4.0},
+  {"rmdemux", "rmdemux name=first ! " SINK, "application/vnd.rn-realmedia",
+      write_rm, 4096, NULL, FALSE, 3.0, 4.0}
+};
+
+GST_START_TEST (test_stream)
+{
+  run_case (&cases[__i__]);
+}
+
+GST_END_TEST;
+
+#endif /* #ifndef GST_DISABLE_PARSE */
+
+static Suite *
+perf_suite (void)
+{
+  Suite *s = suite_create ("perf");
+  TCase *tc_chain = tcase_create ("streams");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_set_timeout (tc_chain, 60);
+
+#ifndef GST_DISABLE_PARSE
+  tcase_add_loop_test (tc_chain, test_stream, 0, G_N_ELEMENTS (cases));
+#endif
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int nf;
+  Suite *s;
+  SRunner *sr;
+
+  s = perf_suite ();
+  sr = srunner_create (s);
+
+  gst_check_init (&argc, &argv);
+  hook_buffer_finalize ();
+
+  srunner_run_all (sr, CK_NORMAL);
+  nf = srunner_ntests_failed (sr);
+  srunner_free (sr);
+
+  return nf;
+}
@@ -0,0 +1,149 @@
+/* GStreamer
+ *
+ * unit test for asfmux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#ifndef GST_DISABLE_PARSE
+
+#define NUM_BUFFERS 50
+#define SAMPLES_PER_BUFFER 1024
+
+static guint handoff_count;
+static guint64 handoff_bytes;
+
+static void
+handoff_cb (GstElement * sink, GstBuffer * buf, GstPad * pad, gpointer data)
+{
+  handoff_count++;
+  handoff_bytes += GST_BUFFER_SIZE (buf);
+}
+
+static GstElement *
+make_pipeline (const gchar * pipe_str)
+{
+  GstElement *bin;
+  GError *error = NULL;
+
+  bin = gst_parse_launch (pipe_str, &error);
+  fail_unless (bin != NULL, "Error parsing pipeline: %s",
+      error ? error->message : "(invalid error)");
+
+  return bin;
+}
+
+/* runs @bin to EOS and fails on errors */
+static void
+run_pipeline (GstElement * bin)
+{
+  GstMessage *msg;
+  GstBus *bus;
+
+  fail_if (gst_element_set_state (bin,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (bin);
+  msg = gst_bus_poll (bus, GST_MESSAGE_EOS | GST_MESSAGE_ERROR, -1);
+  fail_unless (msg != NULL);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS,
+      "error while running the pipeline");
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  gst_element_set_state (bin, GST_STATE_NULL);
+}
+
+GST_START_TEST (test_round_trip)
+{
+  GstElement *bin, *sink;
+  gchar *pipe_str, *filename;
+  gint fd;
+
+  fd = g_file_open_tmp ("asfmux-XXXXXX.asf", &filename, NULL);
+  fail_unless (fd >= 0);
+  close (fd);
+
+  pipe_str = g_strdup_printf ("audiotestsrc num-buffers=%d "
+      "samplesperbuffer=%d ! audio/x-raw-int, rate=8000, channels=1, "
+      "width=16, depth=16 ! asfmux ! filesink location=%s", NUM_BUFFERS,
+      SAMPLES_PER_BUFFER, filename);
+  bin = make_pipeline (pipe_str);
+  g_free (pipe_str);
+  run_pipeline (bin);
+  gst_object_unref (bin);
+
+  handoff_count = 0;
+  handoff_bytes = 0;
+
+  pipe_str = g_strdup_printf ("filesrc location=%s ! asfdemux "
+      "! audio/x-raw-int, rate=8000, channels=1 "
+      "! fakesink name=sink signal-handoffs=true", filename);
+  bin = make_pipeline (pipe_str);
+  g_free (pipe_str);
+  sink = gst_bin_get_by_name (GST_BIN (bin), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff_cb), NULL);
+  gst_object_unref (sink);
+  run_pipeline (bin);
+  gst_object_unref (bin);
+
+  /* everything we muxed comes out again */
+  fail_unless (handoff_count > 0);
+  fail_unless_equals_int (handoff_bytes, NUM_BUFFERS * SAMPLES_PER_BUFFER * 2);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+GST_END_TEST;
+
+#endif /* #ifndef GST_DISABLE_PARSE */
+
+Suite *
+asfmux_suite (void)
+{
+  Suite *s = suite_create ("asfmux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+
+#ifndef GST_DISABLE_PARSE
+  tcase_add_test (tc_chain, test_round_trip);
+#endif
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int nf;
+
+  Suite *s = asfmux_suite ();
+  SRunner *sr = srunner_create (s);
+
+  gst_check_init (&argc, &argv);
+
+  srunner_run_all (sr, CK_NORMAL);
+  nf = srunner_ntests_failed (sr);
+  srunner_free (sr);
+
+  return nf;
+}